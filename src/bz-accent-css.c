@@ -0,0 +1,301 @@
+/* bz-accent-css.c
+ *
+ * Copyright 2025 Adam Masciola
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+/* All accent color rules live in a fixed set of display-wide providers,
+   each holding the rules whose key hashes to it. Adding or removing a
+   provider restyles every widget on the display, so each one is
+   installed once and only reloaded, at most once per main loop
+   iteration, when one of its own rules changes. A new rule thus costs a
+   reparse of its sheet rather than of every rule. Rules nobody uses
+   anymore stay around until enough of them pile up. */
+
+#include "bz-accent-css.h"
+
+#define LUMINANCE_THRESHOLD 130.0
+#define MAX_UNUSED_RULES    256
+#define N_SHEETS            32
+
+/* Same as .flathub-lotion and .flathub-gunmetal in style.css */
+#define LOTION_COLOR   "#fafafa"
+#define GUNMETAL_COLOR "#251f32"
+
+/* Run before GTK relayouts and draws, so classes added during this
+   iteration already have their rules on the next frame */
+#define RELOAD_PRIORITY (GDK_PRIORITY_REDRAW - 10)
+
+struct _BzAccentRule
+{
+  int   refs;
+  guint sheet;
+  char *key;
+  char *light_color;
+  char *dark_color;
+  char *light_class;
+  char *dark_class;
+
+  /* Part of the rule rather than a class of its own, so a change of
+     colors never leaves a stale text class on widgets using it */
+  const char *light_text_color;
+  const char *dark_text_color;
+};
+
+typedef struct
+{
+  GtkCssProvider *provider;
+  GHashTable     *rules;
+} Sheet;
+
+static Sheet       sheets[N_SHEETS]     = { 0 };
+static guint32     dirty_sheets         = 0;
+static GHashTable *color_is_light_cache = NULL;
+static guint       reload_source        = 0;
+static guint       n_unused             = 0;
+
+G_STATIC_ASSERT (N_SHEETS <= sizeof (dirty_sheets) * 8);
+
+static void
+rule_free (BzAccentRule *rule);
+
+static void
+queue_reload (guint sheet);
+
+static gboolean
+reload_idle (gpointer user_data);
+
+static void
+reload_sheet (Sheet *sheet);
+
+static const char *
+text_color_for_color (const char *color);
+
+BzAccentRule *
+bz_accent_css_acquire (const char *id,
+                       const char *light_accent_color,
+                       const char *dark_accent_color)
+{
+  g_autoptr (GString) fixed_id = NULL;
+  const char   *light          = NULL;
+  const char   *dark           = NULL;
+  guint         sheet_idx      = 0;
+  Sheet        *sheet          = NULL;
+  BzAccentRule *rule           = NULL;
+
+  g_return_val_if_fail (id != NULL, NULL);
+  g_return_val_if_fail (light_accent_color != NULL || dark_accent_color != NULL, NULL);
+
+  light = light_accent_color != NULL ? light_accent_color : dark_accent_color;
+  dark  = dark_accent_color != NULL ? dark_accent_color : light_accent_color;
+
+  fixed_id = g_string_new (id);
+  g_string_replace (fixed_id, ".", "--", 0);
+
+  sheet_idx = g_str_hash (fixed_id->str) % N_SHEETS;
+  sheet     = &sheets[sheet_idx];
+  if (sheet->rules == NULL)
+    sheet->rules = g_hash_table_new_full (
+        g_str_hash, g_str_equal,
+        NULL, (GDestroyNotify) rule_free);
+
+  rule = g_hash_table_lookup (sheet->rules, fixed_id->str);
+  if (rule != NULL && rule->refs == 0)
+    n_unused--;
+
+  if (rule != NULL &&
+      (!g_str_equal (rule->light_color, light) ||
+       !g_str_equal (rule->dark_color, dark)))
+    {
+      /* The colors for this app changed, e.g. after a catalog
+         refresh. The classes stay the same, so every widget using
+         them picks the new colors up with the reload */
+      g_clear_pointer (&rule->light_color, g_free);
+      g_clear_pointer (&rule->dark_color, g_free);
+      rule->light_color      = g_strdup (light);
+      rule->dark_color       = g_strdup (dark);
+      rule->light_text_color = text_color_for_color (light);
+      rule->dark_text_color  = text_color_for_color (dark);
+      queue_reload (sheet_idx);
+    }
+  else if (rule == NULL)
+    {
+      rule                   = g_new0 (BzAccentRule, 1);
+      rule->sheet            = sheet_idx;
+      rule->key              = g_strdup (fixed_id->str);
+      rule->light_color      = g_strdup (light);
+      rule->dark_color       = g_strdup (dark);
+      rule->light_class      = g_strdup_printf ("%s-light", fixed_id->str);
+      rule->dark_class       = g_strdup_printf ("%s-dark", fixed_id->str);
+      rule->light_text_color = text_color_for_color (light);
+      rule->dark_text_color  = text_color_for_color (dark);
+      g_hash_table_replace (sheet->rules, rule->key, rule);
+      queue_reload (sheet_idx);
+    }
+
+  rule->refs++;
+  return rule;
+}
+
+void
+bz_accent_css_release (BzAccentRule *rule)
+{
+  g_return_if_fail (rule != NULL);
+  g_return_if_fail (rule->refs > 0);
+
+  if (--rule->refs > 0)
+    return;
+
+  n_unused++;
+  if (n_unused > MAX_UNUSED_RULES)
+    queue_reload (rule->sheet);
+}
+
+const char *
+bz_accent_rule_get_class (BzAccentRule *rule,
+                          gboolean      dark)
+{
+  g_return_val_if_fail (rule != NULL, NULL);
+  return dark ? rule->dark_class : rule->light_class;
+}
+
+static void
+rule_free (BzAccentRule *rule)
+{
+  g_clear_pointer (&rule->key, g_free);
+  g_clear_pointer (&rule->light_color, g_free);
+  g_clear_pointer (&rule->dark_color, g_free);
+  g_clear_pointer (&rule->light_class, g_free);
+  g_clear_pointer (&rule->dark_class, g_free);
+  g_free (rule);
+}
+
+static void
+queue_reload (guint sheet)
+{
+  dirty_sheets |= 1u << sheet;
+  if (reload_source != 0)
+    return;
+
+  reload_source = g_idle_add_full (
+      RELOAD_PRIORITY,
+      reload_idle,
+      NULL, NULL);
+}
+
+static gboolean
+reload_idle (gpointer user_data)
+{
+  GHashTableIter iter = { 0 };
+  BzAccentRule  *rule = NULL;
+
+  reload_source = 0;
+
+  if (n_unused > MAX_UNUSED_RULES)
+    {
+      for (guint i = 0; i < N_SHEETS; i++)
+        {
+          if (sheets[i].rules == NULL)
+            continue;
+
+          g_hash_table_iter_init (&iter, sheets[i].rules);
+          while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &rule))
+            {
+              if (rule->refs == 0)
+                {
+                  g_hash_table_iter_remove (&iter);
+                  dirty_sheets |= 1u << i;
+                }
+            }
+        }
+      n_unused = 0;
+    }
+
+  for (guint i = 0; i < N_SHEETS; i++)
+    {
+      if (dirty_sheets & (1u << i))
+        reload_sheet (&sheets[i]);
+    }
+  dirty_sheets = 0;
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+reload_sheet (Sheet *sheet)
+{
+  g_autoptr (GString) css = NULL;
+  GHashTableIter iter     = { 0 };
+  BzAccentRule  *rule     = NULL;
+
+  css = g_string_new (NULL);
+  if (sheet->rules != NULL)
+    {
+      g_hash_table_iter_init (&iter, sheet->rules);
+      while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &rule))
+        g_string_append_printf (
+            css,
+            ".%s{background-color:%s;color:%s;}\n"
+            ".%s{background-color:%s;color:%s;}\n",
+            rule->light_class, rule->light_color, rule->light_text_color,
+            rule->dark_class, rule->dark_color, rule->dark_text_color);
+    }
+
+  if (sheet->provider == NULL)
+    {
+      sheet->provider = gtk_css_provider_new ();
+      gtk_style_context_add_provider_for_display (
+          gdk_display_get_default (),
+          GTK_STYLE_PROVIDER (sheet->provider),
+          GTK_STYLE_PROVIDER_PRIORITY_APPLICATION);
+    }
+  gtk_css_provider_load_from_string (sheet->provider, css->str);
+}
+
+static gdouble
+get_luminance (GdkRGBA *rgba)
+{
+  return (0.299 * rgba->red * 255.0) +
+         (0.587 * rgba->green * 255.0) +
+         (0.114 * rgba->blue * 255.0);
+}
+
+static const char *
+text_color_for_color (const char *color)
+{
+  gpointer cached = NULL;
+  GdkRGBA  rgba   = { 0 };
+  gboolean light  = FALSE;
+
+  if (color_is_light_cache == NULL)
+    color_is_light_cache = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
+  cached = g_hash_table_lookup (color_is_light_cache, color);
+  if (cached != NULL)
+    light = GPOINTER_TO_INT (cached) == 2;
+  else
+    {
+      if (gdk_rgba_parse (&rgba, color))
+        light = get_luminance (&rgba) > LUMINANCE_THRESHOLD;
+      g_hash_table_replace (color_is_light_cache, g_strdup (color),
+                            GINT_TO_POINTER (light ? 2 : 1));
+    }
+
+  return light ? GUNMETAL_COLOR : LOTION_COLOR;
+}
+
+/* End of bz-accent-css.c */
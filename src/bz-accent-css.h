@@ -0,0 +1,45 @@
+/* bz-accent-css.h
+ *
+ * Copyright 2025 Adam Masciola
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include <gtk/gtk.h>
+
+G_BEGIN_DECLS
+
+typedef struct _BzAccentRule BzAccentRule;
+
+BzAccentRule *
+bz_accent_css_acquire (const char *id,
+                       const char *light_accent_color,
+                       const char *dark_accent_color);
+
+void
+bz_accent_css_release (BzAccentRule *rule);
+
+const char *
+bz_accent_rule_get_class (BzAccentRule *rule,
+                          gboolean      dark);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (BzAccentRule, bz_accent_css_release)
+
+G_END_DECLS
+
+/* End of bz-accent-css.h */
@@ -19,6 +19,7 @@
  */
 
 #include "bz-app-tile.h"
+#include "bz-prefetch.h"
 
 struct _BzAppTile
 {
@@ -143,6 +144,7 @@ static void
 bz_app_tile_init (BzAppTile *self)
 {
   gtk_widget_init_template (GTK_WIDGET (self));
+  bz_prefetch_attach (GTK_WIDGET (self));
 }
 
 GtkWidget *
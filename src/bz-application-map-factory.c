@@ -20,6 +20,7 @@
 
 #include "bz-application-map-factory.h"
 #include "bz-util.h"
+#include "bz-visibility-index.h"
 
 struct _BzApplicationMapFactory
 {
@@ -29,7 +30,7 @@ struct _BzApplicationMapFactory
   gpointer               user_data;
   GDestroyNotify         ref_user_data;
   GDestroyNotify         unref_user_data;
-  GtkFilter             *filter;
+  BzVisibilityIndex     *index;
 };
 
 G_DEFINE_FINAL_TYPE (BzApplicationMapFactory, bz_application_map_factory, G_TYPE_OBJECT);
@@ -39,7 +40,7 @@ bz_application_map_factory_dispose (GObject *object)
 {
   BzApplicationMapFactory *self = BZ_APPLICATION_MAP_FACTORY (object);
 
-  g_clear_object (&self->filter);
+  g_clear_object (&self->index);
 
   if (self->unref_user_data != NULL)
     g_clear_pointer (&self->user_data, self->unref_user_data);
@@ -65,19 +66,19 @@ bz_application_map_factory_new (GtkMapListModelMapFunc func,
                                 gpointer               user_data,
                                 GDestroyNotify         ref_user_data,
                                 GDestroyNotify         unref_user_data,
-                                GtkFilter             *filter)
+                                BzVisibilityIndex     *index)
 {
   BzApplicationMapFactory *self = NULL;
 
   g_return_val_if_fail (func != NULL, NULL);
-  g_return_val_if_fail (filter == NULL || GTK_IS_FILTER (filter), NULL);
+  g_return_val_if_fail (index == NULL || BZ_IS_VISIBILITY_INDEX (index), NULL);
 
   self                  = g_object_new (BZ_TYPE_APPLICATION_MAP_FACTORY, NULL);
   self->func            = func;
   self->user_data       = user_data;
   self->ref_user_data   = ref_user_data;
   self->unref_user_data = unref_user_data;
-  self->filter          = bz_maybe_ref (filter, g_object_ref_sink);
+  self->index           = bz_object_maybe_ref (index);
 
   return self;
 }
@@ -92,14 +93,8 @@ bz_application_map_factory_generate (BzApplicationMapFactory *self,
   g_return_val_if_fail (BZ_IS_APPLICATION_MAP_FACTORY (self), NULL);
   g_return_val_if_fail (G_IS_LIST_MODEL (model), NULL);
 
-  if (self->filter != NULL)
-    {
-      GtkFilterListModel *filter_model = NULL;
-
-      filter_model = gtk_filter_list_model_new (
-          g_object_ref (model), g_object_ref (self->filter));
-      backing = G_LIST_MODEL (filter_model);
-    }
+  if (self->index != NULL)
+    backing = bz_visibility_index_filter (self->index, model);
   else
     backing = g_object_ref (model);
 
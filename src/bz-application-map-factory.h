@@ -22,6 +22,8 @@
 
 #include <gtk/gtk.h>
 
+#include "bz-visibility-index.h"
+
 G_BEGIN_DECLS
 
 #define BZ_TYPE_APPLICATION_MAP_FACTORY (bz_application_map_factory_get_type ())
@@ -32,7 +34,7 @@ bz_application_map_factory_new (GtkMapListModelMapFunc func,
                                 gpointer               user_data,
                                 GDestroyNotify         ref_user_data,
                                 GDestroyNotify         unref_user_data,
-                                GtkFilter             *filter);
+                                BzVisibilityIndex     *index);
 
 GListModel *
 bz_application_map_factory_generate (BzApplicationMapFactory *self,
@@ -23,6 +23,8 @@
 
 #define MAX_IDS_PER_BLOCKLIST 2048
 
+#define CATALOG_SNAPSHOT_TYPE "(sa" BZ_ENTRY_GROUP_SNAPSHOT_TYPE ")"
+
 #include "config.h"
 
 #include <glib/gi18n.h>
@@ -32,6 +34,7 @@
 #include "bz-application.h"
 #include "bz-auth-state.h"
 #include "bz-backend-notification.h"
+#include "bz-compress.h"
 #include "bz-content-provider.h"
 #include "bz-entry-cache-manager.h"
 #include "bz-entry-group.h"
@@ -41,11 +44,13 @@
 #include "bz-flathub-state.h"
 #include "bz-flatpak-entry.h"
 #include "bz-flatpak-instance.h"
+#include "bz-global-net.h"
 #include "bz-gnome-shell-search-provider.h"
 #include "bz-hash-table-object.h"
 #include "bz-inspector.h"
 #include "bz-io.h"
 #include "bz-login-page.h"
+#include "bz-memory-stats.h"
 #include "bz-newline-parser.h"
 #include "bz-parser.h"
 #include "bz-preferences-dialog.h"
@@ -54,6 +59,7 @@
 #include "bz-root-curated-config.h"
 #include "bz-serializable.h"
 #include "bz-state-info.h"
+#include "bz-trace.h"
 #include "bz-transaction-manager.h"
 #include "bz-util.h"
 #include "bz-window.h"
@@ -97,7 +103,7 @@ struct _BzApplication
   GSettings                  *settings;
   GTimer                     *init_timer;
   GWeakRef                    main_window;
-  GtkCustomFilter            *appid_filter;
+  BzVisibilityIndex          *visibility_index;
   GtkCustomFilter            *group_filter;
   GtkFilterListModel         *group_filter_model;
   GtkMapListModel            *blocklists_to_files;
@@ -200,6 +206,19 @@ fiber_replace_entry (BzApplication *self,
 static void
 fiber_check_for_updates (BzApplication *self);
 
+static void
+fiber_load_catalog_snapshot (BzApplication *self,
+                             GFile         *file);
+
+static void
+fiber_write_catalog_snapshot (BzApplication *self);
+
+static void
+prune_snapshot_groups (BzApplication *self);
+
+static GFile *
+dup_catalog_snapshot_file (void);
+
 static GFile *
 fiber_dup_flathub_cache_file (char   **path_out,
                               GError **error);
@@ -260,6 +279,10 @@ command_line_open_location (BzApplication           *self,
                             GApplicationCommandLine *cmdline,
                             const char              *path);
 
+static DexFuture *
+dump_memory_stats_finally (DexFuture               *future,
+                           GApplicationCommandLine *cmdline);
+
 static void
 open_generic_id (BzApplication *self,
                  const char    *generic_id);
@@ -277,8 +300,8 @@ map_ids_to_entries (GtkStringObject *string,
                     BzApplication   *self);
 
 static gboolean
-filter_application_ids (GtkStringObject *string,
-                        BzApplication   *self);
+filter_application_ids (const char    *id,
+                        BzApplication *self);
 
 static gboolean
 filter_entry_groups (BzEntryGroup  *group,
@@ -311,7 +334,7 @@ bz_application_dispose (GObject *object)
   dex_clear (&self->ready_to_open_files);
   dex_clear (&self->sync);
   g_clear_handle_id (&self->periodic_timeout_source, g_source_remove);
-  g_clear_object (&self->appid_filter);
+  g_clear_object (&self->visibility_index);
   g_clear_object (&self->application_factory);
   g_clear_object (&self->blocklist_parser);
   g_clear_object (&self->blocklists);
@@ -371,17 +394,22 @@ bz_application_command_line (GApplication            *app,
   g_auto (GStrv) argv                 = NULL;
   gboolean help                       = FALSE;
   gboolean no_window                  = FALSE;
+  gboolean dump_memory_stats          = FALSE;
   g_auto (GStrv) blocklists_strv      = NULL;
   g_auto (GStrv) content_configs_strv = NULL;
   g_auto (GStrv) locations            = NULL;
+  g_autofree char *trace_path         = NULL;
 
   GOptionEntry main_entries[] = {
     { "help", 0, 0, G_OPTION_ARG_NONE, &help, "Print help" },
     { "no-window", 0, 0, G_OPTION_ARG_NONE, &no_window, "Ensure the service is running without creating a new window" },
+    { "dump-memory-stats", 0, 0, G_OPTION_ARG_NONE, &dump_memory_stats, "Print memory usage estimates of the running service and exit" },
     { "extra-blocklist", 0, 0, G_OPTION_ARG_FILENAME_ARRAY, &blocklists_strv, "Add an extra blocklist to read from" },
     { "extra-curated-config", 0, 0, G_OPTION_ARG_FILENAME_ARRAY, &content_configs_strv, "Add an extra yaml file with which to configure the app browser" },
     /* Here for backwards compat */
     { "extra-content-config", 0, 0, G_OPTION_ARG_FILENAME_ARRAY, &content_configs_strv, "Add an extra yaml file with which to configure the app browser (backwards compat)" },
+    /* Acted on in main () before the application exists */
+    { "trace", 0, 0, G_OPTION_ARG_FILENAME, &trace_path, "Write a sysprof capture of the service to FILE, only when starting it", "FILE" },
     { G_OPTION_REMAINING, 0, 0, G_OPTION_ARG_FILENAME_ARRAY, &locations, "flatpakref file to open" },
     { NULL }
   };
@@ -422,6 +450,31 @@ bz_application_command_line (GApplication            *app,
           g_application_command_line_printerr (cmdline, "%s\n", help_text);
           return EXIT_SUCCESS;
         }
+
+      if (trace_path != NULL && g_application_command_line_get_is_remote (cmdline))
+        g_application_command_line_printerr (
+            cmdline, "The Bazaar service is already running, --trace only applies when starting it.\n");
+
+      if (dump_memory_stats)
+        {
+          g_autoptr (DexFuture) future = NULL;
+
+          if (!self->running)
+            {
+              g_application_command_line_printerr (cmdline, "The Bazaar service is not running.\n");
+              return EXIT_FAILURE;
+            }
+
+          /* The caller stays attached until the command line object is
+             released, which is after the stats have been printed */
+          future = bz_memory_stats_collect (self->state);
+          future = dex_future_finally (
+              future,
+              (DexFutureCallback) dump_memory_stats_finally,
+              g_object_ref (cmdline), g_object_unref);
+          dex_future_disown (g_steal_pointer (&future));
+          return EXIT_SUCCESS;
+        }
     }
 
   if (!self->running)
@@ -869,6 +922,8 @@ init_fiber (GWeakRef *wr)
   g_autoptr (GHashTable) cached_set     = NULL;
   g_autofree char *flathub_cache        = NULL;
   g_autoptr (GFile) flathub_cache_file  = NULL;
+  g_autoptr (GFile) snapshot_file       = NULL;
+  gint64 trace_begin                    = 0;
 
   bz_weak_get_or_return_reject (self, wr);
 
@@ -876,6 +931,9 @@ init_fiber (GWeakRef *wr)
   bz_state_info_set_busy (self->state, TRUE);
   bz_state_info_set_background_task_label (self->state, _ ("Performing setup..."));
 
+  /* Finish deleting anything a previous session didn't get to */
+  bz_resume_reaping ();
+
   root_cache_dir      = bz_dup_root_cache_dir ();
   root_cache_dir_file = g_file_new_for_path (root_cache_dir);
   if (dex_await (dex_file_query_exists (root_cache_dir_file), NULL))
@@ -926,6 +984,14 @@ init_fiber (GWeakRef *wr)
         }
     }
 
+  /* Show whatever the last successful sync found while we wait for the
+     real entries to hydrate the groups */
+  trace_begin   = bz_trace_begin ();
+  snapshot_file = dup_catalog_snapshot_file ();
+  fiber_load_catalog_snapshot (self, snapshot_file);
+  bz_trace_end (trace_begin, "Application", "Load Catalog Snapshot",
+                "%u groups", g_list_model_get_n_items (G_LIST_MODEL (self->groups)));
+
   g_clear_object (&self->flatpak);
   self->flatpak = dex_await_object (bz_flatpak_instance_new (), &local_error);
   if (self->flatpak == NULL)
@@ -1005,8 +1071,30 @@ init_fiber (GWeakRef *wr)
           g_str_hash, g_str_equal, g_free, NULL);
     }
 
+  /* Snapshot groups for apps that were removed since the snapshot was
+     written shouldn't linger in the installed list */
+  for (guint i = g_list_model_get_n_items (G_LIST_MODEL (self->installed_apps)); i > 0; i--)
+    {
+      g_autoptr (BzEntryGroup) group = NULL;
+      GListModel *unique_ids         = NULL;
+      guint       n_unique_ids       = 0;
+      gboolean    installed          = FALSE;
+
+      group        = g_list_model_get_item (G_LIST_MODEL (self->installed_apps), i - 1);
+      unique_ids   = bz_entry_group_get_model (group);
+      n_unique_ids = g_list_model_get_n_items (unique_ids);
+      for (guint j = 0; j < n_unique_ids && !installed; j++)
+        installed = g_hash_table_contains (
+            self->installed_set,
+            gtk_string_list_get_string (GTK_STRING_LIST (unique_ids), j));
+
+      if (!installed)
+        g_list_store_remove (self->installed_apps, i - 1);
+    }
+
   /* Revive old cache from previous Bazaar process */
-  cached_set = dex_await_boxed (
+  trace_begin = bz_trace_begin ();
+  cached_set  = dex_await_boxed (
       bz_entry_cache_manager_enumerate_disk (self->cache),
       &local_error);
   if (cached_set != NULL)
@@ -1067,7 +1155,9 @@ init_fiber (GWeakRef *wr)
         }
 
       gtk_filter_changed (GTK_FILTER (self->group_filter), GTK_FILTER_CHANGE_LESS_STRICT);
-      gtk_filter_changed (GTK_FILTER (self->appid_filter), GTK_FILTER_CHANGE_LESS_STRICT);
+      bz_visibility_index_invalidate (self->visibility_index);
+
+      bz_trace_end (trace_begin, "Application", "Revive Cache", "%u entries", entries->len);
     }
   else
     {
@@ -1080,11 +1170,14 @@ init_fiber (GWeakRef *wr)
     {
       if (dex_await (dex_file_query_exists (flathub_cache_file), NULL))
         {
+          g_autoptr (GBytes) raw   = NULL;
           g_autoptr (GBytes) bytes = NULL;
 
-          bytes = dex_await_boxed (
+          raw = dex_await_boxed (
               dex_file_load_contents_bytes (flathub_cache_file),
               &local_error);
+          if (raw != NULL)
+            bytes = bz_decompress_cache_bytes (raw, &local_error);
           if (bytes != NULL)
             {
               g_autoptr (GVariant) variant       = NULL;
@@ -1150,12 +1243,14 @@ cache_flathub_fiber (GWeakRef *wr)
     {
       g_autoptr (GVariantBuilder) builder = NULL;
       g_autoptr (GVariant) variant        = NULL;
+      g_autoptr (GBytes) raw              = NULL;
       g_autoptr (GBytes) bytes            = NULL;
 
       builder = g_variant_builder_new (G_VARIANT_TYPE_VARDICT);
       bz_serializable_serialize (BZ_SERIALIZABLE (self->flathub), builder);
       variant = g_variant_builder_end (builder);
-      bytes   = g_variant_get_data_as_bytes (variant);
+      raw     = g_variant_get_data_as_bytes (variant);
+      bytes   = bz_compress_cache_bytes (raw);
 
       result = dex_await (
           dex_file_replace_contents_bytes (
@@ -1193,9 +1288,13 @@ respond_to_flatpak_fiber (RespondToFlatpakData *data)
   g_autoptr (GTimer) timer            = NULL;
   gboolean update_labels              = FALSE;
   gboolean update_filter              = FALSE;
+  guint    n_handled                  = 0;
+  gint64   trace_begin                = 0;
 
   bz_weak_get_or_return_reject (self, data->self);
 
+  trace_begin = bz_trace_begin ();
+
   window = gtk_application_get_active_window (GTK_APPLICATION (self));
   if (window != NULL)
     clock = gtk_widget_get_frame_clock (GTK_WIDGET (window));
@@ -1233,6 +1332,7 @@ respond_to_flatpak_fiber (RespondToFlatpakData *data)
 
       notif = g_value_get_object (dex_future_get_value (read_future, NULL));
       kind  = bz_backend_notification_get_kind (notif);
+      n_handled++;
       switch (kind)
         {
         case BZ_BACKEND_NOTIFICATION_KIND_ERROR:
@@ -1483,6 +1583,10 @@ respond_to_flatpak_fiber (RespondToFlatpakData *data)
       read_future = dex_channel_receive (self->flatpak_notifs);
     }
 
+  bz_trace_end (trace_begin, "Application", "Handle Notifications",
+                "%u notifications in %.2f ms of a %.2f ms budget",
+                n_handled, g_timer_elapsed (timer, NULL) * 1000.0, reread_timeout * 1000.0);
+
   if (build_futures->len > 0)
     dex_await (
         dex_future_allv (
@@ -1493,11 +1597,12 @@ respond_to_flatpak_fiber (RespondToFlatpakData *data)
   if (update_filter)
     {
       gtk_filter_changed (GTK_FILTER (self->group_filter), GTK_FILTER_CHANGE_LESS_STRICT);
-      gtk_filter_changed (GTK_FILTER (self->appid_filter), GTK_FILTER_CHANGE_LESS_STRICT);
+      bz_visibility_index_invalidate (self->visibility_index);
     }
 
   if (update_labels)
     {
+      bz_trace_counter_set (BZ_TRACE_COUNTER_INCOMING_ENTRIES, self->n_notifications_incoming);
       if (self->n_notifications_incoming > 0)
         {
           g_autofree char *label = NULL;
@@ -1510,6 +1615,9 @@ respond_to_flatpak_fiber (RespondToFlatpakData *data)
           bz_state_info_set_background_task_label (self->state, _ ("Checking for updates"));
           fiber_check_for_updates (self);
           bz_state_info_set_background_task_label (self->state, NULL);
+
+          prune_snapshot_groups (self);
+          fiber_write_catalog_snapshot (self);
         }
     }
 
@@ -1900,6 +2008,149 @@ fiber_replace_entry (BzApplication *self,
     }
 }
 
+static void
+fiber_load_catalog_snapshot (BzApplication *self,
+                             GFile         *file)
+{
+  g_autoptr (GError) local_error   = NULL;
+  g_autofree char *path            = NULL;
+  g_autoptr (GMappedFile) mapped   = NULL;
+  g_autoptr (GBytes) bytes         = NULL;
+  g_autoptr (GVariant) snapshot    = NULL;
+  const char *version              = NULL;
+  g_autoptr (GVariant) groups      = NULL;
+  GVariantIter iter                = { 0 };
+  GVariant    *group_snapshot      = NULL;
+
+  /* Map the snapshot rather than reading it, the groups only borrow
+     from it while they are built. The writer replaces the file by
+     renaming over it, so the mapping stays valid even if that races. */
+  path   = g_file_get_path (file);
+  mapped = g_mapped_file_new (path, FALSE, &local_error);
+  if (mapped == NULL)
+    {
+      if (!g_error_matches (local_error, G_FILE_ERROR, G_FILE_ERROR_NOENT))
+        g_warning ("Unable to load catalog snapshot: %s", local_error->message);
+      return;
+    }
+  bytes = g_mapped_file_get_bytes (mapped);
+
+  snapshot = g_variant_new_from_bytes (G_VARIANT_TYPE (CATALOG_SNAPSHOT_TYPE), bytes, FALSE);
+  g_variant_get (snapshot, "(&s@a" BZ_ENTRY_GROUP_SNAPSHOT_TYPE ")", &version, &groups);
+  if (g_strcmp0 (version, PACKAGE_VERSION) != 0)
+    return;
+
+  g_variant_iter_init (&iter, groups);
+  while ((group_snapshot = g_variant_iter_next_value (&iter)) != NULL)
+    {
+      g_autoptr (BzEntryGroup) group = NULL;
+      const char *id                 = NULL;
+
+      group = bz_entry_group_new_from_snapshot (self->entry_factory, group_snapshot);
+      g_variant_unref (group_snapshot);
+      if (group == NULL)
+        continue;
+
+      id = bz_entry_group_get_id (group);
+      if (g_hash_table_contains (self->ids_to_groups, id))
+        continue;
+
+      g_list_store_append (self->groups, group);
+      g_hash_table_replace (self->ids_to_groups, g_strdup (id), g_object_ref (group));
+
+      if (bz_entry_group_get_removable (group) > 0)
+        g_list_store_insert_sorted (
+            self->installed_apps, group,
+            (GCompareDataFunc) cmp_group, NULL);
+    }
+
+  gtk_filter_changed (GTK_FILTER (self->group_filter), GTK_FILTER_CHANGE_LESS_STRICT);
+  bz_visibility_index_invalidate (self->visibility_index);
+}
+
+static void
+fiber_write_catalog_snapshot (BzApplication *self)
+{
+  g_autoptr (GError) local_error = NULL;
+  g_autoptr (GFile) file         = NULL;
+  guint n_groups                 = 0;
+  GVariantBuilder builder        = { 0 };
+  g_autoptr (GVariant) snapshot  = NULL;
+  g_autoptr (GBytes) bytes       = NULL;
+  gboolean result                = FALSE;
+
+  n_groups = g_list_model_get_n_items (G_LIST_MODEL (self->groups));
+  if (n_groups == 0)
+    return;
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a" BZ_ENTRY_GROUP_SNAPSHOT_TYPE));
+  for (guint i = 0; i < n_groups; i++)
+    {
+      g_autoptr (BzEntryGroup) group = NULL;
+      GVariant *group_snapshot       = NULL;
+
+      group          = g_list_model_get_item (G_LIST_MODEL (self->groups), i);
+      group_snapshot = bz_entry_group_snapshot (group);
+      if (group_snapshot != NULL)
+        g_variant_builder_add_value (&builder, group_snapshot);
+    }
+  snapshot = g_variant_ref_sink (g_variant_new (
+      "(s@a" BZ_ENTRY_GROUP_SNAPSHOT_TYPE ")",
+      PACKAGE_VERSION, g_variant_builder_end (&builder)));
+  bytes    = g_variant_get_data_as_bytes (snapshot);
+
+  file   = dup_catalog_snapshot_file ();
+  result = dex_await (
+      dex_file_replace_contents_bytes (
+          file, bytes, NULL, FALSE,
+          G_FILE_CREATE_REPLACE_DESTINATION),
+      &local_error);
+  if (!result)
+    g_warning ("Unable to write catalog snapshot: %s", local_error->message);
+}
+
+static void
+prune_snapshot_groups (BzApplication *self)
+{
+  guint    n_groups = 0;
+  gboolean pruned   = FALSE;
+
+  /* Groups restored from the snapshot whose entries never came back
+     belong to apps that left the remotes, so they shouldn't be shown or
+     written into the next snapshot */
+  n_groups = g_list_model_get_n_items (G_LIST_MODEL (self->groups));
+  for (guint i = n_groups; i > 0; i--)
+    {
+      g_autoptr (BzEntryGroup) group = NULL;
+      guint position                 = 0;
+
+      group = g_list_model_get_item (G_LIST_MODEL (self->groups), i - 1);
+      if (bz_entry_group_prune_snapshot (group))
+        continue;
+
+      if (g_list_store_find (self->installed_apps, group, &position))
+        g_list_store_remove (self->installed_apps, position);
+      g_hash_table_remove (self->ids_to_groups, bz_entry_group_get_id (group));
+      g_list_store_remove (self->groups, i - 1);
+      pruned = TRUE;
+    }
+
+  if (pruned)
+    bz_visibility_index_invalidate (self->visibility_index);
+}
+
+static GFile *
+dup_catalog_snapshot_file (void)
+{
+  g_autofree char *root_cache_dir = NULL;
+  g_autofree char *path           = NULL;
+
+  /* Living in the root cache dir means a version wipe takes it out too */
+  root_cache_dir = bz_dup_root_cache_dir ();
+  path           = g_build_filename (root_cache_dir, "catalog-snapshot", NULL);
+  return g_file_new_for_path (path);
+}
+
 static void
 fiber_check_for_updates (BzApplication *self)
 {
@@ -2088,7 +2339,7 @@ show_hide_app_setting_changed (BzApplication *self,
   bz_state_info_set_show_only_flathub (self->state, g_settings_get_boolean (self->settings, "show-only-flathub"));
 
   gtk_filter_changed (GTK_FILTER (self->group_filter), GTK_FILTER_CHANGE_DIFFERENT);
-  gtk_filter_changed (GTK_FILTER (self->appid_filter), GTK_FILTER_CHANGE_DIFFERENT);
+  bz_visibility_index_invalidate (self->visibility_index);
 
   g_object_thaw_notify (G_OBJECT (self->state));
 }
@@ -2377,7 +2628,7 @@ blocklists_changed (BzApplication *self,
     }
 
   gtk_filter_changed (GTK_FILTER (self->group_filter), GTK_FILTER_CHANGE_DIFFERENT);
-  gtk_filter_changed (GTK_FILTER (self->appid_filter), GTK_FILTER_CHANGE_DIFFERENT);
+  bz_visibility_index_invalidate (self->visibility_index);
 }
 
 static void
@@ -2404,7 +2655,7 @@ txt_blocklists_changed (BzApplication *self,
     }
 
   gtk_filter_changed (GTK_FILTER (self->group_filter), GTK_FILTER_CHANGE_DIFFERENT);
-  gtk_filter_changed (GTK_FILTER (self->appid_filter), GTK_FILTER_CHANGE_DIFFERENT);
+  bz_visibility_index_invalidate (self->visibility_index);
 }
 
 static void
@@ -2446,6 +2697,10 @@ init_service_struct (BzApplication *self,
   g_clear_error (&local_error);
 #endif
 
+  if (self->config != NULL &&
+      bz_main_config_get_flathub_api_url (self->config) != NULL)
+    bz_set_flathub_api_url (bz_main_config_get_flathub_api_url (self->config));
+
   self->init_timer          = g_timer_new ();
   self->ready_to_open_files = dex_promise_new ();
 
@@ -2626,12 +2881,11 @@ init_service_struct (BzApplication *self,
       (GtkMapListModelMapFunc) map_ids_to_entries,
       self, NULL, NULL, NULL);
 
-  filter = gtk_custom_filter_new (
-      (GtkCustomFilterFunc) filter_application_ids, self, NULL);
-  self->appid_filter        = g_object_ref_sink (g_steal_pointer (&filter));
+  self->visibility_index = bz_visibility_index_new (
+      (BzVisibilityIndexFunc) filter_application_ids, self);
   self->application_factory = bz_application_map_factory_new (
       (GtkMapListModelMapFunc) map_generic_ids_to_groups,
-      self, NULL, NULL, GTK_FILTER (self->appid_filter));
+      self, NULL, NULL, self->visibility_index);
 
   filter = gtk_custom_filter_new (
       (GtkCustomFilterFunc) filter_entry_groups, self, NULL);
@@ -2657,6 +2911,7 @@ init_service_struct (BzApplication *self,
   bz_state_info_set_application_factory (self->state, self->application_factory);
   bz_state_info_set_blocklists (self->state, G_LIST_MODEL (self->blocklists));
   bz_state_info_set_blocklists_provider (self->state, self->blocklists_provider);
+  bz_state_info_set_cache_manager (self->state, self->cache);
   bz_state_info_set_curated_configs (self->state, G_LIST_MODEL (self->curated_configs));
   bz_state_info_set_curated_provider (self->state, self->curated_provider);
   bz_state_info_set_entry_factory (self->state, self->entry_factory);
@@ -2784,6 +3039,29 @@ command_line_open_location (BzApplication           *self,
     }
 }
 
+static DexFuture *
+dump_memory_stats_finally (DexFuture               *future,
+                           GApplicationCommandLine *cmdline)
+{
+  g_autoptr (GError) local_error = NULL;
+  const GValue *value            = NULL;
+  g_autofree char *text          = NULL;
+
+  value = dex_future_get_value (future, &local_error);
+  if (value == NULL)
+    {
+      g_application_command_line_printerr (
+          cmdline, "Unable to collect memory stats: %s\n", local_error->message);
+      g_application_command_line_set_exit_status (cmdline, EXIT_FAILURE);
+      return dex_future_new_true ();
+    }
+
+  text = bz_memory_stats_format (g_value_get_variant (value));
+  g_application_command_line_print (cmdline, "%s\n", text);
+
+  return dex_future_new_true ();
+}
+
 static void
 open_generic_id (BzApplication *self,
                  const char    *generic_id)
@@ -2854,14 +3132,12 @@ map_ids_to_entries (GtkStringObject *string,
 }
 
 static gboolean
-filter_application_ids (GtkStringObject *string,
-                        BzApplication   *self)
+filter_application_ids (const char    *id,
+                        BzApplication *self)
 {
   BzEntryGroup *group = NULL;
 
-  group = g_hash_table_lookup (
-      self->ids_to_groups,
-      gtk_string_object_get_string (string));
+  group = g_hash_table_lookup (self->ids_to_groups, id);
   if (group != NULL)
     return validate_group_for_ui (self, group);
   else
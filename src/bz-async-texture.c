@@ -26,15 +26,36 @@
 #define MAX_LOAD_RETRIES       3
 #define RETRY_INTERVAL_SECONDS 1
 
+/* Downscaled variants are generated by halving the original until the
+   next level would drop below MIN_MIP_SIZE on its longest side */
+#define MAX_MIP_LEVELS 6
+#define MIN_MIP_SIZE   32
+
+/* Download priorities passed to the download worker */
+#define DOWNLOAD_PRIORITY_OFFSCREEN 0
+#define DOWNLOAD_PRIORITY_VISIBLE   100
+
+/* Smoothing factor for the time-to-visible moving average */
+#define TIME_TO_VISIBLE_SMOOTHING 0.1
+
+/* Cached textures up to this size on their longest side (i.e. icons) are
+   additionally kept as raw premultiplied pixels which can be mapped
+   straight into a GdkMemoryTexture without going through glycin */
+#define MAX_RAW_SIZE  256
+#define RAW_MAGIC     "BZRGBA\0\1"
+#define RAW_MAGIC_LEN 8
+
 #include "config.h"
 
 #include <glycin-gtk4-2/glycin-gtk4.h>
 #include <libdex.h>
+#include <math.h>
 
 #include "bz-async-texture.h"
 #include "bz-download-worker.h"
 #include "bz-env.h"
 #include "bz-io.h"
+#include "bz-trace.h"
 #include "bz-util.h"
 
 BZ_DEFINE_DATA (
@@ -47,15 +68,58 @@ BZ_DEFINE_DATA (
       char         *cache_into_path;
       GCancellable *cancellable;
       int           retries;
+      int           size_hint;
+      /* nothing has drawn the texture yet, only find out its size */
+      gboolean      probe;
       GWeakRef      self;
+
+      /* guarded by schedule_mutex */
+      DexPromise *slot_promise;
+      gint64      last_drawn;
+      guint64     serial;
+
+      /* written by the fiber before it resolves */
+      int      out_width;
+      int      out_height;
+      int      out_size;
+      gboolean out_probed;
     },
     BZ_RELEASE_DATA (source, g_object_unref);
     BZ_RELEASE_DATA (source_uri, g_free);
     BZ_RELEASE_DATA (cache_into, g_object_unref);
     BZ_RELEASE_DATA (cache_into_path, g_free);
     BZ_RELEASE_DATA (cancellable, g_object_unref);
+    BZ_RELEASE_DATA (slot_promise, dex_unref);
     g_weak_ref_clear (&self->self);)
 
+static GMutex     schedule_mutex = { 0 };
+static GPtrArray *pending_loads  = NULL;
+static guint      active_loads   = 0;
+static guint64    load_serial    = 0;
+
+static GMutex time_to_visible_mutex   = { 0 };
+static double average_time_to_visible = 0.0;
+
+static guint n_raw_hits = 0;
+static guint n_decodes  = 0;
+
+/* Every live texture, for the memory panel. Values are weak refs so
+   walking this never races with a texture being disposed */
+static GMutex      live_mutex    = { 0 };
+static GHashTable *live_textures = NULL;
+static guint       n_loaded      = 0;
+static guint64     loaded_bytes  = 0;
+
+typedef struct
+{
+  char    magic[RAW_MAGIC_LEN];
+  gint64  birth_unix_stamp;
+  guint32 width;
+  guint32 height;
+  guint32 stride;
+  guint32 reserved;
+} RawHeader;
+
 struct _BzAsyncTexture
 {
   GObject parent_instance;
@@ -68,10 +132,25 @@ struct _BzAsyncTexture
 
   DexFuture    *task;
   GCancellable *cancellable;
+  LoadData     *load_data;
 
   int        retries;
   DexFuture *retry_future;
 
+  /* largest size in device pixels anyone has asked to draw us at, 0
+     until the first snapshot */
+  int size_hint;
+  /* dimensions of the original image, which may be larger than the
+     variant we actually have loaded */
+  int intrinsic_width;
+  int intrinsic_height;
+  int loaded_size;
+
+  /* monotonic time of the most recent draw, and of the first draw
+     which had nothing to show yet */
+  gint64 last_drawn;
+  gint64 waiting_since;
+
   GdkPaintable *paintable;
   GMutex        texture_mutex;
 };
@@ -99,6 +178,9 @@ static GParamSpec *props[LAST_PROP] = { 0 };
 static DexFuture *
 load_fiber_work (LoadData *data);
 
+static DexFuture *
+load_fiber_work_inner (LoadData *data);
+
 static DexFuture *
 load_finally (DexFuture *future,
               LoadData  *data);
@@ -106,6 +188,10 @@ load_finally (DexFuture *future,
 static void
 maybe_load (BzAsyncTexture *self);
 
+static void
+start_load (BzAsyncTexture *self,
+            gboolean        probe);
+
 static DexFuture *
 retry_cb (DexFuture *future,
           LoadData  *data);
@@ -113,15 +199,93 @@ retry_cb (DexFuture *future,
 static gboolean
 idle_notify (BzAsyncTexture *self);
 
+static gboolean
+idle_invalidate_size (BzAsyncTexture *self);
+
+static gboolean
+needs_larger_variant (BzAsyncTexture *self);
+
+static double
+get_max_display_scale (void);
+
+static int
+choose_mip_level (int width,
+                  int height,
+                  int mip_levels,
+                  int size_hint);
+
+static char *
+dup_mip_path (const char *cache_into_path,
+              int         level);
+
+static GlyFrame *
+load_exported_frame (GFile   *file,
+                     GError **error);
+
+static GdkTexture *
+halve_texture (GdkTexture *texture);
+
+static void
+write_metadata (GFile      *file,
+                const char *path,
+                gint64      birth_unix_stamp,
+                int         width,
+                int         height,
+                int         mip_levels,
+                int         size_hint);
+
+static char *
+dup_raw_path (const char *cache_into_path,
+              int         level);
+
+static GdkTexture *
+load_raw_pixels (const char *path,
+                 gint64      birth_unix_stamp);
+
+static void
+write_raw_pixels (const char *path,
+                  GdkTexture *texture,
+                  gint64      birth_unix_stamp);
+
+static DexFuture *
+acquire_load_slot (LoadData *data);
+
+static void
+release_load_slot (void);
+
+static void
+touch_load (LoadData *data,
+            gint64    last_drawn);
+
+static int
+get_download_priority (LoadData *data);
+
+static void
+record_time_to_visible (gint64 usec);
+
+static void
+account_loaded (GdkPaintable *paintable,
+                gboolean      add);
+
+static void
+free_weak_ref (GWeakRef *wr);
+
 static void
 bz_async_texture_dispose (GObject *object)
 {
   BzAsyncTexture *self = BZ_ASYNC_TEXTURE (object);
 
+  g_mutex_lock (&live_mutex);
+  if (live_textures != NULL)
+    g_hash_table_remove (live_textures, self);
+  g_mutex_unlock (&live_mutex);
+  account_loaded (self->paintable, FALSE);
+
   if (self->cancellable != NULL)
     g_cancellable_cancel (self->cancellable);
   dex_clear (&self->task);
   g_clear_object (&self->cancellable);
+  g_clear_pointer (&self->load_data, load_data_unref);
   dex_clear (&self->retry_future);
 
   g_clear_object (&self->source);
@@ -134,6 +298,14 @@ bz_async_texture_dispose (GObject *object)
   G_OBJECT_CLASS (bz_async_texture_parent_class)->dispose (object);
 }
 
+static void
+bz_async_texture_finalize (GObject *object)
+{
+  bz_trace_counter_add (BZ_TRACE_COUNTER_LIVE_TEXTURES, -1);
+
+  G_OBJECT_CLASS (bz_async_texture_parent_class)->finalize (object);
+}
+
 static void
 bz_async_texture_get_property (GObject    *object,
                                guint       prop_id,
@@ -182,6 +354,7 @@ bz_async_texture_class_init (BzAsyncTextureClass *klass)
   GObjectClass *object_class = G_OBJECT_CLASS (klass);
 
   object_class->dispose      = bz_async_texture_dispose;
+  object_class->finalize     = bz_async_texture_finalize;
   object_class->get_property = bz_async_texture_get_property;
   object_class->set_property = bz_async_texture_set_property;
 
@@ -212,9 +385,24 @@ bz_async_texture_class_init (BzAsyncTextureClass *klass)
 static void
 bz_async_texture_init (BzAsyncTexture *self)
 {
+  GWeakRef *wr = NULL;
+
   self->retries   = 0;
   self->paintable = NULL;
   g_mutex_init (&self->texture_mutex);
+
+  wr = g_new0 (GWeakRef, 1);
+  g_weak_ref_init (wr, self);
+
+  g_mutex_lock (&live_mutex);
+  if (live_textures == NULL)
+    live_textures = g_hash_table_new_full (
+        g_direct_hash, g_direct_equal,
+        NULL, (GDestroyNotify) free_weak_ref);
+  g_hash_table_replace (live_textures, self, wr);
+  g_mutex_unlock (&live_mutex);
+
+  bz_trace_counter_add (BZ_TRACE_COUNTER_LIVE_TEXTURES, 1);
 }
 
 static void
@@ -225,8 +413,18 @@ paintable_snapshot (GdkPaintable *paintable,
 {
   BzAsyncTexture *self            = BZ_ASYNC_TEXTURE (paintable);
   g_autoptr (GMutexLocker) locker = NULL;
+  int size_hint                   = 0;
+
+  size_hint = (int) ceil (MAX (width, height) * get_max_display_scale ());
 
   locker = g_mutex_locker_new (&self->texture_mutex);
+  self->size_hint  = MAX (self->size_hint, size_hint);
+  self->last_drawn = g_get_monotonic_time ();
+  if (self->waiting_since == 0 && !GDK_IS_TEXTURE (self->paintable))
+    self->waiting_since = self->last_drawn;
+
+  if (self->load_data != NULL)
+    touch_load (self->load_data, self->last_drawn);
   maybe_load (self);
 
   if (self->paintable != NULL)
@@ -268,6 +466,8 @@ paintable_get_intrinsic_width (GdkPaintable *paintable)
   locker = g_mutex_locker_new (&self->texture_mutex);
   maybe_load (self);
 
+  if (self->intrinsic_width > 0)
+    return self->intrinsic_width;
   if (self->paintable != NULL)
     return gdk_paintable_get_intrinsic_width (self->paintable);
 
@@ -283,6 +483,8 @@ paintable_get_intrinsic_height (GdkPaintable *paintable)
   locker = g_mutex_locker_new (&self->texture_mutex);
   maybe_load (self);
 
+  if (self->intrinsic_height > 0)
+    return self->intrinsic_height;
   if (self->paintable != NULL)
     return gdk_paintable_get_intrinsic_height (self->paintable);
 
@@ -298,6 +500,8 @@ paintable_get_intrinsic_aspect_ratio (GdkPaintable *paintable)
   locker = g_mutex_locker_new (&self->texture_mutex);
   maybe_load (self);
 
+  if (self->intrinsic_width > 0 && self->intrinsic_height > 0)
+    return (double) self->intrinsic_width / (double) self->intrinsic_height;
   if (self->paintable != NULL)
     return gdk_paintable_get_intrinsic_aspect_ratio (self->paintable);
 
@@ -415,7 +619,7 @@ bz_async_texture_dup_future (BzAsyncTexture *self)
   g_return_val_if_fail (BZ_IS_ASYNC_TEXTURE (self), NULL);
 
   locker = g_mutex_locker_new (&self->texture_mutex);
-  maybe_load (self);
+  start_load (self, FALSE);
 
   if (self->task != NULL)
     return dex_ref (self->task);
@@ -436,7 +640,7 @@ bz_async_texture_ensure (BzAsyncTexture *self)
   g_return_if_fail (BZ_IS_ASYNC_TEXTURE (self));
 
   locker = g_mutex_locker_new (&self->texture_mutex);
-  maybe_load (self);
+  start_load (self, FALSE);
 }
 
 void
@@ -448,6 +652,7 @@ bz_async_texture_cancel (BzAsyncTexture *self)
     g_cancellable_cancel (self->cancellable);
   dex_clear (&self->task);
   g_clear_object (&self->cancellable);
+  g_clear_pointer (&self->load_data, load_data_unref);
   self->retries = G_MAXINT;
 }
 
@@ -458,14 +663,132 @@ bz_async_texture_is_loading (BzAsyncTexture *self)
   return self->task != NULL && dex_future_is_pending (self->task);
 }
 
+double
+bz_async_texture_get_average_time_to_visible (void)
+{
+  g_autoptr (GMutexLocker) locker = NULL;
+
+  locker = g_mutex_locker_new (&time_to_visible_mutex);
+  return average_time_to_visible;
+}
+
+void
+bz_async_texture_get_decode_stats (guint *raw_hits,
+                                   guint *decodes)
+{
+  if (raw_hits != NULL)
+    *raw_hits = g_atomic_int_get (&n_raw_hits);
+  if (decodes != NULL)
+    *decodes = g_atomic_int_get (&n_decodes);
+}
+
+void
+bz_async_texture_get_memory_stats (guint   *n_live,
+                                   guint   *n_loaded_out,
+                                   guint64 *pixel_bytes)
+{
+  g_autoptr (GMutexLocker) locker = NULL;
+
+  locker = g_mutex_locker_new (&live_mutex);
+  if (n_live != NULL)
+    *n_live = live_textures != NULL ? g_hash_table_size (live_textures) : 0;
+  if (n_loaded_out != NULL)
+    *n_loaded_out = n_loaded;
+  if (pixel_bytes != NULL)
+    *pixel_bytes = loaded_bytes;
+}
+
+guint
+bz_async_texture_drop_undrawn (gint64 undrawn_usec)
+{
+  g_autoptr (GPtrArray) textures = NULL;
+  gint64 now                     = 0;
+  guint  n_dropped               = 0;
+
+  textures = g_ptr_array_new_with_free_func (g_object_unref);
+
+  g_mutex_lock (&live_mutex);
+  if (live_textures != NULL)
+    {
+      GHashTableIter iter = { 0 };
+      GWeakRef      *wr   = NULL;
+
+      g_hash_table_iter_init (&iter, live_textures);
+      while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &wr))
+        {
+          BzAsyncTexture *texture = NULL;
+
+          texture = g_weak_ref_get (wr);
+          if (texture != NULL)
+            g_ptr_array_add (textures, texture);
+        }
+    }
+  g_mutex_unlock (&live_mutex);
+
+  now = g_get_monotonic_time ();
+  for (guint i = 0; i < textures->len; i++)
+    {
+      BzAsyncTexture *texture         = NULL;
+      g_autoptr (GMutexLocker) locker = NULL;
+
+      texture = g_ptr_array_index (textures, i);
+      locker  = g_mutex_locker_new (&texture->texture_mutex);
+
+      if (!GDK_IS_TEXTURE (texture->paintable) ||
+          (texture->task != NULL && dex_future_is_pending (texture->task)) ||
+          now - texture->last_drawn < undrawn_usec)
+        continue;
+
+      /* The next draw simply loads it again, from the raw cache if we
+         have one */
+      account_loaded (texture->paintable, FALSE);
+      g_clear_object (&texture->paintable);
+      texture->loaded_size = 0;
+      g_clear_pointer (&locker, g_mutex_locker_free);
+
+      idle_notify (texture);
+      n_dropped++;
+    }
+
+  return n_dropped;
+}
+
+guint
+bz_async_texture_get_n_pending_loads (void)
+{
+  g_autoptr (GMutexLocker) locker = NULL;
+
+  locker = g_mutex_locker_new (&schedule_mutex);
+  return pending_loads != NULL ? pending_loads->len : 0;
+}
+
 static void
 maybe_load (BzAsyncTexture *self)
+{
+  /* Which variant to decode depends on how large we're drawn. Until the
+     first snapshot tells us, only the cached dimensions are read so
+     layout has something to go on, and the decode waits. */
+  if (self->size_hint == 0)
+    {
+      if (self->intrinsic_width <= 0)
+        start_load (self, TRUE);
+    }
+  else
+    start_load (self, FALSE);
+}
+
+static void
+start_load (BzAsyncTexture *self,
+            gboolean        probe)
 {
   g_autoptr (LoadData) data    = NULL;
   g_autoptr (DexFuture) future = NULL;
 
-  if (GDK_IS_TEXTURE (self->paintable) ||
-      (self->task != NULL && dex_future_is_pending (self->task)) ||
+  /* A pending probe is replaced by a real load, anything else pending
+     already covers what's asked for */
+  if ((GDK_IS_TEXTURE (self->paintable) && !needs_larger_variant (self)) ||
+      (self->task != NULL && dex_future_is_pending (self->task) &&
+       (probe || !self->load_data->probe)) ||
       self->retries >= MAX_LOAD_RETRIES)
     return;
 
@@ -483,11 +806,16 @@ maybe_load (BzAsyncTexture *self)
   data->cache_into_path = bz_maybe_strdup (self->cache_into_path);
   data->cancellable     = g_object_ref (self->cancellable);
   data->retries         = self->retries;
+  data->size_hint       = self->size_hint;
+  data->probe           = probe;
+  data->last_drawn      = self->last_drawn;
   g_weak_ref_init (&data->self, self);
 
-  future = dex_scheduler_spawn (
-      bz_get_io_scheduler (),
-      bz_get_dex_stack_size (),
+  g_clear_pointer (&self->load_data, load_data_unref);
+  self->load_data = load_data_ref (data);
+
+  future = bz_spawn (
+      BZ_SCHEDULER_PRIORITY_INTERACTIVE,
       (DexFiberFunc) load_fiber_work,
       load_data_ref (data), load_data_unref);
   future = dex_future_finally (
@@ -499,6 +827,25 @@ maybe_load (BzAsyncTexture *self)
 
 static DexFuture *
 load_fiber_work (LoadData *data)
+{
+  g_autoptr (GError) local_error = NULL;
+  g_autoptr (DexFuture) future   = NULL;
+  gboolean result                = FALSE;
+
+  result = dex_await (acquire_load_slot (data), &local_error);
+  if (!result)
+    return dex_future_new_for_error (g_steal_pointer (&local_error));
+
+  bz_trace_counter_add (BZ_TRACE_COUNTER_TEXTURE_DOWNLOADS, 1);
+  future = load_fiber_work_inner (data);
+  bz_trace_counter_add (BZ_TRACE_COUNTER_TEXTURE_DOWNLOADS, -1);
+  release_load_slot ();
+
+  return g_steal_pointer (&future);
+}
+
+static DexFuture *
+load_fiber_work_inner (LoadData *data)
 {
   static GMutex queueing_mutex = { 0 };
 
@@ -528,6 +875,12 @@ load_fiber_work (LoadData *data)
   g_autoptr (GFile) async_tex_data_file = NULL;
   g_autoptr (GdkTexture) texture        = NULL;
   g_autoptr (GlyFrame) frame            = NULL;
+  int      width                        = 0;
+  int      height                       = 0;
+  int      level                        = 0;
+  gint64   birth_unix_stamp             = 0;
+  gboolean write_raw                    = FALSE;
+  gint64   trace_begin                  = 0;
 
   locker = g_mutex_locker_new (&queueing_mutex);
   if (concurrent_glycin == 0)
@@ -626,15 +979,14 @@ load_fiber_work (LoadData *data)
           g_autoptr (GBytes) bytes     = NULL;
           g_autoptr (GVariant) variant = NULL;
           GTimeSpan age_span           = 0;
-          g_autoptr (GlyLoader) loader = NULL;
-          g_autoptr (GlyImage) image   = NULL;
+          int       mip_levels         = 0;
+          int       stored_size_hint   = 0;
 
           bytes = g_file_load_bytes (async_tex_data_file, NULL, NULL, &local_error);
           if (bytes != NULL)
             variant = g_variant_new_from_bytes (G_VARIANT_TYPE ("a{sv}"), bytes, FALSE);
           if (variant != NULL)
             {
-              gint64 birth_unix_stamp               = 0;
               g_autoptr (GDateTime) birth_date_time = NULL;
 
               if (g_variant_lookup (
@@ -647,26 +999,78 @@ load_fiber_work (LoadData *data)
                 }
               else
                 local_error = g_error_new (G_IO_ERROR, G_IO_ERROR_NOT_FOUND, "key \"birth-unix-stamp\" was not found");
+
+              /* These are missing from metadata written by older versions,
+                 in which case we just fall back to the original image */
+              g_variant_lookup (variant, "width", "i", &width);
+              g_variant_lookup (variant, "height", "i", &height);
+              g_variant_lookup (variant, "mip-levels", "i", &mip_levels);
+              g_variant_lookup (variant, "size-hint", "i", &stored_size_hint);
             }
 
           if (variant != NULL && age_span > 0)
             {
-              if (age_span < CACHE_INVALID_AGE)
+              if (age_span < CACHE_INVALID_AGE && data->probe &&
+                  width > 0 && height > 0)
                 {
-                  RATE_LIMIT_END ();
-                  RATE_LIMIT_BEGIN (glycin);
-
-                  loader = gly_loader_new (cache_into);
-                  /* We assume we exported this file, so uhhh it is safe to
-                     not use sandboxing, since it is faster :-) */
-                  gly_loader_set_sandbox_selector (loader, GLY_SANDBOX_SELECTOR_NOT_SANDBOXED);
-
-                  image = gly_loader_load (loader, &local_error);
-                  if (image != NULL)
-                    frame = gly_image_next_frame (image, &local_error);
-
-                  RATE_LIMIT_END ();
-                  RATE_LIMIT_BEGIN (io);
+                  data->out_width  = width;
+                  data->out_height = height;
+                  data->out_probed = TRUE;
+                  return dex_future_new_true ();
+                }
+              else if (age_span < CACHE_INVALID_AGE)
+                {
+                  int size_hint             = 0;
+                  g_autofree char *raw_path = NULL;
+
+                  /* What we're being drawn at now wins, the stored hint
+                     only helps loads nobody has drawn yet, like
+                     prefetches */
+                  size_hint = data->size_hint > 0 ? data->size_hint : stored_size_hint;
+                  level     = choose_mip_level (width, height, mip_levels, size_hint);
+
+                  raw_path = dup_raw_path (cache_into_path, level);
+                  texture  = load_raw_pixels (raw_path, birth_unix_stamp);
+                  if (texture == NULL)
+                    {
+                      RATE_LIMIT_END ();
+                      RATE_LIMIT_BEGIN (glycin);
+
+                      if (level > 0)
+                        {
+                          g_autofree char *mip_path  = NULL;
+                          g_autoptr (GFile) mip_file = NULL;
+
+                          mip_path = dup_mip_path (cache_into_path, level);
+                          mip_file = g_file_new_for_path (mip_path);
+
+                          frame = load_exported_frame (mip_file, &local_error);
+                          if (frame == NULL)
+                            {
+                              g_debug ("Couldn't load downscaled variant %s, falling back to %s: %s",
+                                       mip_path, cache_into_path, local_error->message);
+                              g_clear_pointer (&local_error, g_error_free);
+                              level = 0;
+                            }
+                        }
+                      if (frame == NULL)
+                        frame = load_exported_frame (cache_into, &local_error);
+                      write_raw = frame != NULL;
+
+                      RATE_LIMIT_END ();
+                      RATE_LIMIT_BEGIN (io);
+                    }
+
+                  /* Remember how large this image was last drawn, so the
+                     next undrawn load can pick the right variant right
+                     away. Smaller draws overwrite larger ones, so one
+                     visit to a large view doesn't pin the big variant. */
+                  if ((frame != NULL || texture != NULL) &&
+                      data->size_hint > 0 && data->size_hint != stored_size_hint)
+                    write_metadata (
+                        async_tex_data_file, async_tex_data_path,
+                        birth_unix_stamp, width, height,
+                        mip_levels, data->size_hint);
                 }
               else
                 g_debug ("Metadata file %s for cached texture at %s indicates this resource is too old (GTimeSpan: %zu), "
@@ -681,7 +1085,7 @@ load_fiber_work (LoadData *data)
               g_clear_pointer (&local_error, g_error_free);
             }
 
-          if (frame == NULL)
+          if (frame == NULL && texture == NULL)
             {
               if (local_error != NULL)
                 g_warning ("An attempt to revive cached texture at %s has failed, "
@@ -702,7 +1106,7 @@ load_fiber_work (LoadData *data)
       RATE_LIMIT_END ();
     }
 
-  if (frame == NULL)
+  if (frame == NULL && texture == NULL)
     {
       g_autoptr (GFile) load_file  = NULL;
       g_autoptr (GlyLoader) loader = NULL;
@@ -772,17 +1176,20 @@ load_fiber_work (LoadData *data)
               RATE_LIMIT_END ();
             }
 
-          result = dex_await (
+          trace_begin = bz_trace_begin ();
+          result      = dex_await (
               dex_future_first (
-                  bz_download_worker_invoke (
+                  bz_download_worker_invoke_with_priority (
                       bz_download_worker_get_default (),
-                      source, load_file),
+                      source, load_file,
+                      get_download_priority (data)),
                   /* increase the timeout as more failures stack up */
                   dex_timeout_new_seconds ((data->retries + 1) * HTTP_TIMEOUT_SECONDS),
                   NULL),
               &local_error);
           if (!result)
             return dex_future_new_for_error (g_steal_pointer (&local_error));
+          bz_trace_end (trace_begin, "Textures", "Download", "%s", source_uri);
         }
       else
         {
@@ -807,6 +1214,8 @@ load_fiber_work (LoadData *data)
 
       RATE_LIMIT_BEGIN (glycin);
 
+      trace_begin = bz_trace_begin ();
+
       loader = gly_loader_new (load_file);
 #ifdef SANDBOXED_LIBFLATPAK
       gly_loader_set_sandbox_selector (loader, GLY_SANDBOX_SELECTOR_NOT_SANDBOXED);
@@ -823,60 +1232,127 @@ load_fiber_work (LoadData *data)
       if (frame == NULL)
         return dex_future_new_for_error (g_steal_pointer (&local_error));
 
-      RATE_LIMIT_END ();
+      texture = gly_gtk_frame_get_texture (frame);
+      if (texture == NULL)
+        return dex_future_new_reject (
+            G_IO_ERROR,
+            G_IO_ERROR_FAILED,
+            "texture loading failed");
+      bz_trace_end (trace_begin, "Textures", "Decode", "%s: %dx%d", source_uri,
+                    gdk_texture_get_width (texture), gdk_texture_get_height (texture));
+
+      width            = gdk_texture_get_width (texture);
+      height           = gdk_texture_get_height (texture);
+      birth_unix_stamp = g_date_time_to_unix (now);
+      write_raw        = TRUE;
 
-      if (async_tex_data_file != NULL)
+      if (cache_into != NULL)
         {
-          g_autoptr (GVariantBuilder) builder  = NULL;
-          g_autoptr (GVariant) variant         = NULL;
-          g_autoptr (GBytes) bytes             = NULL;
-          g_autoptr (GFileOutputStream) output = NULL;
+          g_autoptr (GPtrArray) mip_pngs        = NULL;
+          g_autoptr (GdkTexture) level_texture  = NULL;
+          g_autoptr (GdkTexture) chosen_texture = NULL;
+          int full_size                         = 0;
+          int mip_levels                        = 0;
+          int chosen_level                      = 0;
+
+          /* Generate downscaled variants once up front, so later loads
+             for smaller tiles don't need to decode the whole thing */
+          mip_pngs      = g_ptr_array_new_with_free_func ((GDestroyNotify) g_bytes_unref);
+          level_texture = g_object_ref (texture);
+          full_size     = MAX (width, height);
+
+          while (mip_pngs->len < MAX_MIP_LEVELS &&
+                 (full_size >> (mip_pngs->len + 1)) >= MIN_MIP_SIZE)
+            {
+              g_autoptr (GdkTexture) halved = NULL;
 
-          builder = g_variant_builder_new (G_VARIANT_TYPE ("a{sv}"));
-          g_variant_builder_add (
-              builder,
-              "{sv}",
-              "birth-unix-stamp",
-              g_variant_new_int64 (g_date_time_to_unix (now)));
+              halved = halve_texture (level_texture);
+              g_ptr_array_add (mip_pngs, gdk_texture_save_to_png_bytes (halved));
 
-          variant = g_variant_builder_end (builder);
-          bytes   = g_variant_get_data_as_bytes (variant);
+              if (choose_mip_level (width, height, mip_pngs->len, data->size_hint) == mip_pngs->len)
+                g_set_object (&chosen_texture, halved);
+              g_set_object (&level_texture, halved);
+            }
 
+          RATE_LIMIT_END ();
           RATE_LIMIT_BEGIN (io);
 
-          output = g_file_replace (
-              async_tex_data_file,
-              NULL,
-              FALSE,
-              G_FILE_CREATE_REPLACE_DESTINATION,
-              NULL,
-              &local_error);
-          if (output != NULL)
+          for (guint i = 0; i < mip_pngs->len; i++)
             {
-              gssize bytes_written = 0;
-
-              bytes_written = g_output_stream_write_bytes (G_OUTPUT_STREAM (output), bytes, NULL, &local_error);
-              if (bytes_written > 0)
-                g_output_stream_close (G_OUTPUT_STREAM (output), NULL, &local_error);
+              g_autofree char *mip_path  = NULL;
+              g_autoptr (GFile) mip_file = NULL;
+
+              mip_path = dup_mip_path (cache_into_path, i + 1);
+              mip_file = g_file_new_for_path (mip_path);
+
+              result = g_file_replace_contents (
+                  mip_file,
+                  g_bytes_get_data (g_ptr_array_index (mip_pngs, i), NULL),
+                  g_bytes_get_size (g_ptr_array_index (mip_pngs, i)),
+                  NULL, FALSE,
+                  G_FILE_CREATE_REPLACE_DESTINATION,
+                  NULL, cancellable, &local_error);
+              if (!result)
+                {
+                  g_warning ("Failed to write downscaled variant %s, only %d "
+                             "variants will be available for this image: %s",
+                             mip_path, mip_levels, local_error->message);
+                  g_clear_pointer (&local_error, g_error_free);
+                  break;
+                }
+              mip_levels++;
             }
 
-          RATE_LIMIT_END ();
+          write_metadata (
+              async_tex_data_file, async_tex_data_path,
+              birth_unix_stamp, width, height,
+              mip_levels, data->size_hint);
 
-          if (local_error != NULL)
-            g_warning ("Failed to write async-tex cache metadata to %s ;"
-                       "The image will be fully reloaded next time: %s",
-                       async_tex_data_path, local_error->message);
-          g_clear_pointer (&local_error, g_error_free);
+          chosen_level = choose_mip_level (width, height, mip_levels, data->size_hint);
+          if (chosen_level > 0 && chosen_texture != NULL)
+            {
+              g_set_object (&texture, chosen_texture);
+              level = chosen_level;
+            }
         }
+
+      RATE_LIMIT_END ();
     }
 
-  texture = gly_gtk_frame_get_texture (frame);
+  if (texture == NULL)
+    texture = gly_gtk_frame_get_texture (frame);
   if (texture == NULL)
     return dex_future_new_reject (
         G_IO_ERROR,
         G_IO_ERROR_FAILED,
         "texture loading failed");
 
+  if (width <= 0 || height <= 0)
+    {
+      width  = gdk_texture_get_width (texture);
+      height = gdk_texture_get_height (texture);
+    }
+  data->out_width  = width;
+  data->out_height = height;
+  data->out_size   = MAX (gdk_texture_get_width (texture),
+                          gdk_texture_get_height (texture));
+
+  if (frame != NULL)
+    g_atomic_int_inc (&n_decodes);
+  else
+    g_atomic_int_inc (&n_raw_hits);
+
+  if (write_raw && cache_into != NULL && data->out_size <= MAX_RAW_SIZE)
+    {
+      g_autofree char *raw_path = NULL;
+
+      raw_path = dup_raw_path (cache_into_path, level);
+
+      RATE_LIMIT_BEGIN (io);
+      write_raw_pixels (raw_path, texture, birth_unix_stamp);
+      RATE_LIMIT_END ();
+    }
+
   return dex_future_new_for_object (texture);
 }
 
@@ -892,11 +1368,36 @@ load_finally (DexFuture *future,
 
   locker = g_mutex_locker_new (&self->texture_mutex);
   dex_clear (&self->task);
+  if (self->load_data == data)
+    g_clear_pointer (&self->load_data, load_data_unref);
+
+  if (dex_future_is_resolved (future) && data->out_probed)
+    {
+      self->intrinsic_width  = data->out_width;
+      self->intrinsic_height = data->out_height;
+
+      g_idle_add_full (
+          G_PRIORITY_DEFAULT_IDLE,
+          (GSourceFunc) idle_invalidate_size,
+          g_object_ref (self), g_object_unref);
 
-  if (dex_future_is_resolved (future))
+      return dex_ref (future);
+    }
+  else if (dex_future_is_resolved (future))
     {
+      if (self->waiting_since > 0)
+        {
+          record_time_to_visible (g_get_monotonic_time () - self->waiting_since);
+          self->waiting_since = 0;
+        }
+
+      account_loaded (self->paintable, FALSE);
       g_clear_object (&self->paintable);
-      self->paintable = g_value_dup_object (dex_future_get_value (future, NULL));
+      self->paintable        = g_value_dup_object (dex_future_get_value (future, NULL));
+      account_loaded (self->paintable, TRUE);
+      self->intrinsic_width  = data->out_width;
+      self->intrinsic_height = data->out_height;
+      self->loaded_size      = data->out_size;
 
       g_idle_add_full (
           G_PRIORITY_DEFAULT_IDLE,
@@ -960,3 +1461,417 @@ idle_notify (BzAsyncTexture *self)
 
   return G_SOURCE_REMOVE;
 }
+
+static gboolean
+idle_invalidate_size (BzAsyncTexture *self)
+{
+  gdk_paintable_invalidate_size (GDK_PAINTABLE (self));
+  return G_SOURCE_REMOVE;
+}
+
+static gboolean
+needs_larger_variant (BzAsyncTexture *self)
+{
+  return self->loaded_size > 0 &&
+         self->loaded_size < MAX (self->intrinsic_width, self->intrinsic_height) &&
+         self->size_hint > self->loaded_size;
+}
+
+static double
+get_max_display_scale (void)
+{
+  GdkDisplay *display    = NULL;
+  GListModel *monitors   = NULL;
+  guint       n_monitors = 0;
+  double      scale      = 1.0;
+
+  display = gdk_display_get_default ();
+  if (display == NULL)
+    return scale;
+
+  monitors   = gdk_display_get_monitors (display);
+  n_monitors = g_list_model_get_n_items (monitors);
+  for (guint i = 0; i < n_monitors; i++)
+    {
+      g_autoptr (GdkMonitor) monitor = NULL;
+
+      monitor = g_list_model_get_item (monitors, i);
+      scale   = MAX (scale, gdk_monitor_get_scale (monitor));
+    }
+
+  return scale;
+}
+
+static int
+choose_mip_level (int width,
+                  int height,
+                  int mip_levels,
+                  int size_hint)
+{
+  int full_size = 0;
+  int level     = 0;
+
+  if (size_hint <= 0 || width <= 0 || height <= 0)
+    return 0;
+
+  /* Pick the smallest variant which still covers the requested size */
+  full_size = MAX (width, height);
+  while (level < mip_levels &&
+         (full_size >> (level + 1)) >= size_hint)
+    level++;
+
+  return level;
+}
+
+static char *
+dup_mip_path (const char *cache_into_path,
+              int         level)
+{
+  return g_strdup_printf ("%s.mip-%d.png", cache_into_path, level);
+}
+
+static GlyFrame *
+load_exported_frame (GFile   *file,
+                     GError **error)
+{
+  g_autoptr (GlyLoader) loader = NULL;
+  g_autoptr (GlyImage) image   = NULL;
+
+  loader = gly_loader_new (file);
+  /* We assume we exported this file, so uhhh it is safe to
+     not use sandboxing, since it is faster :-) */
+  gly_loader_set_sandbox_selector (loader, GLY_SANDBOX_SELECTOR_NOT_SANDBOXED);
+
+  image = gly_loader_load (loader, error);
+  if (image == NULL)
+    return NULL;
+
+  return gly_image_next_frame (image, error);
+}
+
+static GdkTexture *
+halve_texture (GdkTexture *texture)
+{
+  int    src_width                            = 0;
+  int    src_height                           = 0;
+  int    dst_width                            = 0;
+  int    dst_height                           = 0;
+  gsize  src_stride                           = 0;
+  gsize  dst_stride                           = 0;
+  g_autoptr (GdkTextureDownloader) downloader = NULL;
+  g_autoptr (GBytes) src_bytes                = NULL;
+  const guchar *src                           = NULL;
+  guchar       *dst                           = NULL;
+  g_autoptr (GBytes) dst_bytes                = NULL;
+
+  src_width  = gdk_texture_get_width (texture);
+  src_height = gdk_texture_get_height (texture);
+  dst_width  = MAX (1, src_width / 2);
+  dst_height = MAX (1, src_height / 2);
+
+  downloader = gdk_texture_downloader_new (texture);
+  gdk_texture_downloader_set_format (downloader, GDK_MEMORY_R8G8B8A8_PREMULTIPLIED);
+  src_bytes = gdk_texture_downloader_download_bytes (downloader, &src_stride);
+  src       = g_bytes_get_data (src_bytes, NULL);
+
+  dst_stride = (gsize) dst_width * 4;
+  dst        = g_malloc (dst_stride * dst_height);
+
+  /* Plain 2x2 box filter, which is fine for premultiplied pixels */
+  for (int y = 0; y < dst_height; y++)
+    {
+      const guchar *row0 = NULL;
+      const guchar *row1 = NULL;
+
+      row0 = src + (gsize) MIN (y * 2, src_height - 1) * src_stride;
+      row1 = src + (gsize) MIN (y * 2 + 1, src_height - 1) * src_stride;
+
+      for (int x = 0; x < dst_width; x++)
+        {
+          int x0 = 0;
+          int x1 = 0;
+
+          x0 = MIN (x * 2, src_width - 1) * 4;
+          x1 = MIN (x * 2 + 1, src_width - 1) * 4;
+
+          for (int c = 0; c < 4; c++)
+            dst[y * dst_stride + x * 4 + c] =
+                (row0[x0 + c] + row0[x1 + c] +
+                 row1[x0 + c] + row1[x1 + c] + 2) /
+                4;
+        }
+    }
+
+  dst_bytes = g_bytes_new_take (dst, dst_stride * dst_height);
+  return gdk_memory_texture_new (
+      dst_width, dst_height,
+      GDK_MEMORY_R8G8B8A8_PREMULTIPLIED,
+      dst_bytes, dst_stride);
+}
+
+static void
+write_metadata (GFile      *file,
+                const char *path,
+                gint64      birth_unix_stamp,
+                int         width,
+                int         height,
+                int         mip_levels,
+                int         size_hint)
+{
+  g_autoptr (GError) local_error       = NULL;
+  g_autoptr (GVariantBuilder) builder  = NULL;
+  g_autoptr (GVariant) variant         = NULL;
+  g_autoptr (GBytes) bytes             = NULL;
+  g_autoptr (GFileOutputStream) output = NULL;
+
+  builder = g_variant_builder_new (G_VARIANT_TYPE ("a{sv}"));
+  g_variant_builder_add (builder, "{sv}", "birth-unix-stamp", g_variant_new_int64 (birth_unix_stamp));
+  g_variant_builder_add (builder, "{sv}", "width", g_variant_new_int32 (width));
+  g_variant_builder_add (builder, "{sv}", "height", g_variant_new_int32 (height));
+  g_variant_builder_add (builder, "{sv}", "mip-levels", g_variant_new_int32 (mip_levels));
+  g_variant_builder_add (builder, "{sv}", "size-hint", g_variant_new_int32 (size_hint));
+
+  variant = g_variant_builder_end (builder);
+  bytes   = g_variant_get_data_as_bytes (variant);
+
+  output = g_file_replace (
+      file,
+      NULL,
+      FALSE,
+      G_FILE_CREATE_REPLACE_DESTINATION,
+      NULL,
+      &local_error);
+  if (output != NULL)
+    {
+      gssize bytes_written = 0;
+
+      bytes_written = g_output_stream_write_bytes (G_OUTPUT_STREAM (output), bytes, NULL, &local_error);
+      if (bytes_written > 0)
+        g_output_stream_close (G_OUTPUT_STREAM (output), NULL, &local_error);
+    }
+
+  if (local_error != NULL)
+    g_warning ("Failed to write async-tex cache metadata to %s ;"
+               "The image will be fully reloaded next time: %s",
+               path, local_error->message);
+}
+
+static char *
+dup_raw_path (const char *cache_into_path,
+              int         level)
+{
+  return g_strdup_printf ("%s.raw-%d", cache_into_path, level);
+}
+
+static GdkTexture *
+load_raw_pixels (const char *path,
+                 gint64      birth_unix_stamp)
+{
+  g_autoptr (GMappedFile) mapped = NULL;
+  g_autoptr (GBytes) bytes       = NULL;
+  g_autoptr (GBytes) pixels      = NULL;
+  RawHeader header               = { 0 };
+  gsize     size                 = 0;
+
+  mapped = g_mapped_file_new (path, FALSE, NULL);
+  if (mapped == NULL)
+    return NULL;
+
+  bytes = g_mapped_file_get_bytes (mapped);
+  size  = g_bytes_get_size (bytes);
+  if (size < sizeof (header))
+    return NULL;
+  memcpy (&header, g_bytes_get_data (bytes, NULL), sizeof (header));
+
+  /* The raw pixels are only valid for the exact cache generation they
+     were decoded from, anything else is treated as a miss */
+  if (memcmp (header.magic, RAW_MAGIC, RAW_MAGIC_LEN) != 0 ||
+      header.birth_unix_stamp != birth_unix_stamp ||
+      header.width == 0 || header.height == 0 ||
+      header.width > MAX_RAW_SIZE || header.height > MAX_RAW_SIZE ||
+      header.stride < header.width * 4 ||
+      size - sizeof (header) < (gsize) header.stride * header.height)
+    return NULL;
+
+  /* The texture keeps the mapping alive */
+  pixels = g_bytes_new_from_bytes (bytes, sizeof (header), (gsize) header.stride * header.height);
+  return gdk_memory_texture_new (
+      header.width, header.height,
+      GDK_MEMORY_R8G8B8A8_PREMULTIPLIED,
+      pixels, header.stride);
+}
+
+static void
+write_raw_pixels (const char *path,
+                  GdkTexture *texture,
+                  gint64      birth_unix_stamp)
+{
+  g_autoptr (GError) local_error              = NULL;
+  g_autoptr (GdkTextureDownloader) downloader = NULL;
+  g_autoptr (GBytes) pixels                   = NULL;
+  g_autoptr (GByteArray) contents             = NULL;
+  RawHeader header                            = { 0 };
+  gsize     stride                            = 0;
+  gboolean  result                            = FALSE;
+
+  downloader = gdk_texture_downloader_new (texture);
+  gdk_texture_downloader_set_format (downloader, GDK_MEMORY_R8G8B8A8_PREMULTIPLIED);
+  pixels = gdk_texture_downloader_download_bytes (downloader, &stride);
+
+  memcpy (header.magic, RAW_MAGIC, RAW_MAGIC_LEN);
+  header.birth_unix_stamp = birth_unix_stamp;
+  header.width            = gdk_texture_get_width (texture);
+  header.height           = gdk_texture_get_height (texture);
+  header.stride           = stride;
+
+  contents = g_byte_array_sized_new (sizeof (header) + g_bytes_get_size (pixels));
+  g_byte_array_append (contents, (const guint8 *) &header, sizeof (header));
+  g_byte_array_append (contents, g_bytes_get_data (pixels, NULL), g_bytes_get_size (pixels));
+
+  result = g_file_set_contents (path, (const char *) contents->data, contents->len, &local_error);
+  if (!result)
+    g_debug ("Couldn't write raw pixel cache to %s: %s", path, local_error->message);
+}
+
+static DexFuture *
+acquire_load_slot (LoadData *data)
+{
+  g_autoptr (GMutexLocker) locker = NULL;
+
+  locker = g_mutex_locker_new (&schedule_mutex);
+  if (active_loads < BZ_ASYNC_TEXTURE_MAX_ACTIVE_LOADS)
+    {
+      active_loads++;
+      return dex_future_new_true ();
+    }
+
+  if (pending_loads == NULL)
+    pending_loads = g_ptr_array_new ();
+
+  data->slot_promise = dex_promise_new ();
+  data->serial       = load_serial++;
+  g_ptr_array_add (pending_loads, load_data_ref (data));
+
+  return dex_ref (data->slot_promise);
+}
+
+static void
+release_load_slot (void)
+{
+  g_autoptr (GMutexLocker) locker = NULL;
+  g_autoptr (GPtrArray) cancelled = NULL;
+  g_autoptr (LoadData) next       = NULL;
+
+  cancelled = g_ptr_array_new_with_free_func (load_data_unref);
+
+  locker = g_mutex_locker_new (&schedule_mutex);
+  while (pending_loads != NULL && pending_loads->len > 0 && next == NULL)
+    {
+      guint best = 0;
+
+      /* Most recently drawn first; textures which were only ensured and
+         never drawn wait behind those, in the order they were queued */
+      for (guint i = 1; i < pending_loads->len; i++)
+        {
+          LoadData *candidate = g_ptr_array_index (pending_loads, i);
+          LoadData *current   = g_ptr_array_index (pending_loads, best);
+
+          if (candidate->last_drawn > current->last_drawn ||
+              (candidate->last_drawn == current->last_drawn &&
+               candidate->serial < current->serial))
+            best = i;
+        }
+
+      next = g_ptr_array_steal_index (pending_loads, best);
+      if (g_cancellable_is_cancelled (next->cancellable))
+        g_ptr_array_add (cancelled, g_steal_pointer (&next));
+    }
+  if (next == NULL)
+    active_loads--;
+  g_clear_pointer (&locker, g_mutex_locker_free);
+
+  /* The slot is handed over directly to the next load */
+  if (next != NULL)
+    dex_promise_resolve_boolean (next->slot_promise, TRUE);
+
+  for (guint i = 0; i < cancelled->len; i++)
+    {
+      LoadData *data = g_ptr_array_index (cancelled, i);
+
+      dex_promise_reject (
+          data->slot_promise,
+          g_error_new (G_IO_ERROR, G_IO_ERROR_CANCELLED,
+                       "texture load was cancelled before it started"));
+    }
+}
+
+static void
+touch_load (LoadData *data,
+            gint64    last_drawn)
+{
+  g_autoptr (GMutexLocker) locker = NULL;
+
+  locker           = g_mutex_locker_new (&schedule_mutex);
+  data->last_drawn = MAX (data->last_drawn, last_drawn);
+}
+
+static int
+get_download_priority (LoadData *data)
+{
+  g_autoptr (GMutexLocker) locker = NULL;
+
+  locker = g_mutex_locker_new (&schedule_mutex);
+  return data->last_drawn > 0
+             ? DOWNLOAD_PRIORITY_VISIBLE
+             : DOWNLOAD_PRIORITY_OFFSCREEN;
+}
+
+static void
+record_time_to_visible (gint64 usec)
+{
+  g_autoptr (GMutexLocker) locker = NULL;
+  double msec                     = 0.0;
+
+  msec = (double) usec / 1000.0;
+
+  locker = g_mutex_locker_new (&time_to_visible_mutex);
+  if (average_time_to_visible <= 0.0)
+    average_time_to_visible = msec;
+  else
+    average_time_to_visible = average_time_to_visible * (1.0 - TIME_TO_VISIBLE_SMOOTHING) +
+                              msec * TIME_TO_VISIBLE_SMOOTHING;
+}
+
+static void
+account_loaded (GdkPaintable *paintable,
+                gboolean      add)
+{
+  g_autoptr (GMutexLocker) locker = NULL;
+  guint64 bytes                   = 0;
+
+  if (!GDK_IS_TEXTURE (paintable))
+    return;
+
+  /* An estimate, assuming 4 bytes per pixel */
+  bytes = (guint64) gdk_texture_get_width (GDK_TEXTURE (paintable)) *
+          (guint64) gdk_texture_get_height (GDK_TEXTURE (paintable)) * 4;
+
+  locker = g_mutex_locker_new (&live_mutex);
+  if (add)
+    {
+      n_loaded++;
+      loaded_bytes += bytes;
+    }
+  else
+    {
+      n_loaded--;
+      loaded_bytes -= MIN (bytes, loaded_bytes);
+    }
+}
+
+static void
+free_weak_ref (GWeakRef *wr)
+{
+  g_weak_ref_clear (wr);
+  g_free (wr);
+}
@@ -25,6 +25,10 @@
 
 G_BEGIN_DECLS
 
+/* Loads beyond this many wait in a queue ordered by how recently their
+   texture was drawn, so tiles which just scrolled into view go first */
+#define BZ_ASYNC_TEXTURE_MAX_ACTIVE_LOADS 16
+
 #define BZ_TYPE_ASYNC_TEXTURE (bz_async_texture_get_type ())
 G_DECLARE_FINAL_TYPE (BzAsyncTexture, bz_async_texture, BZ, ASYNC_TEXTURE, GObject)
 
@@ -66,4 +70,22 @@ bz_async_texture_cancel (BzAsyncTexture *self);
 gboolean
 bz_async_texture_is_loading (BzAsyncTexture *self);
 
+double
+bz_async_texture_get_average_time_to_visible (void);
+
+guint
+bz_async_texture_get_n_pending_loads (void);
+
+void
+bz_async_texture_get_memory_stats (guint   *n_live,
+                                   guint   *n_loaded,
+                                   guint64 *pixel_bytes);
+
+guint
+bz_async_texture_drop_undrawn (gint64 undrawn_usec);
+
+void
+bz_async_texture_get_decode_stats (guint *raw_hits,
+                                   guint *decodes);
+
 G_END_DECLS
@@ -0,0 +1,203 @@
+/* bz-compress.c
+ *
+ * Copyright 2025 Adam Masciola
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "config.h"
+
+#include <gio/gio.h>
+#include <string.h>
+
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#include "bz-compress.h"
+#include "bz-env.h"
+
+/* Cache files are zstd frames behind BZ_COMPRESS_MAGIC. Uncompressed
+   data is passed through untouched on read, which keeps older caches and
+   builds without zstd working. Frames are written without a dictionary,
+   so one that needs a dictionary is rejected and the cache rebuilt. */
+
+/* Don't trust corrupted frame headers with a huge allocation */
+#define MAX_DECOMPRESSED_SIZE (256 * 1024 * 1024)
+
+#ifdef HAVE_ZSTD
+
+static void
+free_cctx (gpointer cctx);
+
+static void
+free_dctx (gpointer dctx);
+
+/* Contexts aren't thread safe but are expensive enough to keep around,
+   so each pool thread gets its own */
+static GPrivate cctx_private = G_PRIVATE_INIT (free_cctx);
+static GPrivate dctx_private = G_PRIVATE_INIT (free_dctx);
+
+#endif
+
+gboolean
+bz_compress_is_enabled (void)
+{
+#ifdef HAVE_ZSTD
+  return bz_get_cache_compression_level () > 0;
+#else
+  return FALSE;
+#endif
+}
+
+GBytes *
+bz_compress_cache_bytes (GBytes *bytes)
+{
+#ifdef HAVE_ZSTD
+  ZSTD_CCtx    *cctx   = NULL;
+  gconstpointer data   = NULL;
+  gsize         size   = 0;
+  gsize         bound  = 0;
+  guint8       *dest   = NULL;
+  gsize         result = 0;
+#endif
+
+  g_return_val_if_fail (bytes != NULL, NULL);
+
+#ifdef HAVE_ZSTD
+  if (!bz_compress_is_enabled ())
+    return g_bytes_ref (bytes);
+
+  cctx = g_private_get (&cctx_private);
+  if (cctx == NULL)
+    {
+      cctx = ZSTD_createCCtx ();
+      g_private_set (&cctx_private, cctx);
+    }
+
+  data  = g_bytes_get_data (bytes, &size);
+  bound = ZSTD_compressBound (size);
+  dest  = g_malloc (BZ_COMPRESS_MAGIC_LEN + bound);
+  memcpy (dest, BZ_COMPRESS_MAGIC, BZ_COMPRESS_MAGIC_LEN);
+
+  result = ZSTD_compressCCtx (
+      cctx, dest + BZ_COMPRESS_MAGIC_LEN, bound,
+      data, size, bz_get_cache_compression_level ());
+
+  if (ZSTD_isError (result))
+    {
+      g_warning ("Failed to compress cache data, writing it uncompressed: %s",
+                 ZSTD_getErrorName (result));
+      g_free (dest);
+      return g_bytes_ref (bytes);
+    }
+
+  dest = g_realloc (dest, BZ_COMPRESS_MAGIC_LEN + result);
+  return g_bytes_new_take (dest, BZ_COMPRESS_MAGIC_LEN + result);
+#else
+  return g_bytes_ref (bytes);
+#endif
+}
+
+GBytes *
+bz_decompress_cache_bytes (GBytes  *bytes,
+                           GError **error)
+{
+  const guint8 *data = NULL;
+  gsize         size = 0;
+#ifdef HAVE_ZSTD
+  ZSTD_DCtx         *dctx         = NULL;
+  unsigned long long content_size = 0;
+  guint8            *dest         = NULL;
+  gsize              result       = 0;
+#endif
+
+  g_return_val_if_fail (bytes != NULL, NULL);
+
+  data = g_bytes_get_data (bytes, &size);
+  if (size < BZ_COMPRESS_MAGIC_LEN ||
+      memcmp (data, BZ_COMPRESS_MAGIC, BZ_COMPRESS_MAGIC_LEN) != 0)
+    return g_bytes_ref (bytes);
+
+#ifdef HAVE_ZSTD
+  data += BZ_COMPRESS_MAGIC_LEN;
+  size -= BZ_COMPRESS_MAGIC_LEN;
+
+  content_size = ZSTD_getFrameContentSize (data, size);
+  if (content_size == ZSTD_CONTENTSIZE_UNKNOWN ||
+      content_size == ZSTD_CONTENTSIZE_ERROR ||
+      content_size > MAX_DECOMPRESSED_SIZE)
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                   "Compressed cache data has an invalid frame header");
+      return NULL;
+    }
+
+  if (ZSTD_getDictID_fromFrame (data, size) != 0)
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                   "Compressed cache data needs a dictionary");
+      return NULL;
+    }
+
+  dctx = g_private_get (&dctx_private);
+  if (dctx == NULL)
+    {
+      dctx = ZSTD_createDCtx ();
+      g_private_set (&dctx_private, dctx);
+    }
+
+  dest = g_malloc (MAX (content_size, 1));
+  result = ZSTD_decompressDCtx (
+      dctx, dest, content_size,
+      data, size);
+
+  if (ZSTD_isError (result) || result != content_size)
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                   "Failed to decompress cache data: %s",
+                   ZSTD_isError (result)
+                       ? ZSTD_getErrorName (result)
+                       : "size mismatch");
+      g_free (dest);
+      return NULL;
+    }
+
+  return g_bytes_new_take (dest, result);
+#else
+  g_set_error (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+               "Cache data is compressed, but this build has no zstd support");
+  return NULL;
+#endif
+}
+
+#ifdef HAVE_ZSTD
+
+static void
+free_cctx (gpointer cctx)
+{
+  ZSTD_freeCCtx (cctx);
+}
+
+static void
+free_dctx (gpointer dctx)
+{
+  ZSTD_freeDCtx (dctx);
+}
+
+#endif
+
+/* End of bz-compress.c */
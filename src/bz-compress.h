@@ -0,0 +1,45 @@
+/* bz-compress.h
+ *
+ * Copyright 2025 Adam Masciola
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* Compressed cache files start with this magic. The first byte is
+   neither ASCII nor a small version number, so it can't be confused with
+   the vardicts or fixed layout tuples written uncompressed. */
+#define BZ_COMPRESS_MAGIC     "\x89" "BZC"
+#define BZ_COMPRESS_MAGIC_LEN 4
+
+gboolean
+bz_compress_is_enabled (void);
+
+GBytes *
+bz_compress_cache_bytes (GBytes *bytes);
+
+GBytes *
+bz_decompress_cache_bytes (GBytes  *bytes,
+                           GError **error);
+
+G_END_DECLS
+
+/* End of bz-compress.h */
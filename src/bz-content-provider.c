@@ -134,6 +134,25 @@ input_file_changed_on_disk (InputTrackingData *data,
 static gboolean
 commence_reload (InputTrackingData *data);
 
+static void
+merge_object (GObject *object,
+              GObject *incoming);
+
+static void
+merge_store (GListStore *store,
+             GListModel *incoming);
+
+static void
+merge_string_list (GtkStringList *list,
+                   GtkStringList *incoming);
+
+static char *
+dup_fingerprint (GObject *object);
+
+static void
+append_fingerprint (GString *string,
+                    GObject *object);
+
 static void
 bz_content_provider_dispose (GObject *object)
 {
@@ -442,9 +461,8 @@ input_files_changed (BzContentProvider *self,
       init_data       = input_init_data_new ();
       init_data->file = g_object_ref (additions[i]);
 
-      future = dex_scheduler_spawn (
-          bz_get_io_scheduler (),
-          bz_get_dex_stack_size (),
+      future = bz_spawn (
+          BZ_SCHEDULER_PRIORITY_INTERACTIVE,
           (DexFiberFunc) input_init_fiber,
           input_init_data_ref (init_data),
           input_init_data_unref);
@@ -579,16 +597,37 @@ input_load_finally (DexFuture         *future,
   const GValue *value                = NULL;
 
   locker = g_mutex_locker_new (&data->mutex);
-  g_list_store_remove_all (data->output);
 
   bz_weak_get_or_return_reject (self, &data->self);
 
   value = dex_future_get_value (future, &local_error);
   if (value != NULL)
-    g_list_store_append (data->output, g_value_get_object (value));
-  else if (local_error->domain != G_IO_ERROR)
-    g_warning ("Could not load object at path %s: %s",
-               data->path, local_error->message);
+    {
+      g_autoptr (GObject) existing = NULL;
+      GObject *incoming            = NULL;
+
+      incoming = g_value_get_object (value);
+      if (g_list_model_get_n_items (G_LIST_MODEL (data->output)) > 0)
+        existing = g_list_model_get_item (G_LIST_MODEL (data->output), 0);
+
+      /* Update the previous tree in place so that everything which
+         didn't change keeps its identity, and with it any widgets and
+         textures created for it */
+      if (existing != NULL &&
+          G_OBJECT_TYPE (existing) == G_OBJECT_TYPE (incoming))
+        merge_object (existing, incoming);
+      else
+        g_list_store_splice (data->output, 0,
+                             g_list_model_get_n_items (G_LIST_MODEL (data->output)),
+                             (gpointer *) &incoming, 1);
+    }
+  else
+    {
+      g_list_store_remove_all (data->output);
+      if (local_error->domain != G_IO_ERROR)
+        g_warning ("Could not load object at path %s: %s",
+                   data->path, local_error->message);
+    }
 
   g_object_notify_by_pspec (G_OBJECT (self), props[PROP_HAS_INPUTS]);
   return NULL;
@@ -616,9 +655,8 @@ commence_reload (InputTrackingData *data)
   load_data->file   = g_file_new_for_path (data->path);
   load_data->parser = g_object_ref (self->parser);
 
-  future = dex_scheduler_spawn (
-      bz_get_io_scheduler (),
-      bz_get_dex_stack_size (),
+  future = bz_spawn (
+      BZ_SCHEDULER_PRIORITY_INTERACTIVE,
       (DexFiberFunc) input_load_fiber,
       input_load_data_ref (load_data),
       input_load_data_unref);
@@ -632,3 +670,288 @@ commence_reload (InputTrackingData *data)
 done:
   return G_SOURCE_REMOVE;
 }
+
+static void
+merge_object (GObject *object,
+              GObject *incoming)
+{
+  g_autofree GParamSpec **specs   = NULL;
+  guint                   n_specs = 0;
+
+  /* Parser output only consists of plain property bags, so copying over
+     whatever differs is enough to make both objects equivalent */
+  specs = g_object_class_list_properties (G_OBJECT_GET_CLASS (object), &n_specs);
+  for (guint i = 0; i < n_specs; i++)
+    {
+      GParamSpec *spec               = specs[i];
+      g_auto (GValue) value          = G_VALUE_INIT;
+      g_auto (GValue) incoming_value = G_VALUE_INIT;
+
+      if ((spec->flags & G_PARAM_READWRITE) != G_PARAM_READWRITE ||
+          (spec->flags & G_PARAM_CONSTRUCT_ONLY) != 0)
+        continue;
+
+      g_value_init (&value, spec->value_type);
+      g_value_init (&incoming_value, spec->value_type);
+      g_object_get_property (object, spec->name, &value);
+      g_object_get_property (incoming, spec->name, &incoming_value);
+
+      if (g_type_is_a (spec->value_type, G_TYPE_OBJECT))
+        {
+          GObject *child          = g_value_get_object (&value);
+          GObject *incoming_child = g_value_get_object (&incoming_value);
+
+          if (child == incoming_child)
+            continue;
+
+          if (child != NULL && incoming_child != NULL)
+            {
+              if (G_IS_LIST_STORE (child) &&
+                  G_IS_LIST_MODEL (incoming_child) &&
+                  g_list_model_get_item_type (G_LIST_MODEL (child)) ==
+                      g_list_model_get_item_type (G_LIST_MODEL (incoming_child)))
+                {
+                  merge_store (G_LIST_STORE (child), G_LIST_MODEL (incoming_child));
+                  continue;
+                }
+              if (GTK_IS_STRING_LIST (child) &&
+                  GTK_IS_STRING_LIST (incoming_child))
+                {
+                  merge_string_list (GTK_STRING_LIST (child), GTK_STRING_LIST (incoming_child));
+                  continue;
+                }
+              if (G_OBJECT_TYPE (child) == G_OBJECT_TYPE (incoming_child) &&
+                  !G_IS_LIST_MODEL (child))
+                {
+                  merge_object (child, incoming_child);
+                  continue;
+                }
+            }
+
+          g_object_set_property (object, spec->name, &incoming_value);
+        }
+      else if (g_param_values_cmp (spec, &value, &incoming_value) != 0)
+        g_object_set_property (object, spec->name, &incoming_value);
+    }
+}
+
+static void
+merge_store (GListStore *store,
+             GListModel *incoming)
+{
+  guint n_old                       = 0;
+  guint n_new                       = 0;
+  guint prefix                      = 0;
+  guint suffix                      = 0;
+  guint n_old_middle                = 0;
+  guint n_new_middle                = 0;
+  g_autoptr (GPtrArray) old_prints  = NULL;
+  g_autoptr (GPtrArray) new_prints  = NULL;
+  g_autoptr (GPtrArray) replacement = NULL;
+  g_autoptr (GHashTable) unused     = NULL;
+
+  n_old      = g_list_model_get_n_items (G_LIST_MODEL (store));
+  n_new      = g_list_model_get_n_items (incoming);
+  old_prints = g_ptr_array_new_with_free_func (g_free);
+  new_prints = g_ptr_array_new_with_free_func (g_free);
+
+  for (guint i = 0; i < n_old; i++)
+    {
+      g_autoptr (GObject) item = NULL;
+
+      item = g_list_model_get_item (G_LIST_MODEL (store), i);
+      g_ptr_array_add (old_prints, dup_fingerprint (item));
+    }
+  for (guint i = 0; i < n_new; i++)
+    {
+      g_autoptr (GObject) item = NULL;
+
+      item = g_list_model_get_item (incoming, i);
+      g_ptr_array_add (new_prints, dup_fingerprint (item));
+    }
+
+  /* Identical items at either end are left alone entirely */
+  while (prefix < n_old && prefix < n_new &&
+         g_str_equal (g_ptr_array_index (old_prints, prefix),
+                      g_ptr_array_index (new_prints, prefix)))
+    prefix++;
+  while (suffix < n_old - prefix && suffix < n_new - prefix &&
+         g_str_equal (g_ptr_array_index (old_prints, n_old - suffix - 1),
+                      g_ptr_array_index (new_prints, n_new - suffix - 1)))
+    suffix++;
+
+  n_old_middle = n_old - prefix - suffix;
+  n_new_middle = n_new - prefix - suffix;
+  if (n_old_middle == 0 && n_new_middle == 0)
+    return;
+
+  if (n_old_middle == n_new_middle)
+    {
+      /* Most likely the same items with a few edits, so update them in
+         place and only descend into what actually changed */
+      for (guint i = prefix; i < prefix + n_old_middle; i++)
+        {
+          g_autoptr (GObject) item          = NULL;
+          g_autoptr (GObject) incoming_item = NULL;
+
+          item          = g_list_model_get_item (G_LIST_MODEL (store), i);
+          incoming_item = g_list_model_get_item (incoming, i);
+
+          if (G_OBJECT_TYPE (item) == G_OBJECT_TYPE (incoming_item))
+            merge_object (item, incoming_item);
+          else
+            g_list_store_splice (store, i, 1, (gpointer *) &incoming_item, 1);
+        }
+      return;
+    }
+
+  /* Items were added or removed, so reuse whatever we can find an exact
+     match for and take the rest from the new tree */
+  unused = g_hash_table_new_full (g_str_hash, g_str_equal, NULL, (GDestroyNotify) g_ptr_array_unref);
+  for (guint i = prefix; i < prefix + n_old_middle; i++)
+    {
+      const char *print = g_ptr_array_index (old_prints, i);
+      GPtrArray  *items = NULL;
+
+      items = g_hash_table_lookup (unused, print);
+      if (items == NULL)
+        {
+          items = g_ptr_array_new_with_free_func (g_object_unref);
+          g_hash_table_replace (unused, (gpointer) print, items);
+        }
+      g_ptr_array_add (items, g_list_model_get_item (G_LIST_MODEL (store), i));
+    }
+
+  replacement = g_ptr_array_new_with_free_func (g_object_unref);
+  for (guint i = prefix; i < prefix + n_new_middle; i++)
+    {
+      const char *print = g_ptr_array_index (new_prints, i);
+      GPtrArray  *items = NULL;
+
+      items = g_hash_table_lookup (unused, print);
+      if (items != NULL && items->len > 0)
+        g_ptr_array_add (replacement, g_ptr_array_steal_index (items, 0));
+      else
+        g_ptr_array_add (replacement, g_list_model_get_item (incoming, i));
+    }
+
+  g_list_store_splice (store, prefix, n_old_middle,
+                       replacement->pdata, replacement->len);
+}
+
+static void
+merge_string_list (GtkStringList *list,
+                   GtkStringList *incoming)
+{
+  guint n_old                      = 0;
+  guint n_new                      = 0;
+  guint prefix                     = 0;
+  guint suffix                     = 0;
+  g_autoptr (GStrvBuilder) builder = NULL;
+  g_auto (GStrv) additions         = NULL;
+
+  n_old = g_list_model_get_n_items (G_LIST_MODEL (list));
+  n_new = g_list_model_get_n_items (G_LIST_MODEL (incoming));
+
+  while (prefix < n_old && prefix < n_new &&
+         g_strcmp0 (gtk_string_list_get_string (list, prefix),
+                    gtk_string_list_get_string (incoming, prefix)) == 0)
+    prefix++;
+  while (suffix < n_old - prefix && suffix < n_new - prefix &&
+         g_strcmp0 (gtk_string_list_get_string (list, n_old - suffix - 1),
+                    gtk_string_list_get_string (incoming, n_new - suffix - 1)) == 0)
+    suffix++;
+
+  if (prefix + suffix == n_old && n_old == n_new)
+    return;
+
+  builder = g_strv_builder_new ();
+  for (guint i = prefix; i < n_new - suffix; i++)
+    g_strv_builder_add (builder, gtk_string_list_get_string (incoming, i));
+  additions = g_strv_builder_end (builder);
+
+  gtk_string_list_splice (list, prefix, n_old - prefix - suffix,
+                          (const char *const *) additions);
+}
+
+static char *
+dup_fingerprint (GObject *object)
+{
+  g_autoptr (GString) string = NULL;
+
+  string = g_string_new (NULL);
+  append_fingerprint (string, object);
+
+  return g_string_free (g_steal_pointer (&string), FALSE);
+}
+
+static void
+append_fingerprint (GString *string,
+                    GObject *object)
+{
+  g_autofree GParamSpec **specs   = NULL;
+  guint                   n_specs = 0;
+
+  if (object == NULL)
+    {
+      g_string_append (string, "NULL");
+      return;
+    }
+
+  g_string_append (string, G_OBJECT_TYPE_NAME (object));
+  g_string_append_c (string, '{');
+
+  if (GTK_IS_STRING_OBJECT (object))
+    {
+      g_autofree char *escaped = NULL;
+
+      escaped = g_strescape (gtk_string_object_get_string (GTK_STRING_OBJECT (object)), NULL);
+      g_string_append_printf (string, "\"%s\"}", escaped);
+      return;
+    }
+
+  if (G_IS_LIST_MODEL (object))
+    {
+      guint n_items = 0;
+
+      n_items = g_list_model_get_n_items (G_LIST_MODEL (object));
+      for (guint i = 0; i < n_items; i++)
+        {
+          g_autoptr (GObject) item = NULL;
+
+          item = g_list_model_get_item (G_LIST_MODEL (object), i);
+          append_fingerprint (string, item);
+          g_string_append_c (string, ',');
+        }
+      g_string_append_c (string, '}');
+      return;
+    }
+
+  specs = g_object_class_list_properties (G_OBJECT_GET_CLASS (object), &n_specs);
+  for (guint i = 0; i < n_specs; i++)
+    {
+      GParamSpec *spec      = specs[i];
+      g_auto (GValue) value = G_VALUE_INIT;
+
+      if ((spec->flags & G_PARAM_READABLE) == 0)
+        continue;
+
+      g_value_init (&value, spec->value_type);
+      g_object_get_property (object, spec->name, &value);
+
+      g_string_append_printf (string, "%s=", spec->name);
+      if (g_type_is_a (spec->value_type, G_TYPE_OBJECT))
+        append_fingerprint (string, g_value_get_object (&value));
+      else
+        {
+          g_autofree char *contents = NULL;
+
+          contents = g_strdup_value_contents (&value);
+          g_string_append (string, contents);
+        }
+      g_string_append_c (string, ';');
+    }
+
+  g_string_append_c (string, '}');
+}
+
@@ -20,6 +20,7 @@
 
 #include "bz-curated-app-tile.h"
 #include "bz-app-tile.h"
+#include "bz-prefetch.h"
 
 struct _BzCuratedAppTile
 {
@@ -144,6 +145,7 @@ static void
 bz_curated_app_tile_init (BzCuratedAppTile *self)
 {
   gtk_widget_init_template (GTK_WIDGET (self));
+  bz_prefetch_attach (GTK_WIDGET (self));
 }
 
 BzCuratedAppTile *
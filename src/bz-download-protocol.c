@@ -0,0 +1,315 @@
+/* bz-download-protocol.c
+ *
+ * Copyright 2025 Adam Masciola
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "config.h"
+
+#include <gio/gio.h>
+#include <string.h>
+
+#include "bz-download-protocol.h"
+
+typedef struct
+{
+  const guint8 *data;
+  gsize         size;
+  gsize         offset;
+} Reader;
+
+static void
+append_u8 (GByteArray *array,
+           guint8      value);
+
+static void
+append_u32 (GByteArray *array,
+            guint32     value);
+
+static void
+append_u64 (GByteArray *array,
+            guint64     value);
+
+static void
+append_string (GByteArray *array,
+               const char *string);
+
+static gboolean
+read_u8 (Reader *reader,
+         guint8 *out);
+
+static gboolean
+read_u32 (Reader  *reader,
+          guint32 *out);
+
+static gboolean
+read_u64 (Reader  *reader,
+          guint64 *out);
+
+static gboolean
+read_string (Reader *reader,
+             char  **out);
+
+void
+bz_download_frame_clear (BzDownloadFrame *frame)
+{
+  g_clear_pointer (&frame->src, g_free);
+  g_clear_pointer (&frame->dest, g_free);
+  g_clear_pointer (&frame->message, g_free);
+}
+
+GBytes *
+bz_download_frame_serialize (const BzDownloadFrame *frame,
+                             GError               **error)
+{
+  g_autoptr (GByteArray) array = NULL;
+  guint32 length               = 0;
+
+  g_return_val_if_fail (frame != NULL, NULL);
+
+  array = g_byte_array_new ();
+
+  /* length is filled in at the end */
+  append_u32 (array, 0);
+  append_u8 (array, frame->type);
+  append_u32 (array, frame->id);
+
+  switch (frame->type)
+    {
+    case BZ_DOWNLOAD_FRAME_REQUEST:
+      append_u8 (array, frame->priority);
+      append_string (array, frame->src);
+      append_string (array, frame->dest);
+      break;
+    case BZ_DOWNLOAD_FRAME_CANCEL:
+      break;
+    case BZ_DOWNLOAD_FRAME_PROGRESS:
+      append_u64 (array, frame->bytes_done);
+      append_u64 (array, frame->bytes_total);
+      break;
+    case BZ_DOWNLOAD_FRAME_REPLY:
+      append_u8 (array, frame->success ? 1 : 0);
+      append_u32 (array, frame->error_code);
+      append_u32 (array, frame->http_status);
+      append_string (array, frame->message);
+      append_u64 (array, frame->bytes_received);
+      append_u64 (array, frame->queue_usec);
+      append_u32 (array, frame->tls_handshakes);
+      append_u8 (array, frame->http_version);
+      break;
+    default:
+      g_critical ("Invalid download frame type %d", frame->type);
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT,
+                   "Invalid download frame type %d", frame->type);
+      return NULL;
+    }
+
+  if (array->len - BZ_DOWNLOAD_FRAME_HEADER_SIZE > BZ_DOWNLOAD_FRAME_MAX_SIZE)
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_MESSAGE_TOO_LARGE,
+                   "Download frame of type %u would be %u bytes, the limit is %u",
+                   frame->type, array->len - BZ_DOWNLOAD_FRAME_HEADER_SIZE,
+                   BZ_DOWNLOAD_FRAME_MAX_SIZE);
+      return NULL;
+    }
+
+  length = GUINT32_TO_LE (array->len - BZ_DOWNLOAD_FRAME_HEADER_SIZE);
+  memcpy (array->data, &length, sizeof (length));
+
+  return g_byte_array_free_to_bytes (g_steal_pointer (&array));
+}
+
+gsize
+bz_download_frame_parse_header (const guint8 *header,
+                                 GError      **error)
+{
+  guint32 length = 0;
+
+  memcpy (&length, header, sizeof (length));
+  length = GUINT32_FROM_LE (length);
+
+  if (length == 0 || length > BZ_DOWNLOAD_FRAME_MAX_SIZE)
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                   "Download frame has invalid length %u", length);
+      return 0;
+    }
+
+  return length;
+}
+
+gboolean
+bz_download_frame_deserialize (BzDownloadFrame *frame,
+                               const guint8    *payload,
+                               gsize            size,
+                               GError         **error)
+{
+  Reader   reader  = { 0 };
+  guint8   type    = 0;
+  guint8   success = 0;
+  gboolean result  = FALSE;
+
+  g_return_val_if_fail (frame != NULL, FALSE);
+  g_return_val_if_fail (payload != NULL || size == 0, FALSE);
+
+  memset (frame, 0, sizeof (*frame));
+  reader.data = payload;
+  reader.size = size;
+
+  result = read_u8 (&reader, &type) &&
+           read_u32 (&reader, &frame->id);
+  if (result)
+    {
+      frame->type = type;
+      switch (frame->type)
+        {
+        case BZ_DOWNLOAD_FRAME_REQUEST:
+          result = read_u8 (&reader, &frame->priority) &&
+                   read_string (&reader, &frame->src) &&
+                   read_string (&reader, &frame->dest);
+          break;
+        case BZ_DOWNLOAD_FRAME_CANCEL:
+          break;
+        case BZ_DOWNLOAD_FRAME_PROGRESS:
+          result = read_u64 (&reader, &frame->bytes_done) &&
+                   read_u64 (&reader, &frame->bytes_total);
+          break;
+        case BZ_DOWNLOAD_FRAME_REPLY:
+          result = read_u8 (&reader, &success) &&
+                   read_u32 (&reader, &frame->error_code) &&
+                   read_u32 (&reader, &frame->http_status) &&
+                   read_string (&reader, &frame->message) &&
+                   read_u64 (&reader, &frame->bytes_received) &&
+                   read_u64 (&reader, &frame->queue_usec) &&
+                   read_u32 (&reader, &frame->tls_handshakes) &&
+                   read_u8 (&reader, &frame->http_version);
+          frame->success = success != 0;
+          break;
+        default:
+          result = FALSE;
+          break;
+        }
+    }
+
+  /* Trailing garbage is just as wrong as a truncated frame */
+  if (!result || reader.offset != reader.size)
+    {
+      bz_download_frame_clear (frame);
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                   "Malformed download frame of type %u", type);
+      return FALSE;
+    }
+
+  return TRUE;
+}
+
+static void
+append_u8 (GByteArray *array,
+           guint8      value)
+{
+  g_byte_array_append (array, &value, sizeof (value));
+}
+
+static void
+append_u32 (GByteArray *array,
+            guint32     value)
+{
+  value = GUINT32_TO_LE (value);
+  g_byte_array_append (array, (const guint8 *) &value, sizeof (value));
+}
+
+static void
+append_u64 (GByteArray *array,
+            guint64     value)
+{
+  value = GUINT64_TO_LE (value);
+  g_byte_array_append (array, (const guint8 *) &value, sizeof (value));
+}
+
+static void
+append_string (GByteArray *array,
+               const char *string)
+{
+  gsize length = 0;
+
+  if (string != NULL)
+    length = strlen (string);
+
+  append_u32 (array, length);
+  if (length > 0)
+    g_byte_array_append (array, (const guint8 *) string, length);
+}
+
+static gboolean
+read_u8 (Reader *reader,
+         guint8 *out)
+{
+  if (reader->size - reader->offset < sizeof (*out))
+    return FALSE;
+
+  *out = reader->data[reader->offset];
+  reader->offset += sizeof (*out);
+  return TRUE;
+}
+
+static gboolean
+read_u32 (Reader  *reader,
+          guint32 *out)
+{
+  guint32 value = 0;
+
+  if (reader->size - reader->offset < sizeof (value))
+    return FALSE;
+
+  memcpy (&value, reader->data + reader->offset, sizeof (value));
+  reader->offset += sizeof (value);
+  *out = GUINT32_FROM_LE (value);
+  return TRUE;
+}
+
+static gboolean
+read_u64 (Reader  *reader,
+          guint64 *out)
+{
+  guint64 value = 0;
+
+  if (reader->size - reader->offset < sizeof (value))
+    return FALSE;
+
+  memcpy (&value, reader->data + reader->offset, sizeof (value));
+  reader->offset += sizeof (value);
+  *out = GUINT64_FROM_LE (value);
+  return TRUE;
+}
+
+static gboolean
+read_string (Reader *reader,
+             char  **out)
+{
+  guint32 length = 0;
+
+  if (!read_u32 (reader, &length) ||
+      reader->size - reader->offset < length ||
+      memchr (reader->data + reader->offset, '\0', length) != NULL)
+    return FALSE;
+
+  *out = g_strndup ((const char *) reader->data + reader->offset, length);
+  reader->offset += length;
+  return TRUE;
+}
+
+/* End of bz-download-protocol.c */
@@ -0,0 +1,101 @@
+/* bz-download-protocol.h
+ *
+ * Copyright 2025 Adam Masciola
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* Frames exchanged between BzDownloadWorker and the dl-worker
+   subprocess. Each frame is a little endian guint32 payload length
+   followed by the payload, which starts with a guint8 frame type and a
+   guint32 request id. Strings are a guint32 length followed by that
+   many bytes, without a terminator. */
+
+#define BZ_DOWNLOAD_FRAME_HEADER_SIZE 4
+#define BZ_DOWNLOAD_FRAME_MAX_SIZE    (64 * 1024)
+
+/* How many downloads a subprocess runs at once. The rest wait for a slot,
+   and BzDownloadWorker only spawns another subprocess once every
+   existing one has this many requests assigned. */
+#define BZ_DOWNLOAD_MAX_CONCURRENT 6
+
+typedef enum
+{
+  /* parent -> worker */
+  BZ_DOWNLOAD_FRAME_REQUEST = 1,
+  BZ_DOWNLOAD_FRAME_CANCEL,
+
+  /* worker -> parent */
+  BZ_DOWNLOAD_FRAME_PROGRESS,
+  BZ_DOWNLOAD_FRAME_REPLY,
+} BzDownloadFrameType;
+
+typedef struct
+{
+  BzDownloadFrameType type;
+  guint32             id;
+
+  /* BZ_DOWNLOAD_FRAME_REQUEST */
+  guint8 priority;
+  char  *src;
+  char  *dest;
+
+  /* BZ_DOWNLOAD_FRAME_PROGRESS */
+  guint64 bytes_done;
+  guint64 bytes_total;
+
+  /* BZ_DOWNLOAD_FRAME_REPLY */
+  gboolean success;
+  guint32  error_code;
+  guint32  http_status;
+  char    *message;
+  /* accounting, see bz_download_worker_get_stats () */
+  guint64 bytes_received;
+  guint64 queue_usec;
+  guint32 tls_handshakes;
+  guint8  http_version; /* SoupHTTPVersion the transfer went over */
+} BzDownloadFrame;
+
+void
+bz_download_frame_clear (BzDownloadFrame *frame);
+
+/* Fails with G_IO_ERROR_MESSAGE_TOO_LARGE rather than produce a frame
+   the other end would refuse */
+GBytes *
+bz_download_frame_serialize (const BzDownloadFrame *frame,
+                             GError               **error);
+
+gsize
+bz_download_frame_parse_header (const guint8 *header,
+                                 GError      **error);
+
+gboolean
+bz_download_frame_deserialize (BzDownloadFrame *frame,
+                               const guint8    *payload,
+                               gsize            size,
+                               GError         **error);
+
+G_DEFINE_AUTO_CLEANUP_CLEAR_FUNC (BzDownloadFrame, bz_download_frame_clear)
+
+G_END_DECLS
+
+/* End of bz-download-protocol.h */
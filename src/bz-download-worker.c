@@ -20,8 +20,19 @@
 
 #include "config.h"
 
+/* Subprocesses without any work for this long are retired, down to a
+   single one */
+#define IDLE_TIMEOUT_SECONDS 30
+
+#include <errno.h>
+#include <glib/gstdio.h>
+#include <libsoup/soup.h>
+#include <unistd.h>
+
+#include "bz-download-protocol.h"
 #include "bz-download-worker.h"
 #include "bz-env.h"
+#include "bz-io.h"
 #include "bz-util.h"
 
 struct _BzDownloadWorker
@@ -31,10 +42,17 @@ struct _BzDownloadWorker
   char *name;
 
   GSubprocess *subprocess;
-  GHashTable  *waiting;
-  GMutex       read_mutex;
+  /* request id -> InvokeWorkerData */
+  GHashTable *waiting;
+  /* dest path -> request id */
+  GHashTable *dests;
+  GMutex      read_mutex;
   DexFuture   *task;
 
+  /* guarded by pool_mutex */
+  guint  n_assigned;
+  gint64 idle_since;
+
   BzGuard *write_gate;
   GMutex   write_mutex;
 };
@@ -69,27 +87,113 @@ BZ_DEFINE_DATA (
       DexPromise *promise;
       GFile      *src;
       GFile      *dest;
+      char       *dest_path;
+      char       *key;
+      guint32     id;
+      guint8      priority;
+      gboolean    settled;
     },
     BZ_RELEASE_DATA (self, bz_weak_release);
     BZ_RELEASE_DATA (promise, dex_unref);
     BZ_RELEASE_DATA (src, g_object_unref);
-    BZ_RELEASE_DATA (dest, g_object_unref));
+    BZ_RELEASE_DATA (dest, g_object_unref);
+    BZ_RELEASE_DATA (dest_path, g_free);
+    BZ_RELEASE_DATA (key, g_free));
 static DexFuture *
 invoke_worker_fiber (InvokeWorkerData *data);
 
+BZ_DEFINE_DATA (
+    cancel_worker,
+    CancelWorker,
+    {
+      GWeakRef *self;
+      char     *key;
+      guint32   id;
+    },
+    BZ_RELEASE_DATA (self, bz_weak_release);
+    BZ_RELEASE_DATA (key, g_free));
+static DexFuture *
+cancel_worker_fiber (CancelWorkerData *data);
+
+static void
+promise_cancelled (GCancellable     *cancellable,
+                   CancelWorkerData *data);
+
+BZ_DEFINE_DATA (
+    share,
+    Share,
+    {
+      GWeakRef *self;
+      GFile    *src;
+      GFile    *from;
+      GFile    *dest;
+      int       priority;
+    },
+    BZ_RELEASE_DATA (self, bz_weak_release);
+    BZ_RELEASE_DATA (src, g_object_unref);
+    BZ_RELEASE_DATA (from, g_object_unref);
+    BZ_RELEASE_DATA (dest, g_object_unref));
+static DexFuture *
+share_finally (DexFuture *future,
+               ShareData *data);
+
+static DexFuture *
+share_fiber (ShareData *data);
+
+/* src uri -> InvokeWorkerData, shared between all workers so a url
+   requested several times at once only goes out once, whatever the
+   destinations are. Entries don't own the request, they are removed as soon as it
+   settles or every caller has dropped the future, so the table never
+   keeps a download alive. */
+static GMutex      in_flight_mutex = { 0 };
+static GHashTable *in_flight       = NULL;
+
+static guint next_id = 0;
+
+/* The pool behind bz_download_worker_get_default () */
+static GMutex     pool_mutex       = { 0 };
+static GPtrArray *pool             = NULL;
+static guint      pool_reap_source = 0;
+
+/* Totals over every reply, guarded by stats_mutex */
+static GMutex  stats_mutex          = { 0 };
+static guint64 stats_replies        = 0;
+static guint64 stats_http2_replies  = 0;
+static guint64 stats_tls_handshakes = 0;
+static guint64 stats_bytes          = 0;
+static guint64 stats_queue_usec     = 0;
+
+static BzDownloadWorker *
+spawn_pool_worker (void);
+
+static gboolean
+reap_idle_workers (gpointer user_data);
+
 static void
 terminate (BzDownloadWorker *self);
 
 static void
-plumb_data_input_stream_read_line_async (GDataInputStream   *stream,
-                                         GCancellable       *cancellable,
-                                         GAsyncReadyCallback callback,
-                                         gpointer            user_data);
+settle_request (BzDownloadWorker *self,
+                InvokeWorkerData *data);
 
-static char *
-plumb_data_input_stream_read_line_finish (GDataInputStream *stream,
-                                          GAsyncResult     *result,
-                                          gpointer          user_data);
+static void
+forget_in_flight (const char *key,
+                  guint32     id);
+
+static void
+finish_request (BzDownloadWorker *self,
+                BzDownloadFrame  *frame);
+
+static gboolean
+write_frame (GWeakRef              *wr,
+             const BzDownloadFrame *frame,
+             GError               **error);
+
+static gboolean
+read_exact (GInputStream *stream,
+            guint8       *buffer,
+            gsize         count,
+            GError      **error);
 
 static void
 bz_download_worker_dispose (GObject *object)
@@ -106,6 +210,7 @@ bz_download_worker_dispose (GObject *object)
 
   g_mutex_clear (&self->read_mutex);
   g_clear_pointer (&self->waiting, g_hash_table_unref);
+  g_clear_pointer (&self->dests, g_hash_table_unref);
   g_clear_pointer (&self->name, g_free);
 
   G_OBJECT_CLASS (bz_download_worker_parent_class)->dispose (object);
@@ -172,7 +277,9 @@ bz_download_worker_init (BzDownloadWorker *self)
   g_mutex_init (&self->write_mutex);
 
   self->waiting = g_hash_table_new_full (
-      g_str_hash, g_str_equal, g_free, dex_unref);
+      NULL, NULL, NULL, invoke_worker_data_unref);
+  self->dests = g_hash_table_new_full (
+      g_str_hash, g_str_equal, g_free, NULL);
 }
 
 static gboolean
@@ -180,13 +287,18 @@ bz_download_worker_initable_init (GInitable    *initable,
                                   GCancellable *cancellable,
                                   GError      **error)
 {
-  BzDownloadWorker *self = BZ_DOWNLOAD_WORKER (initable);
+  BzDownloadWorker *self  = BZ_DOWNLOAD_WORKER (initable);
+  g_autofree char  *store = NULL;
+  g_autofree char  *arg   = NULL;
+
+  store = bz_dup_cache_dir ("download-store");
+  arg   = g_strdup_printf ("--store-dir=%s", store);
 
   self->subprocess = g_subprocess_new (
       G_SUBPROCESS_FLAGS_STDIN_PIPE |
           G_SUBPROCESS_FLAGS_STDOUT_PIPE,
       error,
-      DL_WORKER_BIN_NAME, NULL);
+      DL_WORKER_BIN_NAME, arg, NULL);
   if (self->subprocess == NULL)
     return FALSE;
 
@@ -241,20 +353,87 @@ bz_download_worker_invoke (BzDownloadWorker *self,
                            GFile            *src,
                            GFile            *dest)
 {
-  g_autoptr (DexPromise) promise    = NULL;
-  g_autoptr (InvokeWorkerData) data = NULL;
+  return bz_download_worker_invoke_with_priority (self, src, dest, 0);
+}
+
+DexFuture *
+bz_download_worker_invoke_with_priority (BzDownloadWorker *self,
+                                         GFile            *src,
+                                         GFile            *dest,
+                                         int               priority)
+{
+  g_autoptr (InvokeWorkerData) data  = NULL;
+  g_autoptr (CancelWorkerData) cdata = NULL;
+  g_autoptr (ShareData) sdata        = NULL;
+  g_autoptr (GMutexLocker) locker    = NULL;
+  g_autofree char *src_uri           = NULL;
+  g_autofree char *dest_path         = NULL;
+  g_autofree char *key               = NULL;
+  InvokeWorkerData *existing         = NULL;
 
   dex_return_error_if_fail (BZ_IS_DOWNLOAD_WORKER (self));
   dex_return_error_if_fail (G_IS_FILE (src));
   dex_return_error_if_fail (G_IS_FILE (dest));
 
-  promise = dex_promise_new ();
+  src_uri   = g_file_get_uri (src);
+  dest_path = g_file_get_path (dest);
+  key       = g_strdup (src_uri);
+
+  locker = g_mutex_locker_new (&in_flight_mutex);
+  if (in_flight == NULL)
+    in_flight = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
+  /* A request whose callers all went away is on its way out, so don't
+     hand its promise to a new caller */
+  existing = g_hash_table_lookup (in_flight, key);
+  if (existing != NULL &&
+      !g_cancellable_is_cancelled (dex_promise_get_cancellable (existing->promise)))
+    {
+      if (g_strcmp0 (existing->dest_path, dest_path) == 0)
+        return dex_ref (existing->promise);
+
+      /* Another destination is already getting this url, so just
+         link or copy from there once it is done */
+      sdata           = share_data_new ();
+      sdata->self     = bz_track_weak (self);
+      sdata->src      = g_object_ref (src);
+      sdata->from     = g_object_ref (existing->dest);
+      sdata->dest     = g_object_ref (dest);
+      sdata->priority = priority;
+      return dex_future_finally (
+          dex_ref (existing->promise),
+          (DexFutureCallback) share_finally,
+          share_data_ref (sdata), share_data_unref);
+    }
 
-  data          = invoke_worker_data_new ();
-  data->self    = bz_track_weak (self);
-  data->promise = dex_ref (promise);
-  data->src     = g_object_ref (src);
-  data->dest    = g_object_ref (dest);
+  data            = invoke_worker_data_new ();
+  data->self      = bz_track_weak (self);
+  data->promise   = dex_promise_new_cancellable ();
+  data->src       = g_object_ref (src);
+  data->dest      = g_object_ref (dest);
+  data->dest_path = g_steal_pointer (&dest_path);
+  data->key       = g_strdup (key);
+  data->id        = g_atomic_int_add (&next_id, 1) + 1;
+  data->priority  = CLAMP (priority, 0, G_MAXUINT8);
+
+  g_hash_table_replace (in_flight, g_steal_pointer (&key), data);
+  g_clear_pointer (&locker, g_mutex_locker_free);
+
+  locker = g_mutex_locker_new (&pool_mutex);
+  self->n_assigned++;
+  g_clear_pointer (&locker, g_mutex_locker_free);
+
+  /* The promise is the future callers hold and nothing else chains on
+     it, so it is discarded once the last of them lets go. Tell the
+     subprocess then so it doesn't hold a download slot for nothing. */
+  cdata       = cancel_worker_data_new ();
+  cdata->self = bz_track_weak (self);
+  cdata->key  = g_strdup (data->key);
+  cdata->id   = data->id;
+  g_cancellable_connect (
+      dex_promise_get_cancellable (data->promise),
+      G_CALLBACK (promise_cancelled),
+      g_steal_pointer (&cdata), cancel_worker_data_unref);
 
   dex_future_disown (dex_scheduler_spawn (
       dex_scheduler_get_default (),
@@ -262,96 +441,110 @@ bz_download_worker_invoke (BzDownloadWorker *self,
       (DexFiberFunc) invoke_worker_fiber,
       invoke_worker_data_ref (data),
       invoke_worker_data_unref));
-  return DEX_FUTURE (g_steal_pointer (&promise));
+  return dex_ref (data->promise);
 }
 
 BzDownloadWorker *
 bz_download_worker_get_default (void)
 {
-  static GMutex     mutex         = { 0 };
-  static GPtrArray *workers       = NULL;
-  static guint      next          = 0;
   g_autoptr (GMutexLocker) locker = NULL;
   BzDownloadWorker *ret           = NULL;
 
-  locker = g_mutex_locker_new (&mutex);
-
-  if (workers == NULL)
-    {
-      workers = g_ptr_array_new_with_free_func (g_object_unref);
+  locker = g_mutex_locker_new (&pool_mutex);
 
-      /* TODO: make number of workers controllable with envvar */
-#define N_WORKERS 8
+  if (pool == NULL)
+    pool = g_ptr_array_new_with_free_func (g_object_unref);
 
-      for (guint i = 0; i < N_WORKERS; i++)
-        {
-          g_autoptr (GError) local_error      = NULL;
-          g_autoptr (BzDownloadWorker) worker = NULL;
-
-          worker = bz_download_worker_new ("default", &local_error);
-          if (worker == NULL)
-            g_warning ("FATAL!!! The default download worker could not be spawned: %s",
-                       local_error->message);
-          g_assert (worker != NULL);
+  /* Drop any subprocesses which exited on their own */
+  for (guint i = pool->len; i > 0; i--)
+    {
+      BzDownloadWorker *worker = g_ptr_array_index (pool, i - 1);
 
-          g_ptr_array_add (workers, g_steal_pointer (&worker));
-        }
+      if (g_subprocess_get_identifier (worker->subprocess) == NULL)
+        g_ptr_array_remove_index_fast (pool, i - 1);
     }
 
-  /* Check if any of the subprocesses need to be recreated */
-  for (guint i = 0; i < workers->len; i++)
+  /* Least loaded first, so that one busy host doesn't hold up requests
+     stuck behind it in a round robin */
+  for (guint i = 0; i < pool->len; i++)
     {
-      BzDownloadWorker **loc = NULL;
-
-      loc = (BzDownloadWorker **) &g_ptr_array_index (workers, i);
-      if (g_subprocess_get_identifier ((*loc)->subprocess) == NULL)
-        {
-          g_autoptr (GError) local_error      = NULL;
-          g_autoptr (BzDownloadWorker) worker = NULL;
+      BzDownloadWorker *worker = g_ptr_array_index (pool, i);
 
-          g_clear_object (loc);
+      if (ret == NULL || worker->n_assigned < ret->n_assigned)
+        ret = worker;
+    }
 
-          worker = bz_download_worker_new ("default", &local_error);
-          if (worker == NULL)
-            g_warning ("FATAL!!! The default download worker could not be spawned: %s",
-                       local_error->message);
-          g_assert (worker != NULL);
+  if (ret == NULL ||
+      (ret->n_assigned >= BZ_DOWNLOAD_MAX_CONCURRENT &&
+       pool->len < bz_get_max_download_workers ()))
+    {
+      BzDownloadWorker *worker = NULL;
 
-          *loc = g_steal_pointer (&worker);
-        }
+      worker = spawn_pool_worker ();
+      if (worker != NULL)
+        ret = worker;
     }
+  /* Spawning the very first subprocess isn't allowed to fail */
+  g_assert (ret != NULL);
 
-  ret  = g_ptr_array_index (workers, next);
-  next = (next + 1) % workers->len;
+  /* Keep the reaper away until the caller has had a chance to use it */
+  ret->idle_since = g_get_monotonic_time ();
+
+  if (pool->len > 1 && pool_reap_source == 0)
+    pool_reap_source = g_timeout_add_seconds (
+        IDLE_TIMEOUT_SECONDS / 2, reap_idle_workers, NULL);
 
   return ret;
 }
 
+void
+bz_download_worker_get_stats (guint   *n_workers,
+                              guint64 *replies,
+                              guint64 *http2_replies,
+                              guint64 *tls_handshakes,
+                              guint64 *bytes,
+                              double  *average_queue_wait)
+{
+  g_mutex_lock (&pool_mutex);
+  if (n_workers != NULL)
+    *n_workers = pool != NULL ? pool->len : 0;
+  g_mutex_unlock (&pool_mutex);
+
+  g_mutex_lock (&stats_mutex);
+  if (replies != NULL)
+    *replies = stats_replies;
+  if (http2_replies != NULL)
+    *http2_replies = stats_http2_replies;
+  if (tls_handshakes != NULL)
+    *tls_handshakes = stats_tls_handshakes;
+  if (bytes != NULL)
+    *bytes = stats_bytes;
+  if (average_queue_wait != NULL)
+    *average_queue_wait = stats_replies > 0
+                              ? (double) stats_queue_usec / (double) stats_replies / 1000.0
+                              : 0.0;
+  g_mutex_unlock (&stats_mutex);
+}
+
 static DexFuture *
 monitor_worker_fiber (GWeakRef *wr)
 {
-  g_autoptr (BzDownloadWorker) self              = NULL;
-  g_autoptr (GInputStream) input_stream          = NULL;
-  g_autoptr (GDataInputStream) subprocess_stdout = NULL;
+  g_autoptr (BzDownloadWorker) self     = NULL;
+  g_autoptr (GInputStream) input_stream = NULL;
 
   bz_weak_get_or_return_reject (self, wr);
-  input_stream      = g_object_ref (g_subprocess_get_stdout_pipe (self->subprocess));
-  subprocess_stdout = g_data_input_stream_new (g_object_ref (input_stream));
+  input_stream = g_object_ref (g_subprocess_get_stdout_pipe (self->subprocess));
   g_clear_object (&self);
 
   for (;;)
     {
-      g_autoptr (GError) local_error = NULL;
-      g_autofree char *line          = NULL;
-
-      line = dex_await_string (
-          dex_async_pair_new (
-              subprocess_stdout,
-              &DEX_ASYNC_PAIR_INFO_STRING (
-                  plumb_data_input_stream_read_line_async,
-                  plumb_data_input_stream_read_line_finish)),
-          &local_error);
-      if (line == NULL)
+      g_autoptr (GError) local_error               = NULL;
+      guint8 header[BZ_DOWNLOAD_FRAME_HEADER_SIZE] = { 0 };
+      gsize  length                                = 0;
+      g_autofree guint8 *payload                   = NULL;
+      g_auto (BzDownloadFrame) frame               = { 0 };
+
+      if (!read_exact (input_stream, header, sizeof (header), &local_error))
         {
           if (local_error != NULL)
             g_warning ("Could not read stdout from download worker subprocess: %s",
@@ -359,59 +552,46 @@ monitor_worker_fiber (GWeakRef *wr)
           goto err;
         }
 
-      do
+      length = bz_download_frame_parse_header (header, &local_error);
+      if (length == 0)
         {
-          g_autoptr (GVariant) variant = NULL;
-          g_autofree char *dest_path   = NULL;
-          gboolean         success     = FALSE;
-          DexPromise      *promise     = NULL;
-
-          if (line == NULL)
-            {
-              line = g_data_input_stream_read_line_utf8 (subprocess_stdout, NULL, NULL, &local_error);
-              if (line == NULL)
-                {
-                  if (local_error != NULL)
-                    g_warning ("Could not read stdout from download worker subprocess: %s",
-                               local_error->message);
-                  goto err;
-                }
-            }
-
-          variant = g_variant_parse (G_VARIANT_TYPE ("(sb)"),
-                                     line, NULL, NULL, &local_error);
-          if (variant == NULL)
-            {
-              g_warning ("Could not interpret stdout from download worker subprocess: %s",
-                         local_error->message);
-              goto err;
-            }
-          g_variant_get (variant, "(sb)", &dest_path, &success);
+          g_warning ("Could not interpret stdout from download worker subprocess: %s",
+                     local_error->message);
+          goto err;
+        }
 
-          bz_weak_get_or_return_reject (self, wr);
-          g_mutex_lock (&self->read_mutex);
+      payload = g_malloc (length);
+      if (!read_exact (input_stream, payload, length, &local_error) ||
+          !bz_download_frame_deserialize (&frame, payload, length, &local_error))
+        {
+          if (local_error != NULL)
+            g_warning ("Could not interpret stdout from download worker subprocess: %s",
+                       local_error->message);
+          goto err;
+        }
 
-          promise = g_hash_table_lookup (self->waiting, dest_path);
-          if (promise != NULL)
-            {
-              if (success)
-                dex_promise_resolve_boolean (promise, TRUE);
-              else
-                dex_promise_reject (
-                    promise,
-                    g_error_new (G_IO_ERROR,
-                                 G_IO_ERROR_UNKNOWN,
-                                 "The subprocess reported an error downloading '%s'", dest_path));
-              promise = NULL;
-              g_hash_table_remove (self->waiting, dest_path);
-            }
+      switch (frame.type)
+        {
+        case BZ_DOWNLOAD_FRAME_PROGRESS:
+          g_debug ("Download request %u: %" G_GUINT64_FORMAT " of %" G_GUINT64_FORMAT " bytes",
+                   frame.id, frame.bytes_done, frame.bytes_total);
+          break;
 
+        case BZ_DOWNLOAD_FRAME_REPLY:
+          bz_weak_get_or_return_reject (self, wr);
+          g_mutex_lock (&self->read_mutex);
+          finish_request (self, &frame);
           g_mutex_unlock (&self->read_mutex);
           g_clear_object (&self);
+          break;
 
-          g_clear_pointer (&line, g_free);
+        case BZ_DOWNLOAD_FRAME_REQUEST:
+        case BZ_DOWNLOAD_FRAME_CANCEL:
+        default:
+          g_warning ("Download worker subprocess sent an unexpected frame of type %d",
+                     frame.type);
+          goto err;
         }
-      while (g_input_stream_has_pending (input_stream));
     }
 
   return dex_future_new_true ();
@@ -430,71 +610,67 @@ err:
 static DexFuture *
 invoke_worker_fiber (InvokeWorkerData *data)
 {
-  DexPromise *promise                    = data->promise;
-  GFile      *src                        = data->src;
-  GFile      *dest                       = data->dest;
-  g_autoptr (BzDownloadWorker) self      = NULL;
-  g_autoptr (GError) local_error         = NULL;
-  g_autoptr (BzGuard) guard              = NULL;
-  g_autofree char *src_uri               = NULL;
-  g_autofree char *dest_path             = NULL;
-  DexPromise      *existing              = NULL;
-  g_autoptr (GVariant) variant           = NULL;
-  g_autoptr (GString) output             = NULL;
-  g_autoptr (GOutputStream) stdin_stream = NULL;
-  gint64 bytes_written                   = -1;
+  DexPromise *promise               = data->promise;
+  g_autoptr (BzDownloadWorker) self = NULL;
+  g_autoptr (GError) local_error    = NULL;
+  g_autofree char *src_uri          = NULL;
+  gpointer         existing_id      = NULL;
+  BzDownloadFrame  frame            = { 0 };
 
-  src_uri   = g_file_get_uri (src);
-  dest_path = g_file_get_path (dest);
+  src_uri = g_file_get_uri (data->src);
 
-  bz_weak_get_or_return_reject (self, data->self);
-  g_mutex_lock (&self->read_mutex);
-  existing = g_hash_table_lookup (self->waiting, dest_path);
-  if (existing != NULL)
+  self = g_weak_ref_get (data->self);
+  if (self == NULL)
     {
+      forget_in_flight (data->key, data->id);
       dex_promise_reject (
-          existing,
+          promise,
           g_error_new (G_IO_ERROR,
                        G_IO_ERROR_CANCELLED,
-                       "The operation was replaced"));
-      existing = NULL;
+                       "The download worker was disposed"));
+      return dex_future_new_true ();
     }
-  g_hash_table_replace (self->waiting, g_strdup (dest_path), dex_ref (promise));
-  g_mutex_unlock (&self->read_mutex);
 
-  variant = g_variant_new ("(ss)", src_uri, dest_path);
-  output  = g_string_new (NULL);
-  output  = g_variant_print_string (variant, g_steal_pointer (&output), TRUE);
-  g_string_append_c (output, '\n');
-
-  stdin_stream = g_object_ref (g_subprocess_get_stdin_pipe (self->subprocess));
+  g_mutex_lock (&self->read_mutex);
+  if (g_hash_table_lookup_extended (self->dests, data->dest_path, NULL, &existing_id))
+    {
+      InvokeWorkerData *existing = NULL;
 
-  BZ_BEGIN_GUARD_WITH_CONTEXT (&guard, &self->write_mutex, &self->write_gate);
+      existing = g_hash_table_lookup (self->waiting, existing_id);
+      if (existing != NULL)
+        {
+          dex_promise_reject (
+              existing->promise,
+              g_error_new (G_IO_ERROR,
+                           G_IO_ERROR_CANCELLED,
+                           "The operation was replaced"));
+          settle_request (self, existing);
+        }
+      /* The subprocess will still reply, which is then ignored */
+      g_hash_table_remove (self->waiting, existing_id);
+    }
+  g_hash_table_replace (self->dests, g_strdup (data->dest_path), GUINT_TO_POINTER (data->id));
+  g_hash_table_replace (self->waiting, GUINT_TO_POINTER (data->id), invoke_worker_data_ref (data));
+  g_mutex_unlock (&self->read_mutex);
   g_clear_object (&self);
 
-  bytes_written = dex_await_int64 (
-      dex_future_first (
-          dex_output_stream_write (
-              stdin_stream,
-              output->str,
-              output->len,
-              G_PRIORITY_DEFAULT_IDLE),
-          dex_ref (promise),
-          NULL),
-      &local_error);
-  bz_clear_guard (&guard);
-
-  /* Check if we've been cancelled */
-  if (!dex_future_is_pending (DEX_FUTURE (promise)))
-    return dex_future_new_false ();
+  frame.type     = BZ_DOWNLOAD_FRAME_REQUEST;
+  frame.id       = data->id;
+  frame.priority = data->priority;
+  frame.src      = src_uri;
+  frame.dest     = data->dest_path;
 
-  if (bytes_written < 0)
+  if (!write_frame (data->self, &frame, &local_error))
     {
       bz_weak_get_or_return_reject (self, data->self);
       g_mutex_lock (&self->read_mutex);
 
-      g_hash_table_remove (self->waiting, dest_path);
-      dex_promise_reject (promise, g_steal_pointer (&local_error));
+      if (dex_future_is_pending (DEX_FUTURE (promise)))
+        dex_promise_reject (promise, g_steal_pointer (&local_error));
+      settle_request (self, data);
+      if (GPOINTER_TO_UINT (g_hash_table_lookup (self->dests, data->dest_path)) == data->id)
+        g_hash_table_remove (self->dests, data->dest_path);
+      g_hash_table_remove (self->waiting, GUINT_TO_POINTER (data->id));
 
       g_mutex_unlock (&self->read_mutex);
       g_clear_object (&self);
@@ -503,56 +679,326 @@ invoke_worker_fiber (InvokeWorkerData *data)
   return dex_future_new_true ();
 }
 
+static DexFuture *
+cancel_worker_fiber (CancelWorkerData *data)
+{
+  g_autoptr (GError) local_error = NULL;
+  BzDownloadFrame frame          = { 0 };
+
+  frame.type = BZ_DOWNLOAD_FRAME_CANCEL;
+  frame.id   = data->id;
+
+  if (!write_frame (data->self, &frame, &local_error))
+    return dex_future_new_for_error (g_steal_pointer (&local_error));
+  return dex_future_new_true ();
+}
+
+static void
+promise_cancelled (GCancellable     *cancellable,
+                   CancelWorkerData *data)
+{
+  /* The request itself settles when the subprocess replies */
+  forget_in_flight (data->key, data->id);
+
+  dex_future_disown (dex_scheduler_spawn (
+      dex_scheduler_get_default (),
+      bz_get_dex_stack_size (),
+      (DexFiberFunc) cancel_worker_fiber,
+      cancel_worker_data_ref (data),
+      cancel_worker_data_unref));
+}
+
+static DexFuture *
+share_finally (DexFuture *future,
+               ShareData *data)
+{
+  g_autoptr (BzDownloadWorker) self = NULL;
+  g_autoptr (GError) local_error    = NULL;
+
+  if (dex_future_get_value (future, &local_error) != NULL)
+    return bz_spawn (
+        BZ_SCHEDULER_PRIORITY_INTERACTIVE,
+        (DexFiberFunc) share_fiber,
+        share_data_ref (data), share_data_unref);
+
+  /* The transfer we joined was replaced or lost its subprocess, which
+     says nothing about this request, so send it on its own */
+  if (!g_error_matches (local_error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+    return dex_ref (future);
+
+  bz_weak_get_or_return_reject (self, data->self);
+  return bz_download_worker_invoke_with_priority (
+      self, data->src, data->dest, data->priority);
+}
+
+static DexFuture *
+share_fiber (ShareData *data)
+{
+  g_autoptr (GError) local_error = NULL;
+  g_autofree char *from_path     = NULL;
+  g_autofree char *dest_path     = NULL;
+
+  from_path = g_file_get_path (data->from);
+  dest_path = g_file_get_path (data->dest);
+
+  /* Same as the subprocess does with its blobs */
+  if (g_unlink (dest_path) != 0 && errno != ENOENT)
+    g_warning ("Could not remove %s: %s", dest_path, g_strerror (errno));
+  if (link (from_path, dest_path) == 0)
+    return dex_future_new_true ();
+
+  if (!g_file_copy (data->from, data->dest,
+                    G_FILE_COPY_OVERWRITE,
+                    NULL, NULL, NULL, &local_error))
+    return dex_future_new_for_error (g_steal_pointer (&local_error));
+
+  return dex_future_new_true ();
+}
+
 static void
 terminate (BzDownloadWorker *self)
 {
   GHashTableIter waiting_iter = { 0 };
 
+  g_hash_table_remove_all (self->dests);
+
   g_hash_table_iter_init (&waiting_iter, self->waiting);
   for (;;)
     {
-      g_autofree char *dest_path     = NULL;
-      g_autoptr (DexPromise) promise = NULL;
+      g_autoptr (InvokeWorkerData) data = NULL;
 
       if (!g_hash_table_iter_next (
               &waiting_iter,
-              (gpointer *) &dest_path,
-              (gpointer *) &promise))
+              NULL,
+              (gpointer *) &data))
         break;
       g_hash_table_iter_steal (&waiting_iter);
 
-      dex_promise_reject (
-          promise,
-          g_error_new (G_IO_ERROR,
-                       G_IO_ERROR_CANCELLED,
-                       "The subprocess was terminated"));
+      if (dex_future_is_pending (DEX_FUTURE (data->promise)))
+        dex_promise_reject (
+            data->promise,
+            g_error_new (G_IO_ERROR,
+                         G_IO_ERROR_CANCELLED,
+                         "The subprocess was terminated"));
+      settle_request (self, data);
     }
 }
 
+/* Every request passes through here exactly once before it leaves
+   self->waiting, whether it was answered, replaced, cancelled or the
+   subprocess went away. Called with read_mutex held. */
+static void
+settle_request (BzDownloadWorker *self,
+                InvokeWorkerData *data)
+{
+  g_autoptr (GMutexLocker) locker = NULL;
+
+  if (data->settled)
+    return;
+  data->settled = TRUE;
+
+  forget_in_flight (data->key, data->id);
+
+  locker = g_mutex_locker_new (&pool_mutex);
+  self->n_assigned--;
+  if (self->n_assigned == 0)
+    self->idle_since = g_get_monotonic_time ();
+}
+
+static void
+forget_in_flight (const char *key,
+                  guint32     id)
+{
+  g_autoptr (GMutexLocker) locker = NULL;
+  InvokeWorkerData *existing      = NULL;
+
+  locker   = g_mutex_locker_new (&in_flight_mutex);
+  existing = g_hash_table_lookup (in_flight, key);
+  if (existing != NULL && existing->id == id)
+    g_hash_table_remove (in_flight, key);
+}
+
 static void
-plumb_data_input_stream_read_line_async (GDataInputStream   *stream,
-                                         GCancellable       *cancellable,
-                                         GAsyncReadyCallback callback,
-                                         gpointer            user_data)
+finish_request (BzDownloadWorker *self,
+                BzDownloadFrame  *frame)
+{
+  InvokeWorkerData *data = NULL;
+
+  g_mutex_lock (&stats_mutex);
+  stats_replies++;
+  if (frame->http_version == SOUP_HTTP_2_0)
+    stats_http2_replies++;
+  stats_tls_handshakes += frame->tls_handshakes;
+  stats_bytes += frame->bytes_received;
+  stats_queue_usec += frame->queue_usec;
+  g_mutex_unlock (&stats_mutex);
+
+  data = g_hash_table_lookup (self->waiting, GUINT_TO_POINTER (frame->id));
+  if (data == NULL)
+    /* Replaced or cancelled in the meantime */
+    return;
+
+  if (dex_future_is_pending (DEX_FUTURE (data->promise)))
+    {
+      if (frame->success)
+        dex_promise_resolve_boolean (data->promise, TRUE);
+      else
+        dex_promise_reject (
+            data->promise,
+            g_error_new (G_IO_ERROR,
+                         frame->error_code,
+                         "Could not download to '%s': %s (HTTP %u)",
+                         data->dest_path,
+                         frame->message != NULL ? frame->message : "unknown error",
+                         frame->http_status));
+    }
+
+  settle_request (self, data);
+
+  if (GPOINTER_TO_UINT (g_hash_table_lookup (self->dests, data->dest_path)) == frame->id)
+    g_hash_table_remove (self->dests, data->dest_path);
+  g_hash_table_remove (self->waiting, GUINT_TO_POINTER (frame->id));
+}
+
+static gboolean
+write_frame (GWeakRef              *wr,
+             const BzDownloadFrame *frame,
+             GError               **error)
+{
+  g_autoptr (BzDownloadWorker) self      = NULL;
+  g_autoptr (GOutputStream) stdin_stream = NULL;
+  g_autoptr (BzGuard) guard              = NULL;
+  g_autoptr (GBytes) bytes               = NULL;
+  const char *buffer                     = NULL;
+  gsize       size                       = 0;
+  gsize       offset                     = 0;
+
+  self = g_weak_ref_get (wr);
+  if (self == NULL)
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_CANCELLED,
+                   "The download worker was disposed");
+      return FALSE;
+    }
+
+  bytes = bz_download_frame_serialize (frame, error);
+  if (bytes == NULL)
+    return FALSE;
+
+  buffer       = g_bytes_get_data (bytes, &size);
+  stdin_stream = g_object_ref (g_subprocess_get_stdin_pipe (self->subprocess));
+
+  /* Frames must never interleave, and are never abandoned halfway
+     through since that would desynchronize the stream */
+  BZ_BEGIN_GUARD_WITH_CONTEXT (&guard, &self->write_mutex, &self->write_gate);
+  g_clear_object (&self);
+
+  while (offset < size)
+    {
+      gint64 bytes_written = 0;
+
+      bytes_written = dex_await_int64 (
+          dex_output_stream_write (
+              stdin_stream,
+              buffer + offset,
+              size - offset,
+              G_PRIORITY_DEFAULT_IDLE),
+          error);
+      if (bytes_written < 0)
+        return FALSE;
+
+      offset += bytes_written;
+    }
+
+  return TRUE;
+}
+
+static gboolean
+read_exact (GInputStream *stream,
+            guint8       *buffer,
+            gsize         count,
+            GError      **error)
+{
+  gsize offset = 0;
+
+  while (offset < count)
+    {
+      g_autoptr (GBytes) bytes = NULL;
+      gsize size               = 0;
+
+      bytes = dex_await_boxed (
+          dex_input_stream_read_bytes (
+              stream,
+              count - offset,
+              G_PRIORITY_DEFAULT_IDLE),
+          error);
+      if (bytes == NULL)
+        return FALSE;
+
+      size = g_bytes_get_size (bytes);
+      if (size == 0)
+        {
+          /* A clean EOF between frames leaves error unset */
+          if (offset > 0)
+            g_set_error (error, G_IO_ERROR, G_IO_ERROR_PARTIAL_INPUT,
+                         "Unexpected end of input inside a frame");
+          return FALSE;
+        }
+
+      memcpy (buffer + offset, g_bytes_get_data (bytes, NULL), size);
+      offset += size;
+    }
+
+  return TRUE;
+}
+
+static BzDownloadWorker *
+spawn_pool_worker (void)
 {
-  g_data_input_stream_read_line_async (
-      stream,
-      G_PRIORITY_DEFAULT_IDLE,
-      cancellable,
-      callback,
-      user_data);
+  g_autoptr (GError) local_error      = NULL;
+  g_autoptr (BzDownloadWorker) worker = NULL;
+
+  worker = bz_download_worker_new ("default", &local_error);
+  if (worker == NULL)
+    {
+      if (pool->len == 0)
+        g_critical ("FATAL!!! The default download worker could not be spawned: %s",
+                    local_error->message);
+      else
+        g_warning ("Could not spawn an additional download worker: %s",
+                   local_error->message);
+      return NULL;
+    }
+
+  g_debug ("Spawned download worker, %u now running", pool->len + 1);
+  g_ptr_array_add (pool, g_object_ref (worker));
+  return worker;
 }
 
-static char *
-plumb_data_input_stream_read_line_finish (GDataInputStream *stream,
-                                          GAsyncResult     *result,
-                                          gpointer          user_data)
+static gboolean
+reap_idle_workers (gpointer user_data)
 {
-  return g_data_input_stream_read_line_finish_utf8 (
-      stream,
-      result,
-      NULL,
-      user_data);
+  g_autoptr (GMutexLocker) locker = NULL;
+  gint64 now                      = 0;
+
+  now    = g_get_monotonic_time ();
+  locker = g_mutex_locker_new (&pool_mutex);
+
+  for (guint i = pool->len; i > 0 && pool->len > 1; i--)
+    {
+      BzDownloadWorker *worker = g_ptr_array_index (pool, i - 1);
+
+      /* Dropping the subprocess closes its stdin, which makes it exit */
+      if (worker->n_assigned == 0 &&
+          now - worker->idle_since >= IDLE_TIMEOUT_SECONDS * G_USEC_PER_SEC)
+        g_ptr_array_remove_index_fast (pool, i - 1);
+    }
+
+  if (pool->len > 1)
+    return G_SOURCE_CONTINUE;
+
+  pool_reap_source = 0;
+  return G_SOURCE_REMOVE;
 }
 
 /* End of bz-download-worker.c */
@@ -43,9 +43,23 @@ bz_download_worker_invoke (BzDownloadWorker *self,
                            GFile            *src,
                            GFile            *dest);
 
+DexFuture *
+bz_download_worker_invoke_with_priority (BzDownloadWorker *self,
+                                         GFile            *src,
+                                         GFile            *dest,
+                                         int               priority);
+
 BzDownloadWorker *
 bz_download_worker_get_default (void);
 
+void
+bz_download_worker_get_stats (guint   *n_workers,
+                              guint64 *replies,
+                              guint64 *http2_replies,
+                              guint64 *tls_handshakes,
+                              guint64 *bytes,
+                              double  *average_queue_wait);
+
 G_END_DECLS
 
 /* End of bz-download-worker.h */
@@ -20,6 +20,21 @@
 
 #include "bz-dynamic-list-view.h"
 #include "bz-marshalers.h"
+#include "bz-util.h"
+
+/* In the noscroll kinds every item gets a cheap slot, and only slots
+   near the visible part of every enclosing scrolled window get a real
+   child. Children of slots that scroll far away are unbound and kept
+   for reuse. */
+#define MAX_RECYCLED_CHILDREN 32
+
+typedef struct
+{
+  GtkWidget *outer;
+  GtkWidget *bin;
+  GObject   *item;
+  GBinding  *binding;
+} Slot;
 
 G_DEFINE_ENUM_TYPE (
     BzDynamicListViewKind,
@@ -47,7 +62,15 @@ struct _BzDynamicListView
   char              *child_type_string;
   GtkScrolledWindow *scrolled_window;
 
-  GPtrArray *box_children;
+  GPtrArray *slots;
+  GPtrArray *recycled;
+  int        slot_width;
+  int        slot_height;
+
+  GPtrArray     *viewports;
+  GPtrArray     *watched_adjustments;
+  GdkFrameClock *frame_clock;
+  gulong         layout_handler;
 };
 
 G_DEFINE_FINAL_TYPE (BzDynamicListView, bz_dynamic_list_view, ADW_TYPE_BIN);
@@ -103,10 +126,6 @@ list_item_factory_unbind (BzDynamicListView        *self,
                           GtkListItem              *item,
                           GtkSignalListItemFactory *factory);
 
-static GtkWidget *
-create_child_widget (GObject           *object,
-                     BzDynamicListView *self);
-
 static void
 items_changed (GListModel        *model,
                guint              position,
@@ -114,6 +133,37 @@ items_changed (GListModel        *model,
                guint              added,
                BzDynamicListView *self);
 
+static Slot *
+create_slot (BzDynamicListView *self,
+             GObject           *object);
+
+static void
+slot_free (Slot *slot);
+
+static void
+fill_slot (BzDynamicListView *self,
+           Slot              *slot);
+
+static void
+empty_slot (BzDynamicListView *self,
+            Slot              *slot);
+
+static void
+queue_update (BzDynamicListView *self);
+
+static void
+frame_clock_layout (BzDynamicListView *self,
+                    GdkFrameClock     *frame_clock);
+
+static void
+update_slots (BzDynamicListView *self);
+
+static void
+watch_viewports (BzDynamicListView *self);
+
+static void
+unwatch_viewports (BzDynamicListView *self);
+
 static void
 bz_dynamic_list_view_dispose (GObject *object)
 {
@@ -127,7 +177,11 @@ bz_dynamic_list_view_dispose (GObject *object)
   g_clear_pointer (&self->object_prop, g_free);
   g_clear_pointer (&self->child_type_string, g_free);
 
-  g_clear_pointer (&self->box_children, g_ptr_array_unref);
+  unwatch_viewports (self);
+  g_clear_pointer (&self->slots, g_ptr_array_unref);
+  g_clear_pointer (&self->recycled, g_ptr_array_unref);
+  g_clear_pointer (&self->viewports, g_ptr_array_unref);
+  g_clear_pointer (&self->watched_adjustments, g_ptr_array_unref);
 
   G_OBJECT_CLASS (bz_dynamic_list_view_parent_class)->dispose (object);
 }
@@ -219,15 +273,40 @@ bz_dynamic_list_view_set_property (GObject      *object,
     }
 }
 
+static void
+bz_dynamic_list_view_map (GtkWidget *widget)
+{
+  BzDynamicListView *self = BZ_DYNAMIC_LIST_VIEW (widget);
+
+  GTK_WIDGET_CLASS (bz_dynamic_list_view_parent_class)->map (widget);
+
+  watch_viewports (self);
+  queue_update (self);
+}
+
+static void
+bz_dynamic_list_view_unmap (GtkWidget *widget)
+{
+  BzDynamicListView *self = BZ_DYNAMIC_LIST_VIEW (widget);
+
+  unwatch_viewports (self);
+
+  GTK_WIDGET_CLASS (bz_dynamic_list_view_parent_class)->unmap (widget);
+}
+
 static void
 bz_dynamic_list_view_class_init (BzDynamicListViewClass *klass)
 {
-  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+  GObjectClass   *object_class = G_OBJECT_CLASS (klass);
+  GtkWidgetClass *widget_class = GTK_WIDGET_CLASS (klass);
 
   object_class->set_property = bz_dynamic_list_view_set_property;
   object_class->get_property = bz_dynamic_list_view_get_property;
   object_class->dispose      = bz_dynamic_list_view_dispose;
 
+  widget_class->map   = bz_dynamic_list_view_map;
+  widget_class->unmap = bz_dynamic_list_view_unmap;
+
   props[PROP_MODEL] =
       g_param_spec_object (
           "model",
@@ -337,7 +416,12 @@ bz_dynamic_list_view_init (BzDynamicListView *self)
   self->max_children_per_line = 4;
   self->row_spacing           = 5;
   self->column_spacing        = 5;
-  self->box_children          = g_ptr_array_new ();
+  self->slots                 = g_ptr_array_new_with_free_func ((GDestroyNotify) slot_free);
+  self->recycled              = g_ptr_array_new_with_free_func (g_object_unref);
+  self->slot_width            = -1;
+  self->slot_height           = -1;
+  self->viewports             = g_ptr_array_new_with_free_func (g_object_unref);
+  self->watched_adjustments   = g_ptr_array_new_with_free_func (g_object_unref);
 }
 
 BzDynamicListView *
@@ -586,7 +670,12 @@ refresh (BzDynamicListView *self)
     g_signal_handlers_disconnect_by_func (self->model, items_changed, self);
 
   self->scrolled_window = NULL;
-  g_ptr_array_set_size (self->box_children, 0);
+  for (guint i = 0; i < self->slots->len; i++)
+    empty_slot (self, g_ptr_array_index (self->slots, i));
+  g_ptr_array_set_size (self->slots, 0);
+  g_ptr_array_set_size (self->recycled, 0);
+  self->slot_width  = -1;
+  self->slot_height = -1;
   adw_bin_set_child (ADW_BIN (self), NULL);
   g_object_notify_by_pspec (G_OBJECT (self), props[PROP_VADJUSTMENT]);
 
@@ -653,13 +742,12 @@ refresh (BzDynamicListView *self)
             gtk_list_box_set_selection_mode (
                 GTK_LIST_BOX (widget),
                 GTK_SELECTION_NONE);
-
-            gtk_list_box_bind_model (
-                GTK_LIST_BOX (widget), self->model,
-                (GtkListBoxCreateWidgetFunc) create_child_widget,
-                self, NULL);
+            g_signal_connect (
+                self->model, "items-changed",
+                G_CALLBACK (items_changed), self);
 
             adw_bin_set_child (ADW_BIN (self), widget);
+            items_changed (self->model, 0, 0, g_list_model_get_n_items (self->model), self);
           }
           break;
         case BZ_DYNAMIC_LIST_VIEW_KIND_FLOW_BOX:
@@ -672,12 +760,12 @@ refresh (BzDynamicListView *self)
             gtk_flow_box_set_row_spacing (GTK_FLOW_BOX (widget), self->row_spacing);
             gtk_flow_box_set_column_spacing (GTK_FLOW_BOX (widget), self->column_spacing);
             gtk_flow_box_set_selection_mode (GTK_FLOW_BOX (widget), GTK_SELECTION_NONE);
-            gtk_flow_box_bind_model (
-                GTK_FLOW_BOX (widget), self->model,
-                (GtkFlowBoxCreateWidgetFunc) create_child_widget,
-                self, NULL);
+            g_signal_connect (
+                self->model, "items-changed",
+                G_CALLBACK (items_changed), self);
 
             adw_bin_set_child (ADW_BIN (self), widget);
+            items_changed (self->model, 0, 0, g_list_model_get_n_items (self->model), self);
           }
           break;
         case BZ_DYNAMIC_LIST_VIEW_KIND_CAROUSEL:
@@ -686,6 +774,9 @@ refresh (BzDynamicListView *self)
 
             widget = adw_carousel_new ();
             adw_carousel_set_allow_scroll_wheel (ADW_CAROUSEL (widget), FALSE);
+            g_signal_connect_swapped (
+                widget, "notify::position",
+                G_CALLBACK (queue_update), self);
             g_signal_connect (
                 self->model, "items-changed",
                 G_CALLBACK (items_changed), self);
@@ -781,60 +872,6 @@ list_item_factory_unbind (BzDynamicListView        *self,
   g_signal_emit (self, signals[SIGNAL_UNBIND_WIDGET], 0, child, object);
 }
 
-static GtkWidget *
-create_child_widget (GObject           *object,
-                     BzDynamicListView *self)
-{
-  GtkWidget *widget = NULL;
-
-  widget = g_object_new (self->child_type, NULL);
-  if (self->object_prop != NULL)
-    g_object_bind_property (
-        object, self->object_prop,
-        widget, self->child_prop,
-        G_BINDING_SYNC_CREATE);
-  else
-    g_object_set (widget, self->child_prop, object, NULL);
-
-  gtk_widget_set_receives_default (widget, TRUE);
-  g_signal_emit (self, signals[SIGNAL_BIND_WIDGET], 0, widget, object);
-
-  switch (self->noscroll_kind)
-    {
-    case BZ_DYNAMIC_LIST_VIEW_KIND_LIST_BOX:
-      {
-        GtkWidget *child = NULL;
-
-        child = gtk_list_box_row_new ();
-        gtk_widget_add_css_class (GTK_WIDGET (child), "disable-adw-flow-box-styling");
-        gtk_widget_set_focusable (GTK_WIDGET (child), FALSE);
-
-        gtk_list_box_row_set_selectable (GTK_LIST_BOX_ROW (child), FALSE);
-        gtk_list_box_row_set_child (GTK_LIST_BOX_ROW (child), widget);
-
-        return child;
-      }
-    case BZ_DYNAMIC_LIST_VIEW_KIND_FLOW_BOX:
-      {
-        GtkWidget *child = NULL;
-
-        child = gtk_flow_box_child_new ();
-        gtk_widget_add_css_class (GTK_WIDGET (child), "disable-adw-flow-box-styling");
-        gtk_widget_set_focusable (GTK_WIDGET (child), FALSE);
-
-        gtk_flow_box_child_set_child (GTK_FLOW_BOX_CHILD (child), widget);
-
-        return child;
-      }
-    case BZ_DYNAMIC_LIST_VIEW_KIND_HBOX:
-    case BZ_DYNAMIC_LIST_VIEW_KIND_VBOX:
-    case BZ_DYNAMIC_LIST_VIEW_KIND_CAROUSEL:
-    case BZ_DYNAMIC_LIST_VIEW_N_KINDS:
-    default:
-      return widget;
-    }
-}
-
 static void
 items_changed (GListModel        *model,
                guint              position,
@@ -848,65 +885,340 @@ items_changed (GListModel        *model,
 
   for (guint i = 0; i < removed; i++)
     {
+      Slot *slot = NULL;
+
+      slot = g_ptr_array_index (self->slots, position + i);
+      empty_slot (self, slot);
+
       switch (self->noscroll_kind)
         {
         case BZ_DYNAMIC_LIST_VIEW_KIND_HBOX:
         case BZ_DYNAMIC_LIST_VIEW_KIND_VBOX:
-          {
-            GtkWidget *child = NULL;
-
-            child = g_ptr_array_index (self->box_children, position);
-            gtk_box_remove (GTK_BOX (bin_child), g_steal_pointer (&child));
-            g_ptr_array_remove_index (self->box_children, position);
-          }
-          break;
-        case BZ_DYNAMIC_LIST_VIEW_KIND_CAROUSEL:
-          adw_carousel_remove (
-              ADW_CAROUSEL (bin_child),
-              adw_carousel_get_nth_page (ADW_CAROUSEL (bin_child), position));
+          gtk_box_remove (GTK_BOX (bin_child), slot->outer);
           break;
         case BZ_DYNAMIC_LIST_VIEW_KIND_LIST_BOX:
+          gtk_list_box_remove (GTK_LIST_BOX (bin_child), slot->outer);
+          break;
         case BZ_DYNAMIC_LIST_VIEW_KIND_FLOW_BOX:
+          gtk_flow_box_remove (GTK_FLOW_BOX (bin_child), slot->outer);
+          break;
+        case BZ_DYNAMIC_LIST_VIEW_KIND_CAROUSEL:
+          adw_carousel_remove (ADW_CAROUSEL (bin_child), slot->outer);
+          break;
         case BZ_DYNAMIC_LIST_VIEW_N_KINDS:
         default:
           g_assert_not_reached ();
         }
     }
+  if (removed > 0)
+    g_ptr_array_remove_range (self->slots, position, removed);
 
   for (guint i = 0; i < added; i++)
     {
       g_autoptr (GObject) object = NULL;
-      GtkWidget *widget          = NULL;
+      Slot *slot                 = NULL;
 
       object = g_list_model_get_item (model, position + i);
-      widget = create_child_widget (object, self);
+      slot   = create_slot (self, object);
 
       switch (self->noscroll_kind)
         {
         case BZ_DYNAMIC_LIST_VIEW_KIND_HBOX:
         case BZ_DYNAMIC_LIST_VIEW_KIND_VBOX:
           {
-            if (position + i < self->box_children->len)
-              {
-                GtkWidget *sibling = NULL;
+            GtkWidget *sibling = NULL;
 
-                sibling = g_ptr_array_index (self->box_children, position + i);
-                gtk_box_insert_child_after (GTK_BOX (bin_child), widget, sibling);
-              }
-            else
-              gtk_box_append (GTK_BOX (bin_child), widget);
+            if (position + i > 0)
+              sibling = ((Slot *) g_ptr_array_index (self->slots, position + i - 1))->outer;
+            gtk_box_insert_child_after (GTK_BOX (bin_child), slot->outer, sibling);
           }
           break;
-        case BZ_DYNAMIC_LIST_VIEW_KIND_CAROUSEL:
-          adw_carousel_insert (ADW_CAROUSEL (bin_child), widget, position + i);
-          break;
         case BZ_DYNAMIC_LIST_VIEW_KIND_LIST_BOX:
+          gtk_list_box_insert (GTK_LIST_BOX (bin_child), slot->outer, position + i);
+          break;
         case BZ_DYNAMIC_LIST_VIEW_KIND_FLOW_BOX:
+          gtk_flow_box_insert (GTK_FLOW_BOX (bin_child), slot->outer, position + i);
+          break;
+        case BZ_DYNAMIC_LIST_VIEW_KIND_CAROUSEL:
+          adw_carousel_insert (ADW_CAROUSEL (bin_child), slot->outer, position + i);
+          break;
         case BZ_DYNAMIC_LIST_VIEW_N_KINDS:
         default:
           g_assert_not_reached ();
         }
+
+      g_ptr_array_insert (self->slots, position + i, slot);
+    }
+
+  queue_update (self);
+}
+
+static Slot *
+create_slot (BzDynamicListView *self,
+             GObject           *object)
+{
+  Slot *slot = NULL;
+
+  slot       = g_new0 (Slot, 1);
+  slot->item = g_object_ref (object);
+  slot->bin  = adw_bin_new ();
+  if (self->slot_width >= 0 && self->slot_height >= 0)
+    gtk_widget_set_size_request (slot->bin, self->slot_width, self->slot_height);
+
+  switch (self->noscroll_kind)
+    {
+    case BZ_DYNAMIC_LIST_VIEW_KIND_LIST_BOX:
+      slot->outer = gtk_list_box_row_new ();
+      gtk_widget_add_css_class (slot->outer, "disable-adw-flow-box-styling");
+      gtk_widget_set_focusable (slot->outer, FALSE);
+      gtk_list_box_row_set_selectable (GTK_LIST_BOX_ROW (slot->outer), FALSE);
+      gtk_list_box_row_set_child (GTK_LIST_BOX_ROW (slot->outer), slot->bin);
+      break;
+    case BZ_DYNAMIC_LIST_VIEW_KIND_FLOW_BOX:
+      slot->outer = gtk_flow_box_child_new ();
+      gtk_widget_add_css_class (slot->outer, "disable-adw-flow-box-styling");
+      gtk_widget_set_focusable (slot->outer, FALSE);
+      gtk_flow_box_child_set_child (GTK_FLOW_BOX_CHILD (slot->outer), slot->bin);
+      break;
+    case BZ_DYNAMIC_LIST_VIEW_KIND_HBOX:
+    case BZ_DYNAMIC_LIST_VIEW_KIND_VBOX:
+    case BZ_DYNAMIC_LIST_VIEW_KIND_CAROUSEL:
+    case BZ_DYNAMIC_LIST_VIEW_N_KINDS:
+    default:
+      slot->outer = slot->bin;
+      break;
+    }
+
+  return slot;
+}
+
+static void
+slot_free (Slot *slot)
+{
+  g_clear_object (&slot->item);
+  g_free (slot);
+}
+
+static void
+fill_slot (BzDynamicListView *self,
+           Slot              *slot)
+{
+  GtkWidget *widget = NULL;
+
+  if (adw_bin_get_child (ADW_BIN (slot->bin)) != NULL)
+    return;
+
+  if (self->recycled->len > 0)
+    widget = g_ptr_array_steal_index_fast (self->recycled, self->recycled->len - 1);
+  else
+    {
+      widget = g_object_ref_sink (g_object_new (self->child_type, NULL));
+      gtk_widget_set_receives_default (widget, TRUE);
+    }
+
+  if (self->object_prop != NULL)
+    slot->binding = g_object_ref (g_object_bind_property (
+        slot->item, self->object_prop,
+        widget, self->child_prop,
+        G_BINDING_SYNC_CREATE));
+  else
+    g_object_set (widget, self->child_prop, slot->item, NULL);
+
+  gtk_widget_set_size_request (slot->bin, -1, -1);
+  adw_bin_set_child (ADW_BIN (slot->bin), widget);
+  g_signal_emit (self, signals[SIGNAL_BIND_WIDGET], 0, widget, slot->item);
+
+  if (self->slot_width < 0 || self->slot_height < 0)
+    {
+      /* Empty slots take the size of the first real child, so that
+         they don't all crowd into the viewport at once */
+      gtk_widget_measure (widget, GTK_ORIENTATION_HORIZONTAL, -1,
+                          NULL, &self->slot_width, NULL, NULL);
+      gtk_widget_measure (widget, GTK_ORIENTATION_VERTICAL, self->slot_width,
+                          NULL, &self->slot_height, NULL, NULL);
+
+      for (guint i = 0; i < self->slots->len; i++)
+        {
+          Slot *other = g_ptr_array_index (self->slots, i);
+
+          if (adw_bin_get_child (ADW_BIN (other->bin)) == NULL)
+            gtk_widget_set_size_request (other->bin, self->slot_width, self->slot_height);
+        }
+    }
+
+  g_object_unref (widget);
+}
+
+static void
+empty_slot (BzDynamicListView *self,
+            Slot              *slot)
+{
+  g_autoptr (GtkWidget) widget = NULL;
+
+  widget = bz_object_maybe_ref (adw_bin_get_child (ADW_BIN (slot->bin)));
+  if (widget == NULL)
+    return;
+
+  if (slot->binding != NULL)
+    {
+      g_binding_unbind (slot->binding);
+      g_clear_object (&slot->binding);
+    }
+  else if (self->child_prop != NULL)
+    g_object_set (widget, self->child_prop, NULL, NULL);
+
+  g_signal_emit (self, signals[SIGNAL_UNBIND_WIDGET], 0, widget, slot->item);
+
+  adw_bin_set_child (ADW_BIN (slot->bin), NULL);
+  if (self->slot_width >= 0 && self->slot_height >= 0)
+    gtk_widget_set_size_request (slot->bin, self->slot_width, self->slot_height);
+
+  if (self->recycled->len < MAX_RECYCLED_CHILDREN)
+    g_ptr_array_add (self->recycled, g_steal_pointer (&widget));
+}
+
+static void
+queue_update (BzDynamicListView *self)
+{
+  if (self->layout_handler != 0 ||
+      self->slots->len == 0 ||
+      !gtk_widget_get_mapped (GTK_WIDGET (self)))
+    return;
+
+  /* Run after GTK lays out the frame so new slots have a position,
+     anything we change gets laid out again within the same frame */
+  self->frame_clock    = gtk_widget_get_frame_clock (GTK_WIDGET (self));
+  self->layout_handler = g_signal_connect_object (
+      self->frame_clock, "layout",
+      G_CALLBACK (frame_clock_layout), self,
+      G_CONNECT_SWAPPED | G_CONNECT_AFTER);
+  gdk_frame_clock_request_phase (self->frame_clock, GDK_FRAME_CLOCK_PHASE_LAYOUT);
+}
+
+static void
+frame_clock_layout (BzDynamicListView *self,
+                    GdkFrameClock     *frame_clock)
+{
+  g_clear_signal_handler (&self->layout_handler, frame_clock);
+  self->frame_clock = NULL;
+
+  update_slots (self);
+}
+
+static void
+update_slots (BzDynamicListView *self)
+{
+  if (self->noscroll_kind == BZ_DYNAMIC_LIST_VIEW_KIND_CAROUSEL)
+    {
+      GtkWidget *carousel = NULL;
+      double     position = 0.0;
+
+      carousel = adw_bin_get_child (ADW_BIN (self));
+      position = adw_carousel_get_position (ADW_CAROUSEL (carousel));
+
+      for (guint i = 0; i < self->slots->len; i++)
+        {
+          Slot  *slot     = g_ptr_array_index (self->slots, i);
+          double distance = ABS ((double) i - position);
+
+          if (distance < 2.0)
+            fill_slot (self, slot);
+          else if (distance >= 3.0)
+            empty_slot (self, slot);
+        }
+      return;
+    }
+
+  if (self->slot_width < 0 || self->slot_height < 0)
+    {
+      /* Nothing to estimate the layout with yet */
+      fill_slot (self, g_ptr_array_index (self->slots, 0));
+      queue_update (self);
+      return;
+    }
+
+  for (guint i = 0; i < self->slots->len; i++)
+    {
+      Slot    *slot = g_ptr_array_index (self->slots, i);
+      gboolean near = TRUE;
+      gboolean far  = FALSE;
+
+      /* Fill slots within one viewport of being visible, empty them
+         once they are more than two away */
+      for (guint j = 0; j < self->viewports->len; j++)
+        {
+          GtkWidget      *viewport = g_ptr_array_index (self->viewports, j);
+          graphene_rect_t bounds   = { 0 };
+          graphene_rect_t inner    = { 0 };
+          graphene_rect_t outer    = { 0 };
+          float           width    = 0.0;
+          float           height   = 0.0;
+
+          if (!gtk_widget_compute_bounds (slot->outer, viewport, &bounds))
+            continue;
+
+          width  = gtk_widget_get_width (viewport);
+          height = gtk_widget_get_height (viewport);
+          graphene_rect_init (&inner, -width, -height, width * 3.0, height * 3.0);
+          graphene_rect_init (&outer, -width * 2.0, -height * 2.0, width * 5.0, height * 5.0);
+
+          if (!graphene_rect_intersection (&bounds, &inner, NULL))
+            near = FALSE;
+          if (!graphene_rect_intersection (&bounds, &outer, NULL))
+            far = TRUE;
+        }
+
+      if (near)
+        fill_slot (self, slot);
+      else if (far)
+        empty_slot (self, slot);
+    }
+}
+
+static void
+watch_viewports (BzDynamicListView *self)
+{
+  unwatch_viewports (self);
+
+  for (GtkWidget *ancestor = gtk_widget_get_parent (GTK_WIDGET (self));
+       ancestor != NULL;
+       ancestor = gtk_widget_get_parent (ancestor))
+    {
+      GtkAdjustment *adjustments[2] = { 0 };
+
+      if (!GTK_IS_SCROLLED_WINDOW (ancestor))
+        continue;
+
+      adjustments[0] = gtk_scrolled_window_get_hadjustment (GTK_SCROLLED_WINDOW (ancestor));
+      adjustments[1] = gtk_scrolled_window_get_vadjustment (GTK_SCROLLED_WINDOW (ancestor));
+
+      for (guint i = 0; i < G_N_ELEMENTS (adjustments); i++)
+        {
+          g_signal_connect_swapped (adjustments[i], "value-changed", G_CALLBACK (queue_update), self);
+          g_signal_connect_swapped (adjustments[i], "changed", G_CALLBACK (queue_update), self);
+          g_ptr_array_add (self->watched_adjustments, g_object_ref (adjustments[i]));
+        }
+      g_ptr_array_add (self->viewports, g_object_ref (ancestor));
+    }
+}
+
+static void
+unwatch_viewports (BzDynamicListView *self)
+{
+  if (self->frame_clock != NULL)
+    g_clear_signal_handler (&self->layout_handler, self->frame_clock);
+  self->frame_clock = NULL;
+
+  if (self->watched_adjustments != NULL)
+    {
+      for (guint i = 0; i < self->watched_adjustments->len; i++)
+        g_signal_handlers_disconnect_by_func (
+            g_ptr_array_index (self->watched_adjustments, i),
+            queue_update, self);
+      g_ptr_array_set_size (self->watched_adjustments, 0);
     }
+  if (self->viewports != NULL)
+    g_ptr_array_set_size (self->viewports, 0);
 }
 
 /* End of bz-dynamic-list-view.c */
@@ -26,11 +26,13 @@
 
 #include <malloc.h>
 
+#include "bz-compress.h"
 #include "bz-entry-cache-manager.h"
 #include "bz-env.h"
 #include "bz-flatpak-entry.h"
 #include "bz-io.h"
 #include "bz-serializable.h"
+#include "bz-trace.h"
 #include "bz-util.h"
 
 /* clang-format off */
@@ -41,8 +43,7 @@ BZ_DEFINE_DATA (
     ongoing_task,
     OngoingTask,
     {
-      DexScheduler *scheduler;
-      DexPromise   *init;
+      DexPromise *init;
 
       GHashTable *alive_hash;
       GHashTable *writing_hash;
@@ -60,7 +61,6 @@ BZ_DEFINE_DATA (
       BzGuard *writing_gate;
       GMutex   writing_mutex;
     },
-    BZ_RELEASE_DATA (scheduler, dex_unref);
     BZ_RELEASE_DATA (init, dex_unref);
     BZ_RELEASE_DATA (alive_hash, g_hash_table_unref);
     BZ_RELEASE_DATA (writing_hash, g_hash_table_unref);
@@ -83,8 +83,7 @@ struct _BzEntryCacheManager
 
   guint64 max_memory_usage;
 
-  DexScheduler *scheduler;
-  guint64       memory_usage;
+  guint64 memory_usage;
 
   OngoingTaskData *task_data;
   DexFuture       *watch_task;
@@ -155,12 +154,20 @@ read_task_fiber (ReadTaskData *data);
 static DexFuture *
 enumerate_disk_fiber (OngoingTaskData *data);
 
+static DexFuture *
+sweep_fiber (OngoingTaskData *task_data);
+
+static DexFuture *
+stats_fiber (OngoingTaskData *task_data);
+
+static void
+sweep (OngoingTaskData *task_data);
+
 static void
 bz_entry_cache_manager_dispose (GObject *object)
 {
   BzEntryCacheManager *self = BZ_ENTRY_CACHE_MANAGER (object);
 
-  dex_clear (&self->scheduler);
   dex_clear (&self->watch_task);
   g_clear_pointer (&self->task_data, ongoing_task_data_unref);
 
@@ -225,17 +232,11 @@ bz_entry_cache_manager_class_init (BzEntryCacheManagerClass *klass)
 static void
 bz_entry_cache_manager_init (BzEntryCacheManager *self)
 {
-  static DexScheduler *global_scheduler = NULL;
   g_autoptr (OngoingTaskData) task_data = NULL;
 
-  if (g_once_init_enter_pointer (&global_scheduler))
-    g_once_init_leave_pointer (&global_scheduler, dex_thread_pool_scheduler_new ());
-
-  self->scheduler    = dex_ref (global_scheduler);
   self->memory_usage = 0;
 
   task_data             = ongoing_task_data_new ();
-  task_data->scheduler  = dex_ref (self->scheduler);
   task_data->init       = dex_promise_new ();
   task_data->alive_hash = g_hash_table_new_full (
       g_str_hash, g_str_equal, g_free, living_entry_data_unref);
@@ -251,9 +252,8 @@ bz_entry_cache_manager_init (BzEntryCacheManager *self)
   g_mutex_init (&task_data->writing_mutex);
   self->task_data = g_steal_pointer (&task_data);
 
-  self->watch_task = dex_scheduler_spawn (
-      self->scheduler,
-      bz_get_dex_stack_size (),
+  self->watch_task = bz_spawn (
+      BZ_SCHEDULER_PRIORITY_BACKGROUND,
       (DexFiberFunc) watch_init_fiber,
       ongoing_task_data_ref (self->task_data),
       ongoing_task_data_unref);
@@ -299,9 +299,8 @@ bz_entry_cache_manager_add (BzEntryCacheManager *self,
   data->unique_id_checksum = g_strdup (bz_entry_get_unique_id_checksum (entry));
   data->entry              = g_object_ref (entry);
 
-  future = dex_scheduler_spawn (
-      self->scheduler,
-      bz_get_dex_stack_size (),
+  future = bz_spawn (
+      BZ_SCHEDULER_PRIORITY_BACKGROUND,
       (DexFiberFunc) write_task_fiber,
       write_task_data_ref (data),
       write_task_data_unref);
@@ -322,9 +321,8 @@ bz_entry_cache_manager_get (BzEntryCacheManager *self,
   data->task_data          = ongoing_task_data_ref (self->task_data);
   data->unique_id_checksum = g_compute_checksum_for_string (G_CHECKSUM_MD5, unique_id, -1);
 
-  future = dex_scheduler_spawn (
-      self->scheduler,
-      bz_get_dex_stack_size (),
+  future = bz_spawn (
+      BZ_SCHEDULER_PRIORITY_INTERACTIVE,
       (DexFiberFunc) read_task_fiber,
       read_task_data_ref (data),
       read_task_data_unref);
@@ -345,9 +343,8 @@ bz_entry_cache_manager_get_by_checksum (BzEntryCacheManager *self,
   data->task_data          = ongoing_task_data_ref (self->task_data);
   data->unique_id_checksum = g_strdup (unique_id_checksum);
 
-  future = dex_scheduler_spawn (
-      self->scheduler,
-      bz_get_dex_stack_size (),
+  future = bz_spawn (
+      BZ_SCHEDULER_PRIORITY_INTERACTIVE,
       (DexFiberFunc) read_task_fiber,
       read_task_data_ref (data),
       read_task_data_unref);
@@ -361,15 +358,44 @@ bz_entry_cache_manager_enumerate_disk (BzEntryCacheManager *self)
 
   dex_return_error_if_fail (BZ_IS_ENTRY_CACHE_MANAGER (self));
 
-  future = dex_scheduler_spawn (
-      self->scheduler,
-      bz_get_dex_stack_size (),
+  future = bz_spawn (
+      BZ_SCHEDULER_PRIORITY_BACKGROUND,
       (DexFiberFunc) enumerate_disk_fiber,
       ongoing_task_data_ref (self->task_data),
       ongoing_task_data_unref);
   return g_steal_pointer (&future);
 }
 
+DexFuture *
+bz_entry_cache_manager_sweep (BzEntryCacheManager *self)
+{
+  g_autoptr (DexFuture) future = NULL;
+
+  dex_return_error_if_fail (BZ_IS_ENTRY_CACHE_MANAGER (self));
+
+  future = bz_spawn (
+      BZ_SCHEDULER_PRIORITY_BACKGROUND,
+      (DexFiberFunc) sweep_fiber,
+      ongoing_task_data_ref (self->task_data),
+      ongoing_task_data_unref);
+  return g_steal_pointer (&future);
+}
+
+DexFuture *
+bz_entry_cache_manager_dup_stats (BzEntryCacheManager *self)
+{
+  g_autoptr (DexFuture) future = NULL;
+
+  dex_return_error_if_fail (BZ_IS_ENTRY_CACHE_MANAGER (self));
+
+  future = bz_spawn (
+      BZ_SCHEDULER_PRIORITY_INTERACTIVE,
+      (DexFiberFunc) stats_fiber,
+      ongoing_task_data_ref (self->task_data),
+      ongoing_task_data_unref);
+  return g_steal_pointer (&future);
+}
+
 static DexFuture *
 write_task_fiber (WriteTaskData *data)
 {
@@ -385,8 +411,8 @@ write_task_fiber (WriteTaskData *data)
   DexFuture *writing_future            = NULL;
   g_autoptr (LivingEntryData) living   = NULL;
   g_autoptr (DexPromise) promise       = NULL;
-  g_autoptr (GVariantBuilder) builder  = NULL;
   g_autoptr (GVariant) variant         = NULL;
+  g_autoptr (GBytes) raw               = NULL;
   g_autoptr (GBytes) bytes             = NULL;
   g_autofree char *main_cache          = NULL;
   g_autoptr (GFile) parent_file        = NULL;
@@ -395,6 +421,7 @@ write_task_fiber (WriteTaskData *data)
   gssize   bytes_written               = 0;
   gboolean result                      = FALSE;
   g_autoptr (GError) ret_error         = NULL;
+  gint64 trace_begin                   = 0;
 
   if (!BZ_IS_FLATPAK_ENTRY (entry))
     return dex_future_new_reject (
@@ -421,6 +448,7 @@ write_task_fiber (WriteTaskData *data)
     }
   task_data->ongoing_queued[slot_index]++;
   g_clear_pointer (&locker, g_mutex_locker_free);
+  bz_trace_counter_add (BZ_TRACE_COUNTER_CACHE_WRITE_QUEUE, 1);
 
   BZ_BEGIN_GUARD_WITH_CONTEXT (&slot_guard,
                                &task_data->ongoing_mutexes[slot_index],
@@ -429,6 +457,7 @@ write_task_fiber (WriteTaskData *data)
   locker = g_mutex_locker_new (&task_data->ongoing_queueing_mutex);
   task_data->ongoing_queued[slot_index]--;
   g_clear_pointer (&locker, g_mutex_locker_free);
+  bz_trace_counter_add (BZ_TRACE_COUNTER_CACHE_WRITE_QUEUE, -1);
 
   dex_await (dex_ref (task_data->init), NULL);
 
@@ -475,10 +504,11 @@ write_task_fiber (WriteTaskData *data)
                                &living->mutex,
                                &living->gate);
   {
-    builder = g_variant_builder_new (G_VARIANT_TYPE_VARDICT);
-    bz_serializable_serialize (BZ_SERIALIZABLE (entry), builder);
-    variant = g_variant_builder_end (builder);
-    bytes   = g_variant_get_data_as_bytes (variant);
+    trace_begin = bz_trace_begin ();
+
+    variant = g_variant_ref_sink (bz_flatpak_entry_serialize_fixed (BZ_FLATPAK_ENTRY (entry)));
+    raw     = g_variant_get_data_as_bytes (variant);
+    bytes   = bz_compress_cache_bytes (raw);
 
     main_cache  = bz_dup_module_dir ();
     parent_file = g_file_new_for_path (main_cache);
@@ -539,6 +569,8 @@ write_task_fiber (WriteTaskData *data)
       }
 
     g_timer_start (living->cached);
+    bz_trace_end (trace_begin, "Cache", "Write Entry", "%s: %zu bytes, %zu on disk",
+                  unique_id_checksum, g_bytes_get_size (raw), g_bytes_get_size (bytes));
   }
 done:
   bz_clear_guard (&slot_guard);
@@ -577,11 +609,14 @@ read_task_fiber (ReadTaskData *data)
   g_autofree char *main_cache          = NULL;
   g_autofree char *path                = NULL;
   g_autoptr (GFile) file               = NULL;
+  g_autoptr (GBytes) raw               = NULL;
   g_autoptr (GBytes) bytes             = NULL;
   g_autoptr (GVariant) variant         = NULL;
   g_autoptr (BzFlatpakEntry) entry     = NULL;
+  gboolean fixed                       = FALSE;
   gboolean result                      = FALSE;
   g_autoptr (GError) ret_error         = NULL;
+  gint64 trace_begin                   = 0;
 
   dex_await (dex_ref (task_data->init), NULL);
 
@@ -660,12 +695,14 @@ read_task_fiber (ReadTaskData *data)
 
   /* living data was guarded */
 
+  trace_begin = bz_trace_begin ();
+
   main_cache = bz_dup_module_dir ();
   path       = g_build_filename (main_cache, unique_id_checksum, NULL);
   file       = g_file_new_for_path (path);
 
-  bytes = g_file_load_bytes (file, NULL, NULL, &local_error);
-  if (bytes == NULL)
+  raw = g_file_load_bytes (file, NULL, NULL, &local_error);
+  if (raw == NULL)
     {
       ret_error = g_error_new (
           BZ_ENTRY_CACHE_ERROR,
@@ -675,19 +712,41 @@ read_task_fiber (ReadTaskData *data)
       goto done;
     }
 
-  variant = g_variant_new_from_bytes (G_VARIANT_TYPE_VARDICT, bytes, FALSE);
-  if (variant == NULL)
+  bytes = bz_decompress_cache_bytes (raw, &local_error);
+  if (bytes == NULL)
     {
       ret_error = g_error_new (
           BZ_ENTRY_CACHE_ERROR,
           BZ_ENTRY_CACHE_ERROR_DECACHE_FAILED,
-          "Failed to interpret variant from %s: %s",
+          "Failed to decompress %s: %s",
           path, local_error->message);
       goto done;
     }
 
-  entry  = g_object_new (BZ_TYPE_FLATPAK_ENTRY, NULL);
-  result = bz_serializable_deserialize (BZ_SERIALIZABLE (entry), variant, &local_error);
+  /* Caches written before the fixed layout are vardicts, keep reading
+     those until they get rewritten */
+  fixed = g_bytes_get_size (bytes) > 0 &&
+          *(const guchar *) g_bytes_get_data (bytes, NULL) == BZ_FLATPAK_ENTRY_SERIAL_VERSION;
+  if (fixed)
+    variant = g_variant_new_from_bytes (
+        G_VARIANT_TYPE (BZ_FLATPAK_ENTRY_SERIAL_TYPE), bytes, FALSE);
+  else
+    variant = g_variant_new_from_bytes (G_VARIANT_TYPE_VARDICT, bytes, FALSE);
+  if (variant == NULL)
+    {
+      ret_error = g_error_new (
+          BZ_ENTRY_CACHE_ERROR,
+          BZ_ENTRY_CACHE_ERROR_DECACHE_FAILED,
+          "Failed to interpret variant from %s",
+          path);
+      goto done;
+    }
+
+  entry = g_object_new (BZ_TYPE_FLATPAK_ENTRY, NULL);
+  if (fixed)
+    result = bz_flatpak_entry_deserialize_fixed (BZ_FLATPAK_ENTRY (entry), variant, &local_error);
+  else
+    result = bz_serializable_deserialize (BZ_SERIALIZABLE (entry), variant, &local_error);
   if (!result)
     {
       ret_error = g_error_new (
@@ -698,6 +757,8 @@ read_task_fiber (ReadTaskData *data)
       goto done;
     }
   g_weak_ref_init (&living->wr, entry);
+  bz_trace_end (trace_begin, "Cache", "Read Entry", "%s: %zu bytes on disk, %zu decoded",
+                unique_id_checksum, g_bytes_get_size (raw), g_bytes_get_size (bytes));
 
 done:
   BZ_BEGIN_GUARD_WITH_CONTEXT (&guard,
@@ -805,9 +866,8 @@ static DexFuture *
 watch_cb (DexFuture       *future,
           OngoingTaskData *task_data)
 {
-  return dex_scheduler_spawn (
-      task_data->scheduler,
-      bz_get_dex_stack_size (),
+  return bz_spawn (
+      BZ_SCHEDULER_PRIORITY_BACKGROUND,
       (DexFiberFunc) watch_work_fiber,
       ongoing_task_data_ref (task_data),
       ongoing_task_data_unref);
@@ -815,6 +875,40 @@ watch_cb (DexFuture       *future,
 
 static DexFuture *
 watch_work_fiber (OngoingTaskData *task_data)
+{
+  sweep (task_data);
+  return dex_timeout_new_msec (WATCH_CLEANUP_INTERVAL_MSEC);
+}
+
+static DexFuture *
+sweep_fiber (OngoingTaskData *task_data)
+{
+  sweep (task_data);
+  return dex_future_new_true ();
+}
+
+static DexFuture *
+stats_fiber (OngoingTaskData *task_data)
+{
+  g_autoptr (BzGuard) guard = NULL;
+  guint n_alive             = 0;
+  guint n_reading           = 0;
+  guint n_writing           = 0;
+
+  BZ_BEGIN_GUARD_WITH_CONTEXT (&guard, &task_data->alive_mutex, &task_data->alive_gate);
+  BZ_BEGIN_GUARD_WITH_CONTEXT (&guard, &task_data->reading_mutex, &task_data->reading_gate);
+  BZ_BEGIN_GUARD_WITH_CONTEXT (&guard, &task_data->writing_mutex, &task_data->writing_gate);
+  n_alive   = g_hash_table_size (task_data->alive_hash);
+  n_reading = g_hash_table_size (task_data->reading_hash);
+  n_writing = g_hash_table_size (task_data->writing_hash);
+  bz_clear_guard (&guard);
+
+  return dex_future_new_take_variant (
+      g_variant_ref_sink (g_variant_new ("(uuu)", n_alive, n_reading, n_writing)));
+}
+
+static void
+sweep (OngoingTaskData *task_data)
 {
   g_autoptr (BzGuard) guard0 = NULL;
   GHashTableIter iter        = { 0 };
@@ -875,8 +969,6 @@ watch_work_fiber (OngoingTaskData *task_data)
            "  Another sweep will take place in %d msec",
            g_timer_elapsed (timer, NULL),
            total, active, alive, pruned, WATCH_CLEANUP_INTERVAL_MSEC);
-
-  return dex_timeout_new_msec (WATCH_CLEANUP_INTERVAL_MSEC);
 }
 
 /* End of bz-entry-cache-manager.c */
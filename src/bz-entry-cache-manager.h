@@ -64,6 +64,12 @@ bz_entry_cache_manager_get_by_checksum (BzEntryCacheManager *self,
 DexFuture *
 bz_entry_cache_manager_enumerate_disk (BzEntryCacheManager *self);
 
+DexFuture *
+bz_entry_cache_manager_sweep (BzEntryCacheManager *self);
+
+DexFuture *
+bz_entry_cache_manager_dup_stats (BzEntryCacheManager *self);
+
 G_END_DECLS
 
 /* End of bz-entry-cache-manager.h */
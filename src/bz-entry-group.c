@@ -25,6 +25,7 @@
 #include "bz-async-texture.h"
 #include "bz-env.h"
 #include "bz-io.h"
+#include "bz-trace.h"
 #include "bz-util.h"
 
 struct _BzEntryGroup
@@ -34,6 +35,13 @@ struct _BzEntryGroup
   BzApplicationMapFactory *factory;
 
   GtkStringList *unique_ids;
+  /* the same ids as above, for cheap membership checks */
+  GHashTable    *unique_id_set;
+  /* ids listed by a warm-start snapshot whose entries haven't been
+     added yet */
+  GHashTable    *snapshot_ids;
+  /* developer, the accent colors, remote_repos_string and eol are
+     interned GRefStrings shared with the entries */
   char          *id;
   char          *title;
   char          *developer;
@@ -63,6 +71,7 @@ struct _BzEntryGroup
   int removable_available;
 
   guint64 user_data_size;
+  gint64  user_data_size_time;
 
   DexFuture *user_data_size_future;
   DexFuture *reap_user_data_future;
@@ -108,6 +117,15 @@ enum
 };
 static GParamSpec *props[LAST_PROP] = { 0 };
 
+/* Mutations record which properties they touched in a bitmask while
+   holding the lock, and only notify once it has been released */
+G_STATIC_ASSERT (LAST_PROP <= 64);
+#define PROP_MASK(prop) (G_GUINT64_CONSTANT (1) << (prop))
+
+/* Everything bound to the size reads it again when it changes, which
+   shouldn't start another walk right after one finished */
+#define USER_DATA_SIZE_TTL (10 * G_USEC_PER_SEC)
+
 static void
 installed_changed (BzEntryGroup *self,
                    GParamSpec   *pspec,
@@ -121,6 +139,10 @@ holding_changed (BzEntryGroup *self,
 static DexFuture *
 dup_all_into_store_fiber (BzEntryGroup *self);
 
+static DexFuture *
+user_data_size_peeked (DexFuture *future,
+                       GWeakRef  *wr);
+
 static DexFuture *
 user_data_size_then (DexFuture *future,
                      GWeakRef  *wr);
@@ -128,6 +150,10 @@ user_data_size_then (DexFuture *future,
 static void
 check_user_data_size (BzEntryGroup *self);
 
+static void
+notify_changed (BzEntryGroup *self,
+                guint64       changed);
+
 static void
 bz_entry_group_dispose (GObject *object)
 {
@@ -137,17 +163,19 @@ bz_entry_group_dispose (GObject *object)
   dex_clear (&self->reap_user_data_future);
   g_clear_object (&self->factory);
   g_clear_object (&self->unique_ids);
+  g_clear_pointer (&self->unique_id_set, g_hash_table_unref);
+  g_clear_pointer (&self->snapshot_ids, g_hash_table_unref);
   g_clear_pointer (&self->id, g_free);
   g_clear_pointer (&self->title, g_free);
-  g_clear_pointer (&self->developer, g_free);
+  g_clear_pointer (&self->developer, g_ref_string_release);
   g_clear_pointer (&self->description, g_free);
-  g_clear_pointer (&self->light_accent_color, g_free);
-  g_clear_pointer (&self->dark_accent_color, g_free);
+  g_clear_pointer (&self->light_accent_color, g_ref_string_release);
+  g_clear_pointer (&self->dark_accent_color, g_ref_string_release);
   g_clear_object (&self->icon_paintable);
   g_clear_object (&self->mini_icon);
   g_clear_pointer (&self->search_tokens, g_free);
-  g_clear_pointer (&self->remote_repos_string, g_free);
-  g_clear_pointer (&self->eol, g_free);
+  g_clear_pointer (&self->remote_repos_string, g_ref_string_release);
+  g_clear_pointer (&self->eol, g_ref_string_release);
   g_clear_pointer (&self->donation_url, g_free);
 
   g_weak_ref_clear (&self->ui_entry);
@@ -156,6 +184,14 @@ bz_entry_group_dispose (GObject *object)
   G_OBJECT_CLASS (bz_entry_group_parent_class)->dispose (object);
 }
 
+static void
+bz_entry_group_finalize (GObject *object)
+{
+  bz_trace_counter_add (BZ_TRACE_COUNTER_LIVE_GROUPS, -1);
+
+  G_OBJECT_CLASS (bz_entry_group_parent_class)->finalize (object);
+}
+
 static void
 bz_entry_group_get_property (GObject    *object,
                              guint       prop_id,
@@ -295,6 +331,7 @@ bz_entry_group_class_init (BzEntryGroupClass *klass)
   object_class->set_property = bz_entry_group_set_property;
   object_class->get_property = bz_entry_group_get_property;
   object_class->dispose      = bz_entry_group_dispose;
+  object_class->finalize     = bz_entry_group_finalize;
 
   props[PROP_MODEL] =
       g_param_spec_object (
@@ -472,9 +509,12 @@ static void
 bz_entry_group_init (BzEntryGroup *self)
 {
   self->unique_ids     = gtk_string_list_new (NULL);
+  self->unique_id_set  = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
   self->max_usefulness = -1;
   g_weak_ref_init (&self->ui_entry, NULL);
   g_mutex_init (&self->mutex);
+
+  bz_trace_counter_add (BZ_TRACE_COUNTER_LIVE_GROUPS, 1);
 }
 
 BzEntryGroup *
@@ -490,6 +530,199 @@ bz_entry_group_new (BzApplicationMapFactory *factory)
   return group;
 }
 
+BzEntryGroup *
+bz_entry_group_new_from_snapshot (BzApplicationMapFactory *factory,
+                                  GVariant                *snapshot)
+{
+  g_autoptr (BzEntryGroup) group  = NULL;
+  guchar      version             = 0;
+  const char *developer           = NULL;
+  const char *light_accent_color  = NULL;
+  const char *dark_accent_color   = NULL;
+  const char *remote_repos_string = NULL;
+  const char *eol                 = NULL;
+  g_autoptr (GVariant) icon       = NULL;
+  g_autoptr (GVariant) mini_icon  = NULL;
+  g_autofree const char **ids     = NULL;
+
+  g_return_val_if_fail (BZ_IS_APPLICATION_MAP_FACTORY (factory), NULL);
+  g_return_val_if_fail (snapshot != NULL, NULL);
+
+  /* The snapshot comes from disk, anything that doesn't match the layout
+     is skipped rather than read */
+  if (!g_variant_is_of_type (snapshot, G_VARIANT_TYPE (BZ_ENTRY_GROUP_SNAPSHOT_TYPE)))
+    return NULL;
+  g_variant_get_child (snapshot, 0, "y", &version);
+  if (version != BZ_ENTRY_GROUP_SNAPSHOT_VERSION)
+    return NULL;
+
+  group               = bz_entry_group_new (factory);
+  group->snapshot_ids = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
+  g_variant_get (
+      snapshot,
+      "(ysmsm&sms"
+      "msm&sm&sm&sm&sms"
+      "bbbti(iiiiii)"
+      "m@(sms)mv^a&s)",
+      NULL,
+      &group->id,
+      &group->title,
+      &developer,
+      &group->description,
+      &group->search_tokens,
+      &light_accent_color,
+      &dark_accent_color,
+      &remote_repos_string,
+      &eol,
+      &group->donation_url,
+      &group->is_floss,
+      &group->is_flathub,
+      &group->is_verified,
+      &group->size,
+      &group->n_addons,
+      &group->installable,
+      &group->updatable,
+      &group->removable,
+      &group->installable_available,
+      &group->updatable_available,
+      &group->removable_available,
+      &icon,
+      &mini_icon,
+      &ids);
+
+#define INTERN(field, string) \
+  if ((string) != NULL)       \
+    (field) = g_ref_string_new_intern ((string));
+
+  INTERN (group->developer, developer);
+  INTERN (group->light_accent_color, light_accent_color);
+  INTERN (group->dark_accent_color, dark_accent_color);
+  INTERN (group->remote_repos_string, remote_repos_string);
+  INTERN (group->eol, eol);
+
+#undef INTERN
+
+  if (icon != NULL)
+    {
+      const char *source                = NULL;
+      const char *cache_into            = NULL;
+      g_autoptr (GFile) source_file     = NULL;
+      g_autoptr (GFile) cache_into_file = NULL;
+
+      g_variant_get (icon, "(&sm&s)", &source, &cache_into);
+      source_file = g_file_new_for_uri (source);
+      if (cache_into != NULL)
+        cache_into_file = g_file_new_for_path (cache_into);
+      group->icon_paintable = GDK_PAINTABLE (bz_async_texture_new_lazy (source_file, cache_into_file));
+    }
+
+  if (mini_icon != NULL)
+    group->mini_icon = g_icon_deserialize (mini_icon);
+
+  gtk_string_list_splice (group->unique_ids, 0, 0, ids);
+  for (guint i = 0; ids[i] != NULL; i++)
+    g_hash_table_add (group->snapshot_ids, g_strdup (ids[i]));
+
+  if (g_hash_table_size (group->snapshot_ids) == 0)
+    return NULL;
+
+  return g_steal_pointer (&group);
+}
+
+gboolean
+bz_entry_group_prune_snapshot (BzEntryGroup *self)
+{
+  g_autoptr (GMutexLocker) locker = NULL;
+  GHashTableIter iter             = { 0 };
+  const char    *unique_id        = NULL;
+
+  g_return_val_if_fail (BZ_IS_ENTRY_GROUP (self), FALSE);
+
+  locker = g_mutex_locker_new (&self->mutex);
+  if (self->snapshot_ids == NULL)
+    return TRUE;
+
+  /* Whatever the snapshot listed that the catalog never sent is gone
+     from the remote */
+  g_hash_table_iter_init (&iter, self->snapshot_ids);
+  while (g_hash_table_iter_next (&iter, (gpointer *) &unique_id, NULL))
+    {
+      guint position = 0;
+
+      position = gtk_string_list_find (self->unique_ids, unique_id);
+      if (position != G_MAXUINT)
+        gtk_string_list_remove (self->unique_ids, position);
+    }
+  g_clear_pointer (&self->snapshot_ids, g_hash_table_unref);
+
+  return g_hash_table_size (self->unique_id_set) > 0;
+}
+
+GVariant *
+bz_entry_group_snapshot (BzEntryGroup *self)
+{
+  g_autoptr (GMutexLocker) locker = NULL;
+  g_autoptr (GVariant) icon       = NULL;
+  g_autoptr (GVariant) mini_icon  = NULL;
+  guint n_ids                     = 0;
+  g_autoptr (GStrvBuilder) ids    = NULL;
+  g_auto (GStrv) strv             = NULL;
+
+  g_return_val_if_fail (BZ_IS_ENTRY_GROUP (self), NULL);
+
+  locker = g_mutex_locker_new (&self->mutex);
+  if (self->id == NULL)
+    return NULL;
+
+  if (BZ_IS_ASYNC_TEXTURE (self->icon_paintable))
+    icon = g_variant_ref_sink (g_variant_new (
+        "(sms)",
+        bz_async_texture_get_source_uri (BZ_ASYNC_TEXTURE (self->icon_paintable)),
+        bz_async_texture_get_cache_into_path (BZ_ASYNC_TEXTURE (self->icon_paintable))));
+  if (self->mini_icon != NULL)
+    mini_icon = g_icon_serialize (self->mini_icon);
+
+  ids   = g_strv_builder_new ();
+  n_ids = g_list_model_get_n_items (G_LIST_MODEL (self->unique_ids));
+  for (guint i = 0; i < n_ids; i++)
+    g_strv_builder_add (ids, gtk_string_list_get_string (self->unique_ids, i));
+  strv = g_strv_builder_end (ids);
+
+  /* Maybe types around containers are passed whole, hence the '@' that
+     BZ_ENTRY_GROUP_SNAPSHOT_TYPE doesn't spell out */
+  return g_variant_new (
+      "(ysmsmsms"
+      "msmsmsmsmsms"
+      "bbbti(iiiiii)"
+      "m@(sms)mv^as)",
+      (guchar) BZ_ENTRY_GROUP_SNAPSHOT_VERSION,
+      self->id,
+      self->title,
+      self->developer,
+      self->description,
+      self->search_tokens,
+      self->light_accent_color,
+      self->dark_accent_color,
+      self->remote_repos_string,
+      self->eol,
+      self->donation_url,
+      self->is_floss,
+      self->is_flathub,
+      self->is_verified,
+      self->size,
+      self->n_addons,
+      self->installable,
+      self->updatable,
+      self->removable,
+      self->installable_available,
+      self->updatable_available,
+      self->removable_available,
+      icon,
+      mini_icon,
+      strv);
+}
+
 GMutexLocker *
 bz_entry_group_lock (BzEntryGroup *self)
 {
@@ -732,7 +965,9 @@ bz_entry_group_add (BzEntryGroup *self,
   GListModel   *addons             = NULL;
   int           n_addons           = 0;
   const char   *donation_url       = NULL;
-  guint         existing           = 0;
+  gboolean      existing           = FALSE;
+  gboolean      listed             = FALSE;
+  guint64       changed            = 0;
 
   g_return_if_fail (BZ_IS_ENTRY_GROUP (self));
   g_return_if_fail (BZ_IS_ENTRY (entry));
@@ -743,7 +978,7 @@ bz_entry_group_add (BzEntryGroup *self,
   if (self->id == NULL)
     {
       self->id = g_strdup (bz_entry_get_id (entry));
-      g_object_notify_by_pspec (G_OBJECT (self), props[PROP_ID]);
+      changed |= PROP_MASK (PROP_ID);
     }
   unique_id = bz_entry_get_unique_id (entry);
 
@@ -755,13 +990,13 @@ bz_entry_group_add (BzEntryGroup *self,
       if (eol == NULL && runtime != NULL)
         eol = bz_entry_get_eol (runtime);
 
-      g_clear_pointer (&self->eol, g_free);
+      g_clear_pointer (&self->eol, g_ref_string_release);
       if (eol != NULL)
-        self->eol = g_strdup (eol);
+        self->eol = g_ref_string_new_intern (eol);
       else
         self->has_non_eol = TRUE;
 
-      g_object_notify_by_pspec (G_OBJECT (self), props[PROP_EOL]);
+      changed |= PROP_MASK (PROP_EOL);
     }
 
   title              = bz_entry_get_title (entry);
@@ -783,31 +1018,58 @@ bz_entry_group_add (BzEntryGroup *self,
     n_addons = g_list_model_get_n_items (addons);
 
   usefulness = bz_entry_calc_usefulness (entry);
-  existing   = gtk_string_list_find (self->unique_ids, unique_id);
+  existing   = g_hash_table_contains (self->unique_id_set, unique_id);
+  listed     = existing;
+
+  if (!existing && self->snapshot_ids != NULL)
+    {
+      /* The first real entry replaces the snapshot's counts, the rest
+         are rebuilt as the remaining entries arrive */
+      if (g_hash_table_size (self->unique_id_set) == 0)
+        {
+          self->installable           = 0;
+          self->updatable             = 0;
+          self->removable             = 0;
+          self->installable_available = 0;
+          self->updatable_available   = 0;
+          self->removable_available   = 0;
+          changed |= PROP_MASK (PROP_INSTALLABLE) | PROP_MASK (PROP_UPDATABLE) |
+                     PROP_MASK (PROP_REMOVABLE) | PROP_MASK (PROP_INSTALLABLE_AND_AVAILABLE) |
+                     PROP_MASK (PROP_UPDATABLE_AND_AVAILABLE) | PROP_MASK (PROP_REMOVABLE_AND_AVAILABLE);
+        }
+
+      listed = g_hash_table_remove (self->snapshot_ids, unique_id);
+      if (g_hash_table_size (self->snapshot_ids) == 0)
+        g_clear_pointer (&self->snapshot_ids, g_hash_table_unref);
+    }
 
   if (usefulness >= self->max_usefulness)
     {
-      if (existing != G_MAXUINT)
-        gtk_string_list_remove (self->unique_ids, existing);
+      /* Scanning for the position is only needed when an already
+         known entry got more useful, which is rare */
+      if (listed)
+        gtk_string_list_remove (
+            self->unique_ids,
+            gtk_string_list_find (self->unique_ids, unique_id));
       gtk_string_list_splice (self->unique_ids, 0, 0, (const char *const[]) { unique_id, NULL });
 
       if (title != NULL)
         {
           g_clear_pointer (&self->title, g_free);
           self->title = g_strdup (title);
-          g_object_notify_by_pspec (G_OBJECT (self), props[PROP_TITLE]);
+          changed |= PROP_MASK (PROP_TITLE);
         }
       if (developer != NULL)
         {
-          g_clear_pointer (&self->developer, g_free);
-          self->developer = g_strdup (developer);
-          g_object_notify_by_pspec (G_OBJECT (self), props[PROP_DEVELOPER]);
+          g_clear_pointer (&self->developer, g_ref_string_release);
+          self->developer = g_ref_string_new_intern (developer);
+          changed |= PROP_MASK (PROP_DEVELOPER);
         }
       if (description != NULL)
         {
           g_clear_pointer (&self->description, g_free);
           self->description = g_strdup (description);
-          g_object_notify_by_pspec (G_OBJECT (self), props[PROP_DESCRIPTION]);
+          changed |= PROP_MASK (PROP_DESCRIPTION);
         }
       /* only grab icon paintable if we don't have it already to reduce
          flickering in UI */
@@ -819,127 +1081,129 @@ bz_entry_group_add (BzEntryGroup *self,
         {
           g_clear_object (&self->icon_paintable);
           self->icon_paintable = g_object_ref (icon_paintable);
-          g_object_notify_by_pspec (G_OBJECT (self), props[PROP_ICON_PAINTABLE]);
+          changed |= PROP_MASK (PROP_ICON_PAINTABLE);
         }
       if (mini_icon != NULL)
         {
           g_clear_object (&self->mini_icon);
           self->mini_icon = g_object_ref (mini_icon);
-          g_object_notify_by_pspec (G_OBJECT (self), props[PROP_MINI_ICON]);
+          changed |= PROP_MASK (PROP_MINI_ICON);
         }
       if (search_tokens != NULL)
         {
           g_clear_pointer (&self->search_tokens, g_free);
           self->search_tokens = g_strdup (search_tokens);
-          g_object_notify_by_pspec (G_OBJECT (self), props[PROP_SEARCH_TOKENS]);
+          changed |= PROP_MASK (PROP_SEARCH_TOKENS);
         }
       if (!!is_floss != !!self->is_floss)
         {
           self->is_floss = is_floss;
-          g_object_notify_by_pspec (G_OBJECT (self), props[PROP_IS_FLOSS]);
+          changed |= PROP_MASK (PROP_IS_FLOSS);
         }
       if (light_accent_color != NULL)
         {
-          g_clear_pointer (&self->light_accent_color, g_free);
-          self->light_accent_color = g_strdup (light_accent_color);
-          g_object_notify_by_pspec (G_OBJECT (self), props[PROP_LIGHT_ACCENT_COLOR]);
+          g_clear_pointer (&self->light_accent_color, g_ref_string_release);
+          self->light_accent_color = g_ref_string_new_intern (light_accent_color);
+          changed |= PROP_MASK (PROP_LIGHT_ACCENT_COLOR);
         }
       if (dark_accent_color != NULL)
         {
-          g_clear_pointer (&self->dark_accent_color, g_free);
-          self->dark_accent_color = g_strdup (dark_accent_color);
-          g_object_notify_by_pspec (G_OBJECT (self), props[PROP_DARK_ACCENT_COLOR]);
+          g_clear_pointer (&self->dark_accent_color, g_ref_string_release);
+          self->dark_accent_color = g_ref_string_new_intern (dark_accent_color);
+          changed |= PROP_MASK (PROP_DARK_ACCENT_COLOR);
         }
       if (!!is_flathub != !!self->is_flathub)
         {
           self->is_flathub = is_flathub;
-          g_object_notify_by_pspec (G_OBJECT (self), props[PROP_IS_FLATHUB]);
+          changed |= PROP_MASK (PROP_IS_FLATHUB);
         }
       if (!!is_verified != !!self->is_verified)
         {
           self->is_verified = is_verified;
-          g_object_notify_by_pspec (G_OBJECT (self), props[PROP_IS_VERIFIED]);
+          changed |= PROP_MASK (PROP_IS_VERIFIED);
         }
       if (size != self->size)
         {
           self->size = size;
-          g_object_notify_by_pspec (G_OBJECT (self), props[PROP_SIZE]);
+          changed |= PROP_MASK (PROP_SIZE);
         }
       if (n_addons != self->n_addons)
         {
           self->n_addons = n_addons;
-          g_object_notify_by_pspec (G_OBJECT (self), props[PROP_N_ADDONS]);
+          changed |= PROP_MASK (PROP_N_ADDONS);
         }
       if (donation_url != NULL)
         {
           g_clear_pointer (&self->donation_url, g_free);
           self->donation_url = g_strdup (donation_url);
-          g_object_notify_by_pspec (G_OBJECT (self), props[PROP_DONATION_URL]);
+          changed |= PROP_MASK (PROP_DONATION_URL);
         }
 
       self->max_usefulness = usefulness;
     }
   else
     {
-      if (existing == G_MAXUINT)
+      if (!listed)
         gtk_string_list_append (self->unique_ids, unique_id);
 
       if (title != NULL && self->title == NULL)
         {
           self->title = g_strdup (title);
-          g_object_notify_by_pspec (G_OBJECT (self), props[PROP_TITLE]);
+          changed |= PROP_MASK (PROP_TITLE);
         }
       if (developer != NULL && self->developer == NULL)
         {
-          self->developer = g_strdup (developer);
-          g_object_notify_by_pspec (G_OBJECT (self), props[PROP_DEVELOPER]);
+          self->developer = g_ref_string_new_intern (developer);
+          changed |= PROP_MASK (PROP_DEVELOPER);
         }
       if (description != NULL && self->description == NULL)
         {
           self->description = g_strdup (description);
-          g_object_notify_by_pspec (G_OBJECT (self), props[PROP_DESCRIPTION]);
+          changed |= PROP_MASK (PROP_DESCRIPTION);
         }
       if (icon_paintable != NULL && self->icon_paintable == NULL)
         {
           self->icon_paintable = g_object_ref (icon_paintable);
-          g_object_notify_by_pspec (G_OBJECT (self), props[PROP_ICON_PAINTABLE]);
+          changed |= PROP_MASK (PROP_ICON_PAINTABLE);
         }
       if (mini_icon != NULL && self->mini_icon == NULL)
         {
           self->mini_icon = g_object_ref (mini_icon);
-          g_object_notify_by_pspec (G_OBJECT (self), props[PROP_MINI_ICON]);
+          changed |= PROP_MASK (PROP_MINI_ICON);
         }
       if (search_tokens != NULL && self->search_tokens == NULL)
         {
           self->search_tokens = g_strdup (search_tokens);
-          g_object_notify_by_pspec (G_OBJECT (self), props[PROP_SEARCH_TOKENS]);
+          changed |= PROP_MASK (PROP_SEARCH_TOKENS);
         }
       if (light_accent_color != NULL && self->light_accent_color == NULL)
         {
-          self->light_accent_color = g_strdup (light_accent_color);
-          g_object_notify_by_pspec (G_OBJECT (self), props[PROP_LIGHT_ACCENT_COLOR]);
+          self->light_accent_color = g_ref_string_new_intern (light_accent_color);
+          changed |= PROP_MASK (PROP_LIGHT_ACCENT_COLOR);
         }
       if (dark_accent_color != NULL && self->dark_accent_color == NULL)
         {
-          self->dark_accent_color = g_strdup (dark_accent_color);
-          g_object_notify_by_pspec (G_OBJECT (self), props[PROP_DARK_ACCENT_COLOR]);
+          self->dark_accent_color = g_ref_string_new_intern (dark_accent_color);
+          changed |= PROP_MASK (PROP_DARK_ACCENT_COLOR);
         }
       if (size > 0 && self->size == 0)
         {
           self->size = size;
-          g_object_notify_by_pspec (G_OBJECT (self), props[PROP_SIZE]);
+          changed |= PROP_MASK (PROP_SIZE);
         }
       if (donation_url != NULL && self->donation_url == NULL)
         {
           self->donation_url = g_strdup (donation_url);
-          g_object_notify_by_pspec (G_OBJECT (self), props[PROP_DONATION_URL]);
+          changed |= PROP_MASK (PROP_DONATION_URL);
         }
     }
 
-  if (existing == G_MAXUINT)
+  if (!existing)
     {
       const char *remote_repo = NULL;
 
+      g_hash_table_add (self->unique_id_set, g_strdup (unique_id));
+
       remote_repo = bz_entry_get_remote_repo_name (entry);
       if (remote_repo != NULL)
         {
@@ -957,16 +1221,17 @@ bz_entry_group_add (BzEntryGroup *self,
 
           if (self->remote_repos_string != NULL)
             {
-              g_autofree char *old_string = NULL;
+              g_autofree char *new_string = NULL;
               if (strstr (self->remote_repos_string, capitalized_repo) == NULL)
                 {
-                  old_string                = g_steal_pointer (&self->remote_repos_string);
-                  self->remote_repos_string = g_strdup_printf ("%s • %s", old_string, capitalized_repo);
+                  new_string = g_strdup_printf ("%s • %s", self->remote_repos_string, capitalized_repo);
+                  g_clear_pointer (&self->remote_repos_string, g_ref_string_release);
+                  self->remote_repos_string = g_ref_string_new_intern (new_string);
                 }
             }
           else
             {
-              self->remote_repos_string = g_strdup (capitalized_repo);
+              self->remote_repos_string = g_ref_string_new_intern (capitalized_repo);
             }
         }
 
@@ -976,9 +1241,9 @@ bz_entry_group_add (BzEntryGroup *self,
           if (!bz_entry_is_holding (entry))
             {
               self->removable_available++;
-              g_object_notify_by_pspec (G_OBJECT (self), props[PROP_REMOVABLE_AND_AVAILABLE]);
+              changed |= PROP_MASK (PROP_REMOVABLE_AND_AVAILABLE);
             }
-          g_object_notify_by_pspec (G_OBJECT (self), props[PROP_REMOVABLE]);
+          changed |= PROP_MASK (PROP_REMOVABLE);
         }
       else
         {
@@ -986,11 +1251,14 @@ bz_entry_group_add (BzEntryGroup *self,
           if (!bz_entry_is_holding (entry))
             {
               self->installable_available++;
-              g_object_notify_by_pspec (G_OBJECT (self), props[PROP_INSTALLABLE_AND_AVAILABLE]);
+              changed |= PROP_MASK (PROP_INSTALLABLE_AND_AVAILABLE);
             }
-          g_object_notify_by_pspec (G_OBJECT (self), props[PROP_INSTALLABLE]);
+          changed |= PROP_MASK (PROP_INSTALLABLE);
         }
     }
+
+  g_clear_pointer (&locker, g_mutex_locker_free);
+  notify_changed (self, changed);
 }
 
 void
@@ -1032,6 +1300,7 @@ installed_changed (BzEntryGroup *self,
                    BzEntry      *entry)
 {
   g_autoptr (GMutexLocker) locker = NULL;
+  guint64 changed                 = 0;
 
   locker = g_mutex_locker_new (&self->mutex);
 
@@ -1043,11 +1312,11 @@ installed_changed (BzEntryGroup *self,
         {
           self->installable_available--;
           self->removable_available++;
-          g_object_notify_by_pspec (G_OBJECT (self), props[PROP_INSTALLABLE_AND_AVAILABLE]);
-          g_object_notify_by_pspec (G_OBJECT (self), props[PROP_REMOVABLE_AND_AVAILABLE]);
+          changed |= PROP_MASK (PROP_INSTALLABLE_AND_AVAILABLE);
+          changed |= PROP_MASK (PROP_REMOVABLE_AND_AVAILABLE);
         }
-      g_object_notify_by_pspec (G_OBJECT (self), props[PROP_INSTALLABLE]);
-      g_object_notify_by_pspec (G_OBJECT (self), props[PROP_REMOVABLE]);
+      changed |= PROP_MASK (PROP_INSTALLABLE);
+      changed |= PROP_MASK (PROP_REMOVABLE);
     }
   else
     {
@@ -1057,16 +1326,20 @@ installed_changed (BzEntryGroup *self,
         {
           self->removable_available--;
           self->installable_available++;
-          g_object_notify_by_pspec (G_OBJECT (self), props[PROP_REMOVABLE_AND_AVAILABLE]);
-          g_object_notify_by_pspec (G_OBJECT (self), props[PROP_INSTALLABLE_AND_AVAILABLE]);
+          changed |= PROP_MASK (PROP_REMOVABLE_AND_AVAILABLE);
+          changed |= PROP_MASK (PROP_INSTALLABLE_AND_AVAILABLE);
         }
-      g_object_notify_by_pspec (G_OBJECT (self), props[PROP_REMOVABLE]);
-      g_object_notify_by_pspec (G_OBJECT (self), props[PROP_INSTALLABLE]);
+      changed |= PROP_MASK (PROP_REMOVABLE);
+      changed |= PROP_MASK (PROP_INSTALLABLE);
     }
 
   dex_clear (&self->user_data_size_future);
-  self->user_data_size = 0;
-  g_object_notify_by_pspec (G_OBJECT (self), props[PROP_USER_DATA_SIZE]);
+  self->user_data_size      = 0;
+  self->user_data_size_time = 0;
+  changed |= PROP_MASK (PROP_USER_DATA_SIZE);
+
+  g_clear_pointer (&locker, g_mutex_locker_free);
+  notify_changed (self, changed);
 }
 
 static void
@@ -1075,6 +1348,7 @@ holding_changed (BzEntryGroup *self,
                  BzEntry      *entry)
 {
   g_autoptr (GMutexLocker) locker = NULL;
+  guint64 changed                 = 0;
 
   locker = g_mutex_locker_new (&self->mutex);
 
@@ -1093,8 +1367,11 @@ holding_changed (BzEntryGroup *self,
         self->installable_available++;
     }
 
-  g_object_notify_by_pspec (G_OBJECT (self), props[PROP_REMOVABLE_AND_AVAILABLE]);
-  g_object_notify_by_pspec (G_OBJECT (self), props[PROP_INSTALLABLE_AND_AVAILABLE]);
+  changed |= PROP_MASK (PROP_REMOVABLE_AND_AVAILABLE);
+  changed |= PROP_MASK (PROP_INSTALLABLE_AND_AVAILABLE);
+
+  g_clear_pointer (&locker, g_mutex_locker_free);
+  notify_changed (self, changed);
 }
 
 static DexFuture *
@@ -1155,6 +1432,24 @@ dup_all_into_store_fiber (BzEntryGroup *self)
   return dex_future_new_for_object (store);
 }
 
+static void
+notify_changed (BzEntryGroup *self,
+                guint64       changed)
+{
+  if (changed == 0)
+    return;
+
+  /* Handlers see every change at once and may freely call back into
+     the group, since the lock isn't held anymore */
+  g_object_freeze_notify (G_OBJECT (self));
+  for (guint i = 1; i < LAST_PROP; i++)
+    {
+      if (changed & PROP_MASK (i))
+        g_object_notify_by_pspec (G_OBJECT (self), props[i]);
+    }
+  g_object_thaw_notify (G_OBJECT (self));
+}
+
 static DexFuture *
 reap_user_data_then (DexFuture *future,
                      GWeakRef  *wr)
@@ -1190,6 +1485,26 @@ bz_entry_group_reap_user_data (BzEntryGroup *self)
       bz_weak_release);
 }
 
+static DexFuture *
+user_data_size_peeked (DexFuture *future,
+                       GWeakRef  *wr)
+{
+  g_autoptr (BzEntryGroup) self = NULL;
+  guint64 size                  = 0;
+
+  bz_weak_get_or_return_reject (self, wr);
+
+  /* Nothing known yet just means waiting for the walk */
+  size = dex_await_uint64 (dex_ref (future), NULL);
+  if (size != 0 && self->user_data_size == 0)
+    {
+      self->user_data_size = size;
+      g_object_notify_by_pspec (G_OBJECT (self), props[PROP_USER_DATA_SIZE]);
+    }
+
+  return bz_get_user_data_size_dex (self->id);
+}
+
 static DexFuture *
 user_data_size_then (DexFuture *future,
                      GWeakRef  *wr)
@@ -1206,8 +1521,9 @@ user_data_size_then (DexFuture *future,
   if (error != NULL)
     size = 0;
 
-  old_size             = self->user_data_size;
-  self->user_data_size = size;
+  old_size                  = self->user_data_size;
+  self->user_data_size      = size;
+  self->user_data_size_time = g_get_monotonic_time ();
 
   if (old_size != size)
     g_object_notify_by_pspec (G_OBJECT (self), props[PROP_USER_DATA_SIZE]);
@@ -1227,7 +1543,17 @@ check_user_data_size (BzEntryGroup *self)
   if (self->reap_user_data_future != NULL)
     return;
 
-  future = bz_get_user_data_size_dex (self->id);
+  if (self->user_data_size_time != 0 &&
+      g_get_monotonic_time () - self->user_data_size_time < USER_DATA_SIZE_TTL)
+    return;
+
+  /* Show the last known size as soon as it is read, the walk after it
+     will correct it if anything changed */
+  future = bz_peek_user_data_size_dex (self->id);
+  future = dex_future_finally (
+      future,
+      (DexFutureCallback) user_data_size_peeked,
+      bz_track_weak (self), bz_weak_release);
   future = dex_future_then (
       future,
       (DexFutureCallback) user_data_size_then,
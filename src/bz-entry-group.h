@@ -32,6 +32,40 @@ G_DECLARE_FINAL_TYPE (BzEntryGroup, bz_entry_group, BZ, ENTRY_GROUP, GObject)
 BzEntryGroup *
 bz_entry_group_new (BzApplicationMapFactory *factory);
 
+/* Catalog snapshots hold one of these per group. The layout is fixed so
+   key names aren't repeated for every group and fields are reached by
+   offset straight out of the mapped file. */
+#define BZ_ENTRY_GROUP_SNAPSHOT_VERSION 1
+#define BZ_ENTRY_GROUP_SNAPSHOT_TYPE                                     \
+  "(y"                                                                   \
+  "s"                    /* id */                                        \
+  "msmsmsmsmsmsmsmsms"   /* title, developer, description,               \
+                            search-tokens, light-accent-color,           \
+                            dark-accent-color, remote-repos-string, eol, \
+                            donation-url */                              \
+  "bbb"                  /* is-floss, is-flathub, is-verified */         \
+  "t"                    /* size */                                      \
+  "i"                    /* n-addons */                                  \
+  "(iiiiii)"             /* installable, updatable, removable and their  \
+                            available counterparts */                    \
+  "m(sms)"               /* icon source uri, icon cache path */          \
+  "mv"                   /* serialized mini-icon */                      \
+  "as"                   /* unique-ids */                                \
+  ")"
+
+BzEntryGroup *
+bz_entry_group_new_from_snapshot (BzApplicationMapFactory *factory,
+                                  GVariant                *snapshot);
+
+/* NULL until the group has an id */
+GVariant *
+bz_entry_group_snapshot (BzEntryGroup *self);
+
+/* Forgets snapshot ids the catalog never confirmed, returns FALSE if
+   nothing is left backing the group */
+gboolean
+bz_entry_group_prune_snapshot (BzEntryGroup *self);
+
 /* Only necessary if reading props from another thread, writing is always
    prohibited */
 GMutexLocker *
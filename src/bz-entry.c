@@ -35,6 +35,7 @@
 #include "bz-issue.h"
 #include "bz-release.h"
 #include "bz-serializable.h"
+#include "bz-trace.h"
 #include "bz-url.h"
 #include "bz-util.h"
 #include "bz-verification-status.h"
@@ -67,6 +68,9 @@ G_DEFINE_ENUM_TYPE (
     G_DEFINE_ENUM_VALUE (BZ_RELATION_RECOMMENDS, "recommends"),
     G_DEFINE_ENUM_VALUE (BZ_RELATION_SUPPORTS, "supports"))
 
+/* eol, remote_repo_name, the licenses, project_group, developer,
+   developer_id and the accent colors repeat across thousands of entries,
+   so they are interned GRefStrings rather than private copies */
 typedef struct
 {
   gint     hold;
@@ -228,9 +232,50 @@ maybe_save_paintable (BzEntryPrivate  *priv,
                       GdkPaintable    *paintable,
                       GVariantBuilder *builder);
 
+static GVariant *
+save_paintable (BzEntryPrivate *priv,
+                GdkPaintable   *paintable);
+
 static GdkPaintable *
 make_async_texture (GVariant *parse);
 
+static GVariant *
+strings_to_variant (GListModel *model);
+
+static GVariant *
+paintables_to_variant (BzEntryPrivate *priv,
+                       GListModel     *model);
+
+static GVariant *
+urls_to_variant (GListModel *model);
+
+static GVariant *
+releases_to_variant (GListModel *model);
+
+static GVariant *
+content_rating_to_variant (AsContentRating *rating);
+
+static char *
+next_interned (GVariantIter *iter);
+
+static GdkPaintable *
+next_paintable (GVariantIter *iter);
+
+static GListModel *
+next_strings (GVariantIter *iter);
+
+static GListModel *
+next_paintables (GVariantIter *iter);
+
+static GListModel *
+next_urls (GVariantIter *iter);
+
+static GListModel *
+next_releases (GVariantIter *iter);
+
+static AsContentRating *
+next_content_rating (GVariantIter *iter);
+
 static DexFuture *
 icon_paintable_future_then (DexFuture *future,
                             GWeakRef  *wr);
@@ -268,6 +313,14 @@ bz_entry_dispose (GObject *object)
   G_OBJECT_CLASS (bz_entry_parent_class)->dispose (object);
 }
 
+static void
+bz_entry_finalize (GObject *object)
+{
+  bz_trace_counter_add (BZ_TRACE_COUNTER_LIVE_ENTRIES, -1);
+
+  G_OBJECT_CLASS (bz_entry_parent_class)->finalize (object);
+}
+
 static void
 bz_entry_get_property (GObject    *object,
                        guint       prop_id,
@@ -483,8 +536,8 @@ bz_entry_set_property (GObject      *object,
       priv->title = g_value_dup_string (value);
       break;
     case PROP_EOL:
-      g_clear_pointer (&priv->eol, g_free);
-      priv->eol = g_value_dup_string (value);
+      g_clear_pointer (&priv->eol, g_ref_string_release);
+      priv->eol = bz_maybe_intern (g_value_get_string (value));
       break;
     case PROP_DESCRIPTION:
       g_clear_pointer (&priv->description, g_free);
@@ -495,8 +548,8 @@ bz_entry_set_property (GObject      *object,
       priv->long_description = g_value_dup_string (value);
       break;
     case PROP_REMOTE_REPO_NAME:
-      g_clear_pointer (&priv->remote_repo_name, g_free);
-      priv->remote_repo_name = g_value_dup_string (value);
+      g_clear_pointer (&priv->remote_repo_name, g_ref_string_release);
+      priv->remote_repo_name = bz_maybe_intern (g_value_get_string (value));
       priv->is_flathub       = g_strcmp0 (priv->remote_repo_name, "flathub") == 0;
       g_object_notify_by_pspec (object, props[PROP_IS_FLATHUB]);
       break;
@@ -524,27 +577,27 @@ bz_entry_set_property (GObject      *object,
       priv->remote_repo_icon = g_value_dup_object (value);
       break;
     case PROP_METADATA_LICENSE:
-      g_clear_pointer (&priv->metadata_license, g_free);
-      priv->metadata_license = g_value_dup_string (value);
+      g_clear_pointer (&priv->metadata_license, g_ref_string_release);
+      priv->metadata_license = bz_maybe_intern (g_value_get_string (value));
       break;
     case PROP_PROJECT_LICENSE:
-      g_clear_pointer (&priv->project_license, g_free);
-      priv->project_license = g_value_dup_string (value);
+      g_clear_pointer (&priv->project_license, g_ref_string_release);
+      priv->project_license = bz_maybe_intern (g_value_get_string (value));
       break;
     case PROP_IS_FLOSS:
       priv->is_floss = g_value_get_boolean (value);
       break;
     case PROP_PROJECT_GROUP:
-      g_clear_pointer (&priv->project_group, g_free);
-      priv->project_group = g_value_dup_string (value);
+      g_clear_pointer (&priv->project_group, g_ref_string_release);
+      priv->project_group = bz_maybe_intern (g_value_get_string (value));
       break;
     case PROP_DEVELOPER:
-      g_clear_pointer (&priv->developer, g_free);
-      priv->developer = g_value_dup_string (value);
+      g_clear_pointer (&priv->developer, g_ref_string_release);
+      priv->developer = bz_maybe_intern (g_value_get_string (value));
       break;
     case PROP_DEVELOPER_ID:
-      g_clear_pointer (&priv->developer_id, g_free);
-      priv->developer_id = g_value_dup_string (value);
+      g_clear_pointer (&priv->developer_id, g_ref_string_release);
+      priv->developer_id = bz_maybe_intern (g_value_get_string (value));
       break;
     case PROP_DEVELOPER_APPS:
       g_clear_object (&priv->developer_apps);
@@ -586,12 +639,12 @@ bz_entry_set_property (GObject      *object,
       priv->version_history = g_value_dup_object (value);
       break;
     case PROP_LIGHT_ACCENT_COLOR:
-      g_clear_pointer (&priv->light_accent_color, g_free);
-      priv->light_accent_color = g_value_dup_string (value);
+      g_clear_pointer (&priv->light_accent_color, g_ref_string_release);
+      priv->light_accent_color = bz_maybe_intern (g_value_get_string (value));
       break;
     case PROP_DARK_ACCENT_COLOR:
-      g_clear_pointer (&priv->dark_accent_color, g_free);
-      priv->dark_accent_color = g_value_dup_string (value);
+      g_clear_pointer (&priv->dark_accent_color, g_ref_string_release);
+      priv->dark_accent_color = bz_maybe_intern (g_value_get_string (value));
       break;
     case PROP_IS_MOBILE_FRIENDLY:
       priv->is_mobile_friendly = g_value_get_boolean (value);
@@ -686,6 +739,7 @@ bz_entry_class_init (BzEntryClass *klass)
   object_class->set_property = bz_entry_set_property;
   object_class->get_property = bz_entry_get_property;
   object_class->dispose      = bz_entry_dispose;
+  object_class->finalize     = bz_entry_finalize;
 
   props[PROP_HOLDING] =
       g_param_spec_boolean (
@@ -1035,6 +1089,8 @@ bz_entry_init (BzEntry *self)
 
   priv->hold = 0;
   priv->favorites_count = -1;
+
+  bz_trace_counter_add (BZ_TRACE_COUNTER_LIVE_ENTRIES, 1);
 }
 
 static void
@@ -1437,13 +1493,13 @@ bz_entry_real_deserialize (BzSerializable *serializable,
       else if (g_strcmp0 (key, "title") == 0)
         priv->title = g_variant_dup_string (value, NULL);
       else if (g_strcmp0 (key, "eol") == 0)
-        priv->eol = g_variant_dup_string (value, NULL);
+        priv->eol = g_ref_string_new_intern (g_variant_get_string (value, NULL));
       else if (g_strcmp0 (key, "description") == 0)
         priv->description = g_variant_dup_string (value, NULL);
       else if (g_strcmp0 (key, "long-description") == 0)
         priv->long_description = g_variant_dup_string (value, NULL);
       else if (g_strcmp0 (key, "remote-repo-name") == 0)
-        priv->remote_repo_name = g_variant_dup_string (value, NULL);
+        priv->remote_repo_name = g_ref_string_new_intern (g_variant_get_string (value, NULL));
       else if (g_strcmp0 (key, "url") == 0)
         priv->url = g_variant_dup_string (value, NULL);
       else if (g_strcmp0 (key, "size") == 0)
@@ -1457,15 +1513,17 @@ bz_entry_real_deserialize (BzSerializable *serializable,
       else if (g_strcmp0 (key, "search-tokens") == 0)
         priv->search_tokens = g_variant_dup_string (value, NULL);
       else if (g_strcmp0 (key, "metadata-license") == 0)
-        priv->metadata_license = g_variant_dup_string (value, NULL);
+        priv->metadata_license = g_ref_string_new_intern (g_variant_get_string (value, NULL));
       else if (g_strcmp0 (key, "project-license") == 0)
-        priv->project_license = g_variant_dup_string (value, NULL);
+        priv->project_license = g_ref_string_new_intern (g_variant_get_string (value, NULL));
       else if (g_strcmp0 (key, "is-floss") == 0)
         priv->is_floss = g_variant_get_boolean (value);
+      else if (g_strcmp0 (key, "project-group") == 0)
+        priv->project_group = g_ref_string_new_intern (g_variant_get_string (value, NULL));
       else if (g_strcmp0 (key, "developer") == 0)
-        priv->developer = g_variant_dup_string (value, NULL);
+        priv->developer = g_ref_string_new_intern (g_variant_get_string (value, NULL));
       else if (g_strcmp0 (key, "developer-id") == 0)
-        priv->developer_id = g_variant_dup_string (value, NULL);
+        priv->developer_id = g_ref_string_new_intern (g_variant_get_string (value, NULL));
       else if (g_strcmp0 (key, "screenshot-paintables") == 0)
         {
           g_autoptr (GListStore) store             = NULL;
@@ -1596,9 +1654,9 @@ bz_entry_real_deserialize (BzSerializable *serializable,
           priv->version_history = G_LIST_MODEL (g_steal_pointer (&store));
         }
       else if (g_strcmp0 (key, "light-accent-color") == 0)
-        priv->light_accent_color = g_variant_dup_string (value, NULL);
+        priv->light_accent_color = g_ref_string_new_intern (g_variant_get_string (value, NULL));
       else if (g_strcmp0 (key, "dark-accent-color") == 0)
-        priv->dark_accent_color = g_variant_dup_string (value, NULL);
+        priv->dark_accent_color = g_ref_string_new_intern (g_variant_get_string (value, NULL));
       else if (g_strcmp0 (key, "is-mobile-friendly") == 0)
         priv->is_mobile_friendly = g_variant_get_boolean (value);
       else if (g_strcmp0 (key, "required-controls") == 0 && g_variant_is_of_type (value, G_VARIANT_TYPE_UINT32))
@@ -2273,6 +2331,163 @@ bz_entry_deserialize (BzEntry  *self,
   return bz_entry_real_deserialize (BZ_SERIALIZABLE (self), import, error);
 }
 
+GVariant *
+bz_entry_serialize_fixed (BzEntry *self)
+{
+  BzEntryPrivate *priv           = NULL;
+  GVariantBuilder builder        = { 0 };
+  g_autoptr (GVariant) mini_icon = NULL;
+  GVariant *icon_paintable       = NULL;
+  GVariant *remote_repo_icon     = NULL;
+  GVariant *content_rating       = NULL;
+  GVariant *verification_status  = NULL;
+
+  g_return_val_if_fail (BZ_IS_ENTRY (self), NULL);
+  priv = bz_entry_get_instance_private (self);
+
+  if (priv->icon_paintable != NULL)
+    icon_paintable = save_paintable (priv, priv->icon_paintable);
+  if (priv->mini_icon != NULL)
+    mini_icon = g_icon_serialize (priv->mini_icon);
+  if (priv->remote_repo_icon != NULL)
+    remote_repo_icon = save_paintable (priv, priv->remote_repo_icon);
+  if (priv->content_rating != NULL)
+    content_rating = content_rating_to_variant (priv->content_rating);
+  if (priv->verification_status != NULL)
+    verification_status = bz_verification_status_to_variant (priv->verification_status);
+
+  /* Same order as BZ_ENTRY_SERIAL_TYPE */
+  g_variant_builder_init (&builder, G_VARIANT_TYPE (BZ_ENTRY_SERIAL_TYPE));
+  g_variant_builder_add (&builder, "y", (guchar) BZ_ENTRY_SERIAL_VERSION);
+  g_variant_builder_add (&builder, "b", priv->installed);
+  g_variant_builder_add (&builder, "u", priv->kinds);
+  g_variant_builder_add_value (&builder, strings_to_variant (priv->addons));
+  g_variant_builder_add (&builder, "ms", priv->id);
+  g_variant_builder_add (&builder, "ms", priv->unique_id);
+  g_variant_builder_add (&builder, "ms", priv->unique_id_checksum);
+  g_variant_builder_add (&builder, "ms", priv->title);
+  g_variant_builder_add (&builder, "ms", priv->eol);
+  g_variant_builder_add (&builder, "ms", priv->description);
+  g_variant_builder_add (&builder, "ms", priv->long_description);
+  g_variant_builder_add (&builder, "ms", priv->remote_repo_name);
+  g_variant_builder_add (&builder, "ms", priv->url);
+  g_variant_builder_add (&builder, "t", priv->size);
+  g_variant_builder_add (&builder, "m@(sms)", icon_paintable);
+  g_variant_builder_add (&builder, "mv", mini_icon);
+  g_variant_builder_add (&builder, "m@(sms)", remote_repo_icon);
+  g_variant_builder_add (&builder, "ms", priv->search_tokens);
+  g_variant_builder_add (&builder, "ms", priv->metadata_license);
+  g_variant_builder_add (&builder, "ms", priv->project_license);
+  g_variant_builder_add (&builder, "b", priv->is_floss);
+  g_variant_builder_add (&builder, "ms", priv->project_group);
+  g_variant_builder_add (&builder, "ms", priv->developer);
+  g_variant_builder_add (&builder, "ms", priv->developer_id);
+  g_variant_builder_add_value (&builder, paintables_to_variant (priv, priv->screenshot_paintables));
+  g_variant_builder_add_value (&builder, strings_to_variant (priv->screenshot_captions));
+  g_variant_builder_add_value (&builder, urls_to_variant (priv->share_urls));
+  g_variant_builder_add (&builder, "ms", priv->donation_url);
+  g_variant_builder_add (&builder, "ms", priv->forge_url);
+  g_variant_builder_add_value (&builder, releases_to_variant (priv->version_history));
+  g_variant_builder_add (&builder, "ms", priv->light_accent_color);
+  g_variant_builder_add (&builder, "ms", priv->dark_accent_color);
+  g_variant_builder_add (&builder, "b", priv->is_mobile_friendly);
+  g_variant_builder_add (&builder, "u", priv->required_controls);
+  g_variant_builder_add (&builder, "u", priv->recommended_controls);
+  g_variant_builder_add (&builder, "u", priv->supported_controls);
+  g_variant_builder_add (&builder, "i", priv->min_display_length);
+  g_variant_builder_add (&builder, "i", priv->max_display_length);
+  g_variant_builder_add (&builder, "m@(sa(ss))", content_rating);
+  g_variant_builder_add_value (&builder, strings_to_variant (priv->keywords));
+  g_variant_builder_add (&builder, "m@" BZ_VERIFICATION_STATUS_SERIAL_TYPE, verification_status);
+  g_variant_builder_add (&builder, "b", priv->is_flathub);
+
+  return g_variant_builder_end (&builder);
+}
+
+gboolean
+bz_entry_deserialize_fixed (BzEntry  *self,
+                            GVariant *import,
+                            GError  **error)
+{
+  BzEntryPrivate *priv              = NULL;
+  GVariantIter    iter              = { 0 };
+  guchar          version           = 0;
+  g_autoptr (GVariant) mini_icon    = NULL;
+  g_autoptr (GVariant) verification = NULL;
+
+  g_return_val_if_fail (BZ_IS_ENTRY (self), FALSE);
+  g_return_val_if_fail (import != NULL, FALSE);
+  priv = bz_entry_get_instance_private (self);
+
+  if (!g_variant_is_of_type (import, G_VARIANT_TYPE (BZ_ENTRY_SERIAL_TYPE)))
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                   "Entry variant has unexpected type %s",
+                   g_variant_get_type_string (import));
+      return FALSE;
+    }
+
+  g_variant_iter_init (&iter, import);
+  g_variant_iter_next (&iter, "y", &version);
+  if (version != BZ_ENTRY_SERIAL_VERSION)
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                   "Entry variant has unsupported version %u", version);
+      return FALSE;
+    }
+
+  clear_entry (self);
+
+  /* Same order as BZ_ENTRY_SERIAL_TYPE */
+  g_variant_iter_next (&iter, "b", &priv->installed);
+  g_variant_iter_next (&iter, "u", &priv->kinds);
+  priv->addons = next_strings (&iter);
+  g_variant_iter_next (&iter, "ms", &priv->id);
+  g_variant_iter_next (&iter, "ms", &priv->unique_id);
+  g_variant_iter_next (&iter, "ms", &priv->unique_id_checksum);
+  g_variant_iter_next (&iter, "ms", &priv->title);
+  priv->eol = next_interned (&iter);
+  g_variant_iter_next (&iter, "ms", &priv->description);
+  g_variant_iter_next (&iter, "ms", &priv->long_description);
+  priv->remote_repo_name = next_interned (&iter);
+  g_variant_iter_next (&iter, "ms", &priv->url);
+  g_variant_iter_next (&iter, "t", &priv->size);
+  priv->icon_paintable = next_paintable (&iter);
+  g_variant_iter_next (&iter, "mv", &mini_icon);
+  if (mini_icon != NULL)
+    priv->mini_icon = g_icon_deserialize (mini_icon);
+  priv->remote_repo_icon = next_paintable (&iter);
+  g_variant_iter_next (&iter, "ms", &priv->search_tokens);
+  priv->metadata_license = next_interned (&iter);
+  priv->project_license  = next_interned (&iter);
+  g_variant_iter_next (&iter, "b", &priv->is_floss);
+  priv->project_group         = next_interned (&iter);
+  priv->developer             = next_interned (&iter);
+  priv->developer_id          = next_interned (&iter);
+  priv->screenshot_paintables = next_paintables (&iter);
+  priv->screenshot_captions   = next_strings (&iter);
+  priv->share_urls            = next_urls (&iter);
+  g_variant_iter_next (&iter, "ms", &priv->donation_url);
+  g_variant_iter_next (&iter, "ms", &priv->forge_url);
+  priv->version_history    = next_releases (&iter);
+  priv->light_accent_color = next_interned (&iter);
+  priv->dark_accent_color  = next_interned (&iter);
+  g_variant_iter_next (&iter, "b", &priv->is_mobile_friendly);
+  g_variant_iter_next (&iter, "u", &priv->required_controls);
+  g_variant_iter_next (&iter, "u", &priv->recommended_controls);
+  g_variant_iter_next (&iter, "u", &priv->supported_controls);
+  g_variant_iter_next (&iter, "i", &priv->min_display_length);
+  g_variant_iter_next (&iter, "i", &priv->max_display_length);
+  priv->content_rating = next_content_rating (&iter);
+  priv->keywords       = next_strings (&iter);
+  g_variant_iter_next (&iter, "m@" BZ_VERIFICATION_STATUS_SERIAL_TYPE, &verification);
+  if (verification != NULL)
+    priv->verification_status = bz_verification_status_new_from_variant (verification);
+  g_variant_iter_next (&iter, "b", &priv->is_flathub);
+
+  return TRUE;
+}
+
 static void
 query_flathub (BzEntry *self,
                int      prop)
@@ -2299,9 +2514,8 @@ query_flathub (BzEntry *self,
   data->id        = g_strdup (priv->id);
   data->developer = g_strdup (priv->developer);
 
-  future = dex_scheduler_spawn (
-      bz_get_io_scheduler (),
-      bz_get_dex_stack_size (),
+  future = bz_spawn (
+      BZ_SCHEDULER_PRIORITY_INTERACTIVE,
       (DexFiberFunc) query_flathub_fiber,
       query_flathub_data_ref (data), query_flathub_data_unref);
   future = dex_future_then (
@@ -2531,6 +2745,20 @@ maybe_save_paintable (BzEntryPrivate  *priv,
                       const char      *key,
                       GdkPaintable    *paintable,
                       GVariantBuilder *builder)
+{
+  GVariant *saved = NULL;
+
+  saved = save_paintable (priv, paintable);
+  if (saved == NULL)
+    return FALSE;
+
+  g_variant_builder_add (builder, "{sv}", key, saved);
+  return TRUE;
+}
+
+static GVariant *
+save_paintable (BzEntryPrivate *priv,
+                GdkPaintable   *paintable)
 {
   g_autoptr (GError) local_error = NULL;
   const char *source_uri         = NULL;
@@ -2542,7 +2770,7 @@ maybe_save_paintable (BzEntryPrivate  *priv,
   if (!BZ_IS_ASYNC_TEXTURE (paintable))
     {
       g_warning ("Paintable must be of type BzAsyncTexture to be serialized!");
-      return FALSE;
+      return NULL;
     }
 
   source_uri      = bz_async_texture_get_source_uri (BZ_ASYNC_TEXTURE (paintable));
@@ -2615,8 +2843,7 @@ maybe_save_paintable (BzEntryPrivate  *priv,
     }
 
 done:
-  g_variant_builder_add (builder, "{sv}", key, g_variant_new ("(sms)", source_uri, cache_into_path));
-  return TRUE;
+  return g_variant_new ("(sms)", source_uri, cache_into_path);
 }
 
 static GdkPaintable *
@@ -2661,9 +2888,8 @@ icon_paintable_future_then (DexFuture *future,
   data->self = g_object_ref (self);
   data->path = g_strdup (icon_path);
 
-  return dex_scheduler_spawn (
-      bz_get_io_scheduler (),
-      bz_get_dex_stack_size (),
+  return bz_spawn (
+      BZ_SCHEDULER_PRIORITY_INTERACTIVE,
       (DexFiberFunc) load_mini_icon_fiber,
       load_mini_icon_data_ref (data),
       load_mini_icon_data_unref);
@@ -2765,20 +2991,20 @@ clear_entry (BzEntry *self)
   g_clear_pointer (&priv->unique_id, g_free);
   g_clear_pointer (&priv->unique_id_checksum, g_free);
   g_clear_pointer (&priv->title, g_free);
-  g_clear_pointer (&priv->eol, g_free);
+  g_clear_pointer (&priv->eol, g_ref_string_release);
   g_clear_pointer (&priv->description, g_free);
   g_clear_pointer (&priv->long_description, g_free);
-  g_clear_pointer (&priv->remote_repo_name, g_free);
+  g_clear_pointer (&priv->remote_repo_name, g_ref_string_release);
   g_clear_pointer (&priv->url, g_free);
   g_clear_object (&priv->icon_paintable);
   g_clear_object (&priv->mini_icon);
   g_clear_object (&priv->remote_repo_icon);
   g_clear_pointer (&priv->search_tokens, g_free);
-  g_clear_pointer (&priv->metadata_license, g_free);
-  g_clear_pointer (&priv->project_license, g_free);
-  g_clear_pointer (&priv->project_group, g_free);
-  g_clear_pointer (&priv->developer, g_free);
-  g_clear_pointer (&priv->developer_id, g_free);
+  g_clear_pointer (&priv->metadata_license, g_ref_string_release);
+  g_clear_pointer (&priv->project_license, g_ref_string_release);
+  g_clear_pointer (&priv->project_group, g_ref_string_release);
+  g_clear_pointer (&priv->developer, g_ref_string_release);
+  g_clear_pointer (&priv->developer_id, g_ref_string_release);
   g_clear_object (&priv->developer_apps);
   g_clear_object (&priv->screenshot_paintables);
   g_clear_object (&priv->screenshot_captions);
@@ -2788,11 +3014,318 @@ clear_entry (BzEntry *self)
   g_clear_object (&priv->reviews);
   g_clear_pointer (&priv->ratings_summary, g_free);
   g_clear_object (&priv->version_history);
-  g_clear_pointer (&priv->light_accent_color, g_free);
-  g_clear_pointer (&priv->dark_accent_color, g_free);
+  g_clear_pointer (&priv->light_accent_color, g_ref_string_release);
+  g_clear_pointer (&priv->dark_accent_color, g_ref_string_release);
   g_clear_object (&priv->verification_status);
   g_clear_object (&priv->download_stats);
   g_clear_object (&priv->download_stats_per_country);
   g_clear_object (&priv->content_rating);
   g_clear_object (&priv->keywords);
 }
+
+static GVariant *
+strings_to_variant (GListModel *model)
+{
+  GVariantBuilder builder = { 0 };
+  guint           n_items = 0;
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE_STRING_ARRAY);
+  if (model != NULL)
+    n_items = g_list_model_get_n_items (model);
+  for (guint i = 0; i < n_items; i++)
+    {
+      g_autoptr (GtkStringObject) string = NULL;
+
+      string = g_list_model_get_item (model, i);
+      g_variant_builder_add (&builder, "s", gtk_string_object_get_string (string));
+    }
+
+  return g_variant_builder_end (&builder);
+}
+
+static GVariant *
+paintables_to_variant (BzEntryPrivate *priv,
+                       GListModel     *model)
+{
+  GVariantBuilder builder = { 0 };
+  guint           n_items = 0;
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(sms)"));
+  if (model != NULL)
+    n_items = g_list_model_get_n_items (model);
+  for (guint i = 0; i < n_items; i++)
+    {
+      g_autoptr (GdkPaintable) paintable = NULL;
+      GVariant *saved                    = NULL;
+
+      paintable = g_list_model_get_item (model, i);
+      saved     = save_paintable (priv, paintable);
+      if (saved != NULL)
+        g_variant_builder_add_value (&builder, saved);
+    }
+
+  return g_variant_builder_end (&builder);
+}
+
+static GVariant *
+urls_to_variant (GListModel *model)
+{
+  GVariantBuilder builder = { 0 };
+  guint           n_items = 0;
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a" BZ_URL_SERIAL_TYPE));
+  if (model != NULL)
+    n_items = g_list_model_get_n_items (model);
+  for (guint i = 0; i < n_items; i++)
+    {
+      g_autoptr (BzUrl) url = NULL;
+
+      url = g_list_model_get_item (model, i);
+      g_variant_builder_add_value (&builder, bz_url_to_variant (url));
+    }
+
+  return g_variant_builder_end (&builder);
+}
+
+static GVariant *
+releases_to_variant (GListModel *model)
+{
+  GVariantBuilder builder = { 0 };
+  guint           n_items = 0;
+
+  g_variant_builder_init (
+      &builder, G_VARIANT_TYPE ("a(" BZ_RELEASE_SERIAL_TYPE "a" BZ_ISSUE_SERIAL_TYPE ")"));
+  if (model != NULL)
+    n_items = g_list_model_get_n_items (model);
+  for (guint i = 0; i < n_items; i++)
+    {
+      g_autoptr (BzRelease) release  = NULL;
+      GListModel     *issues         = NULL;
+      GVariantBuilder issues_builder = { 0 };
+      guint           n_issues       = 0;
+
+      release = g_list_model_get_item (model, i);
+      issues  = bz_release_get_issues (release);
+
+      g_variant_builder_init (&issues_builder, G_VARIANT_TYPE ("a" BZ_ISSUE_SERIAL_TYPE));
+      if (issues != NULL)
+        n_issues = g_list_model_get_n_items (issues);
+      for (guint j = 0; j < n_issues; j++)
+        {
+          g_autoptr (BzIssue) issue = NULL;
+
+          issue = g_list_model_get_item (issues, j);
+          g_variant_builder_add_value (&issues_builder, bz_issue_to_variant (issue));
+        }
+
+      g_variant_builder_add (
+          &builder, "(@" BZ_RELEASE_SERIAL_TYPE "@a" BZ_ISSUE_SERIAL_TYPE ")",
+          bz_release_to_variant (release),
+          g_variant_builder_end (&issues_builder));
+    }
+
+  return g_variant_builder_end (&builder);
+}
+
+static GVariant *
+content_rating_to_variant (AsContentRating *rating)
+{
+  const char *kind                   = NULL;
+  g_autofree const char **rating_ids = NULL;
+  GVariantBuilder builder            = { 0 };
+
+  kind       = as_content_rating_get_kind (rating);
+  rating_ids = as_content_rating_get_all_rating_ids ();
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(ss)"));
+  for (gsize i = 0; rating_ids[i] != NULL; i++)
+    {
+      AsContentRatingValue value = AS_CONTENT_RATING_VALUE_UNKNOWN;
+
+      value = as_content_rating_get_value (rating, rating_ids[i]);
+      if (value != AS_CONTENT_RATING_VALUE_UNKNOWN)
+        g_variant_builder_add (&builder, "(ss)", rating_ids[i],
+                               as_content_rating_value_to_string (value));
+    }
+
+  return g_variant_new ("(s@a(ss))",
+                        kind != NULL ? kind : "oars-1.1",
+                        g_variant_builder_end (&builder));
+}
+
+static char *
+next_interned (GVariantIter *iter)
+{
+  const char *string = NULL;
+
+  g_variant_iter_next (iter, "m&s", &string);
+  return string != NULL ? g_ref_string_new_intern (string) : NULL;
+}
+
+static GdkPaintable *
+next_paintable (GVariantIter *iter)
+{
+  g_autoptr (GVariant) saved = NULL;
+
+  g_variant_iter_next (iter, "m@(sms)", &saved);
+  return saved != NULL ? make_async_texture (saved) : NULL;
+}
+
+static GListModel *
+next_strings (GVariantIter *iter)
+{
+  g_autoptr (GVariantIter) strings = NULL;
+  g_autoptr (GListStore) store     = NULL;
+  const char *string               = NULL;
+
+  g_variant_iter_next (iter, "as", &strings);
+  if (g_variant_iter_n_children (strings) == 0)
+    return NULL;
+
+  store = g_list_store_new (GTK_TYPE_STRING_OBJECT);
+  while (g_variant_iter_next (strings, "&s", &string))
+    {
+      g_autoptr (GtkStringObject) object = NULL;
+
+      object = gtk_string_object_new (string);
+      g_list_store_append (store, object);
+    }
+
+  return G_LIST_MODEL (g_steal_pointer (&store));
+}
+
+static GListModel *
+next_paintables (GVariantIter *iter)
+{
+  g_autoptr (GVariant) paintables = NULL;
+  g_autoptr (GListStore) store    = NULL;
+  GVariantIter paintables_iter    = { 0 };
+  GVariant    *saved              = NULL;
+
+  paintables = g_variant_iter_next_value (iter);
+  if (g_variant_n_children (paintables) == 0)
+    return NULL;
+
+  store = g_list_store_new (BZ_TYPE_ASYNC_TEXTURE);
+  g_variant_iter_init (&paintables_iter, paintables);
+  while ((saved = g_variant_iter_next_value (&paintables_iter)) != NULL)
+    {
+      g_autoptr (GdkPaintable) texture = NULL;
+
+      texture = make_async_texture (saved);
+      g_list_store_append (store, texture);
+      g_variant_unref (saved);
+    }
+
+  return G_LIST_MODEL (g_steal_pointer (&store));
+}
+
+static GListModel *
+next_urls (GVariantIter *iter)
+{
+  g_autoptr (GVariant) urls    = NULL;
+  g_autoptr (GListStore) store = NULL;
+  GVariantIter urls_iter       = { 0 };
+  GVariant    *child           = NULL;
+
+  urls = g_variant_iter_next_value (iter);
+  if (g_variant_n_children (urls) == 0)
+    return NULL;
+
+  store = g_list_store_new (BZ_TYPE_URL);
+  g_variant_iter_init (&urls_iter, urls);
+  while ((child = g_variant_iter_next_value (&urls_iter)) != NULL)
+    {
+      g_autoptr (BzUrl) url = NULL;
+
+      url = bz_url_new_from_variant (child);
+      if (url != NULL)
+        g_list_store_append (store, url);
+      g_variant_unref (child);
+    }
+
+  return G_LIST_MODEL (g_steal_pointer (&store));
+}
+
+static GListModel *
+next_releases (GVariantIter *iter)
+{
+  g_autoptr (GVariant) releases = NULL;
+  g_autoptr (GListStore) store  = NULL;
+  GVariantIter releases_iter    = { 0 };
+  GVariant    *child            = NULL;
+
+  releases = g_variant_iter_next_value (iter);
+  if (g_variant_n_children (releases) == 0)
+    return NULL;
+
+  store = g_list_store_new (BZ_TYPE_RELEASE);
+  g_variant_iter_init (&releases_iter, releases);
+  while ((child = g_variant_iter_next_value (&releases_iter)) != NULL)
+    {
+      g_autoptr (GVariant) release_variant = NULL;
+      g_autoptr (GVariant) issues_variant  = NULL;
+      g_autoptr (BzRelease) release        = NULL;
+      gsize n_issues                       = 0;
+
+      release_variant = g_variant_get_child_value (child, 0);
+      issues_variant  = g_variant_get_child_value (child, 1);
+      g_variant_unref (child);
+
+      release = bz_release_new_from_variant (release_variant);
+      if (release == NULL)
+        continue;
+
+      n_issues = g_variant_n_children (issues_variant);
+      if (n_issues > 0)
+        {
+          g_autoptr (GListStore) issues_store = NULL;
+
+          issues_store = g_list_store_new (BZ_TYPE_ISSUE);
+          for (gsize i = 0; i < n_issues; i++)
+            {
+              g_autoptr (GVariant) issue_variant = NULL;
+              g_autoptr (BzIssue) issue          = NULL;
+
+              issue_variant = g_variant_get_child_value (issues_variant, i);
+              issue         = bz_issue_new_from_variant (issue_variant);
+              if (issue != NULL)
+                g_list_store_append (issues_store, issue);
+            }
+          bz_release_set_issues (release, G_LIST_MODEL (issues_store));
+        }
+
+      g_list_store_append (store, release);
+    }
+
+  return G_LIST_MODEL (g_steal_pointer (&store));
+}
+
+static AsContentRating *
+next_content_rating (GVariantIter *iter)
+{
+  g_autoptr (GVariant) saved         = NULL;
+  g_autoptr (GVariantIter) values    = NULL;
+  g_autoptr (AsContentRating) rating = NULL;
+  const char *kind                   = NULL;
+  const char *rating_id              = NULL;
+  const char *value_str              = NULL;
+
+  g_variant_iter_next (iter, "m@(sa(ss))", &saved);
+  if (saved == NULL)
+    return NULL;
+
+  g_variant_get (saved, "(&sa(ss))", &kind, &values);
+  rating = as_content_rating_new ();
+  as_content_rating_set_kind (rating, kind);
+  while (g_variant_iter_next (values, "(&s&s)", &rating_id, &value_str))
+    {
+      AsContentRatingValue value = AS_CONTENT_RATING_VALUE_UNKNOWN;
+
+      value = as_content_rating_value_from_string (value_str);
+      if (value != AS_CONTENT_RATING_VALUE_UNKNOWN)
+        as_content_rating_set_value (rating, rating_id, value);
+    }
+
+  return g_steal_pointer (&rating);
+}
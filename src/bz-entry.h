@@ -24,6 +24,11 @@
 #include <gtk/gtk.h>
 #include <libdex.h>
 
+#include "bz-issue.h"
+#include "bz-release.h"
+#include "bz-url.h"
+#include "bz-verification-status.h"
+
 G_BEGIN_DECLS
 
 typedef enum
@@ -218,6 +223,44 @@ bz_entry_deserialize (BzEntry  *self,
                       GVariant *import,
                       GError  **error);
 
+/* Fixed layout counterpart of the vardict written by bz_entry_serialize (),
+   read back without any key lookups. Bump the version whenever the layout
+   changes. */
+#define BZ_ENTRY_SERIAL_VERSION 1
+#define BZ_ENTRY_SERIAL_TYPE                                                   \
+  "(y"                                                                         \
+  "bu"                 /* installed, kinds */                                  \
+  "as"                 /* addons */                                            \
+  "msmsmsmsmsmsmsmsms" /* id, unique-id, unique-id-checksum, title, eol,       \
+                          description, long-description, remote-repo-name,     \
+                          url */                                               \
+  "t"                  /* size */                                              \
+  "m(sms)mvm(sms)"     /* icon-paintable, mini-icon, remote-repo-icon */       \
+  "msmsms"             /* search-tokens, metadata-license, project-license */  \
+  "b"                  /* is-floss */                                          \
+  "msmsms"             /* project-group, developer, developer-id */            \
+  "a(sms)as"           /* screenshot-paintables, screenshot-captions */        \
+  "a" BZ_URL_SERIAL_TYPE /* share-urls */                                      \
+  "msms"               /* donation-url, forge-url */                           \
+  "a(" BZ_RELEASE_SERIAL_TYPE "a" BZ_ISSUE_SERIAL_TYPE ")" /* version-history */ \
+  "msms"               /* light-accent-color, dark-accent-color */             \
+  "b"                  /* is-mobile-friendly */                                \
+  "uuu"                /* required-, recommended-, supported-controls */       \
+  "ii"                 /* min-display-length, max-display-length */            \
+  "m(sa(ss))"          /* content rating kind and values */                    \
+  "as"                 /* keywords */                                          \
+  "m" BZ_VERIFICATION_STATUS_SERIAL_TYPE /* verification-status */             \
+  "b"                  /* is-flathub */                                        \
+  ")"
+
+GVariant *
+bz_entry_serialize_fixed (BzEntry *self);
+
+gboolean
+bz_entry_deserialize_fixed (BzEntry  *self,
+                            GVariant *import,
+                            GError  **error);
+
 GIcon *
 bz_load_mini_icon_sync (const char *unique_id_checksum,
                         const char *path);
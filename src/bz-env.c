@@ -69,3 +69,82 @@ bz_get_dex_stack_size (void)
 
   return stack_size;
 }
+
+guint
+bz_get_max_download_workers (void)
+{
+  static gsize max_workers = 0;
+
+  if (g_once_init_enter (&max_workers))
+    {
+      const char *envvar = NULL;
+      guint64     value  = 8;
+
+      envvar = g_getenv ("BAZAAR_MAX_DOWNLOAD_WORKERS");
+      if (envvar != NULL)
+        {
+          g_autoptr (GError) local_error = NULL;
+          g_autoptr (GVariant) variant   = NULL;
+
+          variant = g_variant_parse (
+              G_VARIANT_TYPE_UINT32, envvar,
+              NULL, NULL, &local_error);
+          if (variant != NULL)
+            {
+              guint32 parse_result = 0;
+
+              parse_result = g_variant_get_uint32 (variant);
+              if (parse_result == 0 || parse_result > 64)
+                g_warning ("BAZAAR_MAX_DOWNLOAD_WORKERS must be between 1 and 64");
+              else
+                value = parse_result;
+            }
+          else
+            g_warning ("BAZAAR_MAX_DOWNLOAD_WORKERS is invalid: %s", local_error->message);
+        }
+
+      g_once_init_leave (&max_workers, value);
+    }
+
+  return max_workers;
+}
+
+int
+bz_get_cache_compression_level (void)
+{
+  static gsize level = 0;
+
+  if (g_once_init_enter (&level))
+    {
+      const char *envvar = NULL;
+      /* Offset by one so that 0 can mean "not initialized yet" */
+      gsize value = 3 + 1;
+
+      envvar = g_getenv ("BAZAAR_CACHE_COMPRESSION_LEVEL");
+      if (envvar != NULL)
+        {
+          g_autoptr (GError) local_error = NULL;
+          g_autoptr (GVariant) variant   = NULL;
+
+          variant = g_variant_parse (
+              G_VARIANT_TYPE_UINT32, envvar,
+              NULL, NULL, &local_error);
+          if (variant != NULL)
+            {
+              guint32 parse_result = 0;
+
+              parse_result = g_variant_get_uint32 (variant);
+              if (parse_result > 19)
+                g_warning ("BAZAAR_CACHE_COMPRESSION_LEVEL must be between 0 and 19");
+              else
+                value = parse_result + 1;
+            }
+          else
+            g_warning ("BAZAAR_CACHE_COMPRESSION_LEVEL is invalid: %s", local_error->message);
+        }
+
+      g_once_init_leave (&level, value);
+    }
+
+  return level - 1;
+}
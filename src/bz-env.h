@@ -27,4 +27,10 @@ G_BEGIN_DECLS
 gsize
 bz_get_dex_stack_size (void);
 
+guint
+bz_get_max_download_workers (void);
+
+int
+bz_get_cache_compression_level (void);
+
 G_END_DECLS
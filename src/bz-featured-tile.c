@@ -21,6 +21,7 @@
 #include "bz-featured-tile.h"
 #include "bz-entry.h"
 #include "bz-group-tile-css-watcher.h"
+#include "bz-prefetch.h"
 #include "bz-screenshot.h"
 #include "bz-util.h"
 
@@ -480,6 +481,7 @@ bz_featured_tile_init (BzFeaturedTile *self)
   BzFeaturedTileLayout *tile_layout;
 
   gtk_widget_init_template (GTK_WIDGET (self));
+  bz_prefetch_attach (GTK_WIDGET (self));
 
   self->css = bz_group_tile_css_watcher_new ();
   bz_group_tile_css_watcher_set_widget (self->css, GTK_WIDGET (self));
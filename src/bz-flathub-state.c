@@ -521,9 +521,8 @@ bz_flathub_state_set_for_day (BzFlathubState *self,
       self->apps_of_the_week = gtk_string_list_new (NULL);
       self->categories       = g_list_store_new (BZ_TYPE_FLATHUB_CATEGORY);
 
-      future = dex_scheduler_spawn (
-          bz_get_io_scheduler (),
-          bz_get_dex_stack_size (),
+      future = bz_spawn (
+          BZ_SCHEDULER_PRIORITY_INTERACTIVE,
           (DexFiberFunc) initialize_fiber,
           bz_track_weak (self), bz_weak_release);
       future = dex_future_finally (
@@ -894,9 +893,8 @@ bz_flathub_state_search_keyword (BzFlathubState *self,
   dex_return_error_if_fail (BZ_IS_FLATHUB_STATE (self));
   dex_return_error_if_fail (keyword != NULL);
 
-  future = dex_scheduler_spawn (
-      bz_get_io_scheduler (),
-      bz_get_dex_stack_size (),
+  future = bz_spawn (
+      BZ_SCHEDULER_PRIORITY_INTERACTIVE,
       (DexFiberFunc) search_keyword_fiber,
       g_strdup (keyword),
       g_free);
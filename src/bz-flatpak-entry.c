@@ -33,6 +33,7 @@
 #include "bz-release.h"
 #include "bz-serializable.h"
 #include "bz-url.h"
+#include "bz-util.h"
 #include "bz-verification-status.h"
 
 enum
@@ -53,6 +54,7 @@ struct _BzFlatpakEntry
   gboolean user;
   char    *flatpak_name;
   char    *flatpak_id;
+  /* these and the rest are interned GRefStrings */
   char    *flatpak_version;
   char    *application_name;
   char    *application_runtime;
@@ -93,6 +95,9 @@ static GParamSpec *props[LAST_PROP] = { 0 };
 static void
 clear_entry (BzFlatpakEntry *self);
 
+static char *
+next_interned (GVariantIter *iter);
+
 static void
 bz_flatpak_entry_dispose (GObject *object)
 {
@@ -292,17 +297,17 @@ bz_flatpak_entry_real_deserialize (BzSerializable *serializable,
       else if (g_strcmp0 (key, "flatpak-id") == 0)
         self->flatpak_id = g_variant_dup_string (value, NULL);
       else if (g_strcmp0 (key, "flatpak-version") == 0)
-        self->flatpak_version = g_variant_dup_string (value, NULL);
+        self->flatpak_version = g_ref_string_new_intern (g_variant_get_string (value, NULL));
       else if (g_strcmp0 (key, "application-name") == 0)
-        self->application_name = g_variant_dup_string (value, NULL);
+        self->application_name = g_ref_string_new_intern (g_variant_get_string (value, NULL));
       else if (g_strcmp0 (key, "application-runtime") == 0)
-        self->application_runtime = g_variant_dup_string (value, NULL);
+        self->application_runtime = g_ref_string_new_intern (g_variant_get_string (value, NULL));
       else if (g_strcmp0 (key, "application-command") == 0)
-        self->application_command = g_variant_dup_string (value, NULL);
+        self->application_command = g_ref_string_new_intern (g_variant_get_string (value, NULL));
       else if (g_strcmp0 (key, "runtime-name") == 0)
-        self->runtime_name = g_variant_dup_string (value, NULL);
+        self->runtime_name = g_ref_string_new_intern (g_variant_get_string (value, NULL));
       else if (g_strcmp0 (key, "addon-extension-of-ref") == 0)
-        self->addon_extension_of_ref = g_variant_dup_string (value, NULL);
+        self->addon_extension_of_ref = g_ref_string_new_intern (g_variant_get_string (value, NULL));
     }
 
   return bz_entry_deserialize (BZ_ENTRY (self), import, error);
@@ -424,14 +429,18 @@ bz_flatpak_entry_new_for_ref (FlatpakRef    *ref,
   if (!result)
     return NULL;
 
-#define GET_STRING(member, group_name, key) \
-  G_STMT_START                              \
-  {                                         \
-    self->member = g_key_file_get_string (  \
-        key_file, group_name, key, error);  \
-    if (self->member == NULL)               \
-      return NULL;                          \
-  }                                         \
+  /* Runtime refs and the like are shared by a great many entries */
+#define GET_STRING(member, group_name, key)              \
+  G_STMT_START                                           \
+  {                                                      \
+    g_autofree char *_string = NULL;                     \
+                                                         \
+    _string = g_key_file_get_string (                    \
+        key_file, group_name, key, error);               \
+    if (_string == NULL)                                 \
+      return NULL;                                       \
+    self->member = g_ref_string_new_intern (_string);    \
+  }                                                      \
   G_STMT_END
 
   if (g_key_file_has_group (key_file, "Application"))
@@ -472,7 +481,7 @@ bz_flatpak_entry_new_for_ref (FlatpakRef    *ref,
 
   self->flatpak_name    = g_strdup (flatpak_ref_get_name (ref));
   self->flatpak_id      = flatpak_ref_format_ref (ref);
-  self->flatpak_version = g_strdup (flatpak_ref_get_branch (ref));
+  self->flatpak_version = bz_maybe_intern (flatpak_ref_get_branch (ref));
 
   id                 = flatpak_ref_get_name (ref);
   unique_id          = bz_flatpak_ref_format_unique (ref, user);
@@ -1226,15 +1235,91 @@ bz_flatpak_entry_launch (BzFlatpakEntry    *self,
 #endif
 }
 
+GVariant *
+bz_flatpak_entry_serialize_fixed (BzFlatpakEntry *self)
+{
+  g_return_val_if_fail (BZ_IS_FLATPAK_ENTRY (self), NULL);
+
+  /* The nested entry tuple is passed whole, so its type is prefixed with
+     '@' rather than spelled out as BZ_FLATPAK_ENTRY_SERIAL_TYPE does */
+  return g_variant_new (
+      "(ybmsmsmsmsmsmsmsms@" BZ_ENTRY_SERIAL_TYPE ")",
+      (guchar) BZ_FLATPAK_ENTRY_SERIAL_VERSION,
+      self->user,
+      self->flatpak_name,
+      self->flatpak_id,
+      self->flatpak_version,
+      self->application_name,
+      self->application_runtime,
+      self->application_command,
+      self->runtime_name,
+      self->addon_extension_of_ref,
+      bz_entry_serialize_fixed (BZ_ENTRY (self)));
+}
+
+gboolean
+bz_flatpak_entry_deserialize_fixed (BzFlatpakEntry *self,
+                                    GVariant       *import,
+                                    GError        **error)
+{
+  GVariantIter iter          = { 0 };
+  guchar       version       = 0;
+  g_autoptr (GVariant) entry = NULL;
+
+  g_return_val_if_fail (BZ_IS_FLATPAK_ENTRY (self), FALSE);
+  g_return_val_if_fail (import != NULL, FALSE);
+
+  if (!g_variant_is_of_type (import, G_VARIANT_TYPE (BZ_FLATPAK_ENTRY_SERIAL_TYPE)))
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                   "Flatpak entry variant has unexpected type %s",
+                   g_variant_get_type_string (import));
+      return FALSE;
+    }
+
+  g_variant_iter_init (&iter, import);
+  g_variant_iter_next (&iter, "y", &version);
+  if (version != BZ_FLATPAK_ENTRY_SERIAL_VERSION)
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                   "Flatpak entry variant has unsupported version %u", version);
+      return FALSE;
+    }
+
+  clear_entry (self);
+
+  g_variant_iter_next (&iter, "b", &self->user);
+  g_variant_iter_next (&iter, "ms", &self->flatpak_name);
+  g_variant_iter_next (&iter, "ms", &self->flatpak_id);
+  self->flatpak_version        = next_interned (&iter);
+  self->application_name       = next_interned (&iter);
+  self->application_runtime    = next_interned (&iter);
+  self->application_command    = next_interned (&iter);
+  self->runtime_name           = next_interned (&iter);
+  self->addon_extension_of_ref = next_interned (&iter);
+  entry                        = g_variant_iter_next_value (&iter);
+
+  return bz_entry_deserialize_fixed (BZ_ENTRY (self), entry, error);
+}
+
 static void
 clear_entry (BzFlatpakEntry *self)
 {
   g_clear_pointer (&self->flatpak_name, g_free);
   g_clear_pointer (&self->flatpak_id, g_free);
-  g_clear_pointer (&self->flatpak_version, g_free);
-  g_clear_pointer (&self->application_name, g_free);
-  g_clear_pointer (&self->application_runtime, g_free);
-  g_clear_pointer (&self->application_command, g_free);
-  g_clear_pointer (&self->runtime_name, g_free);
-  g_clear_pointer (&self->addon_extension_of_ref, g_free);
+  g_clear_pointer (&self->flatpak_version, g_ref_string_release);
+  g_clear_pointer (&self->application_name, g_ref_string_release);
+  g_clear_pointer (&self->application_runtime, g_ref_string_release);
+  g_clear_pointer (&self->application_command, g_ref_string_release);
+  g_clear_pointer (&self->runtime_name, g_ref_string_release);
+  g_clear_pointer (&self->addon_extension_of_ref, g_ref_string_release);
+}
+
+static char *
+next_interned (GVariantIter *iter)
+{
+  const char *string = NULL;
+
+  g_variant_iter_next (iter, "m&s", &string);
+  return string != NULL ? g_ref_string_new_intern (string) : NULL;
 }
@@ -61,4 +61,26 @@ bz_flatpak_entry_launch (BzFlatpakEntry    *self,
                          BzFlatpakInstance *flatpak,
                          GError           **error);
 
+/* Entry caches start with the version byte, which can never be mistaken
+   for the first byte of the older vardict caches since those always start
+   with an ASCII key */
+#define BZ_FLATPAK_ENTRY_SERIAL_VERSION 1
+#define BZ_FLATPAK_ENTRY_SERIAL_TYPE                                 \
+  "(y"                                                               \
+  "b"                /* user */                                      \
+  "msmsmsmsmsmsmsms" /* flatpak-name, flatpak-id, flatpak-version,   \
+                        application-name, application-runtime,       \
+                        application-command, runtime-name,           \
+                        addon-extension-of-ref */                    \
+  BZ_ENTRY_SERIAL_TYPE                                               \
+  ")"
+
+GVariant *
+bz_flatpak_entry_serialize_fixed (BzFlatpakEntry *self);
+
+gboolean
+bz_flatpak_entry_deserialize_fixed (BzFlatpakEntry *self,
+                                    GVariant       *import,
+                                    GError        **error);
+
 G_END_DECLS
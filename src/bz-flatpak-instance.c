@@ -32,6 +32,7 @@
 #include "bz-flatpak-private.h"
 #include "bz-global-net.h"
 #include "bz-io.h"
+#include "bz-trace.h"
 #include "bz-util.h"
 
 /* clang-format off */
@@ -42,8 +43,6 @@ struct _BzFlatpakInstance
 {
   GObject parent_instance;
 
-  DexScheduler *scheduler;
-
   FlatpakInstallation *system;
   GFileMonitor        *system_events;
   int                  system_mute;
@@ -296,8 +295,6 @@ bz_flatpak_instance_dispose (GObject *object)
 {
   BzFlatpakInstance *self = BZ_FLATPAK_INSTANCE (object);
 
-  dex_clear (&self->scheduler);
-
   g_clear_object (&self->system);
   g_clear_object (&self->system_events);
   g_clear_object (&self->user);
@@ -323,7 +320,6 @@ bz_flatpak_instance_class_init (BzFlatpakInstanceClass *klass)
 static void
 bz_flatpak_instance_init (BzFlatpakInstance *self)
 {
-  self->scheduler   = dex_thread_pool_scheduler_new ();
   self->system_mute = 0;
   self->user_mute   = 0;
   g_mutex_init (&self->mute_mutex);
@@ -359,9 +355,10 @@ bz_flatpak_instance_load_local_package (BzBackend    *backend,
   data->cancellable = bz_object_maybe_ref (cancellable);
   data->file        = g_object_ref (file);
 
-  return dex_scheduler_spawn (
-      self->scheduler,
-      bz_get_dex_stack_size (),
+  /* The user picked the file and is looking at a spinner until it's
+     read */
+  return bz_spawn (
+      BZ_SCHEDULER_PRIORITY_INTERACTIVE,
       (DexFiberFunc) load_local_ref_fiber,
       load_local_ref_data_ref (data),
       load_local_ref_data_unref);
@@ -379,9 +376,8 @@ bz_flatpak_instance_retrieve_remote_refs (BzBackend    *backend,
   data->cancellable = bz_object_maybe_ref (cancellable);
   data->total       = 0;
 
-  return dex_scheduler_spawn (
-      self->scheduler,
-      bz_get_dex_stack_size (),
+  return bz_spawn (
+      BZ_SCHEDULER_PRIORITY_BACKGROUND,
       (DexFiberFunc) retrieve_remote_refs_fiber,
       gather_refs_data_ref (data),
       gather_refs_data_unref);
@@ -398,9 +394,10 @@ bz_flatpak_instance_retrieve_install_ids (BzBackend    *backend,
   data->self        = bz_track_weak (self);
   data->cancellable = bz_object_maybe_ref (cancellable);
 
-  return dex_scheduler_spawn (
-      self->scheduler,
-      bz_get_dex_stack_size (),
+  /* Startup waits on this before any group can show whether it's
+     installed, and so does the library page after an external change */
+  return bz_spawn (
+      BZ_SCHEDULER_PRIORITY_INTERACTIVE,
       (DexFiberFunc) retrieve_installs_fiber,
       gather_refs_data_ref (data),
       gather_refs_data_unref);
@@ -417,9 +414,8 @@ bz_flatpak_instance_retrieve_update_ids (BzBackend    *backend,
   data->self        = bz_track_weak (self);
   data->cancellable = bz_object_maybe_ref (cancellable);
 
-  return dex_scheduler_spawn (
-      self->scheduler,
-      bz_get_dex_stack_size (),
+  return bz_spawn (
+      BZ_SCHEDULER_PRIORITY_BACKGROUND,
       (DexFiberFunc) retrieve_updates_fiber,
       gather_refs_data_ref (data),
       gather_refs_data_unref);
@@ -480,9 +476,10 @@ bz_flatpak_instance_schedule_transaction (BzBackend    *backend,
   data->op_to_progress_hash = g_hash_table_new_full (g_direct_hash, g_direct_equal, g_object_unref, NULL);
   g_mutex_init (&data->mutex);
 
-  return dex_scheduler_spawn (
-      self->scheduler,
-      bz_get_dex_stack_size (),
+  /* The transactions block in libflatpak for as long as the downloads
+     and any polkit prompt take */
+  return bz_spawn (
+      BZ_SCHEDULER_PRIORITY_BLOCKING,
       (DexFiberFunc) transaction_fiber,
       transaction_data_ref (data),
       transaction_data_unref);
@@ -521,9 +518,9 @@ bz_flatpak_instance_new (void)
   data       = init_data_new ();
   data->self = g_object_new (BZ_TYPE_FLATPAK_INSTANCE, NULL);
 
-  return dex_scheduler_spawn (
-      data->self->scheduler,
-      bz_get_dex_stack_size (),
+  /* Nothing in the window can load before the installations are open */
+  return bz_spawn (
+      BZ_SCHEDULER_PRIORITY_INTERACTIVE,
       (DexFiberFunc) init_fiber,
       init_data_ref (data), init_data_unref);
 }
@@ -541,9 +538,10 @@ bz_flatpak_instance_has_flathub (BzFlatpakInstance *self,
   data->self        = bz_track_weak (self);
   data->cancellable = bz_object_maybe_ref (cancellable);
 
-  return dex_scheduler_spawn (
-      self->scheduler,
-      bz_get_dex_stack_size (),
+  /* Only lists the configured remotes, but startup is held up until it
+     knows whether to offer setting up flathub */
+  return bz_spawn (
+      BZ_SCHEDULER_PRIORITY_INTERACTIVE,
       (DexFiberFunc) check_has_flathub_fiber,
       check_has_flathub_data_ref (data), check_has_flathub_data_unref);
 }
@@ -561,9 +559,9 @@ bz_flatpak_instance_ensure_has_flathub (BzFlatpakInstance *self,
   data->self        = bz_track_weak (self);
   data->cancellable = bz_object_maybe_ref (cancellable);
 
-  return dex_scheduler_spawn (
-      self->scheduler,
-      bz_get_dex_stack_size (),
+  /* Adding a system remote waits on a polkit prompt */
+  return bz_spawn (
+      BZ_SCHEDULER_PRIORITY_BLOCKING,
       (DexFiberFunc) ensure_flathub_fiber,
       ensure_flathub_data_ref (data), ensure_flathub_data_unref);
 }
@@ -967,9 +965,8 @@ retrieve_remote_refs_fiber (GatherRefsData *data)
       job_data->installation = g_object_ref (installation);
       job_data->remote       = g_object_ref (remote);
 
-      job_future = dex_scheduler_spawn (
-          self->scheduler,
-          bz_get_dex_stack_size (),
+      job_future = bz_spawn (
+          BZ_SCHEDULER_PRIORITY_BACKGROUND,
           (DexFiberFunc) retrieve_refs_for_remote_fiber,
           retrieve_refs_for_remote_data_ref (job_data),
           retrieve_refs_for_remote_data_unref);
@@ -1055,11 +1052,14 @@ retrieve_refs_for_remote_fiber (RetrieveRefsForRemoteData *data)
   g_autoptr (GHashTable) component_hash = NULL;
   g_autoptr (GdkPaintable) remote_icon  = NULL;
   g_autoptr (GPtrArray) refs            = NULL;
+  gint64 trace_begin                    = 0;
 
   bz_weak_get_or_return_reject (self, data->parent->self);
 
   remote_name = flatpak_remote_get_name (remote);
 
+  trace_begin = bz_trace_begin ();
+
   result = flatpak_installation_update_remote_sync (
       installation,
       remote_name,
@@ -1089,6 +1089,7 @@ retrieve_refs_for_remote_fiber (RetrieveRefsForRemoteData *data)
         "Failed to synchronize appstream data for remote '%s': %s",
         remote_name,
         local_error->message);
+  bz_trace_end (trace_begin, "Flatpak", "Synchronize Remote", "%s", remote_name);
 
   appstream_dir = flatpak_remote_get_appstream_dir (remote, NULL);
   if (appstream_dir == NULL)
@@ -1112,6 +1113,8 @@ retrieve_refs_for_remote_fiber (RetrieveRefsForRemoteData *data)
 
   appstream_xml = g_file_new_for_path (appstream_xml_path);
 
+  trace_begin = bz_trace_begin ();
+
   source = xb_builder_source_new ();
   result = xb_builder_source_load_file (
       source,
@@ -1166,6 +1169,9 @@ retrieve_refs_for_remote_fiber (RetrieveRefsForRemoteData *data)
         appstream_xml_path,
         remote_name,
         local_error->message);
+  bz_trace_end (trace_begin, "Flatpak", "Compile Silo", "%s", remote_name);
+
+  trace_begin = bz_trace_begin ();
 
   root     = xb_silo_get_root (silo);
   children = xb_node_get_children (root);
@@ -1216,8 +1222,11 @@ retrieve_refs_for_remote_fiber (RetrieveRefsForRemoteData *data)
 
       g_hash_table_replace (component_hash, (gpointer) id, component);
     }
+  bz_trace_end (trace_begin, "Flatpak", "Parse Appstream", "%s: %u components",
+                remote_name, as_component_box_len (components));
 
-  refs = flatpak_installation_list_remote_refs_sync (
+  trace_begin = bz_trace_begin ();
+  refs        = flatpak_installation_list_remote_refs_sync (
       installation, remote_name, cancellable, &local_error);
   if (refs == NULL)
     SEND_AND_RETURN_ERROR (
@@ -1226,6 +1235,7 @@ retrieve_refs_for_remote_fiber (RetrieveRefsForRemoteData *data)
         "Failed to enumerate refs for remote '%s': %s",
         remote_name,
         local_error->message);
+  bz_trace_end (trace_begin, "Flatpak", "List Remote Refs", "%s: %u refs", remote_name, refs->len);
 
   {
     g_autoptr (BzBackendNotification) notif = NULL;
@@ -1243,6 +1253,7 @@ retrieve_refs_for_remote_fiber (RetrieveRefsForRemoteData *data)
   g_ptr_array_sort_values_with_data (
       refs, (GCompareDataFunc) cmp_rref, component_hash);
 
+  trace_begin = bz_trace_begin ();
   for (guint i = 0; i < refs->len; i++)
     {
       FlatpakRemoteRef *rref           = NULL;
@@ -1290,6 +1301,7 @@ retrieve_refs_for_remote_fiber (RetrieveRefsForRemoteData *data)
           send_notif_all (self, notif, TRUE);
         }
     }
+  bz_trace_end (trace_begin, "Flatpak", "Build Entries", "%s: %u refs", remote_name, refs->len);
 
   return dex_future_new_true ();
 }
@@ -1681,9 +1693,8 @@ transaction_fiber (TransactionData *data)
 
       g_ptr_array_add (
           jobs,
-          dex_scheduler_spawn (
-              self->scheduler,
-              bz_get_dex_stack_size (),
+          bz_spawn (
+              BZ_SCHEDULER_PRIORITY_BLOCKING,
               (DexFiberFunc) transaction_job_fiber,
               transaction_job_data_ref (job_data),
               transaction_job_data_unref));
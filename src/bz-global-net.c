@@ -20,6 +20,8 @@
 
 #define G_LOG_DOMAIN "BAZAAR::GLOBAL-NET"
 
+#define DEFAULT_FLATHUB_API_URL "https://flathub.org/api/v2"
+
 #include <json-glib/json-glib.h>
 
 #include "bz-env.h"
@@ -37,6 +39,34 @@ BZ_DEFINE_DATA (
     BZ_RELEASE_DATA (message, g_object_unref);
     BZ_RELEASE_DATA (splice_into, g_object_unref));
 
+BZ_DEFINE_DATA (
+    json_query,
+    JsonQuery,
+    {
+      SoupMessage   *message;
+      GOutputStream *output;
+      GBytes        *bytes;
+      char          *route;
+    },
+    BZ_RELEASE_DATA (message, g_object_unref);
+    BZ_RELEASE_DATA (output, g_object_unref);
+    BZ_RELEASE_DATA (bytes, g_bytes_unref);
+    BZ_RELEASE_DATA (route, g_free));
+
+typedef struct
+{
+  guint64 count;
+  guint64 total_bytes;
+  guint64 total_usec;
+  guint64 max_usec;
+} RouteStats;
+
+static GMutex      route_stats_mutex = { 0 };
+static GHashTable *route_stats       = NULL;
+
+static GMutex flathub_api_url_mutex = { 0 };
+static char  *flathub_api_url       = NULL;
+
 static DexFuture *
 http_send_fiber (HttpRequestData *data);
 
@@ -47,7 +77,21 @@ http_send_and_splice_finish (GObject      *object,
 
 static DexFuture *
 query_json_source_then (DexFuture     *future,
-                        GOutputStream *output_stream);
+                        JsonQueryData *data);
+
+static DexFuture *
+parse_json_fiber (JsonQueryData *data);
+
+static DexFuture *
+query_json (SoupMessage *message);
+
+static char *
+dup_route_for_uri (GUri *uri);
+
+static void
+record_route_stats (const char *route,
+                    gsize       size,
+                    gint64      usec);
 
 static DexFuture *
 send (SoupMessage   *message,
@@ -78,11 +122,8 @@ bz_send_with_global_http_session_then_splice_into (SoupMessage   *message,
 DexFuture *
 bz_https_query_json (const char *uri)
 {
-  g_autoptr (GError) local_error   = NULL;
-  g_autoptr (SoupMessage) message  = NULL;
-  SoupMessageHeaders *headers      = NULL;
-  g_autoptr (GOutputStream) output = NULL;
-  g_autoptr (DexFuture) future     = NULL;
+  g_autoptr (SoupMessage) message = NULL;
+  SoupMessageHeaders *headers     = NULL;
 
   dex_return_error_if_fail (uri != NULL);
 
@@ -90,14 +131,7 @@ bz_https_query_json (const char *uri)
   headers = soup_message_get_request_headers (message);
   soup_message_headers_append (headers, "User-Agent", "Bazaar");
 
-  output = g_memory_output_stream_new_resizable ();
-
-  future = send (message, output, TRUE);
-  future = dex_future_then (
-      future,
-      (DexFutureCallback) query_json_source_then,
-      g_object_ref (output), g_object_unref);
-  return g_steal_pointer (&future);
+  return query_json (message);
 }
 
 DexFuture *
@@ -144,19 +178,67 @@ bz_query_flathub_v2_json_authenticated_delete (const char *request,
   return query_flathub_v2_json_with_method (request, SOUP_METHOD_DELETE, token);
 }
 
+void
+bz_set_flathub_api_url (const char *url)
+{
+  g_autoptr (GMutexLocker) locker = NULL;
+
+  locker = g_mutex_locker_new (&flathub_api_url_mutex);
+  g_clear_pointer (&flathub_api_url, g_free);
+  if (url != NULL && *url != '\0')
+    {
+      flathub_api_url = g_strdup (url);
+      /* routes always begin with a slash */
+      while (g_str_has_suffix (flathub_api_url, "/"))
+        flathub_api_url[strlen (flathub_api_url) - 1] = '\0';
+    }
+}
+
+char *
+bz_dup_flathub_api_url (void)
+{
+  g_autoptr (GMutexLocker) locker = NULL;
+  const char *envvar              = NULL;
+
+  /* The environment takes precedence over the main config so a mirror
+     or a local stub server can be used without touching the config */
+  envvar = g_getenv ("BAZAAR_FLATHUB_API_URL");
+  if (envvar != NULL && *envvar != '\0')
+    {
+      g_autofree char *url = NULL;
+
+      url = g_strdup (envvar);
+      while (g_str_has_suffix (url, "/"))
+        url[strlen (url) - 1] = '\0';
+      return g_steal_pointer (&url);
+    }
+
+  locker = g_mutex_locker_new (&flathub_api_url_mutex);
+  if (flathub_api_url != NULL)
+    return g_strdup (flathub_api_url);
+  else
+    return g_strdup (DEFAULT_FLATHUB_API_URL);
+}
+
 static DexFuture *
 query_flathub_v2_json_with_method (const char *request,
                                    const char *method,
                                    const char *token)
 {
-  g_autofree char *uri             = NULL;
-  g_autoptr (SoupMessage) message  = NULL;
-  SoupMessageHeaders *headers      = NULL;
-  g_autoptr (GOutputStream) output = NULL;
-  g_autoptr (DexFuture) future     = NULL;
+  g_autofree char *base_url       = NULL;
+  g_autofree char *uri            = NULL;
+  g_autoptr (SoupMessage) message = NULL;
+  SoupMessageHeaders *headers     = NULL;
+
+  base_url = bz_dup_flathub_api_url ();
+  uri      = g_strconcat (base_url, request, NULL);
+  message  = soup_message_new (method, uri);
+  if (message == NULL)
+    return dex_future_new_reject (
+        G_IO_ERROR,
+        G_IO_ERROR_INVALID_ARGUMENT,
+        "Invalid Flathub API URI: %s", uri);
 
-  uri     = g_strdup_printf ("https://flathub.org/api/v2%s", request);
-  message = soup_message_new (method, uri);
   headers = soup_message_get_request_headers (message);
 
   soup_message_headers_append (headers, "User-Agent", "Bazaar");
@@ -169,14 +251,32 @@ query_flathub_v2_json_with_method (const char *request,
       soup_message_headers_append (headers, "Cookie", cookie_value);
     }
 
-  output = g_memory_output_stream_new_resizable ();
+  return query_json (message);
+}
 
-  future = send (message, output, TRUE);
-  future = dex_future_then (
-      future,
-      (DexFutureCallback) query_json_source_then,
-      g_object_ref (output), g_object_unref);
-  return g_steal_pointer (&future);
+GVariant *
+bz_dup_json_route_stats (void)
+{
+  g_autoptr (GMutexLocker) locker     = NULL;
+  g_autoptr (GVariantBuilder) builder = NULL;
+  GHashTableIter iter                 = { 0 };
+  const char    *route                = NULL;
+  RouteStats    *stats                = NULL;
+
+  builder = g_variant_builder_new (G_VARIANT_TYPE ("a{s(tttt)}"));
+
+  locker = g_mutex_locker_new (&route_stats_mutex);
+  if (route_stats != NULL)
+    {
+      g_hash_table_iter_init (&iter, route_stats);
+      while (g_hash_table_iter_next (&iter, (gpointer *) &route, (gpointer *) &stats))
+        g_variant_builder_add (
+            builder, "{s(tttt)}", route,
+            stats->count, stats->total_bytes,
+            stats->total_usec, stats->max_usec);
+    }
+
+  return g_variant_ref_sink (g_variant_builder_end (builder));
 }
 
 static DexFuture *
@@ -240,25 +340,58 @@ http_send_and_splice_finish (GObject      *object,
 
 static DexFuture *
 query_json_source_then (DexFuture     *future,
-                        GOutputStream *output_stream)
+                        JsonQueryData *data)
+{
+  g_autoptr (JsonQueryData) parse_data = NULL;
+  guint status                         = 0;
+
+  /* Error pages are often JSON too, and must not pass for data */
+  status = soup_message_get_status (data->message);
+  if (!SOUP_STATUS_IS_SUCCESSFUL (status))
+    return dex_future_new_reject (
+        G_IO_ERROR,
+        G_IO_ERROR_FAILED,
+        "%s replied with HTTP status %u %s",
+        data->route, status,
+        soup_message_get_reason_phrase (data->message));
+
+  /* Stealing the buffer doesn't copy it. Soup streams stay on the thread
+     that sent the message, but the parse itself can move elsewhere */
+  parse_data        = json_query_data_new ();
+  parse_data->bytes = g_memory_output_stream_steal_as_bytes (
+      G_MEMORY_OUTPUT_STREAM (data->output));
+  parse_data->route = g_strdup (data->route);
+
+  /* This file is also linked into the download worker, which doesn't
+     have bz_spawn (), so use the default pool. Parses are short and
+     always something the user is looking at anyway */
+  return dex_scheduler_spawn (
+      dex_thread_pool_scheduler_get_default (),
+      bz_get_dex_stack_size (),
+      (DexFiberFunc) parse_json_fiber,
+      json_query_data_ref (parse_data),
+      json_query_data_unref);
+}
+
+static DexFuture *
+parse_json_fiber (JsonQueryData *data)
 {
   g_autoptr (GError) local_error = NULL;
-  g_autoptr (GBytes) bytes       = NULL;
   gsize         bytes_size       = 0;
   gconstpointer bytes_data       = NULL;
   g_autoptr (JsonParser) parser  = NULL;
   gboolean  result               = FALSE;
   JsonNode *node                 = NULL;
+  gint64    start_time           = 0;
 
-  bytes = g_memory_output_stream_steal_as_bytes (
-      G_MEMORY_OUTPUT_STREAM (output_stream));
-  bytes_data = g_bytes_get_data (bytes, &bytes_size);
-
+  bytes_data = g_bytes_get_data (data->bytes, &bytes_size);
   if (bytes_size == 0)
     return dex_future_new_take_boxed (JSON_TYPE_NODE, json_node_new (JSON_NODE_NULL));
 
-  parser = json_parser_new_immutable ();
-  result = json_parser_load_from_data (parser, bytes_data, bytes_size, &local_error);
+  start_time = g_get_monotonic_time ();
+  parser     = json_parser_new_immutable ();
+  result     = json_parser_load_from_data (parser, bytes_data, bytes_size, &local_error);
+  record_route_stats (data->route, bytes_size, g_get_monotonic_time () - start_time);
   if (!result)
     return dex_future_new_for_error (g_steal_pointer (&local_error));
 
@@ -266,6 +399,80 @@ query_json_source_then (DexFuture     *future,
   return dex_future_new_take_boxed (JSON_TYPE_NODE, json_node_ref (node));
 }
 
+static DexFuture *
+query_json (SoupMessage *message)
+{
+  g_autoptr (JsonQueryData) data = NULL;
+  g_autoptr (DexFuture) future   = NULL;
+
+  data          = json_query_data_new ();
+  data->message = g_object_ref (message);
+  data->output  = g_memory_output_stream_new_resizable ();
+  data->route   = dup_route_for_uri (soup_message_get_uri (message));
+
+  future = send (message, data->output, TRUE);
+  future = dex_future_then (
+      future,
+      (DexFutureCallback) query_json_source_then,
+      json_query_data_ref (data), json_query_data_unref);
+  return g_steal_pointer (&future);
+}
+
+static char *
+dup_route_for_uri (GUri *uri)
+{
+  g_auto (GStrv) segments   = NULL;
+  g_autoptr (GString) route = NULL;
+
+  route = g_string_new (g_uri_get_host (uri));
+
+  /* Collapse app ids and such so that routes like /stats/<id> are
+     accounted together rather than one entry per app */
+  segments = g_strsplit (g_uri_get_path (uri), "/", -1);
+  for (guint i = 0; segments[i] != NULL; i++)
+    {
+      if (*segments[i] == '\0')
+        continue;
+
+      g_string_append_c (route, '/');
+      if (strchr (segments[i], '.') != NULL ||
+          g_ascii_isdigit (*segments[i]))
+        g_string_append_c (route, '*');
+      else
+        g_string_append (route, segments[i]);
+    }
+
+  return g_string_free (g_steal_pointer (&route), FALSE);
+}
+
+static void
+record_route_stats (const char *route,
+                    gsize       size,
+                    gint64      usec)
+{
+  g_autoptr (GMutexLocker) locker = NULL;
+  RouteStats *stats               = NULL;
+
+  locker = g_mutex_locker_new (&route_stats_mutex);
+  if (route_stats == NULL)
+    route_stats = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+
+  stats = g_hash_table_lookup (route_stats, route);
+  if (stats == NULL)
+    {
+      stats = g_new0 (RouteStats, 1);
+      g_hash_table_replace (route_stats, g_strdup (route), stats);
+    }
+
+  stats->count++;
+  stats->total_bytes += size;
+  stats->total_usec += usec;
+  stats->max_usec = MAX (stats->max_usec, (guint64) usec);
+
+  g_debug ("Parsed %zu bytes of JSON from %s in %" G_GINT64_FORMAT " usec",
+           size, route, usec);
+}
+
 static DexFuture *
 send (SoupMessage   *message,
       GOutputStream *splice_into,
@@ -52,4 +52,13 @@ bz_query_flathub_v2_json_authenticated_delete (const char *request,
 DexFuture *
 bz_query_flathub_v2_json_take (char *request);
 
+void
+bz_set_flathub_api_url (const char *url);
+
+char *
+bz_dup_flathub_api_url (void);
+
+GVariant *
+bz_dup_json_route_stats (void);
+
 G_END_DECLS
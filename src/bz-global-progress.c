@@ -77,12 +77,16 @@ global_progress_bar_theme_changed (BzGlobalProgress *self,
                                    const char       *key,
                                    GSettings        *settings);
 
+static void
+update_tick (BzGlobalProgress *self);
+
 static void
 bz_global_progress_dispose (GObject *object)
 {
   BzGlobalProgress *self = BZ_GLOBAL_PROGRESS (object);
 
-  gtk_widget_remove_tick_callback (GTK_WIDGET (self), self->tick);
+  if (self->tick > 0)
+    gtk_widget_remove_tick_callback (GTK_WIDGET (self), self->tick);
   self->tick = 0;
 
   if (self->settings != NULL)
@@ -558,10 +562,7 @@ tick_cb (BzGlobalProgress *self,
     linear_value = 2.0 - linear_value;
 
   self->pending_time_mod = adw_easing_ease (ADW_EASE_IN_OUT_CUBIC, linear_value);
-
-  if (self->pending_progress > 0.0 &&
-      self->transition_progress > 0.0)
-    gtk_widget_queue_draw (GTK_WIDGET (self));
+  gtk_widget_queue_draw (GTK_WIDGET (self));
 
   return G_SOURCE_CONTINUE;
 }
@@ -578,8 +579,6 @@ bz_global_progress_init (BzGlobalProgress *self)
 
   self->expand_size = 100;
 
-  self->tick = gtk_widget_add_tick_callback (GTK_WIDGET (self), (GtkTickCallback) tick_cb, NULL, NULL);
-
   transition_target          = adw_property_animation_target_new (G_OBJECT (self), "transition-progress");
   transition_spring          = adw_spring_params_new (0.75, 0.8, 200.0);
   self->transition_animation = adw_spring_animation_new (
@@ -793,6 +792,7 @@ bz_global_progress_set_transition_progress (BzGlobalProgress *self,
 
   self->transition_progress = MAX (progress, 0.0);
   gtk_widget_queue_resize (GTK_WIDGET (self));
+  update_tick (self);
 
   g_object_notify_by_pspec (G_OBJECT (self), props[PROP_TRANSITION_PROGRESS]);
 }
@@ -812,6 +812,7 @@ bz_global_progress_set_pending_progress (BzGlobalProgress *self,
 
   self->pending_progress = MAX (progress, 0.0);
   gtk_widget_queue_draw (GTK_WIDGET (self));
+  update_tick (self);
 
   g_object_notify_by_pspec (G_OBJECT (self), props[PROP_PENDING_PROGRESS]);
 }
@@ -883,3 +884,25 @@ global_progress_bar_theme_changed (BzGlobalProgress *self,
 {
   gtk_widget_queue_draw (GTK_WIDGET (self));
 }
+
+static void
+update_tick (BzGlobalProgress *self)
+{
+  gboolean needs_tick = FALSE;
+
+  /* The pending animation is the only thing driven by the frame clock
+     directly, so only keep the tick callback around while it is actually
+     visible. Otherwise an idle window would wake up every frame for
+     nothing. */
+  needs_tick = self->pending_progress > 0.0 &&
+               self->transition_progress > 0.0;
+
+  if (needs_tick && self->tick == 0)
+    self->tick = gtk_widget_add_tick_callback (
+        GTK_WIDGET (self), (GtkTickCallback) tick_cb, NULL, NULL);
+  else if (!needs_tick && self->tick > 0)
+    {
+      gtk_widget_remove_tick_callback (GTK_WIDGET (self), self->tick);
+      self->tick = 0;
+    }
+}
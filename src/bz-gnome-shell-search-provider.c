@@ -450,7 +450,7 @@ start_request (BzGnomeShellSearchProvider *self,
   data->application = g_application_get_default ();
   g_application_hold (data->application);
 
-  future = bz_search_engine_query (self->engine, terms);
+  future = bz_search_engine_query (self->engine, terms, NULL);
   future = dex_future_finally (
       future, (DexFutureCallback) request_finally,
       request_data_ref (data), request_data_unref);
@@ -20,10 +20,9 @@
 
 #include <adwaita.h>
 
+#include "bz-accent-css.h"
 #include "bz-group-tile-css-watcher.h"
 
-#define LUMINANCE_THRESHOLD 130.0
-
 struct _BzGroupTileCssWatcher
 {
   GObject parent_instance;
@@ -31,11 +30,7 @@ struct _BzGroupTileCssWatcher
   GWeakRef      widget;
   BzEntryGroup *group;
 
-  GtkCssProvider *css;
-  char           *light_class;
-  char           *dark_class;
-  char           *light_text_class;
-  char           *dark_text_class;
+  BzAccentRule *rule;
 };
 
 G_DEFINE_FINAL_TYPE (BzGroupTileCssWatcher, bz_group_tile_css_watcher, G_TYPE_OBJECT);
@@ -146,7 +141,7 @@ dark_changed (BzGroupTileCssWatcher *self,
   g_autoptr (GtkWidget) widget = NULL;
   gboolean is_dark;
 
-  if (self->css == NULL)
+  if (self->rule == NULL)
     return;
 
   widget = g_weak_ref_get (&self->widget);
@@ -155,13 +150,8 @@ dark_changed (BzGroupTileCssWatcher *self,
 
   is_dark = adw_style_manager_get_dark (adw_style_manager_get_default ());
 
-  gtk_widget_remove_css_class (widget, self->light_class);
-  gtk_widget_remove_css_class (widget, self->dark_class);
-  gtk_widget_remove_css_class (widget, self->light_text_class);
-  gtk_widget_remove_css_class (widget, self->dark_text_class);
-
-  gtk_widget_add_css_class (widget, is_dark ? self->dark_class : self->light_class);
-  gtk_widget_add_css_class (widget, is_dark ? self->dark_text_class : self->light_text_class);
+  gtk_widget_remove_css_class (widget, bz_accent_rule_get_class (self->rule, !is_dark));
+  gtk_widget_add_css_class (widget, bz_accent_rule_get_class (self->rule, is_dark));
 }
 
 static void
@@ -226,35 +216,13 @@ bz_group_tile_css_watcher_set_group (BzGroupTileCssWatcher *self,
   g_object_notify_by_pspec (G_OBJECT (self), props[PROP_GROUP]);
 }
 
-static gdouble
-get_luminance (GdkRGBA *rgba)
-{
-  return (0.299 * rgba->red * 255.0) +
-         (0.587 * rgba->green * 255.0) +
-         (0.114 * rgba->blue * 255.0);
-}
-
-static gboolean
-color_is_light (const char *hex_color)
-{
-  GdkRGBA rgba;
-  gdouble luminance;
-
-  if (hex_color == NULL || !gdk_rgba_parse (&rgba, hex_color))
-    return FALSE;
-
-  luminance = get_luminance (&rgba);
-
-  return luminance > LUMINANCE_THRESHOLD;
-}
-
 static void
 refresh (BzGroupTileCssWatcher *self)
 {
   g_autoptr (GtkWidget) widget   = NULL;
-  const char *id                 = NULL;
   const char *light_accent_color = NULL;
   const char *dark_accent_color  = NULL;
+  gboolean    is_dark            = FALSE;
 
   clear (self);
 
@@ -263,54 +231,20 @@ refresh (BzGroupTileCssWatcher *self)
       widget == NULL)
     return;
 
-  id                 = bz_entry_group_get_id (self->group);
   light_accent_color = bz_entry_group_get_light_accent_color (self->group);
   dark_accent_color  = bz_entry_group_get_dark_accent_color (self->group);
+  if (light_accent_color == NULL &&
+      dark_accent_color == NULL)
+    return;
 
-  if (light_accent_color != NULL ||
-      dark_accent_color != NULL)
-    {
-      g_autoptr (GString) fixed_id = NULL;
-      g_autofree char *css_string  = NULL;
-      gboolean         is_dark;
-
-      fixed_id = g_string_new (id);
-      g_string_replace (fixed_id, ".", "--", 0);
-
-      self->light_class = g_strdup_printf ("%s-light", fixed_id->str);
-      self->dark_class  = g_strdup_printf ("%s-dark", fixed_id->str);
-
-      self->light_text_class = g_strdup (
-          color_is_light (light_accent_color != NULL ? light_accent_color : dark_accent_color)
-              ? "flathub-gunmetal"
-              : "flathub-lotion");
-
-      self->dark_text_class = g_strdup (
-          color_is_light (dark_accent_color != NULL ? dark_accent_color : light_accent_color)
-              ? "flathub-gunmetal"
-              : "flathub-lotion");
-
-      css_string = g_strdup_printf (
-          ".%s{background-color:%s;}\n"
-          ".%s{background-color:%s;}",
-          self->light_class,
-          light_accent_color != NULL ? light_accent_color : dark_accent_color,
-          self->dark_class,
-          dark_accent_color != NULL ? dark_accent_color : light_accent_color);
-
-      self->css = gtk_css_provider_new ();
-      gtk_css_provider_load_from_string (
-          self->css, css_string);
-      gtk_style_context_add_provider_for_display (
-          gdk_display_get_default (),
-          GTK_STYLE_PROVIDER (self->css),
-          GTK_STYLE_PROVIDER_PRIORITY_APPLICATION);
-
-      is_dark = adw_style_manager_get_dark (adw_style_manager_get_default ());
-
-      gtk_widget_add_css_class (widget, is_dark ? self->dark_class : self->light_class);
-      gtk_widget_add_css_class (widget, is_dark ? self->dark_text_class : self->light_text_class);
-    }
+  self->rule = bz_accent_css_acquire (
+      bz_entry_group_get_id (self->group),
+      light_accent_color,
+      dark_accent_color);
+
+  is_dark = adw_style_manager_get_dark (adw_style_manager_get_default ());
+
+  gtk_widget_add_css_class (widget, bz_accent_rule_get_class (self->rule, is_dark));
 }
 
 static void
@@ -318,29 +252,17 @@ clear (BzGroupTileCssWatcher *self)
 {
   g_autoptr (GtkWidget) widget = NULL;
 
+  if (self->rule == NULL)
+    return;
+
   widget = g_weak_ref_get (&self->widget);
   if (widget != NULL)
     {
-      if (self->light_class != NULL)
-        gtk_widget_remove_css_class (widget, self->light_class);
-      if (self->dark_class != NULL)
-        gtk_widget_remove_css_class (widget, self->dark_class);
-      if (self->light_text_class != NULL)
-        gtk_widget_remove_css_class (widget, self->light_text_class);
-      if (self->dark_text_class != NULL)
-        gtk_widget_remove_css_class (widget, self->dark_text_class);
+      gtk_widget_remove_css_class (widget, bz_accent_rule_get_class (self->rule, FALSE));
+      gtk_widget_remove_css_class (widget, bz_accent_rule_get_class (self->rule, TRUE));
     }
 
-  g_clear_pointer (&self->light_class, g_free);
-  g_clear_pointer (&self->dark_class, g_free);
-  g_clear_pointer (&self->light_text_class, g_free);
-  g_clear_pointer (&self->dark_text_class, g_free);
-
-  if (self->css != NULL)
-    gtk_style_context_remove_provider_for_display (
-        gdk_display_get_default (),
-        GTK_STYLE_PROVIDER (self->css));
-  g_clear_pointer (&self->css, g_object_unref);
+  g_clear_pointer (&self->rule, bz_accent_css_release);
 }
 
 /* End of bz-group-tile-css-watcher.c */
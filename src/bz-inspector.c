@@ -18,8 +18,23 @@
  * SPDX-License-Identifier: GPL-3.0-or-later
  */
 
+#include "config.h"
+
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
 #include "bz-inspector.h"
+#include "bz-async-texture.h"
+#include "bz-download-worker.h"
 #include "bz-entry-inspector.h"
+#include "bz-global-net.h"
+#include "bz-memory-stats.h"
+#include "bz-util.h"
+#include "bz-window.h"
+
+/* The memory panel walks every group, so don't do it every tick */
+#define MEMORY_REFRESH_TICKS 3
 
 struct _BzInspector
 {
@@ -29,6 +44,19 @@ struct _BzInspector
 
   GBinding *debug_mode_binding;
 
+  guint    refresh_timeout;
+  gint64   last_frame_counter;
+  GWeakRef last_frame_clock;
+
+  guint      memory_ticks;
+  DexFuture *memory_future;
+
+  GtkLabel           *frame_clock_label;
+  GtkLabel           *texture_loads_label;
+  GtkLabel           *download_workers_label;
+  GtkLabel           *search_latency_label;
+  GtkLabel           *json_stats_label;
+  GtkLabel           *memory_stats_label;
   GtkCheckButton     *debug_mode_check;
   GtkEditable        *search_entry;
   GtkFilterListModel *filter_model;
@@ -50,6 +78,35 @@ static gboolean
 filter_func (BzEntryGroup *group,
              BzInspector  *self);
 
+static gboolean
+refresh_timeout_cb (BzInspector *self);
+
+static void
+refresh_frame_clock (BzInspector *self);
+
+static void
+refresh_search_latency (BzInspector *self);
+
+static void
+refresh_texture_loads (BzInspector *self);
+
+static void
+refresh_download_workers (BzInspector *self);
+
+static void
+refresh_json_stats (BzInspector *self);
+
+static void
+refresh_memory_stats (BzInspector *self);
+
+static DexFuture *
+memory_stats_then (DexFuture *future,
+                   GWeakRef  *wr);
+
+static DexFuture *
+sweep_then (DexFuture *future,
+            GWeakRef  *wr);
+
 static void
 bz_inspector_dispose (GObject *object)
 {
@@ -59,6 +116,10 @@ bz_inspector_dispose (GObject *object)
 
   g_clear_object (&self->debug_mode_binding);
 
+  g_clear_handle_id (&self->refresh_timeout, g_source_remove);
+  g_weak_ref_clear (&self->last_frame_clock);
+  dex_clear (&self->memory_future);
+
   G_OBJECT_CLASS (bz_inspector_parent_class)->dispose (object);
 }
 
@@ -135,6 +196,53 @@ decache_and_inspect_cb (GtkListItem *list_item,
     }
 }
 
+static void
+drop_textures_cb (BzInspector *self,
+                  GtkButton   *button)
+{
+  guint n_dropped = 0;
+
+  n_dropped = bz_async_texture_drop_undrawn (G_USEC_PER_SEC);
+  g_debug ("Dropped %u undrawn textures", n_dropped);
+
+  refresh_memory_stats (self);
+}
+
+static void
+sweep_entry_cache_cb (BzInspector *self,
+                      GtkButton   *button)
+{
+  BzEntryCacheManager *cache   = NULL;
+  g_autoptr (DexFuture) future = NULL;
+
+  if (self->state == NULL)
+    return;
+  cache = bz_state_info_get_cache_manager (self->state);
+  if (cache == NULL)
+    return;
+
+  future = bz_entry_cache_manager_sweep (cache);
+  future = dex_future_then (
+      future, (DexFutureCallback) sweep_then,
+      bz_track_weak (self), bz_weak_release);
+  future = dex_future_then (
+      future, (DexFutureCallback) memory_stats_then,
+      bz_track_weak (self), bz_weak_release);
+
+  dex_clear (&self->memory_future);
+  self->memory_future = g_steal_pointer (&future);
+}
+
+static void
+trim_heap_cb (BzInspector *self,
+              GtkButton   *button)
+{
+#ifdef __GLIBC__
+  malloc_trim (0);
+#endif
+  refresh_memory_stats (self);
+}
+
 static char *
 format_uint (gpointer object,
              guint    value)
@@ -162,11 +270,20 @@ bz_inspector_class_init (BzInspectorClass *klass)
   g_object_class_install_properties (object_class, LAST_PROP, props);
 
   gtk_widget_class_set_template_from_resource (widget_class, "/io/github/kolunmi/Bazaar/bz-inspector.ui");
+  gtk_widget_class_bind_template_child (widget_class, BzInspector, frame_clock_label);
+  gtk_widget_class_bind_template_child (widget_class, BzInspector, texture_loads_label);
+  gtk_widget_class_bind_template_child (widget_class, BzInspector, download_workers_label);
+  gtk_widget_class_bind_template_child (widget_class, BzInspector, search_latency_label);
+  gtk_widget_class_bind_template_child (widget_class, BzInspector, json_stats_label);
+  gtk_widget_class_bind_template_child (widget_class, BzInspector, memory_stats_label);
   gtk_widget_class_bind_template_child (widget_class, BzInspector, debug_mode_check);
   gtk_widget_class_bind_template_child (widget_class, BzInspector, search_entry);
   gtk_widget_class_bind_template_child (widget_class, BzInspector, filter_model);
   gtk_widget_class_bind_template_callback (widget_class, decache_and_inspect_cb);
   gtk_widget_class_bind_template_callback (widget_class, entry_changed);
+  gtk_widget_class_bind_template_callback (widget_class, drop_textures_cb);
+  gtk_widget_class_bind_template_callback (widget_class, sweep_entry_cache_cb);
+  gtk_widget_class_bind_template_callback (widget_class, trim_heap_cb);
   gtk_widget_class_bind_template_callback (widget_class, format_uint);
 }
 
@@ -179,6 +296,10 @@ bz_inspector_init (BzInspector *self)
 
   filter = gtk_custom_filter_new ((GtkCustomFilterFunc) filter_func, self, NULL);
   gtk_filter_list_model_set_filter (self->filter_model, GTK_FILTER (filter));
+
+  g_weak_ref_init (&self->last_frame_clock, NULL);
+  self->refresh_timeout = g_timeout_add_seconds (
+      1, (GSourceFunc) refresh_timeout_cb, self);
 }
 
 BzInspector *
@@ -238,4 +359,238 @@ filter_func (BzEntryGroup *group,
   return FALSE;
 }
 
+static gboolean
+refresh_timeout_cb (BzInspector *self)
+{
+  refresh_frame_clock (self);
+  refresh_search_latency (self);
+  refresh_texture_loads (self);
+  refresh_download_workers (self);
+  refresh_json_stats (self);
+
+  if (self->memory_ticks++ % MEMORY_REFRESH_TICKS == 0)
+    refresh_memory_stats (self);
+
+  return G_SOURCE_CONTINUE;
+}
+
+static void
+refresh_frame_clock (BzInspector *self)
+{
+  GApplication  *application            = NULL;
+  GList         *windows                = NULL;
+  GdkFrameClock *frame_clock            = NULL;
+  gint64         counter                = 0;
+  g_autoptr (GdkFrameClock) last_clock  = NULL;
+  g_autofree char *label                = NULL;
+
+  /* Sample the frame counter of the main window rather than connecting to
+     the frame clock, so that watching it doesn't cause any extra wakeups.
+     An idle window with no animations running should report 0 here. */
+  application = g_application_get_default ();
+  if (GTK_IS_APPLICATION (application))
+    windows = gtk_application_get_windows (GTK_APPLICATION (application));
+  for (GList *l = windows; l != NULL; l = l->next)
+    {
+      if (BZ_IS_WINDOW (l->data))
+        {
+          frame_clock = gtk_widget_get_frame_clock (GTK_WIDGET (l->data));
+          break;
+        }
+    }
+
+  if (frame_clock == NULL)
+    {
+      g_weak_ref_set (&self->last_frame_clock, NULL);
+      gtk_label_set_label (self->frame_clock_label, "N/A");
+      return;
+    }
+
+  counter    = gdk_frame_clock_get_frame_counter (frame_clock);
+  last_clock = g_weak_ref_get (&self->last_frame_clock);
+
+  if (last_clock == frame_clock)
+    label = g_strdup_printf (
+        "%" G_GINT64_FORMAT " frames/s",
+        counter - self->last_frame_counter);
+  else
+    label = g_strdup ("...");
+  gtk_label_set_label (self->frame_clock_label, label);
+
+  g_weak_ref_set (&self->last_frame_clock, frame_clock);
+  self->last_frame_counter = counter;
+}
+
+static void
+refresh_search_latency (BzInspector *self)
+{
+  BzSearchEngine *engine       = NULL;
+  g_autoptr (GArray) histogram = NULL;
+  g_autoptr (GString) string   = NULL;
+  guint64 max                  = 0;
+
+  if (self->state == NULL)
+    return;
+  engine = bz_state_info_get_search_engine (self->state);
+  if (engine == NULL)
+    return;
+
+  histogram = bz_search_engine_dup_latency_histogram (engine);
+  for (guint i = 0; i < histogram->len; i++)
+    max = MAX (max, g_array_index (histogram, guint64, i));
+
+  string = g_string_new (NULL);
+  g_string_append_printf (
+      string, "average: %0.2f ms\n",
+      bz_search_engine_get_average_latency (engine));
+
+  for (guint i = 0; i < histogram->len; i++)
+    {
+      guint64 count = 0;
+      guint   width = 0;
+
+      count = g_array_index (histogram, guint64, i);
+      width = max > 0 ? (guint) (40 * count / max) : 0;
+
+      if (i == 0)
+        g_string_append_printf (string, "<  %4u", 1u);
+      else if (i == histogram->len - 1)
+        g_string_append_printf (string, ">= %4u", 1u << (i - 1));
+      else
+        g_string_append_printf (string, "<  %4u", 1u << i);
+
+      g_string_append (string, " ms | ");
+      for (guint j = 0; j < width; j++)
+        g_string_append (string, "#");
+      g_string_append_printf (string, " %" G_GUINT64_FORMAT "\n", count);
+    }
+
+  gtk_label_set_label (self->search_latency_label, string->str);
+}
+
+static void
+refresh_texture_loads (BzInspector *self)
+{
+  g_autofree char *label = NULL;
+  guint raw_hits         = 0;
+  guint decodes          = 0;
+
+  bz_async_texture_get_decode_stats (&raw_hits, &decodes);
+
+  /* How long a texture spends drawn on screen without contents, which is
+     what scrolling quickly through a long list of tiles is bound by */
+  label = g_strdup_printf (
+      "%.1f ms to visible, %u queued, %u raw hits, %u decodes",
+      bz_async_texture_get_average_time_to_visible (),
+      bz_async_texture_get_n_pending_loads (),
+      raw_hits, decodes);
+  gtk_label_set_label (self->texture_loads_label, label);
+}
+
+static void
+refresh_download_workers (BzInspector *self)
+{
+  g_autofree char *label = NULL;
+  g_autofree char *size  = NULL;
+  guint   n_workers      = 0;
+  guint64 replies        = 0;
+  guint64 http2_replies  = 0;
+  guint64 tls_handshakes = 0;
+  guint64 bytes          = 0;
+  double  queue_wait     = 0.0;
+
+  bz_download_worker_get_stats (&n_workers, &replies, &http2_replies,
+                                &tls_handshakes, &bytes, &queue_wait);
+
+  size  = g_format_size (bytes);
+  label = g_strdup_printf (
+      "%u running, %" G_GUINT64_FORMAT "/%" G_GUINT64_FORMAT " over HTTP/2, "
+      "%" G_GUINT64_FORMAT " TLS handshakes, %s, %.1f ms avg queue wait",
+      n_workers, http2_replies, replies, tls_handshakes, size, queue_wait);
+  gtk_label_set_label (self->download_workers_label, label);
+}
+
+static void
+refresh_json_stats (BzInspector *self)
+{
+  g_autoptr (GVariant) stats = NULL;
+  g_autoptr (GString) string = NULL;
+  GVariantIter iter          = { 0 };
+  const char  *route         = NULL;
+  guint64      count         = 0;
+  guint64      total_bytes   = 0;
+  guint64      total_usec    = 0;
+  guint64      max_usec      = 0;
+
+  stats  = bz_dup_json_route_stats ();
+  string = g_string_new (NULL);
+
+  g_variant_iter_init (&iter, stats);
+  while (g_variant_iter_next (&iter, "{&s(tttt)}", &route, &count, &total_bytes, &total_usec, &max_usec))
+    {
+      g_autofree char *size = NULL;
+
+      size = g_format_size (total_bytes / count);
+      if (string->len > 0)
+        g_string_append_c (string, '\n');
+      g_string_append_printf (
+          string, "%s: %" G_GUINT64_FORMAT "x, avg %s, avg %.2f ms, max %.2f ms",
+          route, count, size,
+          (double) total_usec / (double) count / 1000.0,
+          (double) max_usec / 1000.0);
+    }
+
+  gtk_label_set_label (self->json_stats_label, string->len > 0 ? string->str : "N/A");
+}
+
+static void
+refresh_memory_stats (BzInspector *self)
+{
+  g_autoptr (DexFuture) future = NULL;
+
+  if (self->state == NULL)
+    return;
+  /* Still waiting on the last one */
+  if (self->memory_future != NULL &&
+      dex_future_is_pending (self->memory_future))
+    return;
+
+  future = bz_memory_stats_collect (self->state);
+  future = dex_future_then (
+      future, (DexFutureCallback) memory_stats_then,
+      bz_track_weak (self), bz_weak_release);
+
+  dex_clear (&self->memory_future);
+  self->memory_future = g_steal_pointer (&future);
+}
+
+static DexFuture *
+memory_stats_then (DexFuture *future,
+                   GWeakRef  *wr)
+{
+  g_autoptr (BzInspector) self = NULL;
+  const GValue *value          = NULL;
+  g_autofree char *text        = NULL;
+
+  bz_weak_get_or_return_reject (self, wr);
+
+  value = dex_future_get_value (future, NULL);
+  text  = bz_memory_stats_format (g_value_get_variant (value));
+  gtk_label_set_label (self->memory_stats_label, text);
+
+  return dex_future_new_true ();
+}
+
+static DexFuture *
+sweep_then (DexFuture *future,
+            GWeakRef  *wr)
+{
+  g_autoptr (BzInspector) self = NULL;
+
+  bz_weak_get_or_return_reject (self, wr);
+
+  /* Show what the sweep reclaimed */
+  return bz_memory_stats_collect (self->state);
+}
+
 /* End of bz-inspector.c */
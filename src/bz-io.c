@@ -18,107 +18,237 @@
  * SPDX-License-Identifier: GPL-3.0-or-later
  */
 
-#include "bz-io.h"
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <glib/gstdio.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
 #include "bz-env.h"
+#include "bz-io.h"
+#include "bz-util.h"
+
+/* Reaped paths are renamed into a trash directory next to them, which
+   is atomic as long as it stays on the same filesystem, and the actual
+   deletion happens in the background. Whatever is left in a trash
+   directory after a crash is picked up by bz_resume_reaping (). */
+#define TRASH_DIR_NAME   ".bazaar-trash"
+#define MAX_REAP_THREADS 4
+
+/* Per app total from the last walk, shown until a new walk finishes.
+   Files that grow in place don't touch their directory's mtime, so
+   every walk stats every file and the total is all that is kept. */
+#define USER_DATA_SIZE_CACHE_VERSION 2
+#define USER_DATA_SIZE_CACHE_TYPE    "(ut)"
+
+/* Background worker threads run at a lower CPU and IO priority, see
+   setpriority(2) and ioprio_set(2) */
+#define LOWEST_NICE             19
+#define BACKGROUND_IOPRIO_LEVEL 7
+
+#ifndef IOPRIO_CLASS_SHIFT
+#define IOPRIO_CLASS_SHIFT 13
+#endif
+#ifndef IOPRIO_CLASS_BE
+#define IOPRIO_CLASS_BE 2
+#endif
+#ifndef IOPRIO_CLASS_IDLE
+#define IOPRIO_CLASS_IDLE 3
+#endif
+#ifndef IOPRIO_WHO_PROCESS
+#define IOPRIO_WHO_PROCESS 1
+#endif
+
+typedef struct _DeleteJob DeleteJob;
+struct _DeleteJob
+{
+  DeleteJob *parent;
+  char      *path;
+  gint       pending;
+};
+
+BZ_DEFINE_DATA (
+    walk,
+    Walk,
+    {
+      char   *path;
+      dev_t   dev;
+      guint64 size;
+    },
+    BZ_RELEASE_DATA (path, g_free));
+
+BZ_DEFINE_DATA (
+    spawn,
+    Spawn,
+    {
+      DexFiberFunc   func;
+      gpointer       user_data;
+      GDestroyNotify destroy;
+    },
+    BZ_RELEASE_DATA (user_data, self->destroy));
+
+static GThreadPool *reap_pool = NULL;
+
+/* app id -> guint64 *, the last computed totals */
+static GMutex      user_data_sizes_mutex = { 0 };
+static GHashTable *user_data_sizes       = NULL;
 
 static DexFuture *
 reap_file_fiber (GFile *file);
 static DexFuture *
 reap_path_fiber (char *path);
 
-static DexFuture *
-get_directory_size_fiber (GFile *file);
 static DexFuture *
 get_user_data_size_fiber (char *app_id);
 static DexFuture *
+peek_user_data_size_fiber (char *app_id);
+static DexFuture *
 get_all_user_data_ids_fiber (void);
 
-DexScheduler *
-bz_get_io_scheduler (void)
+static void
+reap_file_in_place (GFile *file);
+
+static GThreadPool *
+get_reap_pool (void);
+
+static void
+queue_deletion (DeleteJob *parent,
+                char      *path);
+
+static void
+delete_job_func (DeleteJob *job,
+                 gpointer   user_data);
+
+static void
+finish_delete_job (DeleteJob *job);
+
+static void
+resume_trash_dir (const char *trash_dir);
+
+static DexFuture *
+walk_fiber (WalkData *data);
+
+static guint64
+walk_directory (int         parent_fd,
+                const char *name,
+                dev_t       dev,
+                GPtrArray  *subdirs);
+
+static char *
+dup_user_data_size_cache_path (const char *app_id);
+
+static gboolean
+load_user_data_size_cache (const char *app_id,
+                           guint64    *total);
+
+static void
+save_user_data_size_cache (const char *app_id,
+                           guint64     total);
+
+static void
+remember_user_data_size (const char *app_id,
+                         guint64     size);
+
+static DexScheduler *
+get_scheduler (BzSchedulerPriority priority);
+
+static DexFuture *
+background_fiber (SpawnData *data);
+
+static void
+deprioritize_current_thread (void);
+
+DexFuture *
+bz_spawn (BzSchedulerPriority priority,
+          DexFiberFunc        func,
+          gpointer            user_data,
+          GDestroyNotify      destroy)
 {
-  static DexScheduler *scheduler = NULL;
+  g_autoptr (SpawnData) data = NULL;
+
+  dex_return_error_if_fail (func != NULL);
+
+  if (priority != BZ_SCHEDULER_PRIORITY_BACKGROUND)
+    return dex_scheduler_spawn (
+        get_scheduler (priority),
+        bz_get_dex_stack_size (),
+        func, user_data, destroy);
 
-  if (g_once_init_enter_pointer (&scheduler))
-    g_once_init_leave_pointer (&scheduler, dex_thread_pool_scheduler_new ());
+  data            = spawn_data_new ();
+  data->func      = func;
+  data->user_data = user_data;
+  data->destroy   = destroy;
 
-  return scheduler;
+  return dex_scheduler_spawn (
+      get_scheduler (priority),
+      bz_get_dex_stack_size (),
+      (DexFiberFunc) background_fiber,
+      spawn_data_ref (data), spawn_data_unref);
 }
 
 void
 bz_reap_file (GFile *file)
 {
-  g_autoptr (GError) local_error         = NULL;
-  g_autofree gchar *uri                  = NULL;
-  g_autoptr (GFileEnumerator) enumerator = NULL;
-  gboolean result                        = FALSE;
+  g_autofree char *path       = NULL;
+  g_autofree char *parent     = NULL;
+  g_autofree char *trash_dir  = NULL;
+  g_autofree char *uuid       = NULL;
+  g_autofree char *trash_path = NULL;
 
   g_return_if_fail (G_IS_FILE (file));
 
-  uri = g_file_get_uri (file);
-  if (uri == NULL)
-    uri = g_file_get_path (file);
-
-  enumerator = g_file_enumerate_children (
-      file,
-      G_FILE_ATTRIBUTE_STANDARD_IS_SYMLINK
-      "," G_FILE_ATTRIBUTE_STANDARD_NAME
-      "," G_FILE_ATTRIBUTE_STANDARD_TYPE
-      "," G_FILE_ATTRIBUTE_TIME_MODIFIED,
-      G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
-      NULL,
-      &local_error);
-  if (enumerator == NULL)
+  path = g_file_get_path (file);
+  if (path == NULL)
     {
-      if (!g_error_matches (local_error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND))
-        g_warning ("failed to reap cache directory '%s': %s", uri, local_error->message);
-      g_clear_pointer (&local_error, g_error_free);
+      reap_file_in_place (file);
       return;
     }
 
-  for (;;)
+  parent     = g_path_get_dirname (path);
+  trash_dir  = g_build_filename (parent, TRASH_DIR_NAME, NULL);
+  uuid       = g_uuid_string_random ();
+  trash_path = g_build_filename (trash_dir, uuid, NULL);
+
+  if (g_mkdir_with_parents (trash_dir, 0700) != 0 ||
+      rename (path, trash_path) != 0)
     {
-      g_autoptr (GFileInfo) info = NULL;
-      g_autoptr (GFile) child    = NULL;
-      GFileType file_type        = G_FILE_TYPE_UNKNOWN;
+      if (errno == ENOENT && !g_file_test (path, G_FILE_TEST_EXISTS))
+        return;
 
-      info = g_file_enumerator_next_file (enumerator, NULL, &local_error);
-      if (info == NULL)
-        {
-          if (local_error != NULL)
-            g_warning ("failed to enumerate cache directory '%s': %s", uri, local_error->message);
-          g_clear_pointer (&local_error, g_error_free);
-          break;
-        }
+      /* Could not move it out of the way, e.g. because the trash
+         directory is on another filesystem */
+      reap_file_in_place (file);
+      return;
+    }
 
-      child     = g_file_enumerator_get_child (enumerator, info);
-      file_type = g_file_info_get_file_type (info);
+  queue_deletion (NULL, g_steal_pointer (&trash_path));
+}
 
-      if (!g_file_info_get_is_symlink (info) && file_type == G_FILE_TYPE_DIRECTORY)
-        bz_reap_file (child);
-      else
-        {
-          result = g_file_delete (child, NULL, &local_error);
-          if (!result)
-            {
-              g_warning ("failed to reap cache directory '%s': %s", uri, local_error->message);
-              g_clear_pointer (&local_error, g_error_free);
-            }
-        }
-    }
+void
+bz_resume_reaping (void)
+{
+  g_autofree char *root_cache_dir = NULL;
+  g_autofree char *cache_parent   = NULL;
+  g_autofree char *var_app_path   = NULL;
+  g_autofree char *trash_dir      = NULL;
 
-  result = g_file_enumerator_close (enumerator, NULL, &local_error);
-  if (!result)
-    {
-      g_warning ("failed to reap cache directory '%s': %s", uri, local_error->message);
-      g_clear_pointer (&local_error, g_error_free);
-    }
+  root_cache_dir = bz_dup_root_cache_dir ();
+  cache_parent   = g_path_get_dirname (root_cache_dir);
+  var_app_path   = g_build_filename (g_get_home_dir (), ".var", "app", NULL);
 
-  result = g_file_delete (file, NULL, &local_error);
-  if (!result)
-    {
-      g_warning ("failed to reap cache directory '%s': %s", uri, local_error->message);
-      g_clear_pointer (&local_error, g_error_free);
-    }
+  trash_dir = g_build_filename (root_cache_dir, TRASH_DIR_NAME, NULL);
+  resume_trash_dir (trash_dir);
+  g_clear_pointer (&trash_dir, g_free);
+
+  trash_dir = g_build_filename (cache_parent, TRASH_DIR_NAME, NULL);
+  resume_trash_dir (trash_dir);
+  g_clear_pointer (&trash_dir, g_free);
+
+  trash_dir = g_build_filename (var_app_path, TRASH_DIR_NAME, NULL);
+  resume_trash_dir (trash_dir);
 }
 
 DexFuture *
@@ -129,6 +259,8 @@ bz_reap_user_data_dex (const char *app_id)
   dex_return_error_if_fail (app_id != NULL);
 
   user_data_path = g_build_filename (g_get_home_dir (), ".var", "app", app_id, NULL);
+  bz_forget_user_data_size (app_id);
+
   return bz_reap_path_dex (g_steal_pointer (&user_data_path));
 }
 
@@ -147,9 +279,8 @@ DexFuture *
 bz_reap_file_dex (GFile *file)
 {
   dex_return_error_if_fail (G_IS_FILE (file));
-  return dex_scheduler_spawn (
-      bz_get_io_scheduler (),
-      bz_get_dex_stack_size (),
+  return bz_spawn (
+      BZ_SCHEDULER_PRIORITY_BACKGROUND,
       (DexFiberFunc) reap_file_fiber,
       g_object_ref (file), g_object_unref);
 }
@@ -158,9 +289,8 @@ DexFuture *
 bz_reap_path_dex (const char *path)
 {
   dex_return_error_if_fail (path != NULL);
-  return dex_scheduler_spawn (
-      bz_get_io_scheduler (),
-      bz_get_dex_stack_size (),
+  return bz_spawn (
+      BZ_SCHEDULER_PRIORITY_BACKGROUND,
       (DexFiberFunc) reap_path_fiber,
       g_strdup (path), g_free);
 }
@@ -169,19 +299,44 @@ DexFuture *
 bz_get_user_data_size_dex (const char *app_id)
 {
   dex_return_error_if_fail (app_id != NULL);
-  return dex_scheduler_spawn (
-      bz_get_io_scheduler (),
-      bz_get_dex_stack_size (),
+  return bz_spawn (
+      BZ_SCHEDULER_PRIORITY_INTERACTIVE,
       (DexFiberFunc) get_user_data_size_fiber,
       g_strdup (app_id), g_free);
 }
 
+DexFuture *
+bz_peek_user_data_size_dex (const char *app_id)
+{
+  dex_return_error_if_fail (app_id != NULL);
+  return bz_spawn (
+      BZ_SCHEDULER_PRIORITY_INTERACTIVE,
+      (DexFiberFunc) peek_user_data_size_fiber,
+      g_strdup (app_id), g_free);
+}
+
+void
+bz_forget_user_data_size (const char *app_id)
+{
+  g_autoptr (GMutexLocker) locker = NULL;
+  g_autofree char *cache_path     = NULL;
+
+  g_return_if_fail (app_id != NULL);
+
+  locker = g_mutex_locker_new (&user_data_sizes_mutex);
+  if (user_data_sizes != NULL)
+    g_hash_table_remove (user_data_sizes, app_id);
+  g_clear_pointer (&locker, g_mutex_locker_free);
+
+  cache_path = dup_user_data_size_cache_path (app_id);
+  g_unlink (cache_path);
+}
+
 DexFuture *
 bz_get_user_data_ids_dex (void)
 {
-  return dex_scheduler_spawn (
-      bz_get_io_scheduler (),
-      bz_get_dex_stack_size (),
+  return bz_spawn (
+      BZ_SCHEDULER_PRIORITY_INTERACTIVE,
       (DexFiberFunc) get_all_user_data_ids_fiber,
       NULL, NULL);
 }
@@ -189,76 +344,254 @@ bz_get_user_data_ids_dex (void)
 static DexFuture *
 get_user_data_size_fiber (char *app_id)
 {
-  g_autofree char *user_data_path = NULL;
-  g_autoptr (GFile) file          = NULL;
+  g_autofree char *var_app_path  = NULL;
+  g_autoptr (GPtrArray) subdirs  = NULL;
+  g_autoptr (GPtrArray) walks    = NULL;
+  g_autoptr (GPtrArray) futures  = NULL;
+  g_autoptr (GError) local_error = NULL;
+  int         var_app_fd         = -1;
+  struct stat st                 = { 0 };
+  guint64     total              = 0;
 
-  user_data_path = g_build_filename (g_get_home_dir (), ".var", "app", app_id, NULL);
-  file           = g_file_new_for_path (user_data_path);
+  var_app_path = g_build_filename (g_get_home_dir (), ".var", "app", NULL);
+  var_app_fd   = open (var_app_path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (var_app_fd < 0)
+    return dex_future_new_for_uint64 (0);
+
+  if (fstatat (var_app_fd, app_id, &st, AT_SYMLINK_NOFOLLOW) != 0 ||
+      !S_ISDIR (st.st_mode))
+    {
+      close (var_app_fd);
+      bz_forget_user_data_size (app_id);
+      return dex_future_new_for_uint64 (0);
+    }
+
+  subdirs = g_ptr_array_new_with_free_func (g_free);
+
+  /* The files directly inside the app directory are counted here, and
+     each subdirectory (usually cache, config, data) is walked on its
+     own thread */
+  total = walk_directory (var_app_fd, app_id, st.st_dev, subdirs);
+  close (var_app_fd);
 
-  return get_directory_size_fiber (file);
+  walks   = g_ptr_array_new_with_free_func (walk_data_unref);
+  futures = g_ptr_array_new_with_free_func (dex_unref);
+  for (guint i = 0; i < subdirs->len; i++)
+    {
+      g_autoptr (WalkData) data = NULL;
+      const char *name          = g_ptr_array_index (subdirs, i);
+
+      data       = walk_data_new ();
+      data->path = g_build_filename (var_app_path, app_id, name, NULL);
+      data->dev  = st.st_dev;
+
+      g_ptr_array_add (futures, bz_spawn (
+                                    BZ_SCHEDULER_PRIORITY_INTERACTIVE,
+                                    (DexFiberFunc) walk_fiber,
+                                    walk_data_ref (data), walk_data_unref));
+      g_ptr_array_add (walks, g_steal_pointer (&data));
+    }
+
+  if (futures->len > 0 &&
+      !dex_await (dex_future_allv ((DexFuture *const *) futures->pdata, futures->len),
+                  &local_error))
+    return dex_future_new_for_error (g_steal_pointer (&local_error));
+
+  for (guint i = 0; i < walks->len; i++)
+    {
+      WalkData *data = g_ptr_array_index (walks, i);
+      total += data->size;
+    }
+
+  save_user_data_size_cache (app_id, total);
+  remember_user_data_size (app_id, total);
+
+  return dex_future_new_for_uint64 (total);
 }
 
 static DexFuture *
-get_directory_size_fiber (GFile *file)
+peek_user_data_size_fiber (char *app_id)
 {
-  g_autoptr (DexFuture) enumerator_future = NULL;
-  g_autoptr (GFileEnumerator) enumerator  = NULL;
-  g_autoptr (GError) error                = NULL;
-  guint64 total_size                      = 0;
+  g_autoptr (GMutexLocker) locker = NULL;
+  guint64 *known                  = NULL;
+  guint64  total                  = 0;
+
+  locker = g_mutex_locker_new (&user_data_sizes_mutex);
+  if (user_data_sizes != NULL)
+    known = g_hash_table_lookup (user_data_sizes, app_id);
+  if (known != NULL)
+    return dex_future_new_for_uint64 (*known);
+  g_clear_pointer (&locker, g_mutex_locker_free);
+
+  /* Fall back to whatever was computed in a previous session */
+  if (!load_user_data_size_cache (app_id, &total))
+    return dex_future_new_reject (
+        G_IO_ERROR, G_IO_ERROR_NOT_FOUND,
+        "No size of %s is known yet", app_id);
+
+  remember_user_data_size (app_id, total);
+  return dex_future_new_for_uint64 (total);
+}
 
-  enumerator_future = dex_file_enumerate_children (
-      file,
-      G_FILE_ATTRIBUTE_STANDARD_NAME "," G_FILE_ATTRIBUTE_STANDARD_TYPE "," G_FILE_ATTRIBUTE_STANDARD_SIZE,
-      G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
-      G_PRIORITY_DEFAULT);
+static DexFuture *
+walk_fiber (WalkData *data)
+{
+  g_autofree char *parent = NULL;
+  g_autofree char *name   = NULL;
+  int              fd     = -1;
 
-  enumerator = dex_await_object (dex_ref (enumerator_future), &error);
-  if (enumerator == NULL)
+  parent = g_path_get_dirname (data->path);
+  name   = g_path_get_basename (data->path);
+
+  fd = open (parent, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (fd < 0)
+    return dex_future_new_true ();
+
+  data->size = walk_directory (fd, name, data->dev, NULL);
+  close (fd);
+
+  return dex_future_new_true ();
+}
+
+static guint64
+walk_directory (int         parent_fd,
+                const char *name,
+                dev_t       dev,
+                GPtrArray  *subdirs)
+{
+  int            fd    = -1;
+  DIR           *dir   = NULL;
+  struct stat    st    = { 0 };
+  guint64        total = 0;
+  struct dirent *entry = NULL;
+
+  fd = openat (parent_fd, name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+  if (fd < 0)
+    return 0;
+
+  /* Don't wander into mounts, e.g. a game library on another disk */
+  if (fstat (fd, &st) != 0 || st.st_dev != dev)
     {
-      if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND))
-        return dex_future_new_for_uint64 (0);
-      return dex_future_new_for_error (g_steal_pointer (&error));
+      close (fd);
+      return 0;
     }
 
-  for (;;)
+  dir = fdopendir (fd);
+  if (dir == NULL)
     {
-      g_autoptr (DexFuture) next_future = NULL;
-      g_autolist (GFileInfo) infos      = NULL;
+      close (fd);
+      return 0;
+    }
 
-      next_future = dex_file_enumerator_next_files (enumerator, 10, G_PRIORITY_DEFAULT);
-      infos       = dex_await_boxed (dex_ref (next_future), &error);
+  /* readdir () fills a large getdents64 buffer behind the scenes, and
+     d_type spares a stat for every subdirectory and symlink */
+  while ((entry = readdir (dir)) != NULL)
+    {
+      unsigned char type = entry->d_type;
 
-      if (infos == NULL)
-        {
-          if (error != NULL)
-            return dex_future_new_for_error (g_steal_pointer (&error));
-          break;
-        }
+      if (g_str_equal (entry->d_name, ".") ||
+          g_str_equal (entry->d_name, ".."))
+        continue;
 
-      for (GList *l = infos; l != NULL; l = l->next)
+      if (type == DT_UNKNOWN || type == DT_REG)
         {
-          GFileInfo *info      = l->data;
-          GFileType  file_type = g_file_info_get_file_type (info);
-
-          if (file_type == G_FILE_TYPE_DIRECTORY)
-            {
-              g_autoptr (GFile) child           = g_file_enumerator_get_child (enumerator, info);
-              g_autoptr (DexFuture) size_future = get_directory_size_fiber (child);
-              guint64 child_size                = dex_await_uint64 (dex_ref (size_future), &error);
+          if (fstatat (dirfd (dir), entry->d_name, &st, AT_SYMLINK_NOFOLLOW) != 0)
+            continue;
+          if (S_ISDIR (st.st_mode))
+            type = DT_DIR;
+          else if (S_ISREG (st.st_mode))
+            type = DT_REG;
+          else
+            type = DT_LNK;
 
-              if (error != NULL)
-                return dex_future_new_for_error (g_steal_pointer (&error));
+          if (type == DT_REG)
+            total += st.st_size;
+        }
 
-              total_size += child_size;
-            }
+      if (type == DT_DIR)
+        {
+          if (subdirs != NULL)
+            g_ptr_array_add (subdirs, g_strdup (entry->d_name));
           else
-            {
-              total_size += g_file_info_get_size (info);
-            }
+            total += walk_directory (dirfd (dir), entry->d_name, dev, NULL);
         }
     }
+  closedir (dir);
+
+  return total;
+}
+
+static char *
+dup_user_data_size_cache_path (const char *app_id)
+{
+  g_autofree char *cache_dir = NULL;
+
+  cache_dir = bz_dup_cache_dir ("user-data-sizes");
+  return g_build_filename (cache_dir, app_id, NULL);
+}
 
-  return dex_future_new_for_uint64 (total_size);
+static gboolean
+load_user_data_size_cache (const char *app_id,
+                           guint64    *total)
+{
+  g_autofree char *path          = NULL;
+  g_autoptr (GMappedFile) mapped = NULL;
+  g_autoptr (GBytes) bytes       = NULL;
+  g_autoptr (GVariant) variant   = NULL;
+  guint32 version                = 0;
+  guint64 cached_total           = 0;
+
+  path   = dup_user_data_size_cache_path (app_id);
+  mapped = g_mapped_file_new (path, FALSE, NULL);
+  if (mapped == NULL)
+    return FALSE;
+
+  bytes   = g_mapped_file_get_bytes (mapped);
+  variant = g_variant_new_from_bytes (G_VARIANT_TYPE (USER_DATA_SIZE_CACHE_TYPE), bytes, FALSE);
+  g_variant_get (variant, USER_DATA_SIZE_CACHE_TYPE, &version, &cached_total);
+  if (version != USER_DATA_SIZE_CACHE_VERSION)
+    return FALSE;
+
+  if (total != NULL)
+    *total = cached_total;
+  return TRUE;
+}
+
+static void
+save_user_data_size_cache (const char *app_id,
+                           guint64     total)
+{
+  g_autofree char *path          = NULL;
+  g_autofree char *dir           = NULL;
+  g_autoptr (GVariant) variant   = NULL;
+  g_autoptr (GError) local_error = NULL;
+
+  variant = g_variant_ref_sink (g_variant_new (
+      USER_DATA_SIZE_CACHE_TYPE,
+      (guint32) USER_DATA_SIZE_CACHE_VERSION,
+      total));
+
+  path = dup_user_data_size_cache_path (app_id);
+  dir  = g_path_get_dirname (path);
+  g_mkdir_with_parents (dir, 0755);
+
+  if (!g_file_set_contents (path,
+                            g_variant_get_data (variant),
+                            g_variant_get_size (variant),
+                            &local_error))
+    g_warning ("Could not cache user data size of %s: %s", app_id, local_error->message);
+}
+
+static void
+remember_user_data_size (const char *app_id,
+                         guint64     size)
+{
+  g_autoptr (GMutexLocker) locker = NULL;
+
+  locker = g_mutex_locker_new (&user_data_sizes_mutex);
+  if (user_data_sizes == NULL)
+    user_data_sizes = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+  g_hash_table_replace (user_data_sizes, g_strdup (app_id), g_memdup2 (&size, sizeof (size)));
 }
 
 static DexFuture *
@@ -317,6 +650,9 @@ get_all_user_data_ids_fiber (void)
           if (file_type == G_FILE_TYPE_DIRECTORY)
             {
               const char *app_id = g_file_info_get_name (info);
+
+              if (g_str_equal (app_id, TRASH_DIR_NAME))
+                continue;
               g_hash_table_insert (ids, g_strdup (app_id), NULL);
             }
         }
@@ -351,6 +687,199 @@ bz_dup_cache_dir (const char *submodule)
   return g_build_filename (root_cache_dir, submodule, NULL);
 }
 
+static void
+reap_file_in_place (GFile *file)
+{
+  g_autoptr (GError) local_error         = NULL;
+  g_autofree gchar *uri                  = NULL;
+  g_autoptr (GFileEnumerator) enumerator = NULL;
+  gboolean result                        = FALSE;
+
+  uri = g_file_get_uri (file);
+  if (uri == NULL)
+    uri = g_file_get_path (file);
+
+  enumerator = g_file_enumerate_children (
+      file,
+      G_FILE_ATTRIBUTE_STANDARD_IS_SYMLINK
+      "," G_FILE_ATTRIBUTE_STANDARD_NAME
+      "," G_FILE_ATTRIBUTE_STANDARD_TYPE
+      "," G_FILE_ATTRIBUTE_TIME_MODIFIED,
+      G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+      NULL,
+      &local_error);
+  if (enumerator == NULL)
+    {
+      if (!g_error_matches (local_error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND))
+        g_warning ("failed to reap cache directory '%s': %s", uri, local_error->message);
+      g_clear_pointer (&local_error, g_error_free);
+      return;
+    }
+
+  for (;;)
+    {
+      g_autoptr (GFileInfo) info = NULL;
+      g_autoptr (GFile) child    = NULL;
+      GFileType file_type        = G_FILE_TYPE_UNKNOWN;
+
+      info = g_file_enumerator_next_file (enumerator, NULL, &local_error);
+      if (info == NULL)
+        {
+          if (local_error != NULL)
+            g_warning ("failed to enumerate cache directory '%s': %s", uri, local_error->message);
+          g_clear_pointer (&local_error, g_error_free);
+          break;
+        }
+
+      child     = g_file_enumerator_get_child (enumerator, info);
+      file_type = g_file_info_get_file_type (info);
+
+      if (!g_file_info_get_is_symlink (info) && file_type == G_FILE_TYPE_DIRECTORY)
+        reap_file_in_place (child);
+      else
+        {
+          result = g_file_delete (child, NULL, &local_error);
+          if (!result)
+            {
+              g_warning ("failed to reap cache directory '%s': %s", uri, local_error->message);
+              g_clear_pointer (&local_error, g_error_free);
+            }
+        }
+    }
+
+  result = g_file_enumerator_close (enumerator, NULL, &local_error);
+  if (!result)
+    {
+      g_warning ("failed to reap cache directory '%s': %s", uri, local_error->message);
+      g_clear_pointer (&local_error, g_error_free);
+    }
+
+  result = g_file_delete (file, NULL, &local_error);
+  if (!result)
+    {
+      g_warning ("failed to reap cache directory '%s': %s", uri, local_error->message);
+      g_clear_pointer (&local_error, g_error_free);
+    }
+}
+
+static GThreadPool *
+get_reap_pool (void)
+{
+  if (g_once_init_enter_pointer (&reap_pool))
+    g_once_init_leave_pointer (
+        &reap_pool,
+        g_thread_pool_new (
+            (GFunc) delete_job_func, NULL,
+            MAX_REAP_THREADS, FALSE, NULL));
+
+  return reap_pool;
+}
+
+static void
+queue_deletion (DeleteJob *parent,
+                char      *path)
+{
+  DeleteJob *job = NULL;
+
+  job          = g_new0 (DeleteJob, 1);
+  job->parent  = parent;
+  job->path    = path;
+  job->pending = 1;
+
+  if (parent != NULL)
+    g_atomic_int_inc (&parent->pending);
+
+  g_thread_pool_push (get_reap_pool (), job, NULL);
+}
+
+static void
+delete_job_func (DeleteJob *job,
+                 gpointer   user_data)
+{
+  int            old_prio = -1;
+  DIR           *dir      = NULL;
+  struct dirent *entry    = NULL;
+
+#ifdef SYS_ioprio_set
+  /* The pool threads are shared, so only hold the idle class while
+     deleting */
+  old_prio = syscall (SYS_ioprio_get, IOPRIO_WHO_PROCESS, 0);
+  syscall (SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0,
+           IOPRIO_CLASS_IDLE << IOPRIO_CLASS_SHIFT);
+#endif
+
+  if (unlink (job->path) == 0 || errno == ENOENT)
+    goto done;
+
+  dir = opendir (job->path);
+  if (dir == NULL)
+    goto done;
+
+  /* Subdirectories become their own jobs, the directory itself is
+     removed by whichever job finishes last */
+  while ((entry = readdir (dir)) != NULL)
+    {
+      unsigned char type = entry->d_type;
+
+      if (g_str_equal (entry->d_name, ".") ||
+          g_str_equal (entry->d_name, ".."))
+        continue;
+
+      if (type == DT_UNKNOWN)
+        {
+          struct stat st = { 0 };
+
+          if (fstatat (dirfd (dir), entry->d_name, &st, AT_SYMLINK_NOFOLLOW) != 0)
+            continue;
+          type = S_ISDIR (st.st_mode) ? DT_DIR : DT_REG;
+        }
+
+      if (type == DT_DIR)
+        queue_deletion (job, g_build_filename (job->path, entry->d_name, NULL));
+      else if (unlinkat (dirfd (dir), entry->d_name, 0) != 0 && errno != ENOENT)
+        g_warning ("failed to reap '%s/%s': %s", job->path, entry->d_name, g_strerror (errno));
+    }
+  closedir (dir);
+
+done:
+#ifdef SYS_ioprio_set
+  if (old_prio >= 0)
+    syscall (SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, old_prio);
+#endif
+
+  finish_delete_job (job);
+}
+
+static void
+finish_delete_job (DeleteJob *job)
+{
+  while (job != NULL && g_atomic_int_dec_and_test (&job->pending))
+    {
+      DeleteJob *parent = job->parent;
+
+      if (rmdir (job->path) != 0 && errno != ENOENT)
+        g_warning ("failed to reap '%s': %s", job->path, g_strerror (errno));
+
+      g_free (job->path);
+      g_free (job);
+      job = parent;
+    }
+}
+
+static void
+resume_trash_dir (const char *trash_dir)
+{
+  g_autoptr (GDir) dir = NULL;
+  const char *name     = NULL;
+
+  dir = g_dir_open (trash_dir, 0, NULL);
+  if (dir == NULL)
+    return;
+
+  while ((name = g_dir_read_name (dir)) != NULL)
+    queue_deletion (NULL, g_build_filename (trash_dir, name, NULL));
+}
+
 static DexFuture *
 reap_file_fiber (GFile *file)
 {
@@ -364,3 +893,69 @@ reap_path_fiber (char *path)
   bz_reap_path (path);
   return dex_future_new_true ();
 }
+
+static DexScheduler *
+get_scheduler (BzSchedulerPriority priority)
+{
+  static DexScheduler *interactive = NULL;
+  static DexScheduler *background  = NULL;
+  static DexScheduler *blocking    = NULL;
+
+  switch (priority)
+    {
+    case BZ_SCHEDULER_PRIORITY_INTERACTIVE:
+      if (g_once_init_enter_pointer (&interactive))
+        g_once_init_leave_pointer (&interactive, dex_thread_pool_scheduler_new ());
+      return interactive;
+    case BZ_SCHEDULER_PRIORITY_BACKGROUND:
+      if (g_once_init_enter_pointer (&background))
+        g_once_init_leave_pointer (&background, dex_thread_pool_scheduler_new ());
+      return background;
+    case BZ_SCHEDULER_PRIORITY_BLOCKING:
+      if (g_once_init_enter_pointer (&blocking))
+        g_once_init_leave_pointer (&blocking, dex_thread_pool_scheduler_new ());
+      return blocking;
+    default:
+      g_assert_not_reached ();
+    }
+}
+
+static DexFuture *
+background_fiber (SpawnData *data)
+{
+  /* Only background fibers are ever spawned onto this pool, so every
+     worker thread can stay deprioritized for good */
+  deprioritize_current_thread ();
+  return data->func (data->user_data);
+}
+
+static void
+deprioritize_current_thread (void)
+{
+  static GPrivate deprioritized = G_PRIVATE_INIT (NULL);
+  pid_t           tid           = 0;
+  int             base          = 0;
+
+  if (g_private_get (&deprioritized) != NULL)
+    return;
+  g_private_set (&deprioritized, GINT_TO_POINTER (TRUE));
+
+  /* On Linux both of these take a thread id and apply to that thread
+     only */
+  tid = syscall (SYS_gettid);
+
+  /* -1 is a valid nice value, so errno tells failure apart. Raising the
+     value is always allowed, so lower it relative to what the thread
+     inherited rather than to an absolute value that could be higher. */
+  errno = 0;
+  base  = getpriority (PRIO_PROCESS, tid);
+  if (errno != 0)
+    g_debug ("Unable to read background thread CPU priority: %s", g_strerror (errno));
+  else if (setpriority (PRIO_PROCESS, tid, MIN (base + BZ_BACKGROUND_NICE_INCREMENT, LOWEST_NICE)) != 0)
+    g_debug ("Unable to lower background thread CPU priority: %s", g_strerror (errno));
+#ifdef SYS_ioprio_set
+  if (syscall (SYS_ioprio_set, IOPRIO_WHO_PROCESS, tid,
+               (IOPRIO_CLASS_BE << IOPRIO_CLASS_SHIFT) | BACKGROUND_IOPRIO_LEVEL) != 0)
+    g_debug ("Unable to lower background thread IO priority: %s", g_strerror (errno));
+#endif
+}
@@ -25,8 +25,28 @@
 
 G_BEGIN_DECLS
 
-DexScheduler *
-bz_get_io_scheduler (void);
+/* Work the user is waiting on right now (textures, searches, the page
+   being viewed) is kept apart from work that merely has to finish
+   eventually (catalog syncs, cache writes, cleanup), so the latter can't
+   starve the former. Fibers that sit in a blocking call for minutes
+   (flatpak transactions) get a pool of their own, since they would pin
+   a worker of either of the others for as long as they run. */
+typedef enum
+{
+  BZ_SCHEDULER_PRIORITY_INTERACTIVE = 0,
+  BZ_SCHEDULER_PRIORITY_BACKGROUND,
+  BZ_SCHEDULER_PRIORITY_BLOCKING,
+} BzSchedulerPriority;
+
+/* How much background worker threads add to the nice value they
+   started with, capped at the lowest priority of 19 */
+#define BZ_BACKGROUND_NICE_INCREMENT 10
+
+DexFuture *
+bz_spawn (BzSchedulerPriority priority,
+          DexFiberFunc        func,
+          gpointer            user_data,
+          GDestroyNotify      destroy);
 
 void
 bz_reap_file (GFile *file);
@@ -34,6 +54,9 @@ bz_reap_file (GFile *file);
 void
 bz_reap_path (const char *path);
 
+void
+bz_resume_reaping (void);
+
 DexFuture *
 bz_reap_file_dex (GFile *file);
 
@@ -46,6 +69,12 @@ bz_reap_user_data_dex (const char *app_id);
 DexFuture *
 bz_get_user_data_size_dex (const char *app_id);
 
+DexFuture *
+bz_peek_user_data_size_dex (const char *app_id);
+
+void
+bz_forget_user_data_size (const char *app_id);
+
 DexFuture *
 bz_get_user_data_ids_dex (void);
 
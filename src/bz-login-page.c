@@ -25,6 +25,7 @@
 
 #include "bz-auth-state.h"
 #include "bz-flathub-auth-provider.h"
+#include "bz-global-net.h"
 #include "bz-login-page.h"
 #include "bz-util.h"
 
@@ -124,13 +125,23 @@ parse_json_response (GBytes  *bytes,
 
 static SoupMessage *
 create_flathub_request (const char *method,
-                        const char *route)
+                        const char *route,
+                        GError    **error)
 {
+  g_autofree char *base_url   = NULL;
   g_autofree char *url        = NULL;
   g_autoptr (SoupMessage) msg = NULL;
 
-  url = g_strdup_printf ("https://flathub.org/api/v2%s", route);
-  msg = soup_message_new (method, url);
+  base_url = bz_dup_flathub_api_url ();
+  url      = g_strconcat (base_url, route, NULL);
+  msg      = soup_message_new (method, url);
+  if (msg == NULL)
+    {
+      /* The base url is configurable, so this isn't a programmer error */
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT,
+                   "Invalid uri: %s", url);
+      return NULL;
+    }
 
   soup_message_headers_append (soup_message_get_request_headers (msg),
                                "accept", "application/json");
@@ -180,6 +191,7 @@ complete_oauth (BzLoginPage *self,
   g_autofree char *route              = NULL;
   g_autofree char *json_data          = NULL;
   g_autoptr (SoupMessage) msg         = NULL;
+  g_autoptr (GError) local_error      = NULL;
 
   gtk_stack_set_visible_child_name (self->main_stack, "loading");
 
@@ -208,9 +220,12 @@ complete_oauth (BzLoginPage *self,
   route = g_strdup_printf ("/auth/login/%s",
                            bz_flathub_auth_provider_get_method (self->current_provider));
 
-  msg = soup_message_new ("POST", g_strdup_printf ("https://flathub.org/api/v2%s", route));
-  soup_message_headers_append (soup_message_get_request_headers (msg),
-                               "accept", "application/json");
+  msg = create_flathub_request ("POST", route, &local_error);
+  if (msg == NULL)
+    {
+      show_error_take (self, g_strdup_printf ("Error: %s", local_error->message));
+      return;
+    }
   soup_message_headers_append (soup_message_get_request_headers (msg),
                                "Content-Type", "application/json");
 
@@ -277,9 +292,15 @@ on_decide_policy (BzLoginPage             *self,
 static void
 get_user_info (BzLoginPage *self)
 {
-  g_autoptr (SoupMessage) msg = NULL;
+  g_autoptr (SoupMessage) msg    = NULL;
+  g_autoptr (GError) local_error = NULL;
 
-  msg = create_flathub_request ("GET", "/auth/userinfo");
+  msg = create_flathub_request ("GET", "/auth/userinfo", &local_error);
+  if (msg == NULL)
+    {
+      show_error_take (self, g_strdup_printf ("Error: %s", local_error->message));
+      return;
+    }
   soup_session_send_and_read_async (
       self->session, msg, G_PRIORITY_DEFAULT,
       NULL, (GAsyncReadyCallback) on_user_info_loaded,
@@ -464,6 +485,7 @@ on_provider_row_activated (BzLoginPage *self,
   BzFlathubAuthProvider *provider = NULL;
   g_autoptr (SoupMessage) msg     = NULL;
   g_autofree char *route          = NULL;
+  g_autoptr (GError) local_error  = NULL;
 
   provider = g_object_get_data (G_OBJECT (button), "provider");
   if (provider == NULL)
@@ -476,7 +498,12 @@ on_provider_row_activated (BzLoginPage *self,
 
   route = g_strdup_printf ("/auth/login/%s",
                            bz_flathub_auth_provider_get_method (provider));
-  msg   = create_flathub_request ("GET", route);
+  msg   = create_flathub_request ("GET", route, &local_error);
+  if (msg == NULL)
+    {
+      show_error_take (self, g_strdup_printf ("Error: %s", local_error->message));
+      return;
+    }
 
   soup_session_send_and_read_async (
       self->session, msg, G_PRIORITY_DEFAULT,
@@ -569,11 +596,17 @@ done:
 static void
 load_providers (BzLoginPage *self)
 {
-  g_autoptr (SoupMessage) msg = NULL;
+  g_autoptr (SoupMessage) msg    = NULL;
+  g_autoptr (GError) local_error = NULL;
 
   gtk_stack_set_visible_child_name (self->main_stack, "loading");
 
-  msg = create_flathub_request ("GET", "/auth/login");
+  msg = create_flathub_request ("GET", "/auth/login", &local_error);
+  if (msg == NULL)
+    {
+      show_error_take (self, g_strdup_printf ("Error loading providers: %s", local_error->message));
+      return;
+    }
   soup_session_send_and_read_async (
       self->session, msg, G_PRIORITY_DEFAULT,
       NULL, (GAsyncReadyCallback) on_providers_loaded,
@@ -0,0 +1,235 @@
+/* bz-memory-stats.c
+ *
+ * Copyright 2025 Adam Masciola
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+/* Rough accounting of where memory goes, for the inspector and
+   --dump-memory-stats. Byte counts are estimates: object sizes don't
+   include the strings and children they own, and textures are counted
+   at 4 bytes per pixel. */
+
+#include <stdio.h>
+#include <unistd.h>
+
+#include "bz-async-texture.h"
+#include "bz-download-worker.h"
+#include "bz-entry-group.h"
+#include "bz-env.h"
+#include "bz-flatpak-entry.h"
+#include "bz-memory-stats.h"
+#include "bz-trace.h"
+#include "bz-util.h"
+
+/* Rough per-item cost of an entry cache table slot, the md5 checksum key
+   plus the bookkeeping struct and hash table node */
+#define CACHE_TABLE_ITEM_BYTES 128
+
+BZ_DEFINE_DATA (
+    collect,
+    Collect,
+    {
+      BzStateInfo *state;
+    },
+    BZ_RELEASE_DATA (state, g_object_unref));
+
+static DexFuture *
+collect_fiber (CollectData *data);
+
+static void
+add_row (GVariantBuilder *builder,
+         const char      *category,
+         guint            count,
+         guint64          bytes);
+
+static guint64
+get_instance_size (GType type);
+
+static guint64
+get_rss (void);
+
+DexFuture *
+bz_memory_stats_collect (BzStateInfo *state)
+{
+  g_autoptr (CollectData) data = NULL;
+
+  dex_return_error_if_fail (BZ_IS_STATE_INFO (state));
+
+  data        = collect_data_new ();
+  data->state = g_object_ref (state);
+
+  return dex_scheduler_spawn (
+      dex_scheduler_get_default (),
+      bz_get_dex_stack_size (),
+      (DexFiberFunc) collect_fiber,
+      collect_data_ref (data), collect_data_unref);
+}
+
+char *
+bz_memory_stats_format (GVariant *stats)
+{
+  g_autoptr (GString) string = NULL;
+  GVariantIter iter          = { 0 };
+  const char  *category      = NULL;
+  guint        count         = 0;
+  guint64      bytes         = 0;
+
+  g_return_val_if_fail (g_variant_is_of_type (stats, G_VARIANT_TYPE ("a(sut)")), NULL);
+
+  string = g_string_new (NULL);
+
+  g_variant_iter_init (&iter, stats);
+  while (g_variant_iter_next (&iter, "(&sut)", &category, &count, &bytes))
+    {
+      g_autofree char *size = NULL;
+
+      size = g_format_size (bytes);
+      if (string->len > 0)
+        g_string_append_c (string, '\n');
+      g_string_append_printf (string, "%-28s %8u %12s", category, count, size);
+    }
+
+  return g_string_free (g_steal_pointer (&string), FALSE);
+}
+
+static DexFuture *
+collect_fiber (CollectData *data)
+{
+  BzStateInfo         *state         = data->state;
+  GVariantBuilder      builder       = { 0 };
+  int                  n_entries     = 0;
+  int                  n_groups      = 0;
+  guint                n_textures    = 0;
+  guint                n_loaded      = 0;
+  guint64              pixel_bytes   = 0;
+  BzSearchEngine      *engine        = NULL;
+  GListModel          *indexed       = NULL;
+  guint                n_indexed     = 0;
+  guint64              indexed_bytes = 0;
+  BzEntryCacheManager *cache         = NULL;
+  guint                n_alive       = 0;
+  guint                n_reading     = 0;
+  guint                n_writing     = 0;
+  guint                n_pending     = 0;
+  guint                n_workers     = 0;
+  guint                n_fibers      = 0;
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(sut)"));
+
+  add_row (&builder, "Process RSS", 0, get_rss ());
+
+  n_entries = bz_trace_counter_get (BZ_TRACE_COUNTER_LIVE_ENTRIES);
+  add_row (&builder, "Entries", n_entries,
+           n_entries * get_instance_size (BZ_TYPE_FLATPAK_ENTRY));
+
+  n_groups = bz_trace_counter_get (BZ_TRACE_COUNTER_LIVE_GROUPS);
+  add_row (&builder, "Entry groups", n_groups,
+           n_groups * get_instance_size (BZ_TYPE_ENTRY_GROUP));
+
+  bz_async_texture_get_memory_stats (&n_textures, &n_loaded, &pixel_bytes);
+  add_row (&builder, "Textures", n_textures,
+           n_textures * get_instance_size (BZ_TYPE_ASYNC_TEXTURE));
+  add_row (&builder, "Texture pixels", n_loaded, pixel_bytes);
+
+  engine = bz_state_info_get_search_engine (state);
+  if (engine != NULL)
+    indexed = bz_search_engine_get_model (engine);
+  if (indexed != NULL)
+    n_indexed = g_list_model_get_n_items (indexed);
+  for (guint i = 0; i < n_indexed; i++)
+    {
+      g_autoptr (BzEntryGroup) group  = NULL;
+      g_autoptr (GMutexLocker) locker = NULL;
+      const char *strings[4]          = { 0 };
+
+      group  = g_list_model_get_item (indexed, i);
+      locker = bz_entry_group_lock (group);
+
+      /* The same strings a query is tested against */
+      strings[0] = bz_entry_group_get_id (group);
+      strings[1] = bz_entry_group_get_title (group);
+      strings[2] = bz_entry_group_get_developer (group);
+      strings[3] = bz_entry_group_get_search_tokens (group);
+      for (guint j = 0; j < G_N_ELEMENTS (strings); j++)
+        if (strings[j] != NULL)
+          indexed_bytes += strlen (strings[j]) + 1;
+    }
+  add_row (&builder, "Search index strings", n_indexed, indexed_bytes);
+
+  cache = bz_state_info_get_cache_manager (state);
+  if (cache != NULL)
+    {
+      g_autoptr (GVariant) cache_stats = NULL;
+
+      cache_stats = dex_await_variant (bz_entry_cache_manager_dup_stats (cache), NULL);
+      if (cache_stats != NULL)
+        g_variant_get (cache_stats, "(uuu)", &n_alive, &n_reading, &n_writing);
+    }
+  add_row (&builder, "Entry cache: alive", n_alive, (guint64) n_alive * CACHE_TABLE_ITEM_BYTES);
+  add_row (&builder, "Entry cache: reading", n_reading, (guint64) n_reading * CACHE_TABLE_ITEM_BYTES);
+  add_row (&builder, "Entry cache: writing", n_writing, (guint64) n_writing * CACHE_TABLE_ITEM_BYTES);
+
+  n_pending = bz_async_texture_get_n_pending_loads ();
+  bz_download_worker_get_stats (&n_workers, NULL, NULL, NULL, NULL, NULL);
+  add_row (&builder, "Texture load queue", n_pending, 0);
+  add_row (&builder, "Download workers", n_workers, 0);
+
+  /* Only the fibers we keep count of, libdex doesn't expose a total */
+  n_fibers = n_pending +
+             bz_trace_counter_get (BZ_TRACE_COUNTER_TEXTURE_DOWNLOADS) +
+             bz_trace_counter_get (BZ_TRACE_COUNTER_CACHE_WRITE_QUEUE) +
+             n_reading + n_writing;
+  add_row (&builder, "Fiber stacks (known)", n_fibers,
+           (guint64) n_fibers * bz_get_dex_stack_size ());
+
+  return dex_future_new_take_variant (
+      g_variant_ref_sink (g_variant_builder_end (&builder)));
+}
+
+static void
+add_row (GVariantBuilder *builder,
+         const char      *category,
+         guint            count,
+         guint64          bytes)
+{
+  g_variant_builder_add (builder, "(sut)", category, count, bytes);
+}
+
+static guint64
+get_instance_size (GType type)
+{
+  GTypeQuery query = { 0 };
+
+  g_type_query (type, &query);
+  return query.instance_size;
+}
+
+static guint64
+get_rss (void)
+{
+  g_autofree char *contents = NULL;
+  guint64          pages    = 0;
+
+  if (!g_file_get_contents ("/proc/self/statm", &contents, NULL, NULL))
+    return 0;
+  if (sscanf (contents, "%*u %" G_GUINT64_FORMAT, &pages) != 1)
+    return 0;
+
+  return pages * sysconf (_SC_PAGESIZE);
+}
+
+/* End of bz-memory-stats.c */
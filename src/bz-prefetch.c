@@ -0,0 +1,258 @@
+/* bz-prefetch.c
+ *
+ * Copyright 2025 Adam Masciola
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+/* Hovering or focusing a tile for a moment is a good hint that it is
+   about to be opened, so start resolving what the full view needs. The
+   hint is withdrawn when the pointer and focus both leave, which drops
+   the pending resolution. Anything already started is allowed to
+   finish since it ends up cached. */
+
+#include "bz-async-texture.h"
+#include "bz-entry-group.h"
+#include "bz-prefetch.h"
+#include "bz-result.h"
+#include "bz-util.h"
+
+#define PREFETCH_DWELL_MSEC  150
+#define PREFETCH_SCREENSHOTS 2
+#define PREFETCH_DATA_KEY    "bz-prefetch"
+
+BZ_DEFINE_DATA (
+    prefetch,
+    Prefetch,
+    {
+      GWeakRef  *tile;
+      gboolean   hovered;
+      gboolean   focused;
+      guint      dwell_source;
+      DexFuture *future;
+    },
+    BZ_RELEASE_DATA (tile, bz_weak_release);
+    BZ_RELEASE_UTAG (dwell_source, g_source_remove);
+    BZ_RELEASE_DATA (future, dex_unref));
+
+static void
+update (PrefetchData *data);
+
+static gboolean
+dwell_timeout (PrefetchData *data);
+
+static DexFuture *
+ui_entry_then (DexFuture *future,
+               GWeakRef  *wr);
+
+static void
+group_changed (PrefetchData *data,
+               GParamSpec   *pspec,
+               GtkWidget    *tile);
+
+static void
+motion_enter (PrefetchData             *data,
+              double                    x,
+              double                    y,
+              GtkEventControllerMotion *controller);
+
+static void
+motion_leave (PrefetchData             *data,
+              GtkEventControllerMotion *controller);
+
+static void
+focus_enter (PrefetchData            *data,
+             GtkEventControllerFocus *controller);
+
+static void
+focus_leave (PrefetchData            *data,
+             GtkEventControllerFocus *controller);
+
+void
+bz_prefetch_attach (GtkWidget *tile)
+{
+  g_autoptr (PrefetchData) data = NULL;
+  GtkEventController *motion    = NULL;
+  GtkEventController *focus     = NULL;
+
+  g_return_if_fail (GTK_IS_WIDGET (tile));
+  g_return_if_fail (g_object_class_find_property (G_OBJECT_GET_CLASS (tile), "group") != NULL);
+
+  data       = prefetch_data_new ();
+  data->tile = bz_track_weak (tile);
+
+  motion = gtk_event_controller_motion_new ();
+  g_signal_connect_swapped (motion, "enter", G_CALLBACK (motion_enter), data);
+  g_signal_connect_swapped (motion, "leave", G_CALLBACK (motion_leave), data);
+  gtk_widget_add_controller (tile, motion);
+
+  focus = gtk_event_controller_focus_new ();
+  g_signal_connect_swapped (focus, "enter", G_CALLBACK (focus_enter), data);
+  g_signal_connect_swapped (focus, "leave", G_CALLBACK (focus_leave), data);
+  gtk_widget_add_controller (tile, focus);
+
+  /* Tiles are recycled while the pointer may still be over them */
+  g_signal_connect_swapped (tile, "notify::group", G_CALLBACK (group_changed), data);
+
+  g_object_set_data_full (
+      G_OBJECT (tile), PREFETCH_DATA_KEY,
+      g_steal_pointer (&data), prefetch_data_unref);
+}
+
+static void
+update (PrefetchData *data)
+{
+  if (data->hovered || data->focused)
+    {
+      /* ui_entry_then () may have run before the future was stored, in
+         which case it couldn't clear it and a finished one is left */
+      if (data->dwell_source == 0 &&
+          (data->future == NULL || !dex_future_is_pending (data->future)))
+        data->dwell_source = g_timeout_add (
+            PREFETCH_DWELL_MSEC, (GSourceFunc) dwell_timeout, data);
+    }
+  else
+    {
+      g_clear_handle_id (&data->dwell_source, g_source_remove);
+      dex_clear (&data->future);
+    }
+}
+
+static gboolean
+dwell_timeout (PrefetchData *data)
+{
+  g_autoptr (GtkWidget) tile     = NULL;
+  g_autoptr (BzEntryGroup) group = NULL;
+  g_autoptr (BzResult) ui_entry  = NULL;
+  g_autoptr (DexFuture) future   = NULL;
+
+  data->dwell_source = 0;
+
+  tile = g_weak_ref_get (data->tile);
+  if (tile == NULL)
+    return G_SOURCE_REMOVE;
+
+  g_object_get (tile, "group", &group, NULL);
+  if (group == NULL)
+    return G_SOURCE_REMOVE;
+
+  /* Goes through the entry cache, so the full view finds it there */
+  ui_entry = bz_entry_group_dup_ui_entry (group);
+  if (ui_entry == NULL)
+    return G_SOURCE_REMOVE;
+
+  /* The tile owns data and data owns the future, so holding data here
+     would keep both alive until the entry resolves */
+  future = bz_result_dup_future (ui_entry);
+  future = dex_future_then (
+      future, (DexFutureCallback) ui_entry_then,
+      bz_track_weak (tile), bz_weak_release);
+  dex_clear (&data->future);
+  data->future = g_steal_pointer (&future);
+
+  return G_SOURCE_REMOVE;
+}
+
+static DexFuture *
+ui_entry_then (DexFuture *future,
+               GWeakRef  *wr)
+{
+  g_autoptr (GtkWidget) tile   = NULL;
+  PrefetchData *data           = NULL;
+  const GValue *value          = NULL;
+  BzEntry      *entry          = NULL;
+  GListModel   *screenshots    = NULL;
+  g_autoptr (GListModel) stats = NULL;
+  guint n_screenshots          = 0;
+
+  /* Done either way, so a later hint can start another one */
+  tile = g_weak_ref_get (wr);
+  if (tile != NULL)
+    data = g_object_get_data (G_OBJECT (tile), PREFETCH_DATA_KEY);
+  if (data != NULL)
+    dex_clear (&data->future);
+
+  value = dex_future_get_value (future, NULL);
+  if (value == NULL || !G_VALUE_HOLDS (value, BZ_TYPE_ENTRY))
+    return dex_future_new_true ();
+  entry = g_value_get_object (value);
+
+  /* Until these are drawn they are fetched at the lowest download
+     priority, so visible content still goes first */
+  screenshots = bz_entry_get_screenshot_paintables (entry);
+  if (screenshots != NULL)
+    n_screenshots = g_list_model_get_n_items (screenshots);
+  for (guint i = 0; i < MIN (n_screenshots, PREFETCH_SCREENSHOTS); i++)
+    {
+      g_autoptr (GObject) paintable = NULL;
+
+      paintable = g_list_model_get_item (screenshots, i);
+      if (BZ_IS_ASYNC_TEXTURE (paintable))
+        bz_async_texture_ensure (BZ_ASYNC_TEXTURE (paintable));
+    }
+
+  /* Reading the property issues the Flathub stats query */
+  g_object_get (entry, "download-stats", &stats, NULL);
+
+  return dex_future_new_true ();
+}
+
+static void
+group_changed (PrefetchData *data,
+               GParamSpec   *pspec,
+               GtkWidget    *tile)
+{
+  /* Whatever was pending was for the previous group */
+  g_clear_handle_id (&data->dwell_source, g_source_remove);
+  dex_clear (&data->future);
+  update (data);
+}
+
+static void
+motion_enter (PrefetchData             *data,
+              double                    x,
+              double                    y,
+              GtkEventControllerMotion *controller)
+{
+  data->hovered = TRUE;
+  update (data);
+}
+
+static void
+motion_leave (PrefetchData             *data,
+              GtkEventControllerMotion *controller)
+{
+  data->hovered = FALSE;
+  update (data);
+}
+
+static void
+focus_enter (PrefetchData            *data,
+             GtkEventControllerFocus *controller)
+{
+  data->focused = TRUE;
+  update (data);
+}
+
+static void
+focus_leave (PrefetchData            *data,
+             GtkEventControllerFocus *controller)
+{
+  data->focused = FALSE;
+  update (data);
+}
+
+/* End of bz-prefetch.c */
@@ -21,6 +21,7 @@
 #include "bz-rich-app-tile.h"
 #include "bz-entry.h"
 #include "bz-group-tile-css-watcher.h"
+#include "bz-prefetch.h"
 #include "bz-rounded-picture.h"
 #include "bz-themed-entry-group-rect.h"
 #include "bz-util.h"
@@ -269,6 +270,7 @@ static void
 bz_rich_app_tile_init (BzRichAppTile *self)
 {
   gtk_widget_init_template (GTK_WIDGET (self));
+  bz_prefetch_attach (GTK_WIDGET (self));
 }
 
 GtkWidget *
@@ -21,7 +21,9 @@
 #include "bz-search-engine.h"
 #include "bz-entry-group.h"
 #include "bz-env.h"
+#include "bz-io.h"
 #include "bz-search-result.h"
+#include "bz-trace.h"
 #include "bz-util.h"
 
 struct _BzSearchEngine
@@ -29,6 +31,10 @@ struct _BzSearchEngine
   GObject parent_instance;
 
   GListModel *model;
+
+  GMutex  latency_mutex;
+  double  average_latency;
+  guint64 latency_buckets[BZ_SEARCH_ENGINE_N_LATENCY_BUCKETS];
 };
 
 G_DEFINE_FINAL_TYPE (BzSearchEngine, bz_search_engine, G_TYPE_OBJECT);
@@ -64,15 +70,26 @@ cmp_scores (Score *a,
 #define SAME_CLUSTER   0.1
 #define NO_MATCH       0.0
 
+/* How often a sub task checks whether the query was cancelled */
+#define CANCEL_CHECK_INTERVAL 64
+
+/* Weight of the newest sample in the moving latency average */
+#define LATENCY_SMOOTHING 0.25
+
 BZ_DEFINE_DATA (
     query_task,
     QueryTask,
     {
-      char     **terms;
-      GPtrArray *snapshot;
+      GWeakRef     *self;
+      char        **terms;
+      GPtrArray    *snapshot;
+      GCancellable *cancellable;
+      gint64        start_time;
     },
+    BZ_RELEASE_DATA (self, bz_weak_release);
     BZ_RELEASE_DATA (terms, g_strfreev);
-    BZ_RELEASE_DATA (snapshot, g_ptr_array_unref))
+    BZ_RELEASE_DATA (snapshot, g_ptr_array_unref);
+    BZ_RELEASE_DATA (cancellable, g_object_unref))
 static DexFuture *
 query_task_fiber (QueryTaskData *data);
 
@@ -80,17 +97,23 @@ BZ_DEFINE_DATA (
     query_sub_task,
     QuerySubTask,
     {
-      char      *query_utf8;
-      GPtrArray *shallow_mirror;
-      double     threshold;
-      guint      work_offset;
-      guint      work_length;
+      char         *query_utf8;
+      GPtrArray    *shallow_mirror;
+      GCancellable *cancellable;
+      double        threshold;
+      guint         work_offset;
+      guint         work_length;
     },
     BZ_RELEASE_DATA (query_utf8, g_free);
-    BZ_RELEASE_DATA (shallow_mirror, g_ptr_array_unref));
+    BZ_RELEASE_DATA (shallow_mirror, g_ptr_array_unref);
+    BZ_RELEASE_DATA (cancellable, g_object_unref));
 static DexFuture *
 query_sub_task_fiber (QuerySubTaskData *data);
 
+static void
+record_latency (BzSearchEngine *self,
+                gint64          usec);
+
 static inline GUnicodeType
 utf8_char_class (const char *s,
                  gunichar   *ch_out);
@@ -109,6 +132,16 @@ bz_search_engine_dispose (GObject *object)
   G_OBJECT_CLASS (bz_search_engine_parent_class)->dispose (object);
 }
 
+static void
+bz_search_engine_finalize (GObject *object)
+{
+  BzSearchEngine *self = BZ_SEARCH_ENGINE (object);
+
+  g_mutex_clear (&self->latency_mutex);
+
+  G_OBJECT_CLASS (bz_search_engine_parent_class)->finalize (object);
+}
+
 static void
 bz_search_engine_get_property (GObject    *object,
                                guint       prop_id,
@@ -153,6 +186,7 @@ bz_search_engine_class_init (BzSearchEngineClass *klass)
   object_class->set_property = bz_search_engine_set_property;
   object_class->get_property = bz_search_engine_get_property;
   object_class->dispose      = bz_search_engine_dispose;
+  object_class->finalize     = bz_search_engine_finalize;
 
   props[PROP_MODEL] =
       g_param_spec_object (
@@ -167,6 +201,7 @@ bz_search_engine_class_init (BzSearchEngineClass *klass)
 static void
 bz_search_engine_init (BzSearchEngine *self)
 {
+  g_mutex_init (&self->latency_mutex);
 }
 
 BzSearchEngine *
@@ -198,7 +233,8 @@ bz_search_engine_set_model (BzSearchEngine *self,
 
 DexFuture *
 bz_search_engine_query (BzSearchEngine    *self,
-                        const char *const *terms)
+                        const char *const *terms,
+                        GCancellable      *cancellable)
 {
   guint n_groups = 0;
 
@@ -245,18 +281,47 @@ bz_search_engine_query (BzSearchEngine    *self,
       for (guint i = 0; i < snapshot->len; i++)
         g_ptr_array_index (snapshot, i) = g_list_model_get_item (self->model, i);
 
-      data           = query_task_data_new ();
-      data->terms    = g_strdupv ((gchar **) terms);
-      data->snapshot = g_steal_pointer (&snapshot);
+      data              = query_task_data_new ();
+      data->self        = bz_track_weak (self);
+      data->terms       = g_strdupv ((gchar **) terms);
+      data->snapshot    = g_steal_pointer (&snapshot);
+      data->cancellable = bz_object_maybe_ref (cancellable);
+      data->start_time  = g_get_monotonic_time ();
 
-      return dex_scheduler_spawn (
-          dex_thread_pool_scheduler_get_default (),
-          bz_get_dex_stack_size (),
+      return bz_spawn (
+          BZ_SCHEDULER_PRIORITY_INTERACTIVE,
           (DexFiberFunc) query_task_fiber,
           query_task_data_ref (data), query_task_data_unref);
     }
 }
 
+double
+bz_search_engine_get_average_latency (BzSearchEngine *self)
+{
+  g_autoptr (GMutexLocker) locker = NULL;
+
+  g_return_val_if_fail (BZ_IS_SEARCH_ENGINE (self), 0.0);
+
+  locker = g_mutex_locker_new (&self->latency_mutex);
+  return self->average_latency;
+}
+
+GArray *
+bz_search_engine_dup_latency_histogram (BzSearchEngine *self)
+{
+  g_autoptr (GMutexLocker) locker = NULL;
+  g_autoptr (GArray) histogram    = NULL;
+
+  g_return_val_if_fail (BZ_IS_SEARCH_ENGINE (self), NULL);
+
+  histogram = g_array_sized_new (FALSE, FALSE, sizeof (guint64), BZ_SEARCH_ENGINE_N_LATENCY_BUCKETS);
+
+  locker = g_mutex_locker_new (&self->latency_mutex);
+  g_array_append_vals (histogram, self->latency_buckets, BZ_SEARCH_ENGINE_N_LATENCY_BUCKETS);
+
+  return g_steal_pointer (&histogram);
+}
+
 static DexFuture *
 query_task_fiber (QueryTaskData *data)
 {
@@ -271,6 +336,12 @@ query_task_fiber (QueryTaskData *data)
   g_autoptr (GPtrArray) sub_futures = NULL;
   g_autoptr (GArray) scores         = NULL;
   g_autoptr (GPtrArray) results     = NULL;
+  gint64 trace_begin                = 0;
+
+  if (g_cancellable_set_error_if_cancelled (data->cancellable, &local_error))
+    return dex_future_new_for_error (g_steal_pointer (&local_error));
+
+  trace_begin = bz_trace_begin ();
 
   query_utf8 = g_strjoinv (" ", terms);
   threshold  = (double) g_utf8_strlen (query_utf8, -1);
@@ -287,6 +358,7 @@ query_task_fiber (QueryTaskData *data)
       sub_data                 = query_sub_task_data_new ();
       sub_data->query_utf8     = g_strdup (query_utf8);
       sub_data->shallow_mirror = g_ptr_array_ref (shallow_mirror);
+      sub_data->cancellable    = bz_object_maybe_ref (data->cancellable);
       sub_data->threshold      = threshold;
       sub_data->work_offset    = i * scores_per_task;
       sub_data->work_length    = scores_per_task;
@@ -294,9 +366,8 @@ query_task_fiber (QueryTaskData *data)
       if (i >= n_sub_tasks - 1)
         sub_data->work_length += shallow_mirror->len % n_sub_tasks;
 
-      future = dex_scheduler_spawn (
-          dex_thread_pool_scheduler_get_default (),
-          bz_get_dex_stack_size (),
+      future = bz_spawn (
+          BZ_SCHEDULER_PRIORITY_INTERACTIVE,
           (DexFiberFunc) query_sub_task_fiber,
           query_sub_task_data_ref (sub_data),
           query_sub_task_data_unref);
@@ -344,6 +415,19 @@ query_task_fiber (QueryTaskData *data)
       g_ptr_array_index (results, i) = g_steal_pointer (&search_result);
     }
 
+  /* Only completed queries count towards latency, cancelled ones would
+     just drag the average down */
+  if (!g_cancellable_is_cancelled (data->cancellable))
+    {
+      g_autoptr (BzSearchEngine) self = NULL;
+
+      self = g_weak_ref_get (data->self);
+      if (self != NULL)
+        record_latency (self, g_get_monotonic_time () - data->start_time);
+    }
+  bz_trace_end (trace_begin, "Search", "Query", "\"%s\": %u of %u groups in %u tasks",
+                query_utf8, results->len, shallow_mirror->len, n_sub_tasks);
+
   return dex_future_new_take_boxed (
       G_TYPE_PTR_ARRAY,
       g_steal_pointer (&results));
@@ -352,12 +436,14 @@ query_task_fiber (QueryTaskData *data)
 static DexFuture *
 query_sub_task_fiber (QuerySubTaskData *data)
 {
-  GPtrArray *shallow_mirror     = data->shallow_mirror;
-  char      *query_utf8         = data->query_utf8;
-  double     threshold          = data->threshold;
-  guint      work_offset        = data->work_offset;
-  guint      work_length        = data->work_length;
-  g_autoptr (GArray) scores_out = NULL;
+  GPtrArray    *shallow_mirror   = data->shallow_mirror;
+  char         *query_utf8       = data->query_utf8;
+  GCancellable *cancellable      = data->cancellable;
+  double        threshold        = data->threshold;
+  guint         work_offset      = data->work_offset;
+  guint         work_length      = data->work_length;
+  g_autoptr (GArray) scores_out  = NULL;
+  g_autoptr (GError) local_error = NULL;
 
   scores_out = g_array_new (FALSE, FALSE, sizeof (Score));
 
@@ -371,6 +457,10 @@ query_sub_task_fiber (QuerySubTaskData *data)
       const char   *search_tokens     = NULL;
       double        score             = 0.0;
 
+      if (i % CANCEL_CHECK_INTERVAL == 0 &&
+          g_cancellable_set_error_if_cancelled (cancellable, &local_error))
+        return dex_future_new_for_error (g_steal_pointer (&local_error));
+
       group  = g_ptr_array_index (shallow_mirror, work_offset + i);
       locker = bz_entry_group_lock (group);
 
@@ -406,6 +496,29 @@ query_sub_task_fiber (QuerySubTaskData *data)
   return dex_future_new_take_boxed (G_TYPE_ARRAY, g_steal_pointer (&scores_out));
 }
 
+static void
+record_latency (BzSearchEngine *self,
+                gint64          usec)
+{
+  g_autoptr (GMutexLocker) locker = NULL;
+  double ms                       = 0.0;
+  guint  bucket                   = 0;
+
+  ms = (double) usec / 1000.0;
+  for (double bound = 1.0;
+       bucket < BZ_SEARCH_ENGINE_N_LATENCY_BUCKETS - 1 && ms >= bound;
+       bound *= 2.0)
+    bucket++;
+
+  locker = g_mutex_locker_new (&self->latency_mutex);
+
+  self->latency_buckets[bucket]++;
+  if (self->average_latency <= 0.0)
+    self->average_latency = ms;
+  else
+    self->average_latency += LATENCY_SMOOTHING * (ms - self->average_latency);
+}
+
 #define UTF8_FOREACH_FORWARD(_var, _s) \
   for (const char *_var = (_s);        \
        _var != NULL && *_var != '\0';  \
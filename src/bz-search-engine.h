@@ -25,6 +25,11 @@
 
 G_BEGIN_DECLS
 
+/* bucket 0 holds queries faster than 1ms, bucket `n` holds queries which
+   took between 2^(n-1) and 2^n ms, and the last bucket holds everything
+   slower than that */
+#define BZ_SEARCH_ENGINE_N_LATENCY_BUCKETS 12
+
 #define BZ_TYPE_SEARCH_ENGINE (bz_search_engine_get_type ())
 G_DECLARE_FINAL_TYPE (BzSearchEngine, bz_search_engine, BZ, SEARCH_ENGINE, GObject)
 
@@ -40,7 +45,14 @@ bz_search_engine_set_model (BzSearchEngine *self,
 
 DexFuture *
 bz_search_engine_query (BzSearchEngine    *self,
-                        const char *const *terms);
+                        const char *const *terms,
+                        GCancellable      *cancellable);
+
+double
+bz_search_engine_get_average_latency (BzSearchEngine *self);
+
+GArray *
+bz_search_engine_dup_latency_histogram (BzSearchEngine *self);
 
 G_END_DECLS
 
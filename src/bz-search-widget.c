@@ -46,6 +46,8 @@ struct _BzSearchWidget
   GtkSelectionModel *selection_model;
   guint              search_update_timeout;
   DexFuture         *search_query;
+  GCancellable      *search_cancellable;
+  guint64            search_generation;
 
   /* Template widgets */
   GtkText     *search_bar;
@@ -76,6 +78,22 @@ enum
 };
 static guint signals[LAST_SIGNAL];
 
+/* The debounce delay tracks the engine's average query latency, so
+   typing on fast hardware feels instant while slow hardware isn't
+   flooded with queries which will be cancelled anyway */
+#define DEBOUNCE_LATENCY_FACTOR 2.0
+#define DEBOUNCE_MIN_MSEC       5
+#define DEBOUNCE_MAX_MSEC       300
+
+BZ_DEFINE_DATA (
+    search_query,
+    SearchQuery,
+    {
+      GWeakRef *self;
+      guint64   generation;
+    },
+    BZ_RELEASE_DATA (self, bz_weak_release))
+
 static void
 search_changed (GtkEditable    *editable,
                 BzSearchWidget *self);
@@ -102,8 +120,14 @@ blocklists_items_changed (BzSearchWidget *self,
                           GListModel     *model);
 
 static DexFuture *
-search_query_then (DexFuture *future,
-                   GWeakRef  *wr);
+search_query_then (DexFuture       *future,
+                   SearchQueryData *data);
+
+static void
+cancel_search (BzSearchWidget *self);
+
+static guint
+get_debounce_delay (BzSearchWidget *self);
 
 static void
 update_filter (BzSearchWidget *self);
@@ -126,7 +150,7 @@ bz_search_widget_dispose (GObject *object)
     g_signal_handlers_disconnect_by_func (self->txt_blocklists_provider, blocklists_items_changed, self);
 
   g_clear_handle_id (&self->search_update_timeout, g_source_remove);
-  dex_clear (&self->search_query);
+  cancel_search (self);
 
   g_clear_object (&self->state);
   g_clear_object (&self->selected);
@@ -600,16 +624,15 @@ static void
 search_changed (GtkEditable    *editable,
                 BzSearchWidget *self)
 {
-  GSettings *settings = NULL;
+  guint delay = 0;
 
   g_clear_handle_id (&self->search_update_timeout, g_source_remove);
 
-  settings = bz_state_info_get_settings (self->state);
-  if (settings != NULL &&
-      g_settings_get_boolean (settings, "search-debounce"))
+  delay = get_debounce_delay (self);
+  if (delay > 0)
     {
       self->search_update_timeout = g_timeout_add_once (
-          150, (GSourceOnceFunc) update_filter, self);
+          delay, (GSourceOnceFunc) update_filter, self);
       gtk_widget_set_visible (GTK_WIDGET (self->search_busy), TRUE);
     }
   else
@@ -673,15 +696,19 @@ blocklists_items_changed (BzSearchWidget *self,
 }
 
 static DexFuture *
-search_query_then (DexFuture *future,
-                   GWeakRef  *wr)
+search_query_then (DexFuture       *future,
+                   SearchQueryData *data)
 {
   g_autoptr (BzSearchWidget) self = NULL;
   GPtrArray  *results             = NULL;
   guint       old_length          = 0;
   const char *page_name           = NULL;
 
-  bz_weak_get_or_return_reject (self, wr);
+  bz_weak_get_or_return_reject (self, data->self);
+
+  /* A newer query has been started since, so these results are stale */
+  if (data->generation != self->search_generation)
+    return NULL;
 
   results    = g_value_get_boxed (dex_future_get_value (future, NULL));
   old_length = g_list_model_get_n_items (G_LIST_MODEL (self->search_model));
@@ -706,9 +733,52 @@ search_query_then (DexFuture *future,
   gtk_stack_set_visible_child_name (self->search_stack, page_name);
 
   dex_clear (&self->search_query);
+  g_clear_object (&self->search_cancellable);
   return NULL;
 }
 
+static void
+cancel_search (BzSearchWidget *self)
+{
+  /* Bumping the generation ensures nothing from an older query can land
+     in the model, even if it managed to finish before noticing it was
+     cancelled */
+  self->search_generation++;
+
+  if (self->search_cancellable != NULL)
+    g_cancellable_cancel (self->search_cancellable);
+  g_clear_object (&self->search_cancellable);
+  dex_clear (&self->search_query);
+}
+
+static guint
+get_debounce_delay (BzSearchWidget *self)
+{
+  GSettings      *settings = NULL;
+  BzSearchEngine *engine   = NULL;
+  double          latency  = 0.0;
+  guint           delay    = 0;
+
+  if (self->state == NULL)
+    return 0;
+
+  settings = bz_state_info_get_settings (self->state);
+  if (settings == NULL ||
+      !g_settings_get_boolean (settings, "search-debounce"))
+    return 0;
+
+  engine = bz_state_info_get_search_engine (self->state);
+  if (engine == NULL)
+    return 0;
+
+  latency = bz_search_engine_get_average_latency (engine);
+  delay   = (guint) (latency * DEBOUNCE_LATENCY_FACTOR);
+  if (delay < DEBOUNCE_MIN_MSEC)
+    return 0;
+
+  return MIN (delay, DEBOUNCE_MAX_MSEC);
+}
+
 static void
 update_filter (BzSearchWidget *self)
 {
@@ -719,9 +789,10 @@ update_filter (BzSearchWidget *self)
   g_auto (GStrv) terms             = NULL;
   g_autoptr (DexFuture) future     = NULL;
   g_autofree gchar **tokens        = NULL;
+  g_autoptr (SearchQueryData) data = NULL;
 
   g_clear_handle_id (&self->search_update_timeout, g_source_remove);
-  dex_clear (&self->search_query);
+  cancel_search (self);
 
   gtk_widget_set_visible (GTK_WIDGET (self->search_busy), FALSE);
 
@@ -764,18 +835,24 @@ update_filter (BzSearchWidget *self)
   terms = g_strv_builder_end (builder);
 
   self->search_in_progress = TRUE;
+  self->search_cancellable = g_cancellable_new ();
 
   future = bz_search_engine_query (
       engine,
-      (const char *const *) terms);
+      (const char *const *) terms,
+      self->search_cancellable);
   gtk_widget_set_visible (
       GTK_WIDGET (self->search_busy),
       dex_future_is_pending (future));
 
+  data             = search_query_data_new ();
+  data->self       = bz_track_weak (self);
+  data->generation = self->search_generation;
+
   future = dex_future_then (
       future,
       (DexFutureCallback) search_query_then,
-      bz_track_weak (self), bz_weak_release);
+      search_query_data_ref (data), search_query_data_unref);
   self->search_query = g_steal_pointer (&future);
 }
 
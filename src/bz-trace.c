@@ -0,0 +1,284 @@
+/* bz-trace.c
+ *
+ * Copyright 2025 Adam Masciola
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#define G_LOG_DOMAIN "BAZAAR::TRACE"
+
+#include "config.h"
+
+#include <stdarg.h>
+#include <unistd.h>
+
+#ifdef HAVE_SYSPROF
+#include <sysprof-capture.h>
+#endif
+
+#include "bz-trace.h"
+
+/* Tracing is either written to a capture file of our own (BAZAAR_TRACE or
+   --trace), which works without sysprof running and is what benchmarks
+   should use, or forwarded to a sysprof collector when bazaar was spawned
+   by sysprof. Everything degrades to a cheap no-op when neither applies or
+   when built without libsysprof-capture. */
+
+#ifdef HAVE_SYSPROF
+
+static const struct
+{
+  const char *name;
+  const char *description;
+} counter_info[BZ_N_TRACE_COUNTERS] = {
+  [BZ_TRACE_COUNTER_CACHE_WRITE_QUEUE] = { "Cache Write Queue", "Entries waiting for a cache write slot" },
+  [BZ_TRACE_COUNTER_LIVE_ENTRIES]      = { "Live Entries", "BzEntry instances alive" },
+  [BZ_TRACE_COUNTER_LIVE_GROUPS]       = { "Live Groups", "BzEntryGroup instances alive" },
+  [BZ_TRACE_COUNTER_LIVE_TEXTURES]     = { "Live Textures", "BzAsyncTexture instances alive" },
+  [BZ_TRACE_COUNTER_TEXTURE_DOWNLOADS] = { "Texture Downloads", "Textures loading or downloading" },
+  [BZ_TRACE_COUNTER_INCOMING_ENTRIES]  = { "Incoming Entries", "Backend entries not yet received" },
+};
+
+/* Read from every thread, and cleared by bz_trace_shutdown () while
+   workers may still be running */
+static gint                  enabled                             = FALSE;
+static gboolean              use_collector                       = FALSE;
+static GMutex                writer_mutex                        = { 0 };
+static SysprofCaptureWriter *writer                              = NULL;
+static guint                 counter_ids[BZ_N_TRACE_COUNTERS]    = { 0 };
+
+static void
+define_counters (guint base);
+
+static void
+emit_counter (BzTraceCounter counter,
+              int            value);
+
+#endif
+
+/* Always maintained, the memory panel reads these too */
+static int counter_values[BZ_N_TRACE_COUNTERS] = { 0 };
+
+void
+bz_trace_init (const char *capture_path)
+{
+#ifdef HAVE_SYSPROF
+  guint base = 0;
+
+  g_return_if_fail (!g_atomic_int_get (&enabled));
+
+  if (capture_path == NULL)
+    capture_path = g_getenv ("BAZAAR_TRACE");
+
+  sysprof_clock_init ();
+
+  if (capture_path != NULL && *capture_path != '\0')
+    {
+      writer = sysprof_capture_writer_new (capture_path, 0);
+      if (writer == NULL)
+        {
+          g_warning ("Unable to open trace capture file %s", capture_path);
+          return;
+        }
+
+      base = sysprof_capture_writer_request_counter (writer, BZ_N_TRACE_COUNTERS);
+      g_info ("Writing trace capture to %s", capture_path);
+    }
+  else
+    {
+      sysprof_collector_init ();
+      if (!sysprof_collector_is_active ())
+        return;
+
+      use_collector = TRUE;
+      base          = sysprof_collector_request_counters (BZ_N_TRACE_COUNTERS);
+    }
+
+  define_counters (base);
+  g_atomic_int_set (&enabled, TRUE);
+#endif
+}
+
+void
+bz_trace_shutdown (void)
+{
+#ifdef HAVE_SYSPROF
+  g_autoptr (GMutexLocker) locker = NULL;
+
+  if (!g_atomic_int_compare_and_exchange (&enabled, TRUE, FALSE))
+    return;
+
+  locker = g_mutex_locker_new (&writer_mutex);
+  if (writer != NULL)
+    {
+      sysprof_capture_writer_flush (writer);
+      g_clear_pointer (&writer, sysprof_capture_writer_unref);
+    }
+#endif
+}
+
+gboolean
+bz_trace_is_enabled (void)
+{
+#ifdef HAVE_SYSPROF
+  return g_atomic_int_get (&enabled);
+#else
+  return FALSE;
+#endif
+}
+
+gint64
+bz_trace_begin (void)
+{
+#ifdef HAVE_SYSPROF
+  if (!g_atomic_int_get (&enabled))
+    return 0;
+  return SYSPROF_CAPTURE_CURRENT_TIME;
+#else
+  return 0;
+#endif
+}
+
+void
+bz_trace_end (gint64      begin,
+              const char *group,
+              const char *name,
+              const char *format,
+              ...)
+{
+#ifdef HAVE_SYSPROF
+  gint64 now               = 0;
+  g_autofree char *message = NULL;
+
+  /* A zero begin time means tracing was off when the span started */
+  if (!g_atomic_int_get (&enabled) || begin == 0)
+    return;
+
+  now = SYSPROF_CAPTURE_CURRENT_TIME;
+  if (format != NULL)
+    {
+      va_list args;
+
+      va_start (args, format);
+      message = g_strdup_vprintf (format, args);
+      va_end (args);
+    }
+
+  if (use_collector)
+    sysprof_collector_mark (begin, now - begin, group, name, message);
+  else
+    {
+      g_autoptr (GMutexLocker) locker = NULL;
+
+      locker = g_mutex_locker_new (&writer_mutex);
+      if (writer != NULL)
+        sysprof_capture_writer_add_mark (
+            writer, begin, -1, getpid (), now - begin,
+            group, name, message != NULL ? message : "");
+    }
+#endif
+}
+
+void
+bz_trace_counter_add (BzTraceCounter counter,
+                      int            delta)
+{
+  int value = 0;
+
+  g_return_if_fail (counter < BZ_N_TRACE_COUNTERS);
+
+  /* Keep counting while disabled so the values are right if a capture
+     starts later on */
+  value = g_atomic_int_add (&counter_values[counter], delta) + delta;
+#ifdef HAVE_SYSPROF
+  if (g_atomic_int_get (&enabled))
+    emit_counter (counter, value);
+#else
+  (void) value;
+#endif
+}
+
+void
+bz_trace_counter_set (BzTraceCounter counter,
+                      int            value)
+{
+  g_return_if_fail (counter < BZ_N_TRACE_COUNTERS);
+
+  g_atomic_int_set (&counter_values[counter], value);
+#ifdef HAVE_SYSPROF
+  if (g_atomic_int_get (&enabled))
+    emit_counter (counter, value);
+#endif
+}
+
+int
+bz_trace_counter_get (BzTraceCounter counter)
+{
+  g_return_val_if_fail (counter < BZ_N_TRACE_COUNTERS, 0);
+  return g_atomic_int_get (&counter_values[counter]);
+}
+
+#ifdef HAVE_SYSPROF
+
+static void
+define_counters (guint base)
+{
+  SysprofCaptureCounter counters[BZ_N_TRACE_COUNTERS] = { 0 };
+
+  for (guint i = 0; i < BZ_N_TRACE_COUNTERS; i++)
+    {
+      counter_ids[i] = base + i;
+
+      g_strlcpy (counters[i].category, "Bazaar", sizeof (counters[i].category));
+      g_strlcpy (counters[i].name, counter_info[i].name, sizeof (counters[i].name));
+      g_strlcpy (counters[i].description, counter_info[i].description, sizeof (counters[i].description));
+      counters[i].id        = counter_ids[i];
+      counters[i].type      = SYSPROF_CAPTURE_COUNTER_INT64;
+      counters[i].value.v64 = g_atomic_int_get (&counter_values[i]);
+    }
+
+  if (use_collector)
+    sysprof_collector_define_counters (counters, BZ_N_TRACE_COUNTERS);
+  else
+    sysprof_capture_writer_define_counters (
+        writer, SYSPROF_CAPTURE_CURRENT_TIME, -1, getpid (),
+        counters, BZ_N_TRACE_COUNTERS);
+}
+
+static void
+emit_counter (BzTraceCounter counter,
+              int            value)
+{
+  SysprofCaptureCounterValue counter_value = { 0 };
+
+  counter_value.v64 = value;
+  if (use_collector)
+    sysprof_collector_set_counters (&counter_ids[counter], &counter_value, 1);
+  else
+    {
+      g_autoptr (GMutexLocker) locker = NULL;
+
+      locker = g_mutex_locker_new (&writer_mutex);
+      if (writer != NULL)
+        sysprof_capture_writer_set_counters (
+            writer, SYSPROF_CAPTURE_CURRENT_TIME, -1, getpid (),
+            &counter_ids[counter], &counter_value, 1);
+    }
+}
+
+#endif
+
+/* End of bz-trace.c */
@@ -0,0 +1,71 @@
+/* bz-trace.h
+ *
+ * Copyright 2025 Adam Masciola
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef enum
+{
+  BZ_TRACE_COUNTER_CACHE_WRITE_QUEUE = 0,
+  BZ_TRACE_COUNTER_LIVE_ENTRIES,
+  BZ_TRACE_COUNTER_LIVE_GROUPS,
+  BZ_TRACE_COUNTER_LIVE_TEXTURES,
+  BZ_TRACE_COUNTER_TEXTURE_DOWNLOADS,
+  BZ_TRACE_COUNTER_INCOMING_ENTRIES,
+
+  BZ_N_TRACE_COUNTERS,
+} BzTraceCounter;
+
+void
+bz_trace_init (const char *capture_path);
+
+void
+bz_trace_shutdown (void);
+
+gboolean
+bz_trace_is_enabled (void);
+
+gint64
+bz_trace_begin (void);
+
+void
+bz_trace_end (gint64      begin,
+              const char *group,
+              const char *name,
+              const char *format,
+              ...) G_GNUC_PRINTF (4, 5);
+
+void
+bz_trace_counter_add (BzTraceCounter counter,
+                      int            delta);
+
+void
+bz_trace_counter_set (BzTraceCounter counter,
+                      int            value);
+
+int
+bz_trace_counter_get (BzTraceCounter counter);
+
+G_END_DECLS
+
+/* End of bz-trace.h */
@@ -34,6 +34,11 @@ struct _BzUserDataPage
   BzStateInfo *state;
   GListModel  *model;
 
+  /* BzEntryGroup -> guint64 *, read by the sort so it never does any
+     io of its own */
+  GHashTable *sizes;
+  guint       resort_source;
+
   /* Template widgets */
   AdwViewStack *stack;
 };
@@ -64,14 +69,25 @@ items_changed (BzUserDataPage *self,
 static void
 set_page (BzUserDataPage *self);
 
+static void
+user_data_size_changed (BzUserDataPage *self,
+                        GParamSpec     *pspec,
+                        BzEntryGroup   *group);
+
+static gboolean
+resort (BzUserDataPage *self);
+
+static void
+release_model (BzUserDataPage *self);
+
 static void
 bz_user_data_page_dispose (GObject *object)
 {
   BzUserDataPage *self = BZ_USER_DATA_PAGE (object);
 
-  if (self->model != NULL)
-    g_signal_handlers_disconnect_by_func (self->model, items_changed, self);
-  g_clear_object (&self->model);
+  release_model (self);
+  g_clear_handle_id (&self->resort_source, g_source_remove);
+  g_clear_pointer (&self->sizes, g_hash_table_unref);
   g_clear_object (&self->state);
 
   G_OBJECT_CLASS (bz_user_data_page_parent_class)->dispose (object);
@@ -178,6 +194,8 @@ static void
 bz_user_data_page_init (BzUserDataPage *self)
 {
   gtk_widget_init_template (GTK_WIDGET (self));
+
+  self->sizes = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL, g_free);
 }
 
 GtkWidget *
@@ -208,15 +226,77 @@ set_page (BzUserDataPage *self)
     adw_view_stack_set_visible_child_name (self->stack, "empty");
 }
 
+static void
+user_data_size_changed (BzUserDataPage *self,
+                        GParamSpec     *pspec,
+                        BzEntryGroup   *group)
+{
+  guint64 size = 0;
+
+  size = bz_entry_group_get_user_data_size (group);
+  g_hash_table_replace (self->sizes, group, g_memdup2 (&size, sizeof (size)));
+
+  /* Walks tend to finish in bursts, sort once for all of them */
+  if (self->resort_source == 0)
+    self->resort_source = g_idle_add_full (
+        G_PRIORITY_LOW, (GSourceFunc) resort, self, NULL);
+}
+
 static int
-compare_entry_groups_by_title (BzEntryGroup *group_a,
-                               BzEntryGroup *group_b)
+compare_entry_groups_by_size (BzEntryGroup *group_a,
+                              BzEntryGroup *group_b,
+                              GHashTable   *sizes)
 {
-  const char *title_a = bz_entry_group_get_title (group_a);
-  const char *title_b = bz_entry_group_get_title (group_b);
+  guint64    *size_a  = NULL;
+  guint64    *size_b  = NULL;
+  const char *title_a = NULL;
+  const char *title_b = NULL;
+
+  size_a = g_hash_table_lookup (sizes, group_a);
+  size_b = g_hash_table_lookup (sizes, group_b);
+  if (size_a != NULL && size_b != NULL && *size_a != *size_b)
+    return *size_a > *size_b ? -1 : 1;
+  if ((size_a == NULL) != (size_b == NULL))
+    return size_a != NULL ? -1 : 1;
+
+  title_a = bz_entry_group_get_title (group_a);
+  title_b = bz_entry_group_get_title (group_b);
   return g_utf8_collate (title_a, title_b);
 }
 
+static gboolean
+resort (BzUserDataPage *self)
+{
+  self->resort_source = 0;
+
+  if (self->model != NULL)
+    g_list_store_sort (G_LIST_STORE (self->model),
+                       (GCompareDataFunc) compare_entry_groups_by_size,
+                       self->sizes);
+  return G_SOURCE_REMOVE;
+}
+
+static void
+release_model (BzUserDataPage *self)
+{
+  guint n_items = 0;
+
+  if (self->model == NULL)
+    return;
+
+  n_items = g_list_model_get_n_items (self->model);
+  for (guint i = 0; i < n_items; i++)
+    {
+      g_autoptr (BzEntryGroup) group = NULL;
+
+      group = g_list_model_get_item (self->model, i);
+      g_signal_handlers_disconnect_by_func (group, user_data_size_changed, self);
+    }
+
+  g_signal_handlers_disconnect_by_func (self->model, items_changed, self);
+  g_clear_object (&self->model);
+}
+
 static DexFuture *
 fetch_user_data_fiber (GWeakRef *wr)
 {
@@ -228,6 +308,7 @@ fetch_user_data_fiber (GWeakRef *wr)
   BzApplicationMapFactory *factory     = NULL;
   g_autoptr (GListModel) model         = NULL;
   g_autoptr (GListStore) sorted_store  = NULL;
+  g_autoptr (GPtrArray) peeks          = NULL;
   GListModel *installed_groups         = NULL;
   g_autoptr (GHashTable) installed_ids = NULL;
   guint n_items;
@@ -282,20 +363,53 @@ fetch_user_data_fiber (GWeakRef *wr)
   model   = bz_application_map_factory_generate (factory, G_LIST_MODEL (id_list));
 
   sorted_store = g_list_store_new (BZ_TYPE_ENTRY_GROUP);
+  peeks        = g_ptr_array_new_with_free_func (dex_unref);
   n_items      = g_list_model_get_n_items (model);
   for (guint i = 0; i < n_items; i++)
     {
       g_autoptr (BzEntryGroup) group = g_list_model_get_item (model, i);
+
       g_list_store_append (sorted_store, group);
+      g_ptr_array_add (peeks, bz_peek_user_data_size_dex (bz_entry_group_get_id (group)));
     }
-  g_list_store_sort (sorted_store, (GCompareDataFunc) compare_entry_groups_by_title, NULL);
 
-  if (self->model != NULL)
-    g_signal_handlers_disconnect_by_func (self->model, items_changed, self);
+  /* Sizes from the last walk are read off the main thread, so the
+     largest apps are on top before any directory is walked. Apps never
+     measured before simply have no size yet. */
+  if (peeks->len > 0)
+    dex_await (dex_future_allv ((DexFuture *const *) peeks->pdata, peeks->len), NULL);
 
-  g_clear_object (&self->model);
+  g_hash_table_remove_all (self->sizes);
+  for (guint i = 0; i < peeks->len; i++)
+    {
+      g_autoptr (BzEntryGroup) group = NULL;
+      const GValue *value            = NULL;
+      guint64       size             = 0;
+
+      value = dex_future_get_value (g_ptr_array_index (peeks, i), NULL);
+      if (value == NULL)
+        continue;
+
+      group = g_list_model_get_item (G_LIST_MODEL (sorted_store), i);
+      size  = g_value_get_uint64 (value);
+      g_hash_table_replace (self->sizes, group, g_memdup2 (&size, sizeof (size)));
+    }
+  g_list_store_sort (sorted_store, (GCompareDataFunc) compare_entry_groups_by_size, self->sizes);
+
+  release_model (self);
   self->model = G_LIST_MODEL (g_steal_pointer (&sorted_store));
 
+  /* The walks run on the groups themselves, which are shared with every
+     other view of them, and each result sorts the page again */
+  for (guint i = 0; i < n_items; i++)
+    {
+      g_autoptr (BzEntryGroup) group = g_list_model_get_item (self->model, i);
+
+      g_signal_connect_swapped (group, "notify::user-data-size",
+                                G_CALLBACK (user_data_size_changed), self);
+      bz_entry_group_get_user_data_size (group);
+    }
+
   g_signal_connect_swapped (self->model, "items-changed", G_CALLBACK (items_changed), self);
   set_page (self);
 
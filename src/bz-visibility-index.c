@@ -0,0 +1,401 @@
+/* bz-visibility-index.c
+ *
+ * Copyright 2025 Adam Masciola
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+/* One id -> visible table for the whole application. Models created
+   with bz_visibility_index_filter () only hold the positions of their
+   visible ids, and when the table is invalidated they are told exactly
+   which ids flipped, instead of each re-running the check over all of
+   their items. */
+
+#include <gtk/gtk.h>
+
+#include "bz-marshalers.h"
+#include "bz-visibility-index.h"
+
+#define VISIBLE GINT_TO_POINTER (1)
+#define HIDDEN  GINT_TO_POINTER (2)
+
+struct _BzVisibilityIndex
+{
+  GObject parent_instance;
+
+  BzVisibilityIndexFunc func;
+  gpointer              user_data;
+
+  GHashTable *table;
+};
+
+G_DEFINE_FINAL_TYPE (BzVisibilityIndex, bz_visibility_index, G_TYPE_OBJECT);
+
+enum
+{
+  SIGNAL_CHANGED,
+
+  LAST_SIGNAL,
+};
+static guint signals[LAST_SIGNAL];
+
+#define BZ_TYPE_VISIBLE_IDS_MODEL (bz_visible_ids_model_get_type ())
+G_DECLARE_FINAL_TYPE (BzVisibleIdsModel, bz_visible_ids_model, BZ, VISIBLE_IDS_MODEL, GObject)
+
+struct _BzVisibleIdsModel
+{
+  GObject parent_instance;
+
+  BzVisibilityIndex *index;
+  GListModel        *ids;
+
+  /* Ascending positions in ids of the visible items */
+  GArray *positions;
+};
+
+static void
+list_model_iface_init (GListModelInterface *iface);
+
+G_DEFINE_FINAL_TYPE_WITH_CODE (
+    BzVisibleIdsModel,
+    bz_visible_ids_model,
+    G_TYPE_OBJECT,
+    G_IMPLEMENT_INTERFACE (G_TYPE_LIST_MODEL, list_model_iface_init))
+
+static void
+ids_changed (BzVisibleIdsModel *self,
+             guint              position,
+             guint              removed,
+             guint              added,
+             GListModel        *model);
+
+static void
+index_changed (BzVisibleIdsModel *self,
+               GHashTable        *flipped,
+               BzVisibilityIndex *index);
+
+static gboolean
+id_at_is_visible (BzVisibleIdsModel *self,
+                  guint              position);
+
+static guint
+lower_bound (GArray *positions,
+             guint   position);
+
+static void
+bz_visibility_index_dispose (GObject *object)
+{
+  BzVisibilityIndex *self = BZ_VISIBILITY_INDEX (object);
+
+  g_clear_pointer (&self->table, g_hash_table_unref);
+
+  G_OBJECT_CLASS (bz_visibility_index_parent_class)->dispose (object);
+}
+
+static void
+bz_visibility_index_class_init (BzVisibilityIndexClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->dispose = bz_visibility_index_dispose;
+
+  signals[SIGNAL_CHANGED] =
+      g_signal_new (
+          "changed",
+          G_OBJECT_CLASS_TYPE (klass),
+          G_SIGNAL_RUN_FIRST,
+          0,
+          NULL, NULL,
+          bz_marshal_VOID__BOXED,
+          G_TYPE_NONE,
+          1,
+          G_TYPE_HASH_TABLE);
+  g_signal_set_va_marshaller (
+      signals[SIGNAL_CHANGED],
+      G_TYPE_FROM_CLASS (klass),
+      bz_marshal_VOID__BOXEDv);
+}
+
+static void
+bz_visibility_index_init (BzVisibilityIndex *self)
+{
+  self->table = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+}
+
+BzVisibilityIndex *
+bz_visibility_index_new (BzVisibilityIndexFunc func,
+                         gpointer              user_data)
+{
+  BzVisibilityIndex *self = NULL;
+
+  g_return_val_if_fail (func != NULL, NULL);
+
+  self            = g_object_new (BZ_TYPE_VISIBILITY_INDEX, NULL);
+  self->func      = func;
+  self->user_data = user_data;
+
+  return self;
+}
+
+gboolean
+bz_visibility_index_lookup (BzVisibilityIndex *self,
+                            const char        *id)
+{
+  gpointer value   = NULL;
+  gboolean visible = FALSE;
+
+  g_return_val_if_fail (BZ_IS_VISIBILITY_INDEX (self), FALSE);
+  g_return_val_if_fail (id != NULL, FALSE);
+
+  value = g_hash_table_lookup (self->table, id);
+  if (value != NULL)
+    return value == VISIBLE;
+
+  visible = self->func (id, self->user_data);
+  g_hash_table_replace (self->table, g_strdup (id), visible ? VISIBLE : HIDDEN);
+
+  return visible;
+}
+
+void
+bz_visibility_index_invalidate (BzVisibilityIndex *self)
+{
+  g_autoptr (GHashTable) flipped = NULL;
+  GHashTableIter iter            = { 0 };
+  const char    *id              = NULL;
+  gpointer       value           = NULL;
+
+  g_return_if_fail (BZ_IS_VISIBILITY_INDEX (self));
+
+  flipped = g_hash_table_new (g_str_hash, g_str_equal);
+
+  g_hash_table_iter_init (&iter, self->table);
+  while (g_hash_table_iter_next (&iter, (gpointer *) &id, &value))
+    {
+      gpointer now = NULL;
+
+      now = self->func (id, self->user_data) ? VISIBLE : HIDDEN;
+      if (now != value)
+        {
+          g_hash_table_iter_replace (&iter, now);
+          g_hash_table_add (flipped, (gpointer) id);
+        }
+    }
+
+  if (g_hash_table_size (flipped) > 0)
+    g_signal_emit (self, signals[SIGNAL_CHANGED], 0, flipped);
+}
+
+GListModel *
+bz_visibility_index_filter (BzVisibilityIndex *self,
+                            GListModel        *ids)
+{
+  BzVisibleIdsModel *model = NULL;
+
+  g_return_val_if_fail (BZ_IS_VISIBILITY_INDEX (self), NULL);
+  g_return_val_if_fail (G_IS_LIST_MODEL (ids), NULL);
+
+  model        = g_object_new (BZ_TYPE_VISIBLE_IDS_MODEL, NULL);
+  model->index = g_object_ref (self);
+  model->ids   = g_object_ref (ids);
+
+  g_signal_connect_object (
+      ids, "items-changed",
+      G_CALLBACK (ids_changed), model,
+      G_CONNECT_SWAPPED);
+  g_signal_connect_object (
+      self, "changed",
+      G_CALLBACK (index_changed), model,
+      G_CONNECT_SWAPPED);
+
+  ids_changed (model, 0, 0, g_list_model_get_n_items (ids), ids);
+  return G_LIST_MODEL (model);
+}
+
+static void
+bz_visible_ids_model_dispose (GObject *object)
+{
+  BzVisibleIdsModel *self = BZ_VISIBLE_IDS_MODEL (object);
+
+  g_clear_object (&self->index);
+  g_clear_object (&self->ids);
+  g_clear_pointer (&self->positions, g_array_unref);
+
+  G_OBJECT_CLASS (bz_visible_ids_model_parent_class)->dispose (object);
+}
+
+static void
+bz_visible_ids_model_class_init (BzVisibleIdsModelClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->dispose = bz_visible_ids_model_dispose;
+}
+
+static void
+bz_visible_ids_model_init (BzVisibleIdsModel *self)
+{
+  self->positions = g_array_new (FALSE, FALSE, sizeof (guint));
+}
+
+static GType
+list_model_get_item_type (GListModel *list)
+{
+  return GTK_TYPE_STRING_OBJECT;
+}
+
+static guint
+list_model_get_n_items (GListModel *list)
+{
+  BzVisibleIdsModel *self = BZ_VISIBLE_IDS_MODEL (list);
+  return self->positions->len;
+}
+
+static gpointer
+list_model_get_item (GListModel *list,
+                     guint       position)
+{
+  BzVisibleIdsModel *self = BZ_VISIBLE_IDS_MODEL (list);
+
+  if (position >= self->positions->len)
+    return NULL;
+
+  return g_list_model_get_item (
+      self->ids,
+      g_array_index (self->positions, guint, position));
+}
+
+static void
+list_model_iface_init (GListModelInterface *iface)
+{
+  iface->get_item_type = list_model_get_item_type;
+  iface->get_n_items   = list_model_get_n_items;
+  iface->get_item      = list_model_get_item;
+}
+
+static void
+ids_changed (BzVisibleIdsModel *self,
+             guint              position,
+             guint              removed,
+             guint              added,
+             GListModel        *model)
+{
+  g_autoptr (GArray) inserted = NULL;
+  guint start                 = 0;
+  guint end                   = 0;
+
+  start = lower_bound (self->positions, position);
+  end   = lower_bound (self->positions, position + removed);
+  if (end > start)
+    g_array_remove_range (self->positions, start, end - start);
+
+  for (guint i = start; i < self->positions->len; i++)
+    g_array_index (self->positions, guint, i) += added - removed;
+
+  inserted = g_array_new (FALSE, FALSE, sizeof (guint));
+  for (guint i = position; i < position + added; i++)
+    {
+      if (id_at_is_visible (self, i))
+        g_array_append_val (inserted, i);
+    }
+  if (inserted->len > 0)
+    g_array_insert_vals (self->positions, start, inserted->data, inserted->len);
+
+  if (end > start || inserted->len > 0)
+    g_list_model_items_changed (G_LIST_MODEL (self), start, end - start, inserted->len);
+}
+
+static void
+index_changed (BzVisibleIdsModel *self,
+               GHashTable        *flipped,
+               BzVisibilityIndex *index)
+{
+  guint n_ids = 0;
+  guint k     = 0;
+
+  n_ids = g_list_model_get_n_items (self->ids);
+  for (guint i = 0; i < n_ids; i++)
+    {
+      g_autoptr (GtkStringObject) string = NULL;
+      const char *id                     = NULL;
+      gboolean    was                    = FALSE;
+      gboolean    now                    = FALSE;
+
+      was = k < self->positions->len &&
+            g_array_index (self->positions, guint, k) == i;
+
+      string = g_list_model_get_item (self->ids, i);
+      id     = gtk_string_object_get_string (string);
+      if (!g_hash_table_contains (flipped, id))
+        {
+          if (was)
+            k++;
+          continue;
+        }
+      now = bz_visibility_index_lookup (index, id);
+
+      if (was && !now)
+        {
+          g_array_remove_index (self->positions, k);
+          g_list_model_items_changed (G_LIST_MODEL (self), k, 1, 0);
+        }
+      else if (!was && now)
+        {
+          g_array_insert_val (self->positions, k, i);
+          g_list_model_items_changed (G_LIST_MODEL (self), k, 0, 1);
+          k++;
+        }
+      else if (was)
+        k++;
+    }
+}
+
+static gboolean
+id_at_is_visible (BzVisibleIdsModel *self,
+                  guint              position)
+{
+  g_autoptr (GtkStringObject) string = NULL;
+  const char *id                     = NULL;
+
+  string = g_list_model_get_item (self->ids, position);
+  if (string == NULL)
+    return FALSE;
+  id = gtk_string_object_get_string (string);
+
+  return bz_visibility_index_lookup (self->index, id);
+}
+
+static guint
+lower_bound (GArray *positions,
+             guint   position)
+{
+  guint lo = 0;
+  guint hi = positions->len;
+
+  while (lo < hi)
+    {
+      guint mid = lo + (hi - lo) / 2;
+
+      if (g_array_index (positions, guint, mid) < position)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+
+  return lo;
+}
+
+/* End of bz-visibility-index.c */
@@ -0,0 +1,50 @@
+/* bz-visibility-index.h
+ *
+ * Copyright 2025 Adam Masciola
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include <gio/gio.h>
+
+G_BEGIN_DECLS
+
+typedef gboolean (*BzVisibilityIndexFunc) (const char *id,
+                                           gpointer    user_data);
+
+#define BZ_TYPE_VISIBILITY_INDEX (bz_visibility_index_get_type ())
+G_DECLARE_FINAL_TYPE (BzVisibilityIndex, bz_visibility_index, BZ, VISIBILITY_INDEX, GObject)
+
+BzVisibilityIndex *
+bz_visibility_index_new (BzVisibilityIndexFunc func,
+                         gpointer              user_data);
+
+gboolean
+bz_visibility_index_lookup (BzVisibilityIndex *self,
+                            const char        *id);
+
+void
+bz_visibility_index_invalidate (BzVisibilityIndex *self);
+
+GListModel *
+bz_visibility_index_filter (BzVisibilityIndex *self,
+                            GListModel        *ids);
+
+G_END_DECLS
+
+/* End of bz-visibility-index.h */
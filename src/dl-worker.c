@@ -20,6 +20,18 @@
 
 #define G_LOG_DOMAIN "BAZAAR::DL-WORKER-SUBPROCESS"
 
+/* Minimum number of bytes between two progress frames */
+#define PROGRESS_INTERVAL (64 * 1024)
+
+/* Files in the store younger than this are never pruned, since another
+   worker may be about to link or rename them */
+#define PRUNE_MIN_AGE_SECONDS (60 * 60)
+
+#include <errno.h>
+#include <glib/gstdio.h>
+#include <unistd.h>
+
+#include "bz-download-protocol.h"
 #include "bz-env.h"
 #include "bz-global-net.h"
 #include "bz-util.h"
@@ -28,51 +40,186 @@ BZ_DEFINE_DATA (
     main,
     Main,
     {
-      GMainLoop  *loop;
-      GIOChannel *stdout_channel;
+      GMainLoop *loop;
     },
-    BZ_RELEASE_DATA (loop, g_main_loop_unref);
-    BZ_RELEASE_DATA (stdout_channel, g_io_channel_unref));
+    BZ_RELEASE_DATA (loop, g_main_loop_unref));
 
 BZ_DEFINE_DATA (
     download,
     Download,
     {
+      guint32     id;
+      guint8      priority;
+      guint64     serial;
+      gint64      received;
       char       *src;
       char       *dest;
-      GIOChannel *stdout_channel;
+      DexPromise *cancel;
+      DexPromise *slot;
     },
     BZ_RELEASE_DATA (src, g_free);
     BZ_RELEASE_DATA (dest, g_free);
-    BZ_RELEASE_DATA (stdout_channel, g_io_channel_unref));
+    BZ_RELEASE_DATA (cancel, dex_unref);
+    BZ_RELEASE_DATA (slot, dex_unref));
+
+BZ_DEFINE_DATA (
+    fetch,
+    Fetch,
+    {
+      char       *src;
+      DexPromise *promise;
+      GArray     *listeners;
+      guint       http_status;
+      guint64     bytes_done;
+      guint64     bytes_reported;
+      guint64     bytes_total;
+      guint       tls_handshakes;
+      guint       http_version;
+    },
+    BZ_RELEASE_DATA (src, g_free);
+    BZ_RELEASE_DATA (promise, dex_unref);
+    BZ_RELEASE_DATA (listeners, g_array_unref));
+
+BZ_DEFINE_DATA (
+    store,
+    Store,
+    {
+      char *src;
+      char *tmp_path;
+      char *index_path;
+      char *etag;
+    },
+    BZ_RELEASE_DATA (src, g_free);
+    BZ_RELEASE_DATA (tmp_path, g_free);
+    BZ_RELEASE_DATA (index_path, g_free);
+    BZ_RELEASE_DATA (etag, g_free));
+
+BZ_DEFINE_DATA (
+    place,
+    Place,
+    {
+      char *blob_path;
+      char *dest;
+    },
+    BZ_RELEASE_DATA (blob_path, g_free);
+    BZ_RELEASE_DATA (dest, g_free));
+
+/* Downloads are stored once under their SHA-256 in
+   <store>/blobs/<2 chars>/<hash>, with <store>/index/<url hash>
+   remembering which blob and ETag a url last resolved to.
+   Destinations are hard links to the blobs. */
+static char *store_dir = NULL;
+
+/* Only written to from the default scheduler */
+static GIOChannel *stdout_channel = NULL;
+
+/* The following are only touched from fibers on the default scheduler */
+
+/* src uri -> FetchData, so concurrent requests share one transfer */
+static GHashTable *in_flight = NULL;
+/* DownloadData waiting for a slot */
+static GPtrArray *pending     = NULL;
+static guint      n_active    = 0;
+static guint64    next_serial = 0;
+
+/* id -> DownloadData, also read from the stdin thread to cancel */
+static GMutex      requests_mutex = { 0 };
+static GHashTable *requests       = NULL;
 
 static DexFuture *
 read_stdin (MainData *data);
 
+static gboolean
+read_exact (GIOChannel *channel,
+            guint8     *buffer,
+            gsize       count,
+            GError    **error);
+
+static void
+write_frame (const BzDownloadFrame *frame);
+
 static DexFuture *
 download_fiber (DownloadData *data);
 
+static void
+release_slot (void);
+
+static void
+got_body_data (SoupMessage *message,
+               guint        chunk_size,
+               FetchData   *data);
+
+static void
+network_event (SoupMessage       *message,
+               GSocketClientEvent event,
+               GIOStream         *connection,
+               guint             *tls_handshakes);
+
+static DexFuture *
+fetch_fiber (FetchData *data);
+
+static DexFuture *
+fetch_finally (DexFuture *future,
+               FetchData *data);
+
+static DexFuture *
+store_fiber (StoreData *data);
+
+static DexFuture *
+place_fiber (PlaceData *data);
+
+static char *
+dup_blob_path (const char *hash);
+
+static char *
+dup_index_path (const char *src);
+
+static char *
+hash_file (const char *path,
+           GError    **error);
+
+static void
+prune_store (void);
+
 int
 main (int   argc,
       char *argv[])
 {
-  g_autoptr (GIOChannel) stdout_channel = NULL;
-  g_autoptr (GMainLoop) main_loop       = NULL;
-  g_autoptr (MainData) data             = NULL;
-  g_autoptr (DexFuture) future          = NULL;
+  g_autoptr (GError) local_error     = NULL;
+  g_autoptr (GOptionContext) context = NULL;
+  g_autoptr (GMainLoop) main_loop    = NULL;
+  g_autoptr (MainData) data          = NULL;
+  g_autoptr (DexFuture) future       = NULL;
+  const GOptionEntry entries[]       = {
+    { "store-dir", 0, 0, G_OPTION_ARG_FILENAME, &store_dir, "Directory for the content addressed download store", "DIR" },
+    { NULL }
+  };
 
   g_log_writer_default_set_use_stderr (TRUE);
   dex_init ();
 
+  context = g_option_context_new (NULL);
+  g_option_context_add_main_entries (context, entries, NULL);
+  if (!g_option_context_parse (context, &argc, &argv, &local_error))
+    {
+      g_warning ("FATAL: %s", local_error->message);
+      return EXIT_FAILURE;
+    }
+
+  in_flight = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, fetch_data_unref);
+  pending   = g_ptr_array_new_with_free_func (download_data_unref);
+  requests  = g_hash_table_new_full (NULL, NULL, NULL, download_data_unref);
+  if (store_dir != NULL)
+    prune_store ();
+
   stdout_channel = g_io_channel_unix_new (STDOUT_FILENO);
   g_assert (g_io_channel_set_encoding (stdout_channel, NULL, NULL));
   g_io_channel_set_buffered (stdout_channel, FALSE);
 
   main_loop = g_main_loop_new (NULL, FALSE);
 
-  data                 = main_data_new ();
-  data->loop           = g_main_loop_ref (main_loop);
-  data->stdout_channel = g_io_channel_ref (stdout_channel);
+  data       = main_data_new ();
+  data->loop = g_main_loop_ref (main_loop);
 
   future = dex_scheduler_spawn (
       dex_thread_pool_scheduler_get_default (),
@@ -90,19 +237,18 @@ read_stdin (MainData *data)
   g_autoptr (GIOChannel) stdin_channel = NULL;
 
   stdin_channel = g_io_channel_unix_new (STDIN_FILENO);
+  g_assert (g_io_channel_set_encoding (stdin_channel, NULL, NULL));
+
   for (;;)
     {
-      g_autoptr (GError) local_error   = NULL;
-      g_autofree char *string          = NULL;
-      char            *newline         = NULL;
-      g_autoptr (GVariant) variant     = NULL;
-      g_autofree char *src_uri         = NULL;
-      g_autofree char *dest_path       = NULL;
-      g_autoptr (DownloadData) dl_data = NULL;
+      g_autoptr (GError) local_error                = NULL;
+      guint8 header[BZ_DOWNLOAD_FRAME_HEADER_SIZE]  = { 0 };
+      gsize  length                                 = 0;
+      g_autofree guint8 *payload                    = NULL;
+      g_auto (BzDownloadFrame) frame                = { 0 };
+      g_autoptr (DownloadData) dl_data              = NULL;
 
-      g_io_channel_read_line (
-          stdin_channel, &string, NULL, NULL, &local_error);
-      if (string == NULL)
+      if (!read_exact (stdin_channel, header, sizeof (header), &local_error))
         {
           if (local_error != NULL)
             g_warning ("FATAL: Failure reading stdin channel: %s", local_error->message);
@@ -110,78 +256,769 @@ read_stdin (MainData *data)
           return NULL;
         }
 
-      newline = g_utf8_strchr (string, -1, '\n');
-      if (newline != NULL)
-        *newline = '\0';
+      length = bz_download_frame_parse_header (header, &local_error);
+      if (length == 0)
+        {
+          g_warning ("FATAL: %s", local_error->message);
+          g_main_loop_quit (data->loop);
+          return NULL;
+        }
 
-      variant = g_variant_parse (
-          G_VARIANT_TYPE ("(ss)"),
-          string, NULL, NULL,
-          &local_error);
-      if (variant == NULL)
+      payload = g_malloc (length);
+      if (!read_exact (stdin_channel, payload, length, &local_error) ||
+          !bz_download_frame_deserialize (&frame, payload, length, &local_error))
         {
-          g_warning ("Failure parsing variant text '%s' into structure: %s\n",
-                     string, local_error->message);
+          if (local_error != NULL)
+            g_warning ("FATAL: Failure reading frame from stdin channel: %s", local_error->message);
           g_main_loop_quit (data->loop);
-          continue;
+          return NULL;
         }
 
-      g_variant_get (variant, "(ss)", &src_uri, &dest_path);
+      switch (frame.type)
+        {
+        case BZ_DOWNLOAD_FRAME_REQUEST:
+          dl_data           = download_data_new ();
+          dl_data->id       = frame.id;
+          dl_data->priority = frame.priority;
+          dl_data->src      = g_steal_pointer (&frame.src);
+          dl_data->dest     = g_steal_pointer (&frame.dest);
+          dl_data->cancel   = dex_promise_new ();
+          dl_data->received = g_get_monotonic_time ();
 
-      dl_data                 = download_data_new ();
-      dl_data->src            = g_steal_pointer (&src_uri);
-      dl_data->dest           = g_steal_pointer (&dest_path);
-      dl_data->stdout_channel = g_io_channel_ref (data->stdout_channel);
+          g_mutex_lock (&requests_mutex);
+          g_hash_table_replace (requests, GUINT_TO_POINTER (dl_data->id), download_data_ref (dl_data));
+          g_mutex_unlock (&requests_mutex);
 
-      dex_future_disown (dex_scheduler_spawn (
-          dex_scheduler_get_default (),
-          bz_get_dex_stack_size (),
-          (DexFiberFunc) download_fiber,
-          download_data_ref (dl_data), download_data_unref));
+          dex_future_disown (dex_scheduler_spawn (
+              dex_scheduler_get_default (),
+              bz_get_dex_stack_size (),
+              (DexFiberFunc) download_fiber,
+              download_data_ref (dl_data), download_data_unref));
+          break;
+
+        case BZ_DOWNLOAD_FRAME_CANCEL:
+          g_mutex_lock (&requests_mutex);
+          dl_data = g_hash_table_lookup (requests, GUINT_TO_POINTER (frame.id));
+          if (dl_data != NULL)
+            {
+              download_data_ref (dl_data);
+              if (dex_future_is_pending (DEX_FUTURE (dl_data->cancel)))
+                dex_promise_reject (
+                    dl_data->cancel,
+                    g_error_new (G_IO_ERROR, G_IO_ERROR_CANCELLED,
+                                 "Download of %s was cancelled", dl_data->src));
+            }
+          g_mutex_unlock (&requests_mutex);
+          break;
+
+        case BZ_DOWNLOAD_FRAME_PROGRESS:
+        case BZ_DOWNLOAD_FRAME_REPLY:
+        default:
+          g_warning ("Ignoring unexpected frame of type %d", frame.type);
+          break;
+        }
     }
 
   return NULL;
 }
 
+static gboolean
+read_exact (GIOChannel *channel,
+            guint8     *buffer,
+            gsize       count,
+            GError    **error)
+{
+  gsize offset = 0;
+
+  while (offset < count)
+    {
+      GIOStatus status     = G_IO_STATUS_NORMAL;
+      gsize     bytes_read = 0;
+
+      status = g_io_channel_read_chars (
+          channel, (char *) buffer + offset, count - offset,
+          &bytes_read, error);
+      if (status == G_IO_STATUS_ERROR)
+        return FALSE;
+      if (status == G_IO_STATUS_EOF)
+        {
+          if (offset > 0)
+            g_set_error (error, G_IO_ERROR, G_IO_ERROR_PARTIAL_INPUT,
+                         "Unexpected end of input inside a frame");
+          return FALSE;
+        }
+
+      offset += bytes_read;
+    }
+
+  return TRUE;
+}
+
+static void
+write_frame (const BzDownloadFrame *frame)
+{
+  g_autoptr (GError) serialize_error = NULL;
+  g_autoptr (GBytes) bytes           = NULL;
+  const char *data                   = NULL;
+  gsize       size                   = 0;
+  gsize       offset                 = 0;
+
+  bytes = bz_download_frame_serialize (frame, &serialize_error);
+  if (bytes == NULL && frame->type == BZ_DOWNLOAD_FRAME_REPLY)
+    {
+      BzDownloadFrame trimmed = *frame;
+
+      /* The message is the only part of a reply that can grow without
+         bound, and the parent still needs to hear back */
+      g_warning ("Dropping the message of reply %u: %s",
+                 frame->id, serialize_error->message);
+      trimmed.message = NULL;
+      bytes           = bz_download_frame_serialize (&trimmed, NULL);
+    }
+  if (bytes == NULL)
+    {
+      g_warning ("Could not serialize frame: %s", serialize_error->message);
+      return;
+    }
+  data = g_bytes_get_data (bytes, &size);
+
+  while (offset < size)
+    {
+      g_autoptr (GError) local_error = NULL;
+      GIOStatus status               = G_IO_STATUS_NORMAL;
+      gsize     bytes_written        = 0;
+
+      status = g_io_channel_write_chars (
+          stdout_channel, data + offset, size - offset,
+          &bytes_written, &local_error);
+      if (status == G_IO_STATUS_ERROR)
+        {
+          g_warning ("Could not write frame to stdout: %s", local_error->message);
+          return;
+        }
+
+      offset += bytes_written;
+    }
+}
+
 static DexFuture *
 download_fiber (DownloadData *data)
 {
-  gboolean success                          = FALSE;
-  g_autoptr (GError) local_error            = NULL;
-  g_autoptr (GFile) dest_file               = NULL;
-  g_autoptr (GFileOutputStream) dest_output = NULL;
-  g_autoptr (SoupMessage) message           = NULL;
-  g_autoptr (GVariant) variant              = NULL;
-  g_autofree char *output                   = NULL;
-  g_autofree char *output_plus_nl           = NULL;
+  gboolean success                         = FALSE;
+  g_autoptr (GError) local_error           = NULL;
+  g_autoptr (GFile) tmp_file               = NULL;
+  g_autoptr (GFileOutputStream) tmp_output = NULL;
+  g_autoptr (SoupMessage) message          = NULL;
+  g_autoptr (FetchData) fetch              = NULL;
+  g_autoptr (PlaceData) place              = NULL;
+  g_autofree char *blob_path               = NULL;
+  g_autofree char *tmp_name                = NULL;
+  g_autofree char *tmp_path                = NULL;
+  guint            status                  = 0;
+  gboolean         owner                   = FALSE;
+  guint            tls_handshakes          = 0;
+  guint            http_version            = 0;
+  guint64          bytes_received          = 0;
+  gint64           queue_usec              = 0;
+  BzDownloadFrame  reply                   = { 0 };
 
-  dest_file   = g_file_new_for_path (data->dest);
-  dest_output = g_file_replace (
-      dest_file, NULL, FALSE,
-      G_FILE_CREATE_REPLACE_DESTINATION,
-      NULL, &local_error);
-  if (dest_output == NULL)
+  if (n_active >= BZ_DOWNLOAD_MAX_CONCURRENT)
     {
-      g_warning ("%s", local_error->message);
-      goto done;
+      data->slot   = dex_promise_new ();
+      data->serial = next_serial++;
+      g_ptr_array_add (pending, download_data_ref (data));
+
+      success = dex_await (
+          dex_future_first (
+              dex_ref (data->slot),
+              dex_ref (data->cancel),
+              NULL),
+          &local_error);
+      if (!success)
+        {
+          /* If we're no longer queued the slot was handed to us in the
+             same iteration we were cancelled, so pass it on */
+          if (!g_ptr_array_remove (pending, data))
+            release_slot ();
+          goto done;
+        }
     }
+  else
+    n_active++;
+  queue_usec = g_get_monotonic_time () - data->received;
 
-  message = soup_message_new (SOUP_METHOD_GET, data->src);
-  success = dex_await (bz_send_with_global_http_session_then_splice_into (
-                           message, G_OUTPUT_STREAM (dest_output)),
-                       &local_error);
-  if (!success)
+  if (store_dir == NULL)
     {
-      g_warning ("%s", local_error->message);
-      goto done;
+      /* The splice carries on after a cancellation, so it writes to a
+         temporary file which is only moved over the destination once it
+         is known the download is still wanted */
+      tmp_name   = g_uuid_string_random ();
+      tmp_path   = g_strdup_printf ("%s.%s", data->dest, tmp_name);
+      tmp_file   = g_file_new_for_path (tmp_path);
+      tmp_output = g_file_create (tmp_file, G_FILE_CREATE_NONE, NULL, &local_error);
+      if (tmp_output == NULL)
+        goto release;
+
+      message = soup_message_new (SOUP_METHOD_GET, data->src);
+      if (message == NULL)
+        {
+          local_error = g_error_new (G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT,
+                                     "Invalid uri: %s", data->src);
+          goto release;
+        }
+      g_signal_connect (message, "network-event", G_CALLBACK (network_event), &tls_handshakes);
+
+      success = dex_await (
+          dex_future_first (
+              bz_send_with_global_http_session_then_splice_into (
+                  message, G_OUTPUT_STREAM (tmp_output)),
+              dex_ref (data->cancel),
+              NULL),
+          &local_error);
+      bytes_received = g_seekable_tell (G_SEEKABLE (tmp_output));
+      if (success)
+        {
+          status       = soup_message_get_status (message);
+          http_version = soup_message_get_http_version (message);
+          if (!SOUP_STATUS_IS_SUCCESSFUL (status))
+            {
+              local_error = g_error_new (G_IO_ERROR, G_IO_ERROR_FAILED,
+                                         "%s replied with HTTP status %u",
+                                         data->src, status);
+              success     = FALSE;
+            }
+        }
+      /* The cancellation may have come in the same iteration the splice
+         finished */
+      if (success && !dex_future_is_pending (DEX_FUTURE (data->cancel)))
+        success = dex_future_get_value (DEX_FUTURE (data->cancel), &local_error) != NULL;
+      if (success && g_rename (tmp_path, data->dest) != 0)
+        {
+          int errsv = errno;
+
+          local_error = g_error_new (G_IO_ERROR, g_io_error_from_errno (errsv),
+                                     "Could not move download into %s: %s",
+                                     data->dest, g_strerror (errsv));
+          success     = FALSE;
+        }
+      if (!success)
+        g_unlink (tmp_path);
+      goto release;
+    }
+
+  /* Concurrent requests for the same url share one transfer */
+  fetch = g_hash_table_lookup (in_flight, data->src);
+  if (fetch != NULL)
+    fetch_data_ref (fetch);
+  else
+    {
+      g_autoptr (DexFuture) future = NULL;
+
+      owner            = TRUE;
+      fetch            = fetch_data_new ();
+      fetch->src       = g_strdup (data->src);
+      fetch->promise   = dex_promise_new ();
+      fetch->listeners = g_array_new (FALSE, FALSE, sizeof (guint32));
+
+      g_hash_table_replace (in_flight, g_strdup (data->src), fetch_data_ref (fetch));
+
+      future = dex_scheduler_spawn (
+          dex_scheduler_get_default (),
+          bz_get_dex_stack_size (),
+          (DexFiberFunc) fetch_fiber,
+          fetch_data_ref (fetch), fetch_data_unref);
+      future = dex_future_finally (
+          future,
+          (DexFutureCallback) fetch_finally,
+          fetch_data_ref (fetch), fetch_data_unref);
+      dex_future_disown (g_steal_pointer (&future));
     }
+  g_array_append_val (fetch->listeners, data->id);
+
+  /* Cancelling only stops us from waiting, since the transfer may
+     still be shared with other requests */
+  blob_path = dex_await_string (
+      dex_future_first (
+          dex_ref (fetch->promise),
+          dex_ref (data->cancel),
+          NULL),
+      &local_error);
+  status       = fetch->http_status;
+  http_version = fetch->http_version;
+  if (owner)
+    {
+      /* Requests which joined a transfer didn't cost anything extra */
+      tls_handshakes = fetch->tls_handshakes;
+      bytes_received = fetch->bytes_done;
+    }
+
+  for (guint i = 0; i < fetch->listeners->len; i++)
+    {
+      if (g_array_index (fetch->listeners, guint32, i) == data->id)
+        {
+          g_array_remove_index_fast (fetch->listeners, i);
+          break;
+        }
+    }
+
+  if (blob_path == NULL)
+    goto release;
+
+  place            = place_data_new ();
+  place->blob_path = g_steal_pointer (&blob_path);
+  place->dest      = g_strdup (data->dest);
+
+  /* A copy can take a while when the destination is on another
+     filesystem, which would hold up every other request meanwhile */
+  success = dex_await (
+      dex_scheduler_spawn (
+          dex_thread_pool_scheduler_get_default (),
+          bz_get_dex_stack_size (),
+          (DexFiberFunc) place_fiber,
+          place_data_ref (place), place_data_unref),
+      &local_error);
+
+release:
+  release_slot ();
 
 done:
-  variant        = g_variant_new ("(sb)", data->dest, success);
-  output         = g_variant_print (variant, TRUE);
-  output_plus_nl = g_strdup_printf ("%s\n", output);
+  if (!success && local_error != NULL &&
+      !g_error_matches (local_error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+    g_warning ("%s", local_error->message);
+
+  reply.type           = BZ_DOWNLOAD_FRAME_REPLY;
+  reply.id             = data->id;
+  reply.success        = success;
+  reply.http_status    = status;
+  reply.bytes_received = bytes_received;
+  reply.queue_usec     = queue_usec;
+  reply.tls_handshakes = tls_handshakes;
+  reply.http_version   = http_version;
+  if (!success)
+    {
+      if (local_error != NULL && local_error->domain == G_IO_ERROR)
+        reply.error_code = local_error->code;
+      else
+        reply.error_code = G_IO_ERROR_FAILED;
+      reply.message = local_error != NULL ? local_error->message : NULL;
+    }
+  write_frame (&reply);
 
-  g_io_channel_write_chars (data->stdout_channel, output_plus_nl, -1, NULL, NULL);
+  g_mutex_lock (&requests_mutex);
+  g_hash_table_remove (requests, GUINT_TO_POINTER (data->id));
+  g_mutex_unlock (&requests_mutex);
 
   return dex_future_new_true ();
 }
+
+static void
+release_slot (void)
+{
+  g_autoptr (DownloadData) next = NULL;
+  guint best                    = 0;
+
+  if (pending->len == 0)
+    {
+      n_active--;
+      return;
+    }
+
+  for (guint i = 1; i < pending->len; i++)
+    {
+      DownloadData *candidate = g_ptr_array_index (pending, i);
+      DownloadData *current   = g_ptr_array_index (pending, best);
+
+      if (candidate->priority > current->priority ||
+          (candidate->priority == current->priority &&
+           candidate->serial < current->serial))
+        best = i;
+    }
+
+  /* The slot is handed over without touching n_active */
+  next = g_ptr_array_steal_index (pending, best);
+  dex_promise_resolve_boolean (next->slot, TRUE);
+}
+
+static void
+got_body_data (SoupMessage *message,
+               guint        chunk_size,
+               FetchData   *data)
+{
+  BzDownloadFrame frame = { 0 };
+
+  if (data->bytes_total == 0)
+    data->bytes_total = soup_message_headers_get_content_length (
+        soup_message_get_response_headers (message));
+  data->bytes_done += chunk_size;
+
+  if (data->bytes_done - data->bytes_reported < PROGRESS_INTERVAL &&
+      data->bytes_done != data->bytes_total)
+    return;
+  data->bytes_reported = data->bytes_done;
+
+  frame.type        = BZ_DOWNLOAD_FRAME_PROGRESS;
+  frame.bytes_done  = data->bytes_done;
+  frame.bytes_total = data->bytes_total;
+  for (guint i = 0; i < data->listeners->len; i++)
+    {
+      frame.id = g_array_index (data->listeners, guint32, i);
+      write_frame (&frame);
+    }
+}
+
+static void
+network_event (SoupMessage       *message,
+               GSocketClientEvent event,
+               GIOStream         *connection,
+               guint             *tls_handshakes)
+{
+  /* Connections are reused from the session where possible, so this is
+     how often that didn't work out. Replies report the HTTP version
+     their transfer negotiated, which shows whether requests to a host
+     could share one HTTP/2 connection. */
+  if (event == G_SOCKET_CLIENT_TLS_HANDSHAKED)
+    (*tls_handshakes)++;
+}
+
+static DexFuture *
+fetch_fiber (FetchData *data)
+{
+  gboolean result                          = FALSE;
+  g_autoptr (GError) local_error           = NULL;
+  g_autofree char *index_path              = NULL;
+  g_autofree char *indexed_hash            = NULL;
+  g_autofree char *indexed_etag            = NULL;
+  g_autofree char *indexed_blob            = NULL;
+  g_autofree char *tmp_dir                 = NULL;
+  g_autofree char *tmp_name                = NULL;
+  g_autofree char *tmp_path                = NULL;
+  g_autoptr (GFile) tmp_file               = NULL;
+  g_autoptr (GFileOutputStream) tmp_output = NULL;
+  g_autoptr (SoupMessage) message          = NULL;
+  guint            status                  = 0;
+  const char      *etag                    = NULL;
+  g_autoptr (StoreData) store              = NULL;
+  g_autofree char *blob_path               = NULL;
+
+  index_path = dup_index_path (data->src);
+  if (g_file_test (index_path, G_FILE_TEST_EXISTS))
+    {
+      g_autofree char *contents = NULL;
+      gsize            length   = 0;
+
+      if (g_file_get_contents (index_path, &contents, &length, NULL))
+        {
+          g_autoptr (GBytes) bytes   = NULL;
+          g_autoptr (GVariant) index = NULL;
+
+          bytes = g_bytes_new_take (g_steal_pointer (&contents), length);
+          index = g_variant_new_from_bytes (G_VARIANT_TYPE ("(ss)"), bytes, FALSE);
+          g_variant_get (index, "(ss)", &indexed_hash, &indexed_etag);
+
+          indexed_blob = dup_blob_path (indexed_hash);
+          if (!g_file_test (indexed_blob, G_FILE_TEST_EXISTS))
+            g_clear_pointer (&indexed_blob, g_free);
+        }
+    }
+
+  message = soup_message_new (SOUP_METHOD_GET, data->src);
+  if (message == NULL)
+    return dex_future_new_reject (
+        G_IO_ERROR,
+        G_IO_ERROR_INVALID_ARGUMENT,
+        "Invalid uri: %s", data->src);
+  if (indexed_blob != NULL && indexed_etag != NULL && *indexed_etag != '\0')
+    soup_message_headers_append (
+        soup_message_get_request_headers (message),
+        "If-None-Match", indexed_etag);
+  g_signal_connect (message, "got-body-data", G_CALLBACK (got_body_data), data);
+  g_signal_connect (message, "network-event", G_CALLBACK (network_event), &data->tls_handshakes);
+
+  tmp_dir = g_build_filename (store_dir, "tmp", NULL);
+  if (g_mkdir_with_parents (tmp_dir, 0755) != 0)
+    return dex_future_new_reject (
+        G_IO_ERROR,
+        g_io_error_from_errno (errno),
+        "Could not create %s: %s", tmp_dir, g_strerror (errno));
+
+  /* Keep the temporary file in the store so moving it into place is a
+     rename on the same filesystem */
+  tmp_name   = g_uuid_string_random ();
+  tmp_path   = g_build_filename (tmp_dir, tmp_name, NULL);
+  tmp_file   = g_file_new_for_path (tmp_path);
+  tmp_output = g_file_create (tmp_file, G_FILE_CREATE_NONE, NULL, &local_error);
+  if (tmp_output == NULL)
+    return dex_future_new_for_error (g_steal_pointer (&local_error));
+
+  result = dex_await (bz_send_with_global_http_session_then_splice_into (
+                          message, G_OUTPUT_STREAM (tmp_output)),
+                      &local_error);
+  if (!result)
+    {
+      g_unlink (tmp_path);
+      return dex_future_new_for_error (g_steal_pointer (&local_error));
+    }
+
+  status             = soup_message_get_status (message);
+  data->http_status  = status;
+  data->http_version = soup_message_get_http_version (message);
+  if (status == SOUP_STATUS_NOT_MODIFIED && indexed_blob != NULL)
+    {
+      g_unlink (tmp_path);
+      return dex_future_new_take_string (g_steal_pointer (&indexed_blob));
+    }
+  if (!SOUP_STATUS_IS_SUCCESSFUL (status))
+    {
+      g_unlink (tmp_path);
+      return dex_future_new_reject (
+          G_IO_ERROR,
+          G_IO_ERROR_FAILED,
+          "%s replied with HTTP status %u %s",
+          data->src, status,
+          soup_message_get_reason_phrase (message));
+    }
+
+  etag = soup_message_headers_get_one (
+      soup_message_get_response_headers (message), "ETag");
+
+  store             = store_data_new ();
+  store->src        = g_strdup (data->src);
+  store->tmp_path   = g_steal_pointer (&tmp_path);
+  store->index_path = g_steal_pointer (&index_path);
+  store->etag       = g_strdup (etag != NULL ? etag : "");
+
+  /* Hashing reads the whole body again, so keep it off the scheduler
+     every other request runs on */
+  blob_path = dex_await_string (
+      dex_scheduler_spawn (
+          dex_thread_pool_scheduler_get_default (),
+          bz_get_dex_stack_size (),
+          (DexFiberFunc) store_fiber,
+          store_data_ref (store), store_data_unref),
+      &local_error);
+  if (blob_path == NULL)
+    return dex_future_new_for_error (g_steal_pointer (&local_error));
+
+  return dex_future_new_take_string (g_steal_pointer (&blob_path));
+}
+
+static DexFuture *
+fetch_finally (DexFuture *future,
+               FetchData *data)
+{
+  GError *local_error = NULL;
+
+  g_hash_table_remove (in_flight, data->src);
+
+  if (dex_future_get_value (future, &local_error) != NULL)
+    dex_promise_resolve_string (
+        data->promise,
+        g_value_dup_string (dex_future_get_value (future, NULL)));
+  else
+    dex_promise_reject (data->promise, local_error);
+
+  return NULL;
+}
+
+static DexFuture *
+store_fiber (StoreData *data)
+{
+  g_autoptr (GError) local_error = NULL;
+  g_autofree char *hash          = NULL;
+  g_autofree char *blob_path     = NULL;
+  g_autofree char *blob_dir      = NULL;
+  g_autofree char *index_dir     = NULL;
+  g_autoptr (GVariant) index     = NULL;
+  gboolean result                = FALSE;
+
+  hash = hash_file (data->tmp_path, &local_error);
+  if (hash == NULL)
+    {
+      g_unlink (data->tmp_path);
+      return dex_future_new_for_error (g_steal_pointer (&local_error));
+    }
+
+  blob_path = dup_blob_path (hash);
+  if (g_file_test (blob_path, G_FILE_TEST_EXISTS))
+    /* Identical content already stored under another url */
+    g_unlink (data->tmp_path);
+  else
+    {
+      blob_dir = g_path_get_dirname (blob_path);
+      if (g_mkdir_with_parents (blob_dir, 0755) != 0)
+        {
+          int errsv = errno;
+
+          g_unlink (data->tmp_path);
+          return dex_future_new_reject (
+              G_IO_ERROR,
+              g_io_error_from_errno (errsv),
+              "Could not create %s: %s",
+              blob_dir, g_strerror (errsv));
+        }
+
+      if (g_rename (data->tmp_path, blob_path) != 0)
+        {
+          int errsv = errno;
+
+          g_unlink (data->tmp_path);
+          return dex_future_new_reject (
+              G_IO_ERROR,
+              g_io_error_from_errno (errsv),
+              "Could not move download into %s: %s",
+              blob_path, g_strerror (errsv));
+        }
+    }
+
+  index = g_variant_ref_sink (g_variant_new ("(ss)", hash, data->etag));
+
+  index_dir = g_path_get_dirname (data->index_path);
+  if (g_mkdir_with_parents (index_dir, 0755) != 0)
+    {
+      int errsv = errno;
+
+      return dex_future_new_reject (
+          G_IO_ERROR,
+          g_io_error_from_errno (errsv),
+          "Could not create %s: %s",
+          index_dir, g_strerror (errsv));
+    }
+
+  result = g_file_set_contents (
+      data->index_path,
+      g_variant_get_data (index),
+      g_variant_get_size (index),
+      &local_error);
+  if (!result)
+    g_warning ("Could not update download index for %s: %s",
+               data->src, local_error->message);
+
+  return dex_future_new_take_string (g_steal_pointer (&blob_path));
+}
+
+static DexFuture *
+place_fiber (PlaceData *data)
+{
+  g_autoptr (GError) local_error = NULL;
+  g_autoptr (GFile) blob_file    = NULL;
+  g_autoptr (GFile) dest_file    = NULL;
+
+  /* Destinations are replaced rather than written into, so a hard link
+     never lets anyone modify the blob behind our back */
+  if (g_unlink (data->dest) != 0 && errno != ENOENT)
+    g_warning ("Could not remove %s: %s", data->dest, g_strerror (errno));
+
+  if (link (data->blob_path, data->dest) == 0)
+    return dex_future_new_true ();
+
+  /* Different filesystems or no hard link support */
+  blob_file = g_file_new_for_path (data->blob_path);
+  dest_file = g_file_new_for_path (data->dest);
+  if (!g_file_copy (blob_file, dest_file,
+                    G_FILE_COPY_OVERWRITE,
+                    NULL, NULL, NULL, &local_error))
+    return dex_future_new_for_error (g_steal_pointer (&local_error));
+
+  return dex_future_new_true ();
+}
+
+static char *
+dup_blob_path (const char *hash)
+{
+  char prefix[3] = { 0 };
+
+  g_strlcpy (prefix, hash, sizeof (prefix));
+  return g_build_filename (store_dir, "blobs", prefix, hash, NULL);
+}
+
+static char *
+dup_index_path (const char *src)
+{
+  g_autofree char *src_hash  = NULL;
+  char             prefix[3] = { 0 };
+
+  src_hash = g_compute_checksum_for_string (G_CHECKSUM_SHA256, src, -1);
+  g_strlcpy (prefix, src_hash, sizeof (prefix));
+
+  return g_build_filename (store_dir, "index", prefix, src_hash, NULL);
+}
+
+static char *
+hash_file (const char *path,
+           GError    **error)
+{
+  g_autoptr (GMappedFile) mapped = NULL;
+  g_autoptr (GChecksum) checksum = NULL;
+
+  mapped = g_mapped_file_new (path, FALSE, error);
+  if (mapped == NULL)
+    return NULL;
+
+  checksum = g_checksum_new (G_CHECKSUM_SHA256);
+  g_checksum_update (
+      checksum,
+      (const guchar *) g_mapped_file_get_contents (mapped),
+      g_mapped_file_get_length (mapped));
+
+  return g_strdup (g_checksum_get_string (checksum));
+}
+
+static void
+prune_store (void)
+{
+  g_autofree char *blobs_dir = NULL;
+  g_autofree char *tmp_dir   = NULL;
+  g_autoptr (GDir) blobs     = NULL;
+  g_autoptr (GDir) tmp       = NULL;
+  const char *name           = NULL;
+  gint64      cutoff         = 0;
+
+  cutoff = g_get_real_time () / G_USEC_PER_SEC - PRUNE_MIN_AGE_SECONDS;
+
+  /* Leftovers from a worker which died mid-download */
+  tmp_dir = g_build_filename (store_dir, "tmp", NULL);
+  tmp     = g_dir_open (tmp_dir, 0, NULL);
+  if (tmp != NULL)
+    {
+      while ((name = g_dir_read_name (tmp)) != NULL)
+        {
+          g_autofree char *path = NULL;
+          GStatBuf         buf  = { 0 };
+
+          path = g_build_filename (tmp_dir, name, NULL);
+          if (g_stat (path, &buf) == 0 && buf.st_mtime < cutoff)
+            g_unlink (path);
+        }
+    }
+
+  /* Blobs no destination links to anymore. Index entries pointing at
+     them simply miss next time. */
+  blobs_dir = g_build_filename (store_dir, "blobs", NULL);
+  blobs     = g_dir_open (blobs_dir, 0, NULL);
+  if (blobs == NULL)
+    return;
+
+  while ((name = g_dir_read_name (blobs)) != NULL)
+    {
+      g_autofree char *prefix_dir = NULL;
+      g_autoptr (GDir) prefix     = NULL;
+      const char *blob_name       = NULL;
+
+      prefix_dir = g_build_filename (blobs_dir, name, NULL);
+      prefix     = g_dir_open (prefix_dir, 0, NULL);
+      if (prefix == NULL)
+        continue;
+
+      while ((blob_name = g_dir_read_name (prefix)) != NULL)
+        {
+          g_autofree char *path = NULL;
+          GStatBuf         buf  = { 0 };
+
+          path = g_build_filename (prefix_dir, blob_name, NULL);
+          if (g_stat (path, &buf) == 0 &&
+              buf.st_nlink <= 1 &&
+              buf.st_mtime < cutoff)
+            g_unlink (path);
+        }
+    }
+}
@@ -22,6 +22,10 @@ die() {
     echo "                       EX: my fruit_type apple orange pear" 1>&2
     echo "    [ensure]        ensure another type (can have multiple),  EX: GTK_TYPE_WIDGET" 1>&2
     echo "    [property]      property spec (can have multiple),     EX: (see below)" 1>&2
+    echo "    [serialize]     schema version of a fixed layout GVariant tuple (optional)," 1>&2
+    echo "                    generates [prefix]_[name]_to_variant () and" 1>&2
+    echo "                    [prefix]_[name]_new_from_variant (). Object and" 1>&2
+    echo "                    boxed properties are left out.       EX: 1" 1>&2
     echo "" 1>&2
     echo "      The properties are parsed with the form:" 1>&2
     echo "        [name] [ctype] [gtype] [spec-type] [free (optional)] [ref (optional)]" 1>&2
@@ -70,6 +74,7 @@ unset INCLUDES
 unset ENSURES
 unset ENUMS
 unset PROPS
+unset SERIALIZE
 
 while IFS= read -r line; do
 
@@ -116,6 +121,7 @@ ${VAL}"
                 PROPS="$VAL"
             fi
             ;;
+        serialize)       SERIALIZE="$VAL" ;;
         *)  die "unknown key '${KEY}' in ${SPEC_FILE}" ;;
     esac
 
@@ -173,6 +179,43 @@ PAR_HYPHEN="$(to_hyphened "${PAR_PREF}")-${PAR_HYPHEN_NAME}"
 
 YEAR="$(date +'%Y')"
 
+# GVariant type of a property in the serialized tuple, nothing if it
+# can't be serialized
+variant_type_of () {
+    case "$1" in
+        string) printf 'ms' ;;
+        boolean) printf 'b' ;;
+        char|uchar) printf 'y' ;;
+        int|enum) printf 'i' ;;
+        uint|flags|unichar) printf 'u' ;;
+        long|int64) printf 'x' ;;
+        ulong|uint64) printf 't' ;;
+        float|double) printf 'd' ;;
+    esac
+}
+
+variant_ctype_of () {
+    case "$1" in
+        ms) printf 'const char *' ;;
+        b) printf 'gboolean ' ;;
+        y) printf 'guchar ' ;;
+        i) printf 'gint32 ' ;;
+        u) printf 'guint32 ' ;;
+        x) printf 'gint64 ' ;;
+        t) printf 'guint64 ' ;;
+        d) printf 'gdouble ' ;;
+    esac
+}
+
+SERIAL_TYPE="(y"
+while IFS= read -r line; do
+    set -- $line
+    SERIAL_TYPE="${SERIAL_TYPE}$(variant_type_of "$4")"
+done <<EOF
+$PROPS
+EOF
+SERIAL_TYPE="${SERIAL_TYPE})"
+
 print_enums () {
     HEADER="$1"
 
@@ -526,6 +569,77 @@ EOF
 }
 
 
+print_serialize_functions () {
+    HEADER="$1"
+
+    [ -z "$SERIALIZE" ] && return
+
+    if [ "$HEADER" = header ]; then
+        printf '#define %s_SERIAL_VERSION %s\n' "$MACRO" "$SERIALIZE"
+        printf '#define %s_SERIAL_TYPE    "%s"\n\n' "$MACRO" "$SERIAL_TYPE"
+        printf 'GVariant *\n%s_to_variant (%s *self);\n\n' "$SNAKE" "$PASCAL"
+        printf '%s *\n%s_new_from_variant (GVariant *variant);\n' "$PASCAL" "$SNAKE"
+        return
+    fi
+
+    printf 'GVariant *\n%s_to_variant (%s *self)\n{\n' "$SNAKE" "$PASCAL"
+    printf '  g_return_val_if_fail (%s_IS_%s (self), NULL);\n' "$MACRO_PREF" "$MACRO_NAME"
+    printf '  return g_variant_new (\n'
+    printf '      %s_SERIAL_TYPE,\n' "$MACRO"
+    printf '      (guchar) %s_SERIAL_VERSION' "$MACRO"
+    while IFS= read -r line; do
+        set -- $line
+
+        LOC_NAME="$1"
+        LOC_VTYPE="$(variant_type_of "$4")"
+
+        [ -z "$LOC_VTYPE" ] && continue
+        case "$LOC_VTYPE" in
+            ms|b) printf ',\n      self->%s' "$LOC_NAME" ;;
+            *) printf ',\n      (%s) self->%s' "$(variant_ctype_of "$LOC_VTYPE" | tr -d ' ')" "$LOC_NAME" ;;
+        esac
+    done <<EOF
+$PROPS
+EOF
+    printf ');\n}\n\n'
+
+    printf '%s *\n%s_new_from_variant (GVariant *variant)\n{\n' "$PASCAL" "$SNAKE"
+    printf '  g_autoptr (%s) self = NULL;\n' "$PASCAL"
+    printf '  GVariantIter iter = { 0 };\n'
+    printf '  guchar version = 0;\n\n'
+    printf '  g_return_val_if_fail (variant != NULL, NULL);\n\n'
+    printf '  if (!g_variant_is_of_type (variant, G_VARIANT_TYPE (%s_SERIAL_TYPE)))\n' "$MACRO"
+    printf '    return NULL;\n\n'
+    printf '  g_variant_iter_init (&iter, variant);\n'
+    printf '  g_variant_iter_next (&iter, "y", &version);\n'
+    printf '  if (version != %s_SERIAL_VERSION)\n' "$MACRO"
+    printf '    return NULL;\n\n'
+    printf '  self = %s_new ();\n' "$SNAKE"
+    while IFS= read -r line; do
+        set -- $line
+
+        LOC_NAME="$1"
+        LOC_VTYPE="$(variant_type_of "$4")"
+
+        [ -z "$LOC_VTYPE" ] && continue
+        printf '  {\n'
+        case "$LOC_VTYPE" in
+            ms) printf '    const char *value = NULL;\n\n' ;;
+            *) printf '    %svalue = 0;\n\n' "$(variant_ctype_of "$LOC_VTYPE")" ;;
+        esac
+        case "$LOC_VTYPE" in
+            ms) printf '    g_variant_iter_next (&iter, "m&s", &value);\n' ;;
+            *) printf '    g_variant_iter_next (&iter, "%s", &value);\n' "$LOC_VTYPE" ;;
+        esac
+        printf '    %s_set_%s (self, value);\n' "$SNAKE" "$LOC_NAME"
+        printf '  }\n'
+    done <<EOF
+$PROPS
+EOF
+    printf '\n  return g_steal_pointer (&self);\n}\n'
+}
+
+
 [ "$OUTPUT_TYPE" = --header ] && cat > "$H_FILE" <<EOF
 /* $H_FILE
  *
@@ -565,6 +679,8 @@ $(print_get_property_methods header)
 
 $(print_set_property_methods header)
 
+$(print_serialize_functions header)
+
 G_END_DECLS
 
 /* End of $H_FILE */
@@ -681,6 +797,8 @@ $(print_get_property_methods)
 
 $(print_set_property_methods)
 
+$(print_serialize_functions)
+
 /* End of $C_FILE */
 EOF
 
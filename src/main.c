@@ -23,16 +23,19 @@
 #include "config.h"
 
 #include <glib/gi18n.h>
+#include <string.h>
 #include <libdex.h>
 
 #include "bz-application.h"
+#include "bz-trace.h"
 
 int
 main (int   argc,
       char *argv[])
 {
   g_autoptr (BzApplication) app = NULL;
-  int result                    = 0;
+  const char *trace_path        = NULL;
+  int         result            = 0;
 
   if (argc > 1 && g_strcmp0 (argv[1], "--version") == 0)
     {
@@ -40,6 +43,27 @@ main (int   argc,
       return 0;
     }
 
+  /* This has to be peeked at before the application is even constructed
+     so startup shows up in the capture. --trace is left in place for
+     BzApplication to parse along with every other option. */
+  for (int i = 1; i < argc; i++)
+    {
+      if (g_strcmp0 (argv[i], "--") == 0)
+        break;
+      else if (g_str_has_prefix (argv[i], "--trace="))
+        {
+          trace_path = argv[i] + strlen ("--trace=");
+          break;
+        }
+      else if (g_strcmp0 (argv[i], "--trace") == 0 && i + 1 < argc)
+        {
+          trace_path = argv[i + 1];
+          break;
+        }
+    }
+
+  bz_trace_init (trace_path);
+
   g_debug ("Initializing libdex...");
   dex_init ();
 
@@ -59,5 +83,7 @@ main (int   argc,
   g_debug ("Running!");
   result = g_application_run (G_APPLICATION (app), argc, argv);
 
+  bz_trace_shutdown ();
+
   return result;
 }
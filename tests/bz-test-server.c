@@ -0,0 +1,400 @@
+/* bz-test-server.c
+ *
+ * Copyright 2025 Adam Masciola
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include <libsoup/soup.h>
+#include <string.h>
+
+#include "bz-test-server.h"
+
+typedef struct
+{
+  guint       status;
+  GBytes     *body;
+  const char *content_type;
+  char       *etag;
+  guint       latency_msec;
+  gboolean    drop;
+  guint       hits;
+} Route;
+
+struct _BzTestServer
+{
+  GMainContext *context;
+  GMainLoop    *loop;
+  GThread      *thread;
+  SoupServer   *server;
+  GUri         *base;
+
+  /* path -> Route, also read from the server thread */
+  GMutex      mutex;
+  GHashTable *routes;
+};
+
+static void
+route_free (Route *route);
+
+static Route *
+ensure_route (BzTestServer *self,
+              const char   *path);
+
+static void
+add_fixtures_below (BzTestServer *self,
+                    const char   *route,
+                    const char   *dir);
+
+static gpointer
+server_thread (BzTestServer *self);
+
+static void
+handle_request (SoupServer        *server,
+                SoupServerMessage *message,
+                const char        *path,
+                GHashTable        *query,
+                BzTestServer      *self);
+
+static gboolean
+resume_message (SoupServerMessage *message);
+
+BzTestServer *
+bz_test_server_new (void)
+{
+  g_autoptr (GError) local_error = NULL;
+  BzTestServer *self             = NULL;
+  GSList       *uris             = NULL;
+  gboolean      result           = FALSE;
+
+  self          = g_new0 (BzTestServer, 1);
+  self->context = g_main_context_new ();
+  self->loop    = g_main_loop_new (self->context, FALSE);
+  self->routes  = g_hash_table_new_full (
+      g_str_hash, g_str_equal, g_free, (GDestroyNotify) route_free);
+  g_mutex_init (&self->mutex);
+
+  /* The listening socket attaches to the thread default context */
+  g_main_context_push_thread_default (self->context);
+  self->server = soup_server_new (NULL, NULL);
+  soup_server_add_handler (
+      self->server, NULL,
+      (SoupServerCallback) handle_request,
+      self, NULL);
+  result = soup_server_listen_local (
+      self->server, 0,
+      SOUP_SERVER_LISTEN_IPV4_ONLY,
+      &local_error);
+  g_main_context_pop_thread_default (self->context);
+  g_assert_no_error (local_error);
+  g_assert_true (result);
+
+  uris = soup_server_get_uris (self->server);
+  g_assert_nonnull (uris);
+  self->base = g_uri_ref (uris->data);
+  g_slist_free_full (uris, (GDestroyNotify) g_uri_unref);
+
+  self->thread = g_thread_new ("test-server", (GThreadFunc) server_thread, self);
+  return self;
+}
+
+void
+bz_test_server_free (BzTestServer *self)
+{
+  if (self == NULL)
+    return;
+
+  g_main_loop_quit (self->loop);
+  g_thread_join (self->thread);
+
+  g_main_context_push_thread_default (self->context);
+  soup_server_disconnect (self->server);
+  g_clear_object (&self->server);
+  g_main_context_pop_thread_default (self->context);
+
+  g_clear_pointer (&self->base, g_uri_unref);
+  g_clear_pointer (&self->routes, g_hash_table_unref);
+  g_clear_pointer (&self->loop, g_main_loop_unref);
+  g_clear_pointer (&self->context, g_main_context_unref);
+  g_mutex_clear (&self->mutex);
+  g_free (self);
+}
+
+char *
+bz_test_server_dup_url (BzTestServer *self,
+                        const char   *path)
+{
+  g_autoptr (GUri) uri = NULL;
+
+  g_return_val_if_fail (self != NULL, NULL);
+  g_return_val_if_fail (path != NULL && *path == '/', NULL);
+
+  uri = g_uri_parse_relative (self->base, path, G_URI_FLAGS_NONE, NULL);
+  return g_uri_to_string (uri);
+}
+
+void
+bz_test_server_add_route (BzTestServer *self,
+                          const char   *path,
+                          guint         status,
+                          GBytes       *body)
+{
+  g_autoptr (GMutexLocker) locker = NULL;
+  Route *route                    = NULL;
+
+  g_return_if_fail (self != NULL);
+  g_return_if_fail (path != NULL);
+
+  locker = g_mutex_locker_new (&self->mutex);
+  route  = ensure_route (self, path);
+
+  route->status = status;
+  g_clear_pointer (&route->body, g_bytes_unref);
+  if (body != NULL)
+    route->body = g_bytes_ref (body);
+}
+
+void
+bz_test_server_add_fixtures (BzTestServer *self,
+                             const char   *prefix,
+                             const char   *dir)
+{
+  g_autoptr (GMutexLocker) locker = NULL;
+
+  g_return_if_fail (self != NULL);
+  g_return_if_fail (prefix != NULL);
+  g_return_if_fail (dir != NULL);
+
+  locker = g_mutex_locker_new (&self->mutex);
+  add_fixtures_below (self, prefix, dir);
+}
+
+void
+bz_test_server_set_etag (BzTestServer *self,
+                         const char   *path,
+                         const char   *etag)
+{
+  g_autoptr (GMutexLocker) locker = NULL;
+  Route *route                    = NULL;
+
+  g_return_if_fail (self != NULL);
+  g_return_if_fail (path != NULL);
+
+  locker = g_mutex_locker_new (&self->mutex);
+  route  = ensure_route (self, path);
+
+  g_clear_pointer (&route->etag, g_free);
+  route->etag = g_strdup (etag);
+}
+
+void
+bz_test_server_set_latency (BzTestServer *self,
+                            const char   *path,
+                            guint         msec)
+{
+  g_autoptr (GMutexLocker) locker = NULL;
+
+  g_return_if_fail (self != NULL);
+  g_return_if_fail (path != NULL);
+
+  locker = g_mutex_locker_new (&self->mutex);
+  ensure_route (self, path)->latency_msec = msec;
+}
+
+void
+bz_test_server_set_drop (BzTestServer *self,
+                         const char   *path)
+{
+  g_autoptr (GMutexLocker) locker = NULL;
+
+  g_return_if_fail (self != NULL);
+  g_return_if_fail (path != NULL);
+
+  locker = g_mutex_locker_new (&self->mutex);
+  ensure_route (self, path)->drop = TRUE;
+}
+
+guint
+bz_test_server_get_hits (BzTestServer *self,
+                         const char   *path)
+{
+  g_autoptr (GMutexLocker) locker = NULL;
+  Route *route                    = NULL;
+
+  g_return_val_if_fail (self != NULL, 0);
+  g_return_val_if_fail (path != NULL, 0);
+
+  locker = g_mutex_locker_new (&self->mutex);
+  route  = g_hash_table_lookup (self->routes, path);
+  return route != NULL ? route->hits : 0;
+}
+
+static void
+route_free (Route *route)
+{
+  g_clear_pointer (&route->body, g_bytes_unref);
+  g_clear_pointer (&route->etag, g_free);
+  g_free (route);
+}
+
+/* Called with the mutex held */
+static Route *
+ensure_route (BzTestServer *self,
+              const char   *path)
+{
+  Route *route = NULL;
+
+  route = g_hash_table_lookup (self->routes, path);
+  if (route == NULL)
+    {
+      route               = g_new0 (Route, 1);
+      route->status       = SOUP_STATUS_OK;
+      route->content_type = "application/octet-stream";
+      g_hash_table_replace (self->routes, g_strdup (path), route);
+    }
+
+  return route;
+}
+
+/* Called with the mutex held */
+static void
+add_fixtures_below (BzTestServer *self,
+                    const char   *route,
+                    const char   *dir)
+{
+  g_autoptr (GError) local_error = NULL;
+  g_autoptr (GDir) entries       = NULL;
+  const char *name               = NULL;
+
+  entries = g_dir_open (dir, 0, &local_error);
+  g_assert_no_error (local_error);
+
+  while ((name = g_dir_read_name (entries)) != NULL)
+    {
+      g_autofree char *path     = NULL;
+      g_autofree char *child    = NULL;
+      g_autofree char *contents = NULL;
+      gsize            length   = 0;
+      Route           *fixture  = NULL;
+
+      path = g_build_filename (dir, name, NULL);
+      if (g_file_test (path, G_FILE_TEST_IS_DIR))
+        {
+          child = g_strdup_printf ("%s/%s", route, name);
+          add_fixtures_below (self, child, path);
+          continue;
+        }
+      if (!g_str_has_suffix (name, ".json"))
+        continue;
+
+      g_file_get_contents (path, &contents, &length, &local_error);
+      g_assert_no_error (local_error);
+
+      child   = g_strdup_printf ("%s/%.*s", route, (int) (strlen (name) - strlen (".json")), name);
+      fixture = ensure_route (self, child);
+
+      g_clear_pointer (&fixture->body, g_bytes_unref);
+      fixture->body         = g_bytes_new_take (g_steal_pointer (&contents), length);
+      fixture->content_type = "application/json";
+    }
+}
+
+static gpointer
+server_thread (BzTestServer *self)
+{
+  g_main_context_push_thread_default (self->context);
+  g_main_loop_run (self->loop);
+  g_main_context_pop_thread_default (self->context);
+
+  return NULL;
+}
+
+static void
+handle_request (SoupServer        *server,
+                SoupServerMessage *message,
+                const char        *path,
+                GHashTable        *query,
+                BzTestServer      *self)
+{
+  g_autoptr (GMutexLocker) locker = NULL;
+  SoupMessageHeaders *request     = NULL;
+  SoupMessageHeaders *response    = NULL;
+  const char         *if_match    = NULL;
+  Route              *route       = NULL;
+
+  locker = g_mutex_locker_new (&self->mutex);
+  route  = g_hash_table_lookup (self->routes, path);
+  if (route == NULL)
+    {
+      soup_server_message_set_status (message, SOUP_STATUS_NOT_FOUND, NULL);
+      return;
+    }
+  route->hits++;
+
+  if (route->drop)
+    {
+      g_autoptr (GIOStream) stream = NULL;
+
+      stream = soup_server_message_steal_connection (message);
+      g_io_stream_close (stream, NULL, NULL);
+      return;
+    }
+
+  request  = soup_server_message_get_request_headers (message);
+  response = soup_server_message_get_response_headers (message);
+  if_match = soup_message_headers_get_one (request, "If-None-Match");
+
+  if (route->etag != NULL)
+    soup_message_headers_replace (response, "ETag", route->etag);
+
+  if (route->etag != NULL && g_strcmp0 (if_match, route->etag) == 0)
+    soup_server_message_set_status (message, SOUP_STATUS_NOT_MODIFIED, NULL);
+  else
+    {
+      gconstpointer data = NULL;
+      gsize         size = 0;
+
+      if (route->body != NULL)
+        data = g_bytes_get_data (route->body, &size);
+
+      soup_server_message_set_status (message, route->status, NULL);
+      soup_server_message_set_response (
+          message, route->content_type,
+          SOUP_MEMORY_COPY, data, size);
+    }
+
+  /* Hold the reply back without blocking the other requests */
+  if (route->latency_msec > 0)
+    {
+      g_autoptr (GSource) source = NULL;
+
+      soup_server_message_pause (message);
+      source = g_timeout_source_new (route->latency_msec);
+      g_source_set_callback (
+          source, (GSourceFunc) resume_message,
+          g_object_ref (message), g_object_unref);
+      g_source_attach (source, self->context);
+    }
+}
+
+static gboolean
+resume_message (SoupServerMessage *message)
+{
+  soup_server_message_unpause (message);
+  return G_SOURCE_REMOVE;
+}
+
+/* End of bz-test-server.c */
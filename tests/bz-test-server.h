@@ -0,0 +1,79 @@
+/* bz-test-server.h
+ *
+ * Copyright 2025 Adam Masciola
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* A loopback HTTP server on a thread of its own, so tests can block on
+   whatever talks to it. Every path serves a fixed reply, and can be
+   made slow or made to drop the connection instead. */
+typedef struct _BzTestServer BzTestServer;
+
+BzTestServer *
+bz_test_server_new (void);
+
+void
+bz_test_server_free (BzTestServer *self);
+
+char *
+bz_test_server_dup_url (BzTestServer *self,
+                        const char   *path);
+
+void
+bz_test_server_add_route (BzTestServer *self,
+                          const char   *path,
+                          guint         status,
+                          GBytes       *body);
+
+/* Serves every <name>.json below dir, recorded replies of a real API,
+   at prefix/<name> */
+void
+bz_test_server_add_fixtures (BzTestServer *self,
+                             const char   *prefix,
+                             const char   *dir);
+
+/* Answers 304 to requests carrying a matching If-None-Match */
+void
+bz_test_server_set_etag (BzTestServer *self,
+                         const char   *path,
+                         const char   *etag);
+
+void
+bz_test_server_set_latency (BzTestServer *self,
+                            const char   *path,
+                            guint         msec);
+
+/* Closes the connection without replying */
+void
+bz_test_server_set_drop (BzTestServer *self,
+                         const char   *path);
+
+guint
+bz_test_server_get_hits (BzTestServer *self,
+                         const char   *path);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (BzTestServer, bz_test_server_free)
+
+G_END_DECLS
+
+/* End of bz-test-server.h */
@@ -0,0 +1,113 @@
+/* bz-test-texture.c
+ *
+ * Copyright 2025 Adam Masciola
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include <glycin-gtk4-2/glycin-gtk4.h>
+
+#include "bz-test-texture.h"
+
+char *
+bz_test_texture_write_cached (const char *dir,
+                              const char *name,
+                              GBytes     *png,
+                              int         size)
+{
+  g_autoptr (GError) local_error      = NULL;
+  g_autoptr (GVariantBuilder) builder = NULL;
+  g_autoptr (GVariant) metadata       = NULL;
+  g_autofree char *path               = NULL;
+  g_autofree char *metadata_path      = NULL;
+  gconstpointer    data               = NULL;
+  gsize            length             = 0;
+  gint64           birth_unix_stamp   = 0;
+
+  g_return_val_if_fail (dir != NULL, NULL);
+  g_return_val_if_fail (name != NULL, NULL);
+  g_return_val_if_fail (png != NULL, NULL);
+
+  path = g_build_filename (dir, name, NULL);
+  data = g_bytes_get_data (png, &length);
+  g_file_set_contents (path, data, length, &local_error);
+  g_assert_no_error (local_error);
+
+  /* Slightly in the past, a cache entry born this second isn't trusted */
+  birth_unix_stamp = g_get_real_time () / G_USEC_PER_SEC - 60;
+
+  builder = g_variant_builder_new (G_VARIANT_TYPE ("a{sv}"));
+  g_variant_builder_add (builder, "{sv}", "birth-unix-stamp", g_variant_new_int64 (birth_unix_stamp));
+  g_variant_builder_add (builder, "{sv}", "width", g_variant_new_int32 (size));
+  g_variant_builder_add (builder, "{sv}", "height", g_variant_new_int32 (size));
+  g_variant_builder_add (builder, "{sv}", "mip-levels", g_variant_new_int32 (0));
+  g_variant_builder_add (builder, "{sv}", "size-hint", g_variant_new_int32 (0));
+  metadata = g_variant_ref_sink (g_variant_builder_end (builder));
+
+  metadata_path = g_strdup_printf ("%s.bz-async-texture-data", path);
+  g_file_set_contents (
+      metadata_path,
+      g_variant_get_data (metadata),
+      g_variant_get_size (metadata),
+      &local_error);
+  g_assert_no_error (local_error);
+
+  return g_steal_pointer (&path);
+}
+
+GBytes *
+bz_test_texture_make_png (int size)
+{
+  g_autoptr (GBytes) pixels      = NULL;
+  g_autoptr (GdkTexture) texture = NULL;
+  guint8 *data                   = NULL;
+
+  g_return_val_if_fail (size > 0, NULL);
+
+  data = g_malloc ((gsize) size * size * 4);
+  for (gsize i = 0; i < (gsize) size * size; i++)
+    {
+      guint32 value = g_test_rand_int ();
+
+      data[i * 4 + 0] = value & 0xff;
+      data[i * 4 + 1] = (value >> 8) & 0xff;
+      data[i * 4 + 2] = (value >> 16) & 0xff;
+      data[i * 4 + 3] = 0xff;
+    }
+  pixels  = g_bytes_new_take (data, (gsize) size * size * 4);
+  texture = gdk_memory_texture_new (size, size, GDK_MEMORY_R8G8B8A8, pixels, size * 4);
+
+  return gdk_texture_save_to_png_bytes (texture);
+}
+
+gboolean
+bz_test_texture_can_load (const char *path)
+{
+  g_autoptr (GFile) file       = NULL;
+  g_autoptr (GlyLoader) loader = NULL;
+  g_autoptr (GlyImage) image   = NULL;
+
+  g_return_val_if_fail (path != NULL, FALSE);
+
+  file   = g_file_new_for_path (path);
+  loader = gly_loader_new (file);
+  gly_loader_set_sandbox_selector (loader, GLY_SANDBOX_SELECTOR_NOT_SANDBOXED);
+
+  image = gly_loader_load (loader, NULL);
+  return image != NULL;
+}
+
+/* End of bz-test-texture.c */
@@ -0,0 +1,47 @@
+/* bz-test-texture.h
+ *
+ * Copyright 2025 Adam Masciola
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* Lays out an image in dir the way a previous run of BzAsyncTexture
+   leaves its cache, the PNG plus its metadata. Returns the path to pass
+   as cache_into; loads from it never touch the source. */
+char *
+bz_test_texture_write_cached (const char *dir,
+                              const char *name,
+                              GBytes     *png,
+                              int         size);
+
+/* Noise, so the PNG decoder has real work to do */
+GBytes *
+bz_test_texture_make_png (int size);
+
+/* Whether glycin can decode path the way cached images are loaded,
+   outside of the sandbox */
+gboolean
+bz_test_texture_can_load (const char *path);
+
+G_END_DECLS
+
+/* End of bz-test-texture.h */
@@ -0,0 +1,354 @@
+/* test-async-texture.c
+ *
+ * Copyright 2025 Adam Masciola
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include <glib/gstdio.h>
+
+#include "bz-async-texture.h"
+#include "bz-test-texture.h"
+
+/* Every image is laid out in the cache the way a previous run leaves
+   it, so loads go through the cache hit path and never need a network,
+   a display or the glycin sandbox */
+
+#define N_ICONS   2000
+#define ICON_SIZE 64
+
+#define N_TILES    240
+#define TILE_SIZE  64
+#define IMAGE_SIZE 256
+#define VIEWPORT   12
+
+typedef struct
+{
+  char      *root;
+  GPtrArray *sources;
+  GPtrArray *caches;
+} Fixture;
+
+static void
+fixture_set_up (Fixture *fixture,
+                guint    n_images,
+                int      size);
+
+static void
+fixture_tear_down (Fixture *fixture);
+
+static BzAsyncTexture *
+new_texture (Fixture *fixture,
+             guint    i);
+
+static DexFuture *
+load_all (Fixture   *fixture,
+          GPtrArray *textures);
+
+static void
+draw_range (GPtrArray *textures,
+            guint      first,
+            guint      n);
+
+static guint
+count_loaded (GPtrArray *textures,
+              guint      first,
+              guint      n);
+
+static void
+wait_msec (guint msec);
+
+static void
+wait_for (DexFuture *future);
+
+static void
+remove_dir (const char *path);
+
+static void
+test_cold_warm (void)
+{
+  Fixture fixture   = { 0 };
+  gint64  cold_usec = 0;
+  gint64  warm_usec = 0;
+  guint   raw_hits  = 0;
+  guint   decodes   = 0;
+
+  fixture_set_up (&fixture, N_ICONS, ICON_SIZE);
+  if (!bz_test_texture_can_load (g_ptr_array_index (fixture.caches, 0)))
+    {
+      g_test_skip ("No glycin loader for PNG is available");
+      fixture_tear_down (&fixture);
+      return;
+    }
+
+  /* The first pass is what every relaunch used to pay: a decode of the
+     cached PNG. It leaves raw pixels behind, which the second pass
+     maps instead. */
+  for (guint pass = 0; pass < 2; pass++)
+    {
+      g_autoptr (GPtrArray) textures = NULL;
+      g_autoptr (DexFuture) all      = NULL;
+      guint  raw_hits_before         = 0;
+      guint  decodes_before          = 0;
+      gint64 start                   = 0;
+
+      bz_async_texture_get_decode_stats (&raw_hits_before, &decodes_before);
+
+      textures = g_ptr_array_new_with_free_func (g_object_unref);
+      start    = g_get_monotonic_time ();
+      all      = load_all (&fixture, textures);
+      wait_for (dex_ref (all));
+      g_assert_true (dex_future_is_resolved (all));
+
+      if (pass == 0)
+        cold_usec = g_get_monotonic_time () - start;
+      else
+        warm_usec = g_get_monotonic_time () - start;
+
+      bz_async_texture_get_decode_stats (&raw_hits, &decodes);
+      g_assert_cmpuint (raw_hits - raw_hits_before, ==, pass == 0 ? 0 : N_ICONS);
+      g_assert_cmpuint (decodes - decodes_before, ==, pass == 0 ? N_ICONS : 0);
+
+      for (guint i = 0; i < textures->len; i++)
+        g_assert_true (bz_async_texture_get_loaded (g_ptr_array_index (textures, i)));
+    }
+
+  g_test_message ("%u cached icons of %dpx: %" G_GINT64_FORMAT " usec to decode from PNG, "
+                  "%" G_GINT64_FORMAT " usec to map from raw pixels",
+                  N_ICONS, ICON_SIZE, cold_usec, warm_usec);
+
+  fixture_tear_down (&fixture);
+}
+
+static void
+test_scroll (void)
+{
+  Fixture fixture                = { 0 };
+  g_autoptr (GPtrArray) textures = NULL;
+  guint  last_page               = 0;
+  guint  pending_at_stop         = 0;
+  guint  loaded_at_stop          = 0;
+  guint  loaded_at_visible       = 0;
+  gint64 stop                    = 0;
+  gint64 visible_usec            = 0;
+  gint64 all_usec                = 0;
+
+  fixture_set_up (&fixture, N_TILES, IMAGE_SIZE);
+  if (!bz_test_texture_can_load (g_ptr_array_index (fixture.caches, 0)))
+    {
+      g_test_skip ("No glycin loader for PNG is available");
+      fixture_tear_down (&fixture);
+      return;
+    }
+
+  textures = g_ptr_array_new_with_free_func (g_object_unref);
+  for (guint i = 0; i < N_TILES; i++)
+    g_ptr_array_add (textures, new_texture (&fixture, i));
+
+  /* A fling: each page of tiles is drawn once on the way down, faster
+     than their images can load, and the list comes to rest on the last
+     page, which keeps being drawn until it has content */
+  last_page = N_TILES - VIEWPORT;
+  for (guint first = 0; first < last_page; first += VIEWPORT)
+    {
+      draw_range (textures, first, VIEWPORT);
+      g_main_context_iteration (NULL, FALSE);
+    }
+  draw_range (textures, last_page, VIEWPORT);
+
+  pending_at_stop = bz_async_texture_get_n_pending_loads ();
+  loaded_at_stop  = count_loaded (textures, 0, N_TILES);
+  stop            = g_get_monotonic_time ();
+  while (count_loaded (textures, last_page, VIEWPORT) < VIEWPORT)
+    {
+      wait_msec (1);
+      draw_range (textures, last_page, VIEWPORT);
+    }
+  visible_usec      = g_get_monotonic_time () - stop;
+  loaded_at_visible = count_loaded (textures, 0, N_TILES);
+
+  while (count_loaded (textures, 0, N_TILES) < N_TILES)
+    wait_msec (1);
+  all_usec = g_get_monotonic_time () - stop;
+
+  g_test_message ("fling over %u tiles with %u loads queued at rest: visible page loaded "
+                  "after %u other loads in %" G_GINT64_FORMAT " usec, all tiles in "
+                  "%" G_GINT64_FORMAT " usec, average time to visible %.1f msec",
+                  N_TILES, pending_at_stop,
+                  loaded_at_visible - loaded_at_stop - VIEWPORT,
+                  visible_usec, all_usec,
+                  bz_async_texture_get_average_time_to_visible ());
+
+  /* In arrival order the page at rest would load last. Drawn most
+     recently, it may only wait on the loads which already had a slot,
+     plus those which took the slots it freed before the next check. */
+  g_assert_cmpuint (pending_at_stop, >, 2 * (VIEWPORT + BZ_ASYNC_TEXTURE_MAX_ACTIVE_LOADS));
+  g_assert_cmpuint (loaded_at_visible - loaded_at_stop, <=, VIEWPORT + 2 * BZ_ASYNC_TEXTURE_MAX_ACTIVE_LOADS);
+
+  g_clear_pointer (&textures, g_ptr_array_unref);
+  fixture_tear_down (&fixture);
+}
+
+int
+main (int   argc,
+      char *argv[])
+{
+  dex_init ();
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/async-texture/cold-warm", test_cold_warm);
+  g_test_add_func ("/async-texture/scroll", test_scroll);
+
+  return g_test_run ();
+}
+
+static void
+fixture_set_up (Fixture *fixture,
+                guint    n_images,
+                int      size)
+{
+  g_autoptr (GError) local_error = NULL;
+  g_autoptr (GBytes) png         = NULL;
+
+  fixture->root = g_dir_make_tmp ("bz-test-async-texture-XXXXXX", &local_error);
+  g_assert_no_error (local_error);
+  fixture->sources = g_ptr_array_new_with_free_func (g_free);
+  fixture->caches  = g_ptr_array_new_with_free_func (g_free);
+
+  png = bz_test_texture_make_png (size);
+  for (guint i = 0; i < n_images; i++)
+    {
+      g_autofree char *name = NULL;
+
+      /* The sources don't exist, a cache miss fails the test */
+      name = g_strdup_printf ("cache-%u.png", i);
+      g_ptr_array_add (fixture->sources, g_strdup_printf ("%s/source-%u.png", fixture->root, i));
+      g_ptr_array_add (fixture->caches, bz_test_texture_write_cached (fixture->root, name, png, size));
+    }
+}
+
+static void
+fixture_tear_down (Fixture *fixture)
+{
+  remove_dir (fixture->root);
+  g_clear_pointer (&fixture->root, g_free);
+  g_clear_pointer (&fixture->sources, g_ptr_array_unref);
+  g_clear_pointer (&fixture->caches, g_ptr_array_unref);
+}
+
+static BzAsyncTexture *
+new_texture (Fixture *fixture,
+             guint    i)
+{
+  g_autoptr (GFile) source = NULL;
+  g_autoptr (GFile) cache  = NULL;
+
+  source = g_file_new_for_path (g_ptr_array_index (fixture->sources, i));
+  cache  = g_file_new_for_path (g_ptr_array_index (fixture->caches, i));
+
+  return bz_async_texture_new_lazy (source, cache);
+}
+
+static DexFuture *
+load_all (Fixture   *fixture,
+          GPtrArray *textures)
+{
+  g_autoptr (GPtrArray) futures = NULL;
+
+  futures = g_ptr_array_new_with_free_func (dex_unref);
+  for (guint i = 0; i < fixture->sources->len; i++)
+    {
+      g_autoptr (BzAsyncTexture) texture = NULL;
+
+      texture = new_texture (fixture, i);
+      g_ptr_array_add (futures, bz_async_texture_dup_future (texture));
+      g_ptr_array_add (textures, g_steal_pointer (&texture));
+    }
+
+  return dex_future_allv ((DexFuture *const *) futures->pdata, futures->len);
+}
+
+/* What a tile does when its page is on screen */
+static void
+draw_range (GPtrArray *textures,
+            guint      first,
+            guint      n)
+{
+  for (guint i = first; i < first + n; i++)
+    {
+      GtkSnapshot *snapshot          = NULL;
+      g_autoptr (GskRenderNode) node = NULL;
+
+      snapshot = gtk_snapshot_new ();
+      gdk_paintable_snapshot (
+          g_ptr_array_index (textures, i),
+          snapshot, TILE_SIZE, TILE_SIZE);
+      node = gtk_snapshot_free_to_node (snapshot);
+    }
+}
+
+static guint
+count_loaded (GPtrArray *textures,
+              guint      first,
+              guint      n)
+{
+  guint n_loaded = 0;
+
+  for (guint i = first; i < first + n; i++)
+    n_loaded += bz_async_texture_get_loaded (g_ptr_array_index (textures, i)) ? 1 : 0;
+
+  return n_loaded;
+}
+
+static void
+wait_msec (guint msec)
+{
+  g_autoptr (DexFuture) timeout = NULL;
+
+  timeout = dex_timeout_new_msec (msec);
+  wait_for (g_steal_pointer (&timeout));
+}
+
+static void
+wait_for (DexFuture *future)
+{
+  g_autoptr (DexFuture) owned = future;
+
+  while (dex_future_is_pending (owned))
+    g_main_context_iteration (NULL, TRUE);
+}
+
+static void
+remove_dir (const char *path)
+{
+  g_autoptr (GDir) dir = NULL;
+  const char *name     = NULL;
+
+  dir = g_dir_open (path, 0, NULL);
+  if (dir == NULL)
+    return;
+
+  while ((name = g_dir_read_name (dir)) != NULL)
+    {
+      g_autofree char *child = NULL;
+
+      child = g_build_filename (path, name, NULL);
+      g_unlink (child);
+    }
+  g_rmdir (path);
+}
+
+/* End of test-async-texture.c */
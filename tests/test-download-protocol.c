@@ -0,0 +1,371 @@
+/* test-download-protocol.c
+ *
+ * Copyright 2025 Adam Masciola
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include <gio/gio.h>
+#include <string.h>
+
+#include "bz-download-protocol.h"
+
+#define N_FUZZ_ITERATIONS 20000
+#define N_PERF_FRAMES     200000
+
+static void
+fill_frame (BzDownloadFrame    *frame,
+            BzDownloadFrameType type);
+
+static GBytes *
+serialize_checked (const BzDownloadFrame *frame);
+
+static gboolean
+parse (const guint8    *data,
+       gsize            size,
+       BzDownloadFrame *frame,
+       GError         **error);
+
+static void
+assert_frames_equal (const BzDownloadFrame *a,
+                     const BzDownloadFrame *b);
+
+static void
+test_round_trip (void)
+{
+  for (BzDownloadFrameType type = BZ_DOWNLOAD_FRAME_REQUEST;
+       type <= BZ_DOWNLOAD_FRAME_REPLY;
+       type++)
+    {
+      g_auto (BzDownloadFrame) frame   = { 0 };
+      g_auto (BzDownloadFrame) decoded = { 0 };
+      g_autoptr (GBytes) bytes         = NULL;
+      g_autoptr (GError) local_error   = NULL;
+      const guint8 *data               = NULL;
+      gsize         size               = 0;
+
+      fill_frame (&frame, type);
+      bytes = serialize_checked (&frame);
+      data  = g_bytes_get_data (bytes, &size);
+
+      g_assert_true (parse (data, size, &decoded, &local_error));
+      g_assert_no_error (local_error);
+      assert_frames_equal (&frame, &decoded);
+    }
+}
+
+static void
+test_size_limit (void)
+{
+  g_auto (BzDownloadFrame) frame                = { 0 };
+  g_autoptr (GBytes) bytes                      = NULL;
+  g_autoptr (GError) local_error                = NULL;
+  g_autofree char *long_dest                    = NULL;
+  guint8  header[BZ_DOWNLOAD_FRAME_HEADER_SIZE] = { 0 };
+  guint32 length                                = 0;
+
+  /* Serializing refuses what the reader would refuse */
+  fill_frame (&frame, BZ_DOWNLOAD_FRAME_REQUEST);
+  long_dest = g_strnfill (BZ_DOWNLOAD_FRAME_MAX_SIZE, 'a');
+  g_free (frame.dest);
+  frame.dest = g_strdup (long_dest);
+
+  bytes = bz_download_frame_serialize (&frame, &local_error);
+  g_assert_null (bytes);
+  g_assert_error (local_error, G_IO_ERROR, G_IO_ERROR_MESSAGE_TOO_LARGE);
+  g_clear_error (&local_error);
+  g_clear_pointer (&bytes, g_bytes_unref);
+
+  /* Callers report the error, so an invalid type has to set one too */
+  bz_download_frame_clear (&frame);
+  frame.type = BZ_DOWNLOAD_FRAME_REPLY + 1;
+  g_test_expect_message (NULL, G_LOG_LEVEL_CRITICAL, "*Invalid download frame type*");
+  bytes = bz_download_frame_serialize (&frame, &local_error);
+  g_test_assert_expected_messages ();
+  g_assert_null (bytes);
+  g_assert_error (local_error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT);
+  g_clear_error (&local_error);
+
+  length = GUINT32_TO_LE (BZ_DOWNLOAD_FRAME_MAX_SIZE + 1);
+  memcpy (header, &length, sizeof (length));
+  g_assert_cmpuint (bz_download_frame_parse_header (header, &local_error), ==, 0);
+  g_assert_error (local_error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA);
+  g_clear_error (&local_error);
+
+  length = 0;
+  memcpy (header, &length, sizeof (length));
+  g_assert_cmpuint (bz_download_frame_parse_header (header, &local_error), ==, 0);
+  g_assert_error (local_error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA);
+}
+
+static void
+test_truncated (void)
+{
+  for (BzDownloadFrameType type = BZ_DOWNLOAD_FRAME_REQUEST;
+       type <= BZ_DOWNLOAD_FRAME_REPLY;
+       type++)
+    {
+      g_auto (BzDownloadFrame) frame = { 0 };
+      g_autoptr (GBytes) bytes       = NULL;
+      const guint8 *data             = NULL;
+      gsize         size             = 0;
+
+      fill_frame (&frame, type);
+      bytes = serialize_checked (&frame);
+      data  = g_bytes_get_data (bytes, &size);
+
+      /* Every strict prefix of the payload and one byte too many have
+         to be rejected */
+      for (gsize i = BZ_DOWNLOAD_FRAME_HEADER_SIZE; i < size; i++)
+        {
+          g_auto (BzDownloadFrame) decoded = { 0 };
+          g_autoptr (GError) local_error   = NULL;
+
+          g_assert_false (bz_download_frame_deserialize (
+              &decoded, data + BZ_DOWNLOAD_FRAME_HEADER_SIZE,
+              i - BZ_DOWNLOAD_FRAME_HEADER_SIZE, &local_error));
+          g_assert_error (local_error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA);
+        }
+
+      {
+        g_auto (BzDownloadFrame) decoded = { 0 };
+        g_autoptr (GError) local_error   = NULL;
+        g_autofree guint8 *padded        = NULL;
+
+        padded = g_malloc0 (size + 1);
+        memcpy (padded, data, size);
+        g_assert_false (bz_download_frame_deserialize (
+            &decoded, padded + BZ_DOWNLOAD_FRAME_HEADER_SIZE,
+            size + 1 - BZ_DOWNLOAD_FRAME_HEADER_SIZE, &local_error));
+        g_assert_error (local_error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA);
+      }
+    }
+}
+
+static void
+test_fuzz (void)
+{
+  /* The seed comes from g_test_rand_int (), so a failure can be replayed
+     with --seed */
+  for (guint i = 0; i < N_FUZZ_ITERATIONS; i++)
+    {
+      g_auto (BzDownloadFrame) frame   = { 0 };
+      g_auto (BzDownloadFrame) decoded = { 0 };
+      g_autoptr (GBytes) bytes         = NULL;
+      g_autoptr (GError) local_error   = NULL;
+      g_autofree guint8 *mutated       = NULL;
+      const guint8 *data               = NULL;
+      gsize         size               = 0;
+      guint         n_flips            = 0;
+
+      fill_frame (&frame, g_test_rand_int_range (BZ_DOWNLOAD_FRAME_REQUEST, BZ_DOWNLOAD_FRAME_REPLY + 1));
+      bytes   = serialize_checked (&frame);
+      data    = g_bytes_get_data (bytes, &size);
+      mutated = g_memdup2 (data, size);
+
+      if (g_test_rand_bit ())
+        {
+          n_flips = g_test_rand_int_range (1, 8);
+          for (guint j = 0; j < n_flips; j++)
+            mutated[g_test_rand_int_range (0, size)] = g_test_rand_int_range (0, 256);
+        }
+      else
+        {
+          for (gsize j = 0; j < size; j++)
+            mutated[j] = g_test_rand_int_range (0, 256);
+        }
+
+      /* Anything goes as long as it doesn't crash, and whatever parses
+         must survive another round trip unchanged */
+      if (parse (mutated, size, &decoded, &local_error))
+        {
+          g_auto (BzDownloadFrame) again = { 0 };
+          g_autoptr (GBytes) reencoded   = NULL;
+          const guint8 *reencoded_data   = NULL;
+          gsize         reencoded_size   = 0;
+
+          reencoded      = serialize_checked (&decoded);
+          reencoded_data = g_bytes_get_data (reencoded, &reencoded_size);
+          g_assert_true (parse (reencoded_data, reencoded_size, &again, NULL));
+          assert_frames_equal (&decoded, &again);
+        }
+      else
+        g_assert_error (local_error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA);
+    }
+}
+
+static void
+test_throughput (void)
+{
+  g_auto (BzDownloadFrame) request = { 0 };
+  g_auto (BzDownloadFrame) reply   = { 0 };
+  g_autoptr (GTimer) timer         = NULL;
+  gsize  n_bytes                   = 0;
+  double elapsed                   = 0.0;
+
+  if (!g_test_perf ())
+    {
+      g_test_skip ("Only run in performance mode (-m perf)");
+      return;
+    }
+
+  fill_frame (&request, BZ_DOWNLOAD_FRAME_REQUEST);
+  fill_frame (&reply, BZ_DOWNLOAD_FRAME_REPLY);
+
+  /* One request and one reply per download, the same mix a busy
+     subprocess sees */
+  timer = g_timer_new ();
+  for (guint i = 0; i < N_PERF_FRAMES; i++)
+    {
+      const BzDownloadFrame *frame     = i % 2 == 0 ? &request : &reply;
+      g_auto (BzDownloadFrame) decoded = { 0 };
+      g_autoptr (GBytes) bytes         = NULL;
+      const guint8 *data               = NULL;
+      gsize         size               = 0;
+
+      bytes = bz_download_frame_serialize (frame, NULL);
+      data  = g_bytes_get_data (bytes, &size);
+      if (!parse (data, size, &decoded, NULL))
+        g_assert_not_reached ();
+      n_bytes += size;
+    }
+  elapsed = g_timer_elapsed (timer, NULL);
+
+  g_test_maximized_result (N_PERF_FRAMES / elapsed, "%.0f frames/s", N_PERF_FRAMES / elapsed);
+  g_test_message ("%u frames, %.1f MiB in %.3f s",
+                  N_PERF_FRAMES, n_bytes / (1024.0 * 1024.0), elapsed);
+}
+
+int
+main (int   argc,
+      char *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/download-protocol/round-trip", test_round_trip);
+  g_test_add_func ("/download-protocol/size-limit", test_size_limit);
+  g_test_add_func ("/download-protocol/truncated", test_truncated);
+  g_test_add_func ("/download-protocol/fuzz", test_fuzz);
+  g_test_add_func ("/download-protocol/throughput", test_throughput);
+
+  return g_test_run ();
+}
+
+static void
+fill_frame (BzDownloadFrame    *frame,
+            BzDownloadFrameType type)
+{
+  memset (frame, 0, sizeof (*frame));
+  frame->type = type;
+  frame->id   = g_test_rand_int ();
+
+  switch (type)
+    {
+    case BZ_DOWNLOAD_FRAME_REQUEST:
+      frame->priority = g_test_rand_int_range (0, 256);
+      frame->src      = g_strdup ("https://dl.flathub.org/media/io/github/kolunmi/Bazaar/icons/128x128/io.github.kolunmi.Bazaar.png");
+      frame->dest     = g_strdup ("/var/home/user/.cache/io.github.kolunmi.Bazaar/icons/io.github.kolunmi.Bazaar.png");
+      break;
+    case BZ_DOWNLOAD_FRAME_CANCEL:
+      break;
+    case BZ_DOWNLOAD_FRAME_PROGRESS:
+      frame->bytes_done  = g_test_rand_int ();
+      frame->bytes_total = (guint64) g_test_rand_int () << 20;
+      break;
+    case BZ_DOWNLOAD_FRAME_REPLY:
+      frame->success        = g_test_rand_bit ();
+      frame->error_code     = frame->success ? 0 : G_IO_ERROR_NOT_FOUND;
+      frame->http_status    = frame->success ? 200 : 404;
+      frame->message        = frame->success ? NULL : g_strdup ("Not Found");
+      frame->bytes_received = g_test_rand_int ();
+      frame->queue_usec     = g_test_rand_int ();
+      frame->tls_handshakes = g_test_rand_int_range (0, 4);
+      frame->http_version   = g_test_rand_int_range (0, 3);
+      break;
+    default:
+      g_assert_not_reached ();
+    }
+}
+
+static GBytes *
+serialize_checked (const BzDownloadFrame *frame)
+{
+  g_autoptr (GError) local_error = NULL;
+  GBytes *bytes                  = NULL;
+
+  bytes = bz_download_frame_serialize (frame, &local_error);
+  g_assert_no_error (local_error);
+  g_assert_nonnull (bytes);
+
+  return bytes;
+}
+
+/* Goes through the header the same way both ends read a stream */
+static gboolean
+parse (const guint8    *data,
+       gsize            size,
+       BzDownloadFrame *frame,
+       GError         **error)
+{
+  gsize length = 0;
+
+  if (size < BZ_DOWNLOAD_FRAME_HEADER_SIZE)
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, "Short frame");
+      return FALSE;
+    }
+
+  length = bz_download_frame_parse_header (data, error);
+  if (length == 0)
+    return FALSE;
+  if (length != size - BZ_DOWNLOAD_FRAME_HEADER_SIZE)
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                   "Frame claims %zu bytes, but %zu follow",
+                   length, size - BZ_DOWNLOAD_FRAME_HEADER_SIZE);
+      return FALSE;
+    }
+
+  return bz_download_frame_deserialize (
+      frame, data + BZ_DOWNLOAD_FRAME_HEADER_SIZE, length, error);
+}
+
+static void
+assert_frames_equal (const BzDownloadFrame *a,
+                     const BzDownloadFrame *b)
+{
+  g_assert_cmpint (a->type, ==, b->type);
+  g_assert_cmpuint (a->id, ==, b->id);
+  g_assert_cmpuint (a->priority, ==, b->priority);
+  g_assert_cmpstr (a->src, ==, b->src);
+  g_assert_cmpstr (a->dest, ==, b->dest);
+  g_assert_cmpuint (a->bytes_done, ==, b->bytes_done);
+  g_assert_cmpuint (a->bytes_total, ==, b->bytes_total);
+  g_assert_cmpint (!!a->success, ==, !!b->success);
+  g_assert_cmpuint (a->error_code, ==, b->error_code);
+  g_assert_cmpuint (a->http_status, ==, b->http_status);
+  g_assert_cmpuint (a->bytes_received, ==, b->bytes_received);
+  g_assert_cmpuint (a->queue_usec, ==, b->queue_usec);
+  g_assert_cmpuint (a->tls_handshakes, ==, b->tls_handshakes);
+  g_assert_cmpuint (a->http_version, ==, b->http_version);
+
+  /* Empty and missing strings are the same thing on the wire */
+  g_assert_cmpstr (a->message != NULL && a->message[0] != '\0' ? a->message : NULL,
+                   ==,
+                   b->message != NULL && b->message[0] != '\0' ? b->message : NULL);
+}
+
+/* End of test-download-protocol.c */
@@ -0,0 +1,412 @@
+/* test-download-store.c
+ *
+ * Copyright 2025 Adam Masciola
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include <gio/gio.h>
+#include <glib/gstdio.h>
+#include <libsoup/soup.h>
+
+#include "bz-download-protocol.h"
+#include "bz-test-server.h"
+
+/* Drives a real dl-worker subprocess over its stdin and stdout, against
+   a local server that fails in the ways real mirrors do */
+
+#define BODY "\x89PNG\r\n\x1a\n not really an icon, but close enough"
+
+typedef struct
+{
+  BzTestServer  *server;
+  GSubprocess   *worker;
+  GOutputStream *input;
+  GInputStream  *output;
+  char          *root;
+  char          *store_dir;
+  guint32        next_id;
+} Fixture;
+
+static void
+fixture_set_up (Fixture      *fixture,
+                gconstpointer user_data);
+
+static void
+fixture_tear_down (Fixture      *fixture,
+                   gconstpointer user_data);
+
+static guint32
+request (Fixture    *fixture,
+         const char *path,
+         const char *dest);
+
+static void
+read_reply (Fixture         *fixture,
+            BzDownloadFrame *reply);
+
+static char *
+dup_dest (Fixture    *fixture,
+          const char *name);
+
+static void
+assert_no_leftovers (Fixture *fixture);
+
+static void
+remove_recursively (const char *path);
+
+static void
+test_success (Fixture      *fixture,
+              gconstpointer user_data)
+{
+  g_auto (BzDownloadFrame) reply = { 0 };
+  g_autofree char *dest          = NULL;
+  g_autofree char *contents      = NULL;
+  gsize            length        = 0;
+  guint32          id            = 0;
+
+  dest = dup_dest (fixture, "icon.png");
+  id   = request (fixture, "/icon.png", dest);
+  read_reply (fixture, &reply);
+
+  g_assert_cmpuint (reply.id, ==, id);
+  g_assert_true (reply.success);
+  g_assert_cmpuint (reply.http_status, ==, 200);
+  /* The test server speaks plain HTTP, so there is no HTTP/2 to
+     negotiate and no handshake to count */
+  g_assert_cmpuint (reply.http_version, ==, SOUP_HTTP_1_1);
+  g_assert_cmpuint (reply.tls_handshakes, ==, 0);
+  g_assert_true (g_file_get_contents (dest, &contents, &length, NULL));
+  g_assert_cmpmem (contents, length, BODY, sizeof (BODY) - 1);
+  assert_no_leftovers (fixture);
+}
+
+static void
+test_http_errors (Fixture      *fixture,
+                  gconstpointer user_data)
+{
+  const struct
+  {
+    const char *path;
+    guint       status;
+  } cases[] = {
+    { "/missing.png", 404 },
+    { "/broken.png", 500 },
+  };
+
+  for (guint i = 0; i < G_N_ELEMENTS (cases); i++)
+    {
+      g_auto (BzDownloadFrame) reply = { 0 };
+      g_autofree char *dest          = NULL;
+
+      /* Nothing may be committed for an error page */
+      dest = dup_dest (fixture, "error.png");
+      request (fixture, cases[i].path, dest);
+      read_reply (fixture, &reply);
+
+      g_assert_false (reply.success);
+      g_assert_cmpuint (reply.http_status, ==, cases[i].status);
+      g_assert_false (g_file_test (dest, G_FILE_TEST_EXISTS));
+    }
+  assert_no_leftovers (fixture);
+}
+
+static void
+test_dropped_connection (Fixture      *fixture,
+                         gconstpointer user_data)
+{
+  g_auto (BzDownloadFrame) reply = { 0 };
+  g_autofree char *dest          = NULL;
+
+  dest = dup_dest (fixture, "dropped.png");
+  request (fixture, "/dropped.png", dest);
+  read_reply (fixture, &reply);
+
+  g_assert_false (reply.success);
+  g_assert_false (g_file_test (dest, G_FILE_TEST_EXISTS));
+  assert_no_leftovers (fixture);
+}
+
+static void
+test_identical_content (Fixture      *fixture,
+                        gconstpointer user_data)
+{
+  g_auto (BzDownloadFrame) first  = { 0 };
+  g_auto (BzDownloadFrame) second = { 0 };
+  g_autofree char *dest_a         = NULL;
+  g_autofree char *dest_b         = NULL;
+  GStatBuf         buf_a          = { 0 };
+  GStatBuf         buf_b          = { 0 };
+
+  /* Same bytes from two urls are one blob, which both destinations
+     are links to */
+  dest_a = dup_dest (fixture, "a.png");
+  dest_b = dup_dest (fixture, "b.png");
+  request (fixture, "/icon.png", dest_a);
+  read_reply (fixture, &first);
+  request (fixture, "/mirror/icon.png", dest_b);
+  read_reply (fixture, &second);
+
+  g_assert_true (first.success);
+  g_assert_true (second.success);
+  g_assert_cmpint (g_stat (dest_a, &buf_a), ==, 0);
+  g_assert_cmpint (g_stat (dest_b, &buf_b), ==, 0);
+  g_assert_cmpuint (buf_a.st_ino, ==, buf_b.st_ino);
+  g_assert_cmpuint (buf_a.st_nlink, ==, 3);
+}
+
+static void
+test_shared_transfer (Fixture      *fixture,
+                      gconstpointer user_data)
+{
+  g_auto (BzDownloadFrame) first  = { 0 };
+  g_auto (BzDownloadFrame) second = { 0 };
+  g_autofree char *dest_a         = NULL;
+  g_autofree char *dest_b         = NULL;
+
+  /* The second request arrives while the first is still waiting on
+     the server */
+  dest_a = dup_dest (fixture, "slow-a.png");
+  dest_b = dup_dest (fixture, "slow-b.png");
+  request (fixture, "/slow.png", dest_a);
+  request (fixture, "/slow.png", dest_b);
+  read_reply (fixture, &first);
+  read_reply (fixture, &second);
+
+  g_assert_true (first.success);
+  g_assert_true (second.success);
+  g_assert_true (g_file_test (dest_a, G_FILE_TEST_EXISTS));
+  g_assert_true (g_file_test (dest_b, G_FILE_TEST_EXISTS));
+  g_assert_cmpuint (bz_test_server_get_hits (fixture->server, "/slow.png"), ==, 1);
+}
+
+static void
+test_not_modified (Fixture      *fixture,
+                   gconstpointer user_data)
+{
+  g_auto (BzDownloadFrame) first  = { 0 };
+  g_auto (BzDownloadFrame) second = { 0 };
+  g_autofree char *dest_a         = NULL;
+  g_autofree char *dest_b         = NULL;
+  g_autofree char *contents       = NULL;
+  gsize            length         = 0;
+
+  dest_a = dup_dest (fixture, "tagged-a.png");
+  dest_b = dup_dest (fixture, "tagged-b.png");
+  request (fixture, "/tagged.png", dest_a);
+  read_reply (fixture, &first);
+  request (fixture, "/tagged.png", dest_b);
+  read_reply (fixture, &second);
+
+  g_assert_true (first.success);
+  g_assert_cmpuint (first.http_status, ==, 200);
+  g_assert_true (second.success);
+  g_assert_cmpuint (second.http_status, ==, 304);
+  g_assert_true (g_file_get_contents (dest_b, &contents, &length, NULL));
+  g_assert_cmpmem (contents, length, BODY, sizeof (BODY) - 1);
+}
+
+int
+main (int   argc,
+      char *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add ("/download-store/success", Fixture, NULL,
+              fixture_set_up, test_success, fixture_tear_down);
+  g_test_add ("/download-store/http-errors", Fixture, NULL,
+              fixture_set_up, test_http_errors, fixture_tear_down);
+  g_test_add ("/download-store/dropped-connection", Fixture, NULL,
+              fixture_set_up, test_dropped_connection, fixture_tear_down);
+  g_test_add ("/download-store/identical-content", Fixture, NULL,
+              fixture_set_up, test_identical_content, fixture_tear_down);
+  g_test_add ("/download-store/shared-transfer", Fixture, NULL,
+              fixture_set_up, test_shared_transfer, fixture_tear_down);
+  g_test_add ("/download-store/not-modified", Fixture, NULL,
+              fixture_set_up, test_not_modified, fixture_tear_down);
+
+  return g_test_run ();
+}
+
+static void
+fixture_set_up (Fixture      *fixture,
+                gconstpointer user_data)
+{
+  g_autoptr (GError) local_error = NULL;
+  g_autoptr (GBytes) body        = NULL;
+  g_autofree char *store_arg     = NULL;
+  const char      *worker_path   = NULL;
+
+  worker_path = g_getenv ("BZ_TEST_DL_WORKER");
+  g_assert_nonnull (worker_path);
+
+  body            = g_bytes_new_static (BODY, sizeof (BODY) - 1);
+  fixture->server = bz_test_server_new ();
+  bz_test_server_add_route (fixture->server, "/icon.png", 200, body);
+  bz_test_server_add_route (fixture->server, "/mirror/icon.png", 200, body);
+  bz_test_server_add_route (fixture->server, "/missing.png", 404, NULL);
+  bz_test_server_add_route (fixture->server, "/broken.png", 500, NULL);
+  bz_test_server_add_route (fixture->server, "/slow.png", 200, body);
+  bz_test_server_set_latency (fixture->server, "/slow.png", 300);
+  bz_test_server_add_route (fixture->server, "/tagged.png", 200, body);
+  bz_test_server_set_etag (fixture->server, "/tagged.png", "\"v1\"");
+  bz_test_server_set_drop (fixture->server, "/dropped.png");
+
+  fixture->root = g_dir_make_tmp ("bazaar-download-store-XXXXXX", &local_error);
+  g_assert_no_error (local_error);
+  fixture->store_dir = g_build_filename (fixture->root, "store", NULL);
+
+  store_arg       = g_strdup_printf ("--store-dir=%s", fixture->store_dir);
+  fixture->worker = g_subprocess_new (
+      G_SUBPROCESS_FLAGS_STDIN_PIPE |
+          G_SUBPROCESS_FLAGS_STDOUT_PIPE,
+      &local_error,
+      worker_path, store_arg, NULL);
+  g_assert_no_error (local_error);
+
+  fixture->input  = g_subprocess_get_stdin_pipe (fixture->worker);
+  fixture->output = g_subprocess_get_stdout_pipe (fixture->worker);
+}
+
+static void
+fixture_tear_down (Fixture      *fixture,
+                   gconstpointer user_data)
+{
+  /* The worker exits once its stdin closes */
+  g_output_stream_close (fixture->input, NULL, NULL);
+  g_subprocess_wait (fixture->worker, NULL, NULL);
+  g_clear_object (&fixture->worker);
+
+  g_clear_pointer (&fixture->server, bz_test_server_free);
+
+  remove_recursively (fixture->root);
+  g_clear_pointer (&fixture->root, g_free);
+  g_clear_pointer (&fixture->store_dir, g_free);
+}
+
+static guint32
+request (Fixture    *fixture,
+         const char *path,
+         const char *dest)
+{
+  g_autoptr (GError) local_error = NULL;
+  g_autoptr (GBytes) bytes       = NULL;
+  g_autofree char *src           = NULL;
+  BzDownloadFrame  frame         = { 0 };
+  gboolean         result        = FALSE;
+
+  src = bz_test_server_dup_url (fixture->server, path);
+
+  frame.type = BZ_DOWNLOAD_FRAME_REQUEST;
+  frame.id   = ++fixture->next_id;
+  frame.src  = src;
+  frame.dest = (char *) dest;
+
+  bytes = bz_download_frame_serialize (&frame, &local_error);
+  g_assert_no_error (local_error);
+
+  result = g_output_stream_write_all (
+      fixture->input,
+      g_bytes_get_data (bytes, NULL),
+      g_bytes_get_size (bytes),
+      NULL, NULL, &local_error);
+  g_assert_no_error (local_error);
+  g_assert_true (result);
+
+  return frame.id;
+}
+
+static void
+read_reply (Fixture         *fixture,
+            BzDownloadFrame *reply)
+{
+  for (;;)
+    {
+      g_autoptr (GError) local_error               = NULL;
+      guint8 header[BZ_DOWNLOAD_FRAME_HEADER_SIZE] = { 0 };
+      g_autofree guint8 *payload                   = NULL;
+      gsize    length                              = 0;
+      gboolean result                              = FALSE;
+
+      result = g_input_stream_read_all (
+          fixture->output, header, sizeof (header),
+          NULL, NULL, &local_error);
+      g_assert_no_error (local_error);
+      g_assert_true (result);
+
+      length = bz_download_frame_parse_header (header, &local_error);
+      g_assert_no_error (local_error);
+      g_assert_cmpuint (length, >, 0);
+
+      payload = g_malloc (length);
+      result  = g_input_stream_read_all (
+          fixture->output, payload, length,
+          NULL, NULL, &local_error);
+      g_assert_no_error (local_error);
+      g_assert_true (result);
+
+      bz_download_frame_clear (reply);
+      result = bz_download_frame_deserialize (reply, payload, length, &local_error);
+      g_assert_no_error (local_error);
+      g_assert_true (result);
+
+      if (reply->type == BZ_DOWNLOAD_FRAME_REPLY)
+        return;
+      g_assert_cmpint (reply->type, ==, BZ_DOWNLOAD_FRAME_PROGRESS);
+    }
+}
+
+static char *
+dup_dest (Fixture    *fixture,
+          const char *name)
+{
+  return g_build_filename (fixture->root, name, NULL);
+}
+
+static void
+assert_no_leftovers (Fixture *fixture)
+{
+  g_autofree char *tmp_dir = NULL;
+  g_autoptr (GDir) dir     = NULL;
+
+  /* Failed and finished transfers both clean up after themselves */
+  tmp_dir = g_build_filename (fixture->store_dir, "tmp", NULL);
+  dir     = g_dir_open (tmp_dir, 0, NULL);
+  if (dir != NULL)
+    g_assert_null (g_dir_read_name (dir));
+}
+
+static void
+remove_recursively (const char *path)
+{
+  g_autoptr (GDir) dir = NULL;
+  const char *name     = NULL;
+
+  dir = g_dir_open (path, 0, NULL);
+  if (dir != NULL)
+    {
+      while ((name = g_dir_read_name (dir)) != NULL)
+        {
+          g_autofree char *child = NULL;
+
+          child = g_build_filename (path, name, NULL);
+          remove_recursively (child);
+        }
+    }
+  g_remove (path);
+}
+
+/* End of test-download-store.c */
@@ -0,0 +1,315 @@
+/* test-dynamic-list-view.c
+ *
+ * Copyright 2025 Adam Masciola
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "bz-dynamic-list-view.h"
+
+/* A 500 item section in a window of ordinary size, counting how many
+   tiles get built for it. This needs a display; without one every test
+   is skipped. */
+
+#define N_ITEMS       500
+#define TILE_WIDTH    100
+#define TILE_HEIGHT   100
+#define WINDOW_WIDTH  360
+#define WINDOW_HEIGHT 480
+#define MAX_FRAMES    20
+
+#define BZ_TYPE_TEST_TILE (bz_test_tile_get_type ())
+G_DECLARE_FINAL_TYPE (BzTestTile, bz_test_tile, BZ, TEST_TILE, GtkWidget)
+
+struct _BzTestTile
+{
+  GtkWidget parent_instance;
+
+  GObject *item;
+};
+
+G_DEFINE_FINAL_TYPE (BzTestTile, bz_test_tile, GTK_TYPE_WIDGET)
+
+enum
+{
+  PROP_0,
+
+  PROP_ITEM,
+
+  LAST_PROP
+};
+static GParamSpec *props[LAST_PROP] = { 0 };
+
+static guint n_created = 0;
+static guint n_alive   = 0;
+static guint n_binds   = 0;
+
+static void
+count_bind (BzDynamicListView *view,
+            GtkWidget         *widget,
+            gpointer           user_data);
+
+static void
+wait_for_frame (GtkWidget *widget);
+
+static void
+wait_until_settled (GtkWidget *widget);
+
+static void
+set_true (gboolean *flag);
+
+static void
+bz_test_tile_dispose (GObject *object)
+{
+  BzTestTile *self = BZ_TEST_TILE (object);
+
+  g_clear_object (&self->item);
+
+  G_OBJECT_CLASS (bz_test_tile_parent_class)->dispose (object);
+}
+
+static void
+bz_test_tile_finalize (GObject *object)
+{
+  n_alive--;
+
+  G_OBJECT_CLASS (bz_test_tile_parent_class)->finalize (object);
+}
+
+static void
+bz_test_tile_get_property (GObject    *object,
+                           guint       prop_id,
+                           GValue     *value,
+                           GParamSpec *pspec)
+{
+  BzTestTile *self = BZ_TEST_TILE (object);
+
+  switch (prop_id)
+    {
+    case PROP_ITEM:
+      g_value_set_object (value, self->item);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+    }
+}
+
+static void
+bz_test_tile_set_property (GObject      *object,
+                           guint         prop_id,
+                           const GValue *value,
+                           GParamSpec   *pspec)
+{
+  BzTestTile *self = BZ_TEST_TILE (object);
+
+  switch (prop_id)
+    {
+    case PROP_ITEM:
+      g_set_object (&self->item, g_value_get_object (value));
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+    }
+}
+
+static void
+bz_test_tile_class_init (BzTestTileClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->dispose      = bz_test_tile_dispose;
+  object_class->finalize     = bz_test_tile_finalize;
+  object_class->get_property = bz_test_tile_get_property;
+  object_class->set_property = bz_test_tile_set_property;
+
+  props[PROP_ITEM] =
+      g_param_spec_object (
+          "item",
+          NULL, NULL,
+          G_TYPE_OBJECT,
+          G_PARAM_READWRITE);
+
+  g_object_class_install_properties (object_class, LAST_PROP, props);
+}
+
+static void
+bz_test_tile_init (BzTestTile *self)
+{
+  gtk_widget_set_size_request (GTK_WIDGET (self), TILE_WIDTH, TILE_HEIGHT);
+  n_created++;
+  n_alive++;
+}
+
+static void
+test_viewport (gconstpointer user_data)
+{
+  g_autoptr (GListStore) model           = NULL;
+  BzDynamicListViewKind  kind            = GPOINTER_TO_INT (user_data);
+  GtkWidget             *window          = NULL;
+  GtkWidget             *scrolled_window = NULL;
+  GtkWidget             *view            = NULL;
+  GtkAdjustment         *vadjustment     = NULL;
+  gint64                 start           = 0;
+  gint64                 first_frame     = 0;
+  gint64                 settled         = 0;
+  guint                  n_initial       = 0;
+  guint                  n_alive_before  = 0;
+
+  if (gdk_display_get_default () == NULL)
+    {
+      g_test_skip ("No display");
+      return;
+    }
+
+  n_created      = 0;
+  n_binds        = 0;
+  n_alive_before = n_alive;
+
+  model = g_list_store_new (GTK_TYPE_STRING_OBJECT);
+  for (guint i = 0; i < N_ITEMS; i++)
+    {
+      g_autoptr (GtkStringObject) item = NULL;
+      g_autofree char *string          = NULL;
+
+      string = g_strdup_printf ("item %u", i);
+      item   = gtk_string_object_new (string);
+      g_list_store_append (model, item);
+    }
+
+  view = GTK_WIDGET (bz_dynamic_list_view_new ());
+  bz_dynamic_list_view_set_scroll (BZ_DYNAMIC_LIST_VIEW (view), FALSE);
+  bz_dynamic_list_view_set_noscroll_kind (BZ_DYNAMIC_LIST_VIEW (view), kind);
+  bz_dynamic_list_view_set_child_type (BZ_DYNAMIC_LIST_VIEW (view), g_type_name (BZ_TYPE_TEST_TILE));
+  bz_dynamic_list_view_set_child_prop (BZ_DYNAMIC_LIST_VIEW (view), "item");
+  g_signal_connect (view, "bind-widget", G_CALLBACK (count_bind), NULL);
+
+  scrolled_window = gtk_scrolled_window_new ();
+  gtk_scrolled_window_set_policy (GTK_SCROLLED_WINDOW (scrolled_window), GTK_POLICY_NEVER, GTK_POLICY_AUTOMATIC);
+  gtk_scrolled_window_set_child (GTK_SCROLLED_WINDOW (scrolled_window), view);
+
+  window = gtk_window_new ();
+  gtk_window_set_default_size (GTK_WINDOW (window), WINDOW_WIDTH, WINDOW_HEIGHT);
+  gtk_window_set_child (GTK_WINDOW (window), scrolled_window);
+
+  start = g_get_monotonic_time ();
+  bz_dynamic_list_view_set_model (BZ_DYNAMIC_LIST_VIEW (view), G_LIST_MODEL (model));
+  gtk_window_present (GTK_WINDOW (window));
+  wait_for_frame (window);
+  first_frame = g_get_monotonic_time () - start;
+  wait_until_settled (window);
+  settled   = g_get_monotonic_time () - start;
+  n_initial = n_created;
+
+  g_test_message ("%u items: first frame after %" G_GINT64_FORMAT " usec, settled after "
+                  "%" G_GINT64_FORMAT " usec with %u tiles built and %u bound",
+                  N_ITEMS, first_frame, settled, n_created, n_binds);
+
+  /* The viewport plus a margin of one viewport on either side */
+  g_assert_cmpuint (n_initial, >, 0);
+  g_assert_cmpuint (n_initial, <, N_ITEMS / 4);
+
+  /* Jumping to the end hands the tiles from the start over */
+  vadjustment = gtk_scrolled_window_get_vadjustment (GTK_SCROLLED_WINDOW (scrolled_window));
+  gtk_adjustment_set_value (
+      vadjustment,
+      gtk_adjustment_get_upper (vadjustment) -
+          gtk_adjustment_get_page_size (vadjustment));
+  wait_until_settled (window);
+
+  g_test_message ("after scrolling to the end: %u tiles built in total, %u alive, %u binds",
+                  n_created, n_alive - n_alive_before, n_binds);
+
+  g_assert_cmpuint (n_binds, >, n_initial);
+  g_assert_cmpuint (n_alive - n_alive_before, <, N_ITEMS / 4);
+
+  gtk_window_destroy (GTK_WINDOW (window));
+}
+
+int
+main (int   argc,
+      char *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+  if (gtk_init_check ())
+    adw_init ();
+
+  g_type_ensure (BZ_TYPE_TEST_TILE);
+
+  g_test_add_data_func ("/dynamic-list-view/list-box",
+                        GINT_TO_POINTER (BZ_DYNAMIC_LIST_VIEW_KIND_LIST_BOX),
+                        test_viewport);
+  g_test_add_data_func ("/dynamic-list-view/flow-box",
+                        GINT_TO_POINTER (BZ_DYNAMIC_LIST_VIEW_KIND_FLOW_BOX),
+                        test_viewport);
+  g_test_add_data_func ("/dynamic-list-view/vbox",
+                        GINT_TO_POINTER (BZ_DYNAMIC_LIST_VIEW_KIND_VBOX),
+                        test_viewport);
+
+  return g_test_run ();
+}
+
+static void
+count_bind (BzDynamicListView *view,
+            GtkWidget         *widget,
+            gpointer           user_data)
+{
+  n_binds++;
+}
+
+static void
+wait_for_frame (GtkWidget *widget)
+{
+  GdkFrameClock *frame_clock = NULL;
+  gboolean       painted     = FALSE;
+  gulong         handler     = 0;
+
+  frame_clock = gtk_widget_get_frame_clock (widget);
+  g_assert_nonnull (frame_clock);
+
+  handler = g_signal_connect_swapped (
+      frame_clock, "after-paint",
+      G_CALLBACK (set_true), &painted);
+  gtk_widget_queue_draw (widget);
+
+  while (!painted)
+    g_main_context_iteration (NULL, TRUE);
+  g_signal_handler_disconnect (frame_clock, handler);
+}
+
+/* Filling slots changes the layout, which fills more slots on the next
+   frame, until a frame goes by without any new binds */
+static void
+wait_until_settled (GtkWidget *widget)
+{
+  for (guint i = 0; i < MAX_FRAMES; i++)
+    {
+      guint n_before = n_binds;
+
+      wait_for_frame (widget);
+      if (n_binds == n_before && i > 0)
+        return;
+    }
+
+  g_assert_not_reached ();
+}
+
+static void
+set_true (gboolean *flag)
+{
+  *flag = TRUE;
+}
+
+/* End of test-dynamic-list-view.c */
@@ -0,0 +1,276 @@
+/* test-entry-group-snapshot.c
+ *
+ * Copyright 2025 Adam Masciola
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include <gtk/gtk.h>
+
+#include "bz-application-map-factory.h"
+#include "bz-entry-group.h"
+
+/* Field names of BZ_ENTRY_GROUP_SNAPSHOT_TYPE in order, for building
+   the vardict the snapshot used to be written as */
+static const char *const snapshot_keys[] = {
+  "version",
+  "id",
+  "title",
+  "developer",
+  "description",
+  "search-tokens",
+  "light-accent-color",
+  "dark-accent-color",
+  "remote-repos-string",
+  "eol",
+  "donation-url",
+  "is-floss",
+  "is-flathub",
+  "is-verified",
+  "size",
+  "n-addons",
+  "counts",
+  "icon",
+  "mini-icon",
+  "unique-ids",
+};
+
+static gpointer
+map_nothing (gpointer item,
+             gpointer user_data);
+
+static BzApplicationMapFactory *
+make_factory (void);
+
+static GVariant *
+make_snapshot (guchar      version,
+               const char *id);
+
+static GVariant *
+to_vardict (GVariant *snapshot);
+
+static void
+test_round_trip (void)
+{
+  g_autoptr (BzApplicationMapFactory) factory = NULL;
+  g_autoptr (GVariant) snapshot               = NULL;
+  g_autoptr (BzEntryGroup) group              = NULL;
+  g_autoptr (GVariant) written                = NULL;
+
+  factory  = make_factory ();
+  snapshot = g_variant_ref_sink (make_snapshot (BZ_ENTRY_GROUP_SNAPSHOT_VERSION, "org.example.App"));
+  group    = bz_entry_group_new_from_snapshot (factory, snapshot);
+  g_assert_nonnull (group);
+
+  g_assert_cmpstr (bz_entry_group_get_id (group), ==, "org.example.App");
+  g_assert_cmpstr (bz_entry_group_get_title (group), ==, "Example App");
+  g_assert_cmpint (bz_entry_group_get_removable (group), ==, 1);
+  g_assert_cmpuint (g_list_model_get_n_items (bz_entry_group_get_model (group)), ==, 2);
+
+  written = g_variant_ref_sink (bz_entry_group_snapshot (group));
+  g_assert_true (g_variant_equal (snapshot, written));
+}
+
+static void
+test_prune (void)
+{
+  g_autoptr (BzApplicationMapFactory) factory = NULL;
+  g_autoptr (GVariant) snapshot               = NULL;
+  g_autoptr (BzEntryGroup) group              = NULL;
+
+  /* No real entry ever showed up, so nothing is left */
+  factory  = make_factory ();
+  snapshot = g_variant_ref_sink (make_snapshot (BZ_ENTRY_GROUP_SNAPSHOT_VERSION, "org.example.App"));
+  group    = bz_entry_group_new_from_snapshot (factory, snapshot);
+  g_assert_false (bz_entry_group_prune_snapshot (group));
+  g_assert_cmpuint (g_list_model_get_n_items (bz_entry_group_get_model (group)), ==, 0);
+}
+
+static void
+test_rejects_mismatch (void)
+{
+  g_autoptr (BzApplicationMapFactory) factory = NULL;
+  g_autoptr (GVariant) newer                  = NULL;
+  g_autoptr (GVariant) vardict                = NULL;
+  g_autoptr (BzEntryGroup) from_newer         = NULL;
+  g_autoptr (BzEntryGroup) from_vardict       = NULL;
+
+  factory      = make_factory ();
+  newer        = g_variant_ref_sink (make_snapshot (BZ_ENTRY_GROUP_SNAPSHOT_VERSION + 1, "org.example.App"));
+  vardict      = g_variant_ref_sink (to_vardict (newer));
+  from_newer   = bz_entry_group_new_from_snapshot (factory, newer);
+  from_vardict = bz_entry_group_new_from_snapshot (factory, vardict);
+  g_assert_null (from_newer);
+  g_assert_null (from_vardict);
+}
+
+static void
+test_size (void)
+{
+  g_autoptr (GVariantBuilder) fixed  = NULL;
+  g_autoptr (GVariantBuilder) keyed  = NULL;
+  g_autoptr (GVariant) fixed_catalog = NULL;
+  g_autoptr (GVariant) keyed_catalog = NULL;
+  gsize       fixed_size             = 0;
+  gsize       keyed_size             = 0;
+  gint64      start                  = 0;
+  gint64      fixed_usec             = 0;
+  gint64      keyed_usec             = 0;
+  const guint n_groups               = 5000;
+
+  /* Roughly the size of flathub, so the saving reported here is what a
+     real snapshot gains */
+  fixed = g_variant_builder_new (G_VARIANT_TYPE ("a" BZ_ENTRY_GROUP_SNAPSHOT_TYPE));
+  keyed = g_variant_builder_new (G_VARIANT_TYPE ("aa{sv}"));
+  for (guint i = 0; i < n_groups; i++)
+    {
+      g_autofree char *id          = NULL;
+      g_autoptr (GVariant) element = NULL;
+
+      id      = g_strdup_printf ("org.example.App%u", i);
+      element = g_variant_ref_sink (make_snapshot (BZ_ENTRY_GROUP_SNAPSHOT_VERSION, id));
+      g_variant_builder_add_value (fixed, element);
+      g_variant_builder_add_value (keyed, to_vardict (element));
+    }
+  fixed_catalog = g_variant_ref_sink (g_variant_builder_end (fixed));
+  keyed_catalog = g_variant_ref_sink (g_variant_builder_end (keyed));
+  fixed_size    = g_variant_get_size (fixed_catalog);
+  keyed_size    = g_variant_get_size (keyed_catalog);
+  g_assert_cmpuint (fixed_size, <, keyed_size);
+
+  /* Reading one field out of every group, which is what a lookup by
+     offset saves over scanning keys */
+  start = g_get_monotonic_time ();
+  for (guint i = 0; i < n_groups; i++)
+    {
+      g_autoptr (GVariant) element = NULL;
+      g_autoptr (GVariant) title   = NULL;
+
+      element = g_variant_get_child_value (fixed_catalog, i);
+      title   = g_variant_get_child_value (element, 2);
+    }
+  fixed_usec = g_get_monotonic_time () - start;
+
+  start = g_get_monotonic_time ();
+  for (guint i = 0; i < n_groups; i++)
+    {
+      g_autoptr (GVariant) element = NULL;
+      const char *title            = NULL;
+
+      element = g_variant_get_child_value (keyed_catalog, i);
+      g_variant_lookup (element, "title", "&s", &title);
+    }
+  keyed_usec = g_get_monotonic_time () - start;
+
+  g_test_message ("%u groups: fixed layout %zu bytes, %" G_GINT64_FORMAT " usec; "
+                  "vardict %zu bytes, %" G_GINT64_FORMAT " usec",
+                  n_groups, fixed_size, fixed_usec, keyed_size, keyed_usec);
+}
+
+int
+main (int   argc,
+      char *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/entry-group/snapshot/round-trip", test_round_trip);
+  g_test_add_func ("/entry-group/snapshot/prune", test_prune);
+  g_test_add_func ("/entry-group/snapshot/rejects-mismatch", test_rejects_mismatch);
+  g_test_add_func ("/entry-group/snapshot/size", test_size);
+
+  return g_test_run ();
+}
+
+static gpointer
+map_nothing (gpointer item,
+             gpointer user_data)
+{
+  return item;
+}
+
+static BzApplicationMapFactory *
+make_factory (void)
+{
+  return bz_application_map_factory_new (map_nothing, NULL, NULL, NULL, NULL);
+}
+
+static GVariant *
+make_snapshot (guchar      version,
+               const char *id)
+{
+  g_autofree char *flathub_id = NULL;
+  g_autofree char *user_id    = NULL;
+
+  flathub_id = g_strdup_printf ("FLATPAK-SYSTEM::flathub::app/%s/x86_64/stable", id);
+  user_id    = g_strdup_printf ("FLATPAK-USER::flathub-beta::app/%s/x86_64/beta", id);
+
+  return g_variant_new (
+      "(ysmsmsms"
+      "msmsmsmsmsms"
+      "bbbti(iiiiii)"
+      "m@(sms)mv^as)",
+      version,
+      id,
+      "Example App",
+      "Example Developers",
+      "An example application with a typical one line summary",
+      "example app application developers summary",
+      "#3584e4",
+      "#99c1f1",
+      "Flathub, Flathub-beta",
+      NULL,
+      "https://example.org/donate",
+      TRUE,
+      TRUE,
+      FALSE,
+      (guint64) 123456789,
+      2,
+      2, 0, 1, 2, 0, 1,
+      g_variant_new ("(sms)",
+                     "https://dl.flathub.org/media/example/icon.png",
+                     "/var/cache/bazaar/icons/example.png"),
+      NULL,
+      (const char *const[]) { flathub_id, user_id, NULL });
+}
+
+static GVariant *
+to_vardict (GVariant *snapshot)
+{
+  g_autoptr (GVariantBuilder) builder = NULL;
+
+  builder = g_variant_builder_new (G_VARIANT_TYPE_VARDICT);
+  for (guint i = 0; i < G_N_ELEMENTS (snapshot_keys); i++)
+    {
+      g_autoptr (GVariant) child = NULL;
+
+      child = g_variant_get_child_value (snapshot, i);
+      if (g_variant_is_of_type (child, G_VARIANT_TYPE_MAYBE))
+        {
+          g_autoptr (GVariant) inner = NULL;
+
+          inner = g_variant_get_maybe (child);
+          if (inner == NULL)
+            continue;
+          g_variant_builder_add (builder, "{sv}", snapshot_keys[i], inner);
+        }
+      else
+        g_variant_builder_add (builder, "{sv}", snapshot_keys[i], child);
+    }
+
+  return g_variant_builder_end (builder);
+}
+
+/* End of test-entry-group-snapshot.c */
@@ -0,0 +1,243 @@
+/* test-entry-group.c
+ *
+ * Copyright 2025 Adam Masciola
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include <gtk/gtk.h>
+
+#include "bz-application-map-factory.h"
+#include "bz-entry-group.h"
+#include "bz-env.h"
+#include "bz-flatpak-entry.h"
+#include "bz-search-engine.h"
+
+/* Several fibers on the main thread add entries to the same groups, the
+   way a sync of more than one remote does, while searches score those
+   groups on worker threads. Notify handlers take the group lock
+   themselves, so a notification emitted with the lock still held
+   deadlocks here. */
+
+#define N_GROUPS       200
+#define N_MUTATORS     4
+#define N_ADDS         500
+#define ADDS_PER_YIELD 25
+
+typedef struct
+{
+  GPtrArray *groups;
+  guint      mutator;
+} MutateData;
+
+static int n_notifies = 0;
+
+static gpointer
+map_nothing (gpointer item,
+             gpointer user_data);
+
+static BzEntry *
+make_entry (guint group,
+            guint variant);
+
+static void
+group_notify (BzEntryGroup *group,
+              GParamSpec   *pspec,
+              gpointer      user_data);
+
+static DexFuture *
+mutate_fiber (MutateData *data);
+
+static void
+mutate_data_free (MutateData *data);
+
+static void
+test_concurrent_add (void)
+{
+  g_autoptr (BzApplicationMapFactory) factory = NULL;
+  g_autoptr (GPtrArray) groups                = NULL;
+  g_autoptr (GListStore) store                = NULL;
+  g_autoptr (BzSearchEngine) engine           = NULL;
+  g_autoptr (GPtrArray) mutators              = NULL;
+  g_autoptr (DexFuture) all                   = NULL;
+  g_autoptr (DexFuture) search                = NULL;
+  guint  n_searches                           = 0;
+  guint  n_unique_ids                         = 0;
+  gint64 start                                = 0;
+  gint64 elapsed                              = 0;
+
+  factory = bz_application_map_factory_new (map_nothing, NULL, NULL, NULL, NULL);
+  groups  = g_ptr_array_new_with_free_func (g_object_unref);
+  store   = g_list_store_new (BZ_TYPE_ENTRY_GROUP);
+  for (guint i = 0; i < N_GROUPS; i++)
+    {
+      g_autoptr (BzEntryGroup) group = NULL;
+      g_autoptr (BzEntry) entry      = NULL;
+
+      group = bz_entry_group_new (factory);
+      entry = make_entry (i, 0);
+      bz_entry_group_add (group, entry, NULL);
+      g_signal_connect (group, "notify", G_CALLBACK (group_notify), NULL);
+
+      g_list_store_append (store, group);
+      g_ptr_array_add (groups, g_steal_pointer (&group));
+    }
+
+  engine = bz_search_engine_new ();
+  bz_search_engine_set_model (engine, G_LIST_MODEL (store));
+
+  start    = g_get_monotonic_time ();
+  mutators = g_ptr_array_new_with_free_func (dex_unref);
+  for (guint i = 0; i < N_MUTATORS; i++)
+    {
+      MutateData *data = NULL;
+
+      data          = g_new0 (MutateData, 1);
+      data->groups  = g_ptr_array_ref (groups);
+      data->mutator = i;
+      g_ptr_array_add (
+          mutators,
+          dex_scheduler_spawn (
+              dex_scheduler_get_default (),
+              bz_get_dex_stack_size (),
+              (DexFiberFunc) mutate_fiber,
+              data, (GDestroyNotify) mutate_data_free));
+    }
+  all = dex_future_allv ((DexFuture *const *) mutators->pdata, mutators->len);
+
+  /* Keep a search in flight for as long as the mutators run */
+  while (dex_future_is_pending (all))
+    {
+      if (search == NULL || !dex_future_is_pending (search))
+        {
+          if (search != NULL)
+            {
+              g_assert_true (dex_future_is_resolved (search));
+              n_searches++;
+            }
+          dex_clear (&search);
+          search = bz_search_engine_query (
+              engine, (const char *const[]) { "example", NULL }, NULL);
+        }
+      g_main_context_iteration (NULL, TRUE);
+    }
+  elapsed = g_get_monotonic_time () - start;
+  g_assert_true (dex_future_is_resolved (all));
+
+  while (dex_future_is_pending (search))
+    g_main_context_iteration (NULL, TRUE);
+  g_assert_true (dex_future_is_resolved (search));
+
+  /* Every add was a new unique id, none may be lost or doubled */
+  for (guint i = 0; i < groups->len; i++)
+    n_unique_ids += g_list_model_get_n_items (
+        bz_entry_group_get_model (g_ptr_array_index (groups, i)));
+  g_assert_cmpuint (n_unique_ids, ==, N_GROUPS + N_MUTATORS * N_ADDS);
+
+  g_test_message ("%u adds from %u fibers over %u groups: %d notifications, "
+                  "%u searches in %" G_GINT64_FORMAT " usec",
+                  N_MUTATORS * N_ADDS, N_MUTATORS, N_GROUPS,
+                  g_atomic_int_get (&n_notifies), n_searches, elapsed);
+}
+
+int
+main (int   argc,
+      char *argv[])
+{
+  dex_init ();
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/entry-group/concurrent-add", test_concurrent_add);
+
+  return g_test_run ();
+}
+
+static gpointer
+map_nothing (gpointer item,
+             gpointer user_data)
+{
+  return item;
+}
+
+static BzEntry *
+make_entry (guint group,
+            guint variant)
+{
+  g_autofree char *id        = NULL;
+  g_autofree char *unique_id = NULL;
+  g_autofree char *title     = NULL;
+
+  id        = g_strdup_printf ("org.example.App%u", group);
+  unique_id = g_strdup_printf ("FLATPAK-USER::remote%u::app/%s/x86_64/stable", variant, id);
+  title     = g_strdup_printf ("Example App %u", group);
+
+  return g_object_new (
+      BZ_TYPE_FLATPAK_ENTRY,
+      "kinds", BZ_ENTRY_KIND_APPLICATION,
+      "id", id,
+      "unique-id", unique_id,
+      "title", title,
+      "developer", "Example Developers",
+      "search-tokens", "example app stress",
+      "remote-repo-name", variant % 2 == 0 ? "flathub" : "flathub-beta",
+      "size", (guint64) (1000 + variant),
+      NULL);
+}
+
+static void
+group_notify (BzEntryGroup *group,
+              GParamSpec   *pspec,
+              gpointer      user_data)
+{
+  g_autoptr (GMutexLocker) locker = NULL;
+
+  /* Bound tiles and sorters read the group back from here */
+  locker = bz_entry_group_lock (group);
+  g_assert_nonnull (bz_entry_group_get_id (group));
+  g_atomic_int_inc (&n_notifies);
+}
+
+static DexFuture *
+mutate_fiber (MutateData *data)
+{
+  for (guint i = 0; i < N_ADDS; i++)
+    {
+      g_autoptr (BzEntry) entry = NULL;
+      BzEntryGroup *group       = NULL;
+      guint         index       = 0;
+
+      /* Mutators walk the groups at different strides, so they collide */
+      index = (i * (data->mutator * 2 + 1)) % data->groups->len;
+      group = g_ptr_array_index (data->groups, index);
+      entry = make_entry (index, 1 + data->mutator * N_ADDS + i);
+      bz_entry_group_add (group, entry, NULL);
+
+      /* Let the other mutators and the search results in between */
+      if (i % ADDS_PER_YIELD == ADDS_PER_YIELD - 1)
+        dex_await (dex_timeout_new_msec (1), NULL);
+    }
+
+  return dex_future_new_true ();
+}
+
+static void
+mutate_data_free (MutateData *data)
+{
+  g_clear_pointer (&data->groups, g_ptr_array_unref);
+  g_free (data);
+}
+
+/* End of test-entry-group.c */
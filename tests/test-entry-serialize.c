@@ -0,0 +1,303 @@
+/* test-entry-serialize.c
+ *
+ * Copyright 2025 Adam Masciola
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include <gtk/gtk.h>
+#include <string.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+#include "bz-flatpak-entry.h"
+#include "bz-issue.h"
+#include "bz-release.h"
+#include "bz-serializable.h"
+#include "bz-url.h"
+
+static GListModel *
+make_strings (const char *const *strings);
+
+static BzFlatpakEntry *
+make_entry (void);
+
+static void
+test_round_trip (void)
+{
+  g_autoptr (BzFlatpakEntry) entry   = NULL;
+  g_autoptr (BzFlatpakEntry) decoded = NULL;
+  g_autoptr (GVariant) first         = NULL;
+  g_autoptr (GVariant) second        = NULL;
+  g_autoptr (GListModel) releases    = NULL;
+  g_autoptr (GError) local_error     = NULL;
+  gboolean result                    = FALSE;
+
+  entry = make_entry ();
+  first = g_variant_ref_sink (bz_flatpak_entry_serialize_fixed (entry));
+  g_assert_nonnull (first);
+  g_assert_true (g_variant_is_of_type (first, G_VARIANT_TYPE (BZ_FLATPAK_ENTRY_SERIAL_TYPE)));
+
+  decoded = g_object_new (BZ_TYPE_FLATPAK_ENTRY, NULL);
+  result  = bz_flatpak_entry_deserialize_fixed (decoded, first, &local_error);
+  g_assert_no_error (local_error);
+  g_assert_true (result);
+
+  g_assert_cmpstr (bz_flatpak_entry_get_flatpak_name (decoded), ==, "Example");
+  g_assert_cmpstr (bz_flatpak_entry_get_runtime_name (decoded), ==, "org.gnome.Platform");
+  g_assert_true (bz_flatpak_entry_is_user (decoded));
+  g_assert_cmpstr (bz_entry_get_id (BZ_ENTRY (decoded)), ==, "org.example.App");
+  g_assert_cmpstr (bz_entry_get_title (BZ_ENTRY (decoded)), ==, "Example App");
+  g_assert_cmpuint (bz_entry_get_size (BZ_ENTRY (decoded)), ==, 123456789);
+  g_assert_cmpuint (g_list_model_get_n_items (bz_entry_get_share_urls (BZ_ENTRY (decoded))), ==, 2);
+
+  g_object_get (decoded, "version-history", &releases, NULL);
+  g_assert_cmpuint (g_list_model_get_n_items (releases), ==, 1);
+
+  /* Anything lost or reordered on the way shows up as a difference here */
+  second = g_variant_ref_sink (bz_flatpak_entry_serialize_fixed (decoded));
+  g_assert_true (g_variant_equal (first, second));
+}
+
+static void
+test_serialized_bytes (void)
+{
+  g_autoptr (BzFlatpakEntry) entry   = NULL;
+  g_autoptr (BzFlatpakEntry) decoded = NULL;
+  g_autoptr (GVariant) variant       = NULL;
+  g_autoptr (GBytes) bytes           = NULL;
+  g_autoptr (GVariant) loaded        = NULL;
+  g_autoptr (GError) local_error     = NULL;
+  gboolean result                    = FALSE;
+
+  /* Same path as the cache manager, which only ever sees the bytes */
+  entry   = make_entry ();
+  variant = g_variant_ref_sink (bz_flatpak_entry_serialize_fixed (entry));
+  bytes   = g_variant_get_data_as_bytes (variant);
+  g_assert_cmpuint (*(const guchar *) g_bytes_get_data (bytes, NULL), ==, BZ_FLATPAK_ENTRY_SERIAL_VERSION);
+
+  loaded  = g_variant_new_from_bytes (G_VARIANT_TYPE (BZ_FLATPAK_ENTRY_SERIAL_TYPE), bytes, FALSE);
+  decoded = g_object_new (BZ_TYPE_FLATPAK_ENTRY, NULL);
+  result  = bz_flatpak_entry_deserialize_fixed (decoded, loaded, &local_error);
+  g_assert_no_error (local_error);
+  g_assert_true (result);
+  g_assert_cmpstr (bz_entry_get_id (BZ_ENTRY (decoded)), ==, "org.example.App");
+}
+
+static void
+test_wrong_type (void)
+{
+  g_autoptr (BzFlatpakEntry) decoded = NULL;
+  g_autoptr (GVariant) variant       = NULL;
+  g_autoptr (GError) local_error     = NULL;
+  gboolean result                    = FALSE;
+
+  variant = g_variant_ref_sink (g_variant_new ("(ys)", 1, "garbage"));
+  decoded = g_object_new (BZ_TYPE_FLATPAK_ENTRY, NULL);
+  result  = bz_flatpak_entry_deserialize_fixed (decoded, variant, &local_error);
+  g_assert_error (local_error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA);
+  g_assert_false (result);
+}
+
+static void
+test_interned (void)
+{
+  g_autoptr (BzFlatpakEntry) entry = NULL;
+  g_autoptr (GVariant) variant     = NULL;
+  g_autoptr (GPtrArray) decoded    = NULL;
+  const char *shared[4]            = { 0 };
+  gsize       copy_bytes           = 0;
+  gsize       heap_bytes           = 0;
+  const guint n_entries            = 2000;
+#ifdef __GLIBC__
+  struct mallinfo2 before = { 0 };
+  struct mallinfo2 after  = { 0 };
+#endif
+
+  /* Roughly the size of flathub. Every entry repeats the same developer,
+     remote, accent color and runtime, which all decoded entries should share
+     rather than each keep a copy of */
+  entry   = make_entry ();
+  variant = g_variant_ref_sink (bz_flatpak_entry_serialize_fixed (entry));
+  decoded = g_ptr_array_new_with_free_func (g_object_unref);
+
+#ifdef __GLIBC__
+  before = mallinfo2 ();
+#endif
+  for (guint i = 0; i < n_entries; i++)
+    {
+      g_autoptr (BzFlatpakEntry) copy = NULL;
+      g_autoptr (GError) local_error  = NULL;
+      gboolean result                 = FALSE;
+
+      copy   = g_object_new (BZ_TYPE_FLATPAK_ENTRY, NULL);
+      result = bz_flatpak_entry_deserialize_fixed (copy, variant, &local_error);
+      g_assert_no_error (local_error);
+      g_assert_true (result);
+      g_ptr_array_add (decoded, g_steal_pointer (&copy));
+    }
+#ifdef __GLIBC__
+  after      = mallinfo2 ();
+  heap_bytes = after.uordblks - before.uordblks;
+#endif
+
+  for (guint i = 0; i < decoded->len; i++)
+    {
+      BzFlatpakEntry *copy      = g_ptr_array_index (decoded, i);
+      const char     *fields[4] = { 0 };
+
+      fields[0] = bz_entry_get_developer (BZ_ENTRY (copy));
+      fields[1] = bz_entry_get_remote_repo_name (BZ_ENTRY (copy));
+      fields[2] = bz_entry_get_light_accent_color (BZ_ENTRY (copy));
+      fields[3] = bz_flatpak_entry_get_runtime_name (copy);
+
+      for (guint j = 0; j < G_N_ELEMENTS (fields); j++)
+        {
+          g_assert_nonnull (fields[j]);
+          if (i == 0)
+            {
+              shared[j] = fields[j];
+              copy_bytes += (n_entries - 1) * (strlen (fields[j]) + 1);
+            }
+          else
+            g_assert_true (fields[j] == shared[j]);
+        }
+    }
+
+  g_test_message ("%u decoded entries: %zu heap bytes (0 without glibc); "
+                  "interning spares %zu bytes of copies of four fields alone",
+                  n_entries, heap_bytes, copy_bytes);
+}
+
+int
+main (int   argc,
+      char *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/entry/serialize-fixed/round-trip", test_round_trip);
+  g_test_add_func ("/entry/serialize-fixed/bytes", test_serialized_bytes);
+  g_test_add_func ("/entry/serialize-fixed/wrong-type", test_wrong_type);
+  g_test_add_func ("/entry/serialize-fixed/interned", test_interned);
+
+  return g_test_run ();
+}
+
+static GListModel *
+make_strings (const char *const *strings)
+{
+  g_autoptr (GtkStringList) list = NULL;
+
+  list = gtk_string_list_new (strings);
+  return G_LIST_MODEL (g_steal_pointer (&list));
+}
+
+static BzFlatpakEntry *
+make_entry (void)
+{
+  g_autoptr (GVariantBuilder) builder = NULL;
+  g_autoptr (GVariant) vardict        = NULL;
+  g_autoptr (BzFlatpakEntry) entry    = NULL;
+  g_autoptr (GError) local_error      = NULL;
+  g_autoptr (GListStore) urls         = NULL;
+  g_autoptr (GListStore) releases     = NULL;
+  g_autoptr (GListStore) issues       = NULL;
+  g_autoptr (BzUrl) homepage          = NULL;
+  g_autoptr (BzUrl) bugs              = NULL;
+  g_autoptr (BzIssue) issue           = NULL;
+  g_autoptr (BzRelease) release       = NULL;
+  g_autoptr (GListModel) keywords     = NULL;
+  g_autoptr (GListModel) captions     = NULL;
+  gboolean result                     = FALSE;
+
+  /* The flatpak specific fields are read only, so go through the older
+     vardict format to fill those in */
+  builder = g_variant_builder_new (G_VARIANT_TYPE_VARDICT);
+  g_variant_builder_add (builder, "{sv}", "user", g_variant_new_boolean (TRUE));
+  g_variant_builder_add (builder, "{sv}", "flatpak-name", g_variant_new_string ("Example"));
+  g_variant_builder_add (builder, "{sv}", "flatpak-id", g_variant_new_string ("org.example.App"));
+  g_variant_builder_add (builder, "{sv}", "flatpak-version", g_variant_new_string ("1.2.3"));
+  g_variant_builder_add (builder, "{sv}", "application-name", g_variant_new_string ("org.example.App"));
+  g_variant_builder_add (builder, "{sv}", "application-runtime", g_variant_new_string ("org.gnome.Platform/x86_64/49"));
+  g_variant_builder_add (builder, "{sv}", "application-command", g_variant_new_string ("example"));
+  g_variant_builder_add (builder, "{sv}", "runtime-name", g_variant_new_string ("org.gnome.Platform"));
+  vardict = g_variant_ref_sink (g_variant_builder_end (builder));
+
+  entry  = g_object_new (BZ_TYPE_FLATPAK_ENTRY, NULL);
+  result = bz_serializable_deserialize (BZ_SERIALIZABLE (entry), vardict, &local_error);
+  g_assert_no_error (local_error);
+  g_assert_true (result);
+
+  homepage = bz_url_new ();
+  bz_url_set_name (homepage, "Homepage");
+  bz_url_set_url (homepage, "https://example.org");
+  bugs = bz_url_new ();
+  bz_url_set_name (bugs, "Issues");
+  bz_url_set_url (bugs, "https://example.org/issues");
+  bz_url_set_icon_name (bugs, "bug-symbolic");
+  urls = g_list_store_new (BZ_TYPE_URL);
+  g_list_store_append (urls, homepage);
+  g_list_store_append (urls, bugs);
+
+  issue = bz_issue_new ();
+  bz_issue_set_id (issue, "#42");
+  bz_issue_set_url (issue, "https://example.org/issues/42");
+  issues = g_list_store_new (BZ_TYPE_ISSUE);
+  g_list_store_append (issues, issue);
+
+  release = bz_release_new ();
+  bz_release_set_version (release, "1.2.3");
+  bz_release_set_timestamp (release, 1750000000);
+  bz_release_set_description (release, "<p>Fixes</p>");
+  bz_release_set_issues (release, G_LIST_MODEL (issues));
+  releases = g_list_store_new (BZ_TYPE_RELEASE);
+  g_list_store_append (releases, release);
+
+  keywords = make_strings ((const char *const[]) { "example", "test", NULL });
+  captions = make_strings ((const char *const[]) { "Main window", NULL });
+
+  g_object_set (
+      entry,
+      "installed", TRUE,
+      "kinds", BZ_ENTRY_KIND_APPLICATION,
+      "id", "org.example.App",
+      "unique-id", "FLATPAK-USER::flathub::app/org.example.App/x86_64/stable",
+      "unique-id-checksum", "0123456789abcdef",
+      "title", "Example App",
+      "description", "An example",
+      "long-description", "<p>A longer example</p>",
+      "url", "https://example.org",
+      "remote-repo-name", "flathub",
+      "size", (guint64) 123456789,
+      "metadata-license", "CC0-1.0",
+      "project-license", "GPL-3.0-or-later",
+      "is-floss", TRUE,
+      "developer", "Example Developers",
+      "screenshot-captions", captions,
+      "share-urls", urls,
+      "version-history", releases,
+      "light-accent-color", "#3584e4",
+      "is-mobile-friendly", TRUE,
+      "min-display-length", 360,
+      "max-display-length", 1920,
+      "keywords", keywords,
+      NULL);
+
+  return g_steal_pointer (&entry);
+}
+
+/* End of test-entry-serialize.c */
@@ -0,0 +1,244 @@
+/* test-flathub-api.c
+ *
+ * Copyright 2025 Adam Masciola
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include <json-glib/json-glib.h>
+#include <libdex.h>
+
+#include "bz-global-net.h"
+#include "bz-test-server.h"
+
+/* Replays recorded Flathub replies from tests/fixtures/flathub through
+   the same query path the app uses, with BAZAAR_FLATHUB_API_URL
+   pointing at a local server */
+
+#define API_PREFIX "/api/v2"
+#define ERROR_BODY "{\"detail\":\"Internal Server Error\"}"
+
+typedef struct
+{
+  BzTestServer *server;
+} Fixture;
+
+static void
+fixture_set_up (Fixture      *fixture,
+                gconstpointer user_data);
+
+static void
+fixture_tear_down (Fixture      *fixture,
+                   gconstpointer user_data);
+
+static JsonNode *
+await_json (DexFuture *future,
+            GError   **error);
+
+static void
+test_fixtures (Fixture      *fixture,
+               gconstpointer user_data)
+{
+  g_autoptr (GError) local_error = NULL;
+  g_autoptr (JsonNode) stats     = NULL;
+  g_autoptr (JsonNode) popular   = NULL;
+  g_autoptr (JsonNode) count     = NULL;
+  g_autoptr (JsonNode) pick      = NULL;
+  JsonObject *object             = NULL;
+  JsonArray  *hits               = NULL;
+
+  stats = await_json (
+      bz_query_flathub_v2_json ("/stats/org.example.App?all=false&days=175"),
+      &local_error);
+  g_assert_no_error (local_error);
+  object = json_node_get_object (stats);
+  g_assert_true (json_object_has_member (object, "installs_per_day"));
+  g_assert_true (json_object_has_member (object, "installs_per_country"));
+
+  popular = await_json (
+      bz_query_flathub_v2_json ("/collection/popular?page=1&per_page=3"),
+      &local_error);
+  g_assert_no_error (local_error);
+  object = json_node_get_object (popular);
+  hits   = json_object_get_array_member (object, "hits");
+  g_assert_cmpuint (json_array_get_length (hits), ==, 3);
+  g_assert_cmpstr (json_object_get_string_member (json_array_get_object_element (hits, 0), "app_id"),
+                   ==, "org.example.App");
+
+  count = await_json (
+      bz_query_flathub_v2_json ("/favorites/org.example.App/count"),
+      &local_error);
+  g_assert_no_error (local_error);
+  g_assert_cmpint (json_node_get_int (count), ==, 42);
+
+  pick = await_json (
+      bz_query_flathub_v2_json ("/app-picks/app-of-the-day/2025-06-01"),
+      &local_error);
+  g_assert_no_error (local_error);
+  g_assert_cmpstr (json_object_get_string_member (json_node_get_object (pick), "app_id"),
+                   ==, "org.example.App");
+}
+
+static void
+test_http_errors (Fixture      *fixture,
+                  gconstpointer user_data)
+{
+  g_autoptr (GBytes) body       = NULL;
+  g_autoptr (GError) not_found  = NULL;
+  g_autoptr (GError) failed     = NULL;
+  g_autoptr (JsonNode) missing  = NULL;
+  g_autoptr (JsonNode) internal = NULL;
+
+  /* The real API answers errors with a JSON body, which used to be
+     handed to callers as if it were data */
+  body = g_bytes_new_static (ERROR_BODY, sizeof (ERROR_BODY) - 1);
+  bz_test_server_add_route (fixture->server, API_PREFIX "/stats/org.example.Broken", 500, body);
+
+  missing = await_json (
+      bz_query_flathub_v2_json ("/stats/org.example.Missing"),
+      &not_found);
+  g_assert_null (missing);
+  g_assert_error (not_found, G_IO_ERROR, G_IO_ERROR_FAILED);
+
+  internal = await_json (
+      bz_query_flathub_v2_json ("/stats/org.example.Broken"),
+      &failed);
+  g_assert_null (internal);
+  g_assert_error (failed, G_IO_ERROR, G_IO_ERROR_FAILED);
+}
+
+static void
+test_dropped_connection (Fixture      *fixture,
+                         gconstpointer user_data)
+{
+  g_autoptr (GError) local_error = NULL;
+  g_autoptr (JsonNode) node      = NULL;
+
+  bz_test_server_set_drop (fixture->server, API_PREFIX "/collection/popular");
+
+  node = await_json (
+      bz_query_flathub_v2_json ("/collection/popular"),
+      &local_error);
+  g_assert_null (node);
+  g_assert_nonnull (local_error);
+}
+
+static void
+test_latency (Fixture      *fixture,
+              gconstpointer user_data)
+{
+  g_autoptr (GPtrArray) futures = NULL;
+  g_autoptr (DexFuture) all     = NULL;
+  gint64      start             = 0;
+  gint64      elapsed           = 0;
+  const guint n_queries         = 8;
+  const guint latency_msec      = 200;
+
+  bz_test_server_set_latency (fixture->server, API_PREFIX "/stats/org.example.App", latency_msec);
+
+  /* A browse page fires one of these per tile, so they must overlap
+     rather than queue behind each other */
+  futures = g_ptr_array_new_with_free_func (dex_unref);
+  for (guint i = 0; i < n_queries; i++)
+    g_ptr_array_add (futures, bz_query_flathub_v2_json ("/stats/org.example.App"));
+
+  start = g_get_monotonic_time ();
+  all   = dex_future_allv ((DexFuture *const *) futures->pdata, futures->len);
+  while (dex_future_is_pending (all))
+    g_main_context_iteration (NULL, TRUE);
+  elapsed = g_get_monotonic_time () - start;
+
+  g_assert_true (dex_future_is_resolved (all));
+  g_assert_cmpuint (bz_test_server_get_hits (fixture->server, API_PREFIX "/stats/org.example.App"), ==, n_queries);
+  g_assert_cmpint (elapsed, <, (gint64) n_queries * latency_msec * 1000 / 2);
+  g_test_message ("%u queries at %u msec each took %" G_GINT64_FORMAT " usec",
+                  n_queries, latency_msec, elapsed);
+}
+
+static void
+test_base_url (Fixture      *fixture,
+               gconstpointer user_data)
+{
+  g_autofree char *url = NULL;
+
+  /* Trailing slashes would otherwise double up with the route's own */
+  g_setenv ("BAZAAR_FLATHUB_API_URL", "http://127.0.0.1:1/api/v2//", TRUE);
+  url = bz_dup_flathub_api_url ();
+  g_assert_cmpstr (url, ==, "http://127.0.0.1:1/api/v2");
+}
+
+int
+main (int   argc,
+      char *argv[])
+{
+  dex_init ();
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add ("/flathub-api/fixtures", Fixture, NULL,
+              fixture_set_up, test_fixtures, fixture_tear_down);
+  g_test_add ("/flathub-api/http-errors", Fixture, NULL,
+              fixture_set_up, test_http_errors, fixture_tear_down);
+  g_test_add ("/flathub-api/dropped-connection", Fixture, NULL,
+              fixture_set_up, test_dropped_connection, fixture_tear_down);
+  g_test_add ("/flathub-api/latency", Fixture, NULL,
+              fixture_set_up, test_latency, fixture_tear_down);
+  g_test_add ("/flathub-api/base-url", Fixture, NULL,
+              fixture_set_up, test_base_url, fixture_tear_down);
+
+  return g_test_run ();
+}
+
+static void
+fixture_set_up (Fixture      *fixture,
+                gconstpointer user_data)
+{
+  g_autofree char *url = NULL;
+
+  fixture->server = bz_test_server_new ();
+  bz_test_server_add_fixtures (
+      fixture->server, API_PREFIX,
+      g_test_get_filename (G_TEST_DIST, "fixtures", "flathub", NULL));
+
+  url = bz_test_server_dup_url (fixture->server, API_PREFIX "/");
+  g_setenv ("BAZAAR_FLATHUB_API_URL", url, TRUE);
+}
+
+static void
+fixture_tear_down (Fixture      *fixture,
+                   gconstpointer user_data)
+{
+  g_unsetenv ("BAZAAR_FLATHUB_API_URL");
+  g_clear_pointer (&fixture->server, bz_test_server_free);
+}
+
+static JsonNode *
+await_json (DexFuture *future,
+            GError   **error)
+{
+  g_autoptr (DexFuture) owned = future;
+  const GValue *value         = NULL;
+
+  while (dex_future_is_pending (owned))
+    g_main_context_iteration (NULL, TRUE);
+
+  value = dex_future_get_value (owned, error);
+  if (value == NULL)
+    return NULL;
+
+  return json_node_ref (g_value_get_boxed (value));
+}
+
+/* End of test-flathub-api.c */
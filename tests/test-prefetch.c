@@ -0,0 +1,411 @@
+/* test-prefetch.c
+ *
+ * Copyright 2025 Adam Masciola
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include <glib/gstdio.h>
+
+#include "bz-application-map-factory.h"
+#include "bz-async-texture.h"
+#include "bz-entry-group.h"
+#include "bz-flatpak-entry.h"
+#include "bz-prefetch.h"
+#include "bz-result.h"
+#include "bz-test-server.h"
+#include "bz-test-texture.h"
+
+/* Opening an app is modelled as the full view binding the entry: it
+   reads the download stats and draws the first screenshots, and is
+   done once all of them have arrived. Before the click the pointer
+   rests on the tile for longer than the prefetch dwell, but for less
+   than the stats query takes. Tiles are never shown, but widgets still
+   need a display; without one every test is skipped. */
+
+#define API_PREFIX         "/api/v2"
+#define STATS_PATH         API_PREFIX "/stats/org.example.App"
+#define STATS_LATENCY_MSEC 300
+#define CLICK_AFTER_MSEC   400
+#define N_SCREENSHOTS      2
+#define SCREENSHOT_SIZE    256
+
+#define BZ_TYPE_TEST_TILE (bz_test_tile_get_type ())
+G_DECLARE_FINAL_TYPE (BzTestTile, bz_test_tile, BZ, TEST_TILE, GtkWidget)
+
+struct _BzTestTile
+{
+  GtkWidget parent_instance;
+
+  BzEntryGroup *group;
+};
+
+G_DEFINE_FINAL_TYPE (BzTestTile, bz_test_tile, GTK_TYPE_WIDGET)
+
+enum
+{
+  PROP_0,
+
+  PROP_GROUP,
+
+  LAST_PROP
+};
+static GParamSpec *props[LAST_PROP] = { 0 };
+
+typedef struct
+{
+  BzTestServer *server;
+  char         *root;
+  GBytes       *png;
+} Fixture;
+
+static void
+fixture_set_up (Fixture      *fixture,
+                gconstpointer user_data);
+
+static void
+fixture_tear_down (Fixture      *fixture,
+                   gconstpointer user_data);
+
+static gint64
+time_to_render (Fixture *fixture,
+                guint    run,
+                gboolean hover);
+
+static gpointer
+map_to_entry (gpointer item,
+              gpointer user_data);
+
+static void
+rest_pointer_on (GtkWidget *tile);
+
+static gboolean
+has_stats (BzEntry *entry);
+
+static void
+wait_msec (guint msec);
+
+static void
+wait_for (DexFuture *future);
+
+static void
+remove_dir (const char *path);
+
+static void
+bz_test_tile_dispose (GObject *object)
+{
+  BzTestTile *self = BZ_TEST_TILE (object);
+
+  g_clear_object (&self->group);
+
+  G_OBJECT_CLASS (bz_test_tile_parent_class)->dispose (object);
+}
+
+static void
+bz_test_tile_get_property (GObject    *object,
+                           guint       prop_id,
+                           GValue     *value,
+                           GParamSpec *pspec)
+{
+  BzTestTile *self = BZ_TEST_TILE (object);
+
+  switch (prop_id)
+    {
+    case PROP_GROUP:
+      g_value_set_object (value, self->group);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+    }
+}
+
+static void
+bz_test_tile_set_property (GObject      *object,
+                           guint         prop_id,
+                           const GValue *value,
+                           GParamSpec   *pspec)
+{
+  BzTestTile *self = BZ_TEST_TILE (object);
+
+  switch (prop_id)
+    {
+    case PROP_GROUP:
+      if (g_set_object (&self->group, g_value_get_object (value)))
+        g_object_notify_by_pspec (object, props[PROP_GROUP]);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+    }
+}
+
+static void
+bz_test_tile_class_init (BzTestTileClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->dispose      = bz_test_tile_dispose;
+  object_class->get_property = bz_test_tile_get_property;
+  object_class->set_property = bz_test_tile_set_property;
+
+  props[PROP_GROUP] =
+      g_param_spec_object (
+          "group",
+          NULL, NULL,
+          BZ_TYPE_ENTRY_GROUP,
+          G_PARAM_READWRITE | G_PARAM_EXPLICIT_NOTIFY);
+
+  g_object_class_install_properties (object_class, LAST_PROP, props);
+}
+
+static void
+bz_test_tile_init (BzTestTile *self)
+{
+}
+
+static void
+test_time_to_render (Fixture      *fixture,
+                     gconstpointer user_data)
+{
+  g_autofree char *probe         = NULL;
+  gint64           plain_usec    = 0;
+  gint64           prefetch_usec = 0;
+
+  if (gdk_display_get_default () == NULL)
+    {
+      g_test_skip ("No display");
+      return;
+    }
+
+  probe = bz_test_texture_write_cached (fixture->root, "probe.png", fixture->png, SCREENSHOT_SIZE);
+  if (!bz_test_texture_can_load (probe))
+    {
+      g_test_skip ("No glycin loader for PNG is available");
+      return;
+    }
+
+  plain_usec = time_to_render (fixture, 0, FALSE);
+  g_assert_cmpuint (bz_test_server_get_hits (fixture->server, STATS_PATH), ==, 1);
+
+  /* The full view must pick up the query the prefetch started rather
+     than issue its own */
+  prefetch_usec = time_to_render (fixture, 1, TRUE);
+  g_assert_cmpuint (bz_test_server_get_hits (fixture->server, STATS_PATH), ==, 2);
+
+  g_test_message ("stats at %u msec, click %u msec after the pointer arrived: "
+                  "%" G_GINT64_FORMAT " usec to render without prefetch, "
+                  "%" G_GINT64_FORMAT " usec with",
+                  STATS_LATENCY_MSEC, CLICK_AFTER_MSEC, plain_usec, prefetch_usec);
+
+  g_assert_cmpint (prefetch_usec * 2, <, plain_usec);
+}
+
+int
+main (int   argc,
+      char *argv[])
+{
+  dex_init ();
+  g_test_init (&argc, &argv, NULL);
+  gtk_init_check ();
+
+  g_test_add ("/prefetch/time-to-render", Fixture, NULL,
+              fixture_set_up, test_time_to_render, fixture_tear_down);
+
+  return g_test_run ();
+}
+
+static void
+fixture_set_up (Fixture      *fixture,
+                gconstpointer user_data)
+{
+  g_autoptr (GError) local_error = NULL;
+  g_autofree char *url           = NULL;
+
+  fixture->server = bz_test_server_new ();
+  bz_test_server_add_fixtures (
+      fixture->server, API_PREFIX,
+      g_test_get_filename (G_TEST_DIST, "fixtures", "flathub", NULL));
+  bz_test_server_set_latency (fixture->server, STATS_PATH, STATS_LATENCY_MSEC);
+
+  url = bz_test_server_dup_url (fixture->server, API_PREFIX "/");
+  g_setenv ("BAZAAR_FLATHUB_API_URL", url, TRUE);
+
+  fixture->root = g_dir_make_tmp ("bz-test-prefetch-XXXXXX", &local_error);
+  g_assert_no_error (local_error);
+  fixture->png = bz_test_texture_make_png (SCREENSHOT_SIZE);
+}
+
+static void
+fixture_tear_down (Fixture      *fixture,
+                   gconstpointer user_data)
+{
+  g_unsetenv ("BAZAAR_FLATHUB_API_URL");
+  g_clear_pointer (&fixture->server, bz_test_server_free);
+  remove_dir (fixture->root);
+  g_clear_pointer (&fixture->root, g_free);
+  g_clear_pointer (&fixture->png, g_bytes_unref);
+}
+
+/* Every run gets an entry and screenshots of its own, so nothing is
+   shared between them but the server */
+static gint64
+time_to_render (Fixture *fixture,
+                guint    run,
+                gboolean hover)
+{
+  g_autoptr (GListStore) screenshots          = NULL;
+  g_autoptr (BzEntry) entry                   = NULL;
+  g_autoptr (BzApplicationMapFactory) factory = NULL;
+  g_autoptr (BzEntryGroup) group              = NULL;
+  g_autoptr (GtkWidget) tile                  = NULL;
+  g_autoptr (GPtrArray) futures               = NULL;
+  g_autoptr (DexFuture) all                   = NULL;
+  gint64 start                                = 0;
+
+  screenshots = g_list_store_new (BZ_TYPE_ASYNC_TEXTURE);
+  for (guint i = 0; i < N_SCREENSHOTS; i++)
+    {
+      g_autofree char *name              = NULL;
+      g_autofree char *cache_path        = NULL;
+      g_autofree char *source_path       = NULL;
+      g_autoptr (GFile) cache            = NULL;
+      g_autoptr (GFile) source           = NULL;
+      g_autoptr (BzAsyncTexture) texture = NULL;
+
+      name        = g_strdup_printf ("run-%u-screenshot-%u.png", run, i);
+      cache_path  = bz_test_texture_write_cached (fixture->root, name, fixture->png, SCREENSHOT_SIZE);
+      source_path = g_strdup_printf ("%s/source-%s", fixture->root, name);
+      cache       = g_file_new_for_path (cache_path);
+      source      = g_file_new_for_path (source_path);
+      texture     = bz_async_texture_new_lazy (source, cache);
+      g_list_store_append (screenshots, texture);
+    }
+
+  entry = g_object_new (
+      BZ_TYPE_FLATPAK_ENTRY,
+      "kinds", BZ_ENTRY_KIND_APPLICATION,
+      "id", "org.example.App",
+      "unique-id", "FLATPAK-USER::flathub::app/org.example.App/x86_64/stable",
+      "title", "Example App",
+      "remote-repo-name", "flathub",
+      "is-flathub", TRUE,
+      "screenshot-paintables", screenshots,
+      NULL);
+  factory = bz_application_map_factory_new (map_to_entry, entry, NULL, NULL, NULL);
+  group   = bz_entry_group_new (factory);
+  bz_entry_group_add (group, entry, NULL);
+
+  tile = g_object_ref_sink (g_object_new (BZ_TYPE_TEST_TILE, "group", group, NULL));
+  bz_prefetch_attach (tile);
+
+  if (hover)
+    rest_pointer_on (tile);
+  wait_msec (CLICK_AFTER_MSEC);
+
+  start   = g_get_monotonic_time ();
+  futures = g_ptr_array_new_with_free_func (dex_unref);
+  for (guint i = 0; i < N_SCREENSHOTS; i++)
+    {
+      g_autoptr (BzAsyncTexture) texture = NULL;
+
+      texture = g_list_model_get_item (G_LIST_MODEL (screenshots), i);
+      g_ptr_array_add (futures, bz_async_texture_dup_future (texture));
+    }
+  all = dex_future_allv ((DexFuture *const *) futures->pdata, futures->len);
+
+  /* The stats arrive through a property, polled like a binding would */
+  while (dex_future_is_pending (all) || !has_stats (entry))
+    wait_msec (1);
+
+  g_assert_true (dex_future_is_resolved (all));
+  return g_get_monotonic_time () - start;
+}
+
+/* What the entry cache resolves the group's unique id to */
+static gpointer
+map_to_entry (gpointer item,
+              gpointer user_data)
+{
+  g_object_unref (item);
+  return bz_result_new (dex_future_new_for_object (user_data));
+}
+
+/* Stands in for the pointer entering the tile */
+static void
+rest_pointer_on (GtkWidget *tile)
+{
+  g_autoptr (GListModel) controllers = NULL;
+  guint n_controllers                = 0;
+
+  controllers   = gtk_widget_observe_controllers (tile);
+  n_controllers = g_list_model_get_n_items (controllers);
+  for (guint i = 0; i < n_controllers; i++)
+    {
+      g_autoptr (GtkEventController) controller = NULL;
+
+      controller = g_list_model_get_item (controllers, i);
+      if (GTK_IS_EVENT_CONTROLLER_MOTION (controller))
+        g_signal_emit_by_name (controller, "enter", 0.0, 0.0);
+    }
+}
+
+static gboolean
+has_stats (BzEntry *entry)
+{
+  g_autoptr (GListModel) stats = NULL;
+
+  g_object_get (entry, "download-stats", &stats, NULL);
+  return stats != NULL;
+}
+
+static void
+wait_msec (guint msec)
+{
+  g_autoptr (DexFuture) timeout = NULL;
+
+  timeout = dex_timeout_new_msec (msec);
+  wait_for (g_steal_pointer (&timeout));
+}
+
+static void
+wait_for (DexFuture *future)
+{
+  g_autoptr (DexFuture) owned = future;
+
+  while (dex_future_is_pending (owned))
+    g_main_context_iteration (NULL, TRUE);
+}
+
+static void
+remove_dir (const char *path)
+{
+  g_autoptr (GDir) dir = NULL;
+  const char *name     = NULL;
+
+  dir = g_dir_open (path, 0, NULL);
+  if (dir == NULL)
+    return;
+
+  while ((name = g_dir_read_name (dir)) != NULL)
+    {
+      g_autofree char *child = NULL;
+
+      child = g_build_filename (path, name, NULL);
+      g_unlink (child);
+    }
+  g_rmdir (path);
+}
+
+/* End of test-prefetch.c */
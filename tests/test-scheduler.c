@@ -0,0 +1,225 @@
+/* test-scheduler.c
+ *
+ * Copyright 2025 Adam Masciola
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "bz-env.h"
+#include "bz-io.h"
+
+/* Stands in for a full sync: every background worker spins on CPU the
+   way a silo compile does, while short interactive fibers (a search, a
+   texture decode) are timed from spawn to first instruction */
+
+#define BUSY_MSEC 400
+#define N_PROBES  20
+
+static DexFuture *
+busy_fiber (gpointer user_data);
+
+static DexFuture *
+probe_fiber (gpointer user_data);
+
+static DexFuture *
+nice_fiber (gpointer user_data);
+
+static GPtrArray *
+start_busy (DexScheduler *shared);
+
+static void
+wait_for (DexFuture *future);
+
+static void
+measure_probes (DexScheduler *shared,
+                gint64       *median,
+                gint64       *max);
+
+static int
+compare_int64 (gconstpointer a,
+               gconstpointer b);
+
+static void
+test_interactive_latency (void)
+{
+  g_autoptr (GPtrArray) shared_busy = NULL;
+  g_autoptr (GPtrArray) split_busy  = NULL;
+  g_autoptr (DexFuture) all         = NULL;
+  gint64 shared_median              = 0;
+  gint64 shared_max                 = 0;
+  gint64 split_median               = 0;
+  gint64 split_max                  = 0;
+
+  /* Everything on one pool, as it was before the split */
+  shared_busy = start_busy (dex_thread_pool_scheduler_get_default ());
+  measure_probes (dex_thread_pool_scheduler_get_default (), &shared_median, &shared_max);
+  all = dex_future_allv ((DexFuture *const *) shared_busy->pdata, shared_busy->len);
+  wait_for (g_steal_pointer (&all));
+
+  split_busy = start_busy (NULL);
+  measure_probes (NULL, &split_median, &split_max);
+  all = dex_future_allv ((DexFuture *const *) split_busy->pdata, split_busy->len);
+  wait_for (g_steal_pointer (&all));
+
+  g_test_message ("interactive spawn latency with %u busy background fibers of %u msec: "
+                  "shared pool median %" G_GINT64_FORMAT " usec, max %" G_GINT64_FORMAT " usec; "
+                  "split pools median %" G_GINT64_FORMAT " usec, max %" G_GINT64_FORMAT " usec",
+                  shared_busy->len, BUSY_MSEC,
+                  shared_median, shared_max, split_median, split_max);
+
+  /* Wall clock bounds are only meaningful on an otherwise idle machine */
+  if (g_test_perf ())
+    g_assert_cmpint (split_max, <, BUSY_MSEC * 1000 / 2);
+}
+
+static void
+test_background_nice (void)
+{
+  g_autoptr (DexFuture) background  = NULL;
+  g_autoptr (DexFuture) interactive = NULL;
+  const GValue *value               = NULL;
+  int           base                = 0;
+
+  /* Relative to this thread, in case the whole test runs niced */
+  base = getpriority (PRIO_PROCESS, syscall (SYS_gettid));
+
+  background = bz_spawn (BZ_SCHEDULER_PRIORITY_BACKGROUND, nice_fiber, NULL, NULL);
+  wait_for (dex_ref (background));
+  value = dex_future_get_value (background, NULL);
+  g_assert_nonnull (value);
+  g_assert_cmpint (g_value_get_int (value), ==, MIN (base + BZ_BACKGROUND_NICE_INCREMENT, 19));
+
+  interactive = bz_spawn (BZ_SCHEDULER_PRIORITY_INTERACTIVE, nice_fiber, NULL, NULL);
+  wait_for (dex_ref (interactive));
+  value = dex_future_get_value (interactive, NULL);
+  g_assert_nonnull (value);
+  g_assert_cmpint (g_value_get_int (value), ==, base);
+}
+
+int
+main (int   argc,
+      char *argv[])
+{
+  dex_init ();
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/scheduler/interactive-latency", test_interactive_latency);
+  g_test_add_func ("/scheduler/background-nice", test_background_nice);
+
+  return g_test_run ();
+}
+
+static DexFuture *
+busy_fiber (gpointer user_data)
+{
+  gint64 deadline = 0;
+
+  deadline = g_get_monotonic_time () + BUSY_MSEC * 1000;
+  while (g_get_monotonic_time () < deadline)
+    ;
+
+  return dex_future_new_true ();
+}
+
+static DexFuture *
+probe_fiber (gpointer user_data)
+{
+  return dex_future_new_for_int64 (g_get_monotonic_time ());
+}
+
+static DexFuture *
+nice_fiber (gpointer user_data)
+{
+  return dex_future_new_for_int (
+      getpriority (PRIO_PROCESS, syscall (SYS_gettid)));
+}
+
+/* NULL means the background class of bz_spawn () */
+static GPtrArray *
+start_busy (DexScheduler *shared)
+{
+  g_autoptr (GPtrArray) futures = NULL;
+  guint n_busy                  = 0;
+
+  /* Twice the processors, so every worker of the pool is taken */
+  n_busy  = g_get_num_processors () * 2;
+  futures = g_ptr_array_new_with_free_func (dex_unref);
+  for (guint i = 0; i < n_busy; i++)
+    g_ptr_array_add (
+        futures,
+        shared != NULL
+            ? dex_scheduler_spawn (shared, bz_get_dex_stack_size (), busy_fiber, NULL, NULL)
+            : bz_spawn (BZ_SCHEDULER_PRIORITY_BACKGROUND, busy_fiber, NULL, NULL));
+
+  /* Let them get onto their workers first */
+  g_usleep (20 * 1000);
+  return g_steal_pointer (&futures);
+}
+
+static void
+wait_for (DexFuture *future)
+{
+  g_autoptr (DexFuture) owned = future;
+
+  while (dex_future_is_pending (owned))
+    g_main_context_iteration (NULL, TRUE);
+}
+
+static void
+measure_probes (DexScheduler *shared,
+                gint64       *median,
+                gint64       *max)
+{
+  gint64 latencies[N_PROBES] = { 0 };
+
+  for (guint i = 0; i < N_PROBES; i++)
+    {
+      g_autoptr (DexFuture) future = NULL;
+      const GValue *value          = NULL;
+      gint64        spawned        = 0;
+
+      spawned = g_get_monotonic_time ();
+      future  = shared != NULL
+                    ? dex_scheduler_spawn (shared, bz_get_dex_stack_size (), probe_fiber, NULL, NULL)
+                    : bz_spawn (BZ_SCHEDULER_PRIORITY_INTERACTIVE, probe_fiber, NULL, NULL);
+      wait_for (dex_ref (future));
+
+      value = dex_future_get_value (future, NULL);
+      g_assert_nonnull (value);
+      latencies[i] = g_value_get_int64 (value) - spawned;
+    }
+
+  qsort (latencies, N_PROBES, sizeof (*latencies), compare_int64);
+  *median = latencies[N_PROBES / 2];
+  *max    = latencies[N_PROBES - 1];
+}
+
+static int
+compare_int64 (gconstpointer a,
+               gconstpointer b)
+{
+  gint64 lhs = *(const gint64 *) a;
+  gint64 rhs = *(const gint64 *) b;
+
+  return lhs < rhs ? -1 : lhs > rhs;
+}
+
+/* End of test-scheduler.c */